@@ -44,6 +44,44 @@ mkdir -p ${LLVM_DIR}/lib/Transforms/BlockSizeInvarianceAnalysis &&
 cp -R ${SRC_DIR}/abstract-execution/* ${LLVM_DIR}/lib/Transforms/BlockSizeInvarianceAnalysis/ &&
 cp -R ${SRC_DIR}/bsize-invariance-analysis/* ${LLVM_DIR}/lib/Transforms/BlockSizeInvarianceAnalysis/ &&
 
+# Standalone driver (picked up automatically by llvm/tools). It links the
+# analyses directly, so their pass plugin entry points are left out.
+cd ${ROOT_DIR} &&
+mkdir -p ${LLVM_DIR}/tools/drano &&
+cp -R ${SRC_DIR}/abstract-execution/* ${LLVM_DIR}/tools/drano/ &&
+cp -R ${SRC_DIR}/uncoalesced-analysis/* ${LLVM_DIR}/tools/drano/ &&
+cp -R ${SRC_DIR}/bsize-invariance-analysis/* ${LLVM_DIR}/tools/drano/ &&
+cp -R ${SRC_DIR}/drano/* ${LLVM_DIR}/tools/drano/ &&
+rm -f ${LLVM_DIR}/tools/drano/*Plugin.cpp &&
+
+# Benchmark tools. add_llvm_tool rejects source files of its directory that
+# it does not list, so only the sources listed in drano-bench/CMakeLists.txt
+# are copied.
+cd ${ROOT_DIR} &&
+rm -rf ${LLVM_DIR}/tools/drano-bench &&
+mkdir -p ${LLVM_DIR}/tools/drano-bench &&
+cp ${SRC_DIR}/abstract-execution/*.h ${SRC_DIR}/uncoalesced-analysis/*.h \
+   ${SRC_DIR}/bsize-invariance-analysis/*.h ${SRC_DIR}/drano/*.h \
+   ${LLVM_DIR}/tools/drano-bench/ &&
+cd ${SRC_DIR}/uncoalesced-analysis &&
+cp GPUState.cpp InterprocUncoalescedAnalysisPass.cpp MultiplierValue.cpp \
+   UncoalescedAnalysis.cpp UncoalescedAnalysisPass.cpp \
+   UncoalescedSummaries.cpp ${LLVM_DIR}/tools/drano-bench/ &&
+cd ${SRC_DIR}/bsize-invariance-analysis &&
+cp BSizeDependenceValue.cpp BSizeGPUState.cpp BlockSizeInvarianceAnalysis.cpp \
+   BlockSizeInvarianceAnalysisPass.cpp InterprocBSIAnalysisPass.cpp \
+   ${LLVM_DIR}/tools/drano-bench/ &&
+cd ${SRC_DIR}/drano &&
+cp DranoBaseline.cpp DranoDriver.cpp DranoProfile.cpp DranoReport.cpp \
+   ${LLVM_DIR}/tools/drano-bench/ &&
+cp -R ${SRC_DIR}/drano-bench/* ${LLVM_DIR}/tools/drano-bench/ &&
+
+cd ${ROOT_DIR} &&
+mkdir -p ${LLVM_DIR}/tools/drano-client &&
+cp ${SRC_DIR}/abstract-execution/SummaryCache.h ${LLVM_DIR}/tools/drano-client/ &&
+cp ${SRC_DIR}/drano/DranoProtocol.h ${LLVM_DIR}/tools/drano-client/ &&
+cp -R ${SRC_DIR}/drano-client/* ${LLVM_DIR}/tools/drano-client/ &&
+
 
 # Add Drano to LLVM build environment
 if ! grep -q UncoalescedAnalysis "${LLVM_DIR}/lib/Transforms/CMakeLists.txt" ; then
@@ -3,12 +3,17 @@
 
 #include "AbstractState.h"
 #include "AbstractValue.h"
+#include "MemoryAccounting.h"
 
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
+#include <atomic>
+#include <cstdint>
+#include <functional> 
 #include <list> 
 #include <map> 
 #include <string> 
@@ -22,6 +27,18 @@
 
 using namespace llvm;
 
+// Returns the dominator tree of a function. Used by drivers of analyses
+// built on the engine to share dominator trees (e.g. with an analysis
+// manager).
+typedef std::function<const DominatorTree*(const Function*)> DomTreeGetter;
+
+// Returns the number of blocks executed by all engines of the process (read
+// by drano-bench).
+inline std::atomic<uint64_t>& getBlockExecutionCounter() {
+  static std::atomic<uint64_t> counter(0);
+  return counter;
+}
+
 // This class defines an abstract execution engine. An abstract execution engine
 // takes in a program and executes the program abstractly using semantics
 // defined for an abstract value.
@@ -52,6 +69,12 @@ class AbstractExecutionEngine {
     return StateBeforeInstructionMap_[inst];
   }
 
+  // Checks if the execution reached an instruction.
+  bool hasStateBeforeInstruction(const Instruction* inst) const {
+    return StateBeforeInstructionMap_.find(inst) !=
+           StateBeforeInstructionMap_.end();
+  }
+
   // Adds a block to execute next and the state in which the block must be 
   // executed.
   void AddBlockToExecute(const BasicBlock* b, U st);
@@ -63,7 +86,17 @@ class AbstractExecutionEngine {
   virtual U ExecuteInstruction(const Instruction* inst,
                                U st) = 0;
 
+  // Accounts the memory of the engine in Stats (if not null).
+  void setMemoryStats(MemoryStats* Stats) { memory_.setStats(Stats); }
+
  protected:
+  // Measures the structures of the analysis that are measured as a whole,
+  // after each block when memory is accounted (can be overriden).
+  virtual void AccountAnalysisMemory() {}
+
+  // Memory of the structures of this execution.
+  MemoryAccount memory_;
+
   // Entry block where the abstract execution begins.
   const BasicBlock* entryBlock_;
 
@@ -78,6 +111,15 @@ class AbstractExecutionEngine {
   // Add block to recently executed blocks.
   void AddRecentBlock(const BasicBlock* block);
 
+  // Records st as the state before inst.
+  void SetStateBeforeInstruction(const Instruction* inst, const U& st);
+
+  // Estimated bytes of a work item with state st.
+  static int64_t getWorkItemBytes(const U& st) {
+    return getListNodeBytes<std::pair<const BasicBlock*, U>>() +
+           st.getHeapBytes();
+  }
+
   // Stores some recent blocks executed by the engine.
   SmallVector<const BasicBlock*, NUM_RECENT_BLOCKS> recentBlocks_;
 
@@ -94,9 +136,22 @@ AbstractExecutionEngine<T, U>::~AbstractExecutionEngine() {}
 
 template<typename T, typename U>
 void AbstractExecutionEngine<T, U>::AddBlockToExecute(const BasicBlock* b, U st) {
+  memory_.add(MemoryWorklist, getWorkItemBytes(st));
   BlocksToExecuteBuffer_.push_back(std::pair<const BasicBlock*, U>(b, st));
 }
 
+template<typename T, typename U>
+void AbstractExecutionEngine<T, U>::SetStateBeforeInstruction(
+    const Instruction* inst, const U& st) {
+  if (memory_.isEnabled()) {
+    auto it = StateBeforeInstructionMap_.find(inst);
+    memory_.add(MemoryInstructionStates, it != StateBeforeInstructionMap_.end()
+        ? int64_t(st.getHeapBytes()) - int64_t(it->second.getHeapBytes())
+        : getMapNodeBytes<const Instruction*, U>() + st.getHeapBytes());
+  }
+  StateBeforeInstructionMap_[inst] = st;
+}
+
 // Returns a block in recentBlocks_ if found. Otherwise returns the
 // first block in worklist. This optimization is useful for execution
 // of loops. All blocks within the loop are given priority over blocks
@@ -116,12 +171,14 @@ std::pair<const BasicBlock*, U>
       // Block found.
       auto unit = *listIt;
       worklist.erase(listIt);
+      memory_.add(MemoryWorklist, -getWorkItemBytes(unit.second));
       AddRecentBlock(unit.first);
       return unit;
     }
   }
   auto unit = worklist.front();
   worklist.pop_front();
+  memory_.add(MemoryWorklist, -getWorkItemBytes(unit.second));
   AddRecentBlock(unit.first);
   return unit;
 } 
@@ -145,16 +202,24 @@ void AbstractExecutionEngine<T, U>::Execute() {
   // propagated through the block.
   std::list<std::pair<const BasicBlock*, U>> worklist;
   worklist.push_back(std::pair<const BasicBlock*, U>(entryBlock_, initialState_));
+  memory_.add(MemoryWorklist, getWorkItemBytes(initialState_));
 
   // Execute work items in worklist.
   StateBeforeInstructionMap_.clear();
+  memory_.set(MemoryInstructionStates, 0);
+  // Blocks executed, added to the shared counter once at the end.
+  uint64_t blocksExecuted = 0;
   while (!worklist.empty()) {
     auto unit = getNextExecutionUnit(worklist);
     const BasicBlock *b = unit.first; // next block to be executed.
     U st = unit.second; // state before next block.
+    blocksExecuted++;
     LLVM_DEBUG(errs() << "BasicBlock: " << b->getName() << "\n");
 
     // Clear buffer.
+    for (const auto& item : BlocksToExecuteBuffer_) {
+      memory_.add(MemoryWorklist, -getWorkItemBytes(item.second));
+    }
     BlocksToExecuteBuffer_.clear();
     // Execute instructions within the block.
     for (BasicBlock::const_iterator it = b->begin(), ite = b->end(); 
@@ -170,12 +235,12 @@ void AbstractExecutionEngine<T, U>::Execute() {
           // State before block unchanged; no need to execute block.
           if (oldState == newState) break;
 
-          StateBeforeInstructionMap_[I] = newState;
+          SetStateBeforeInstruction(I, newState);
         } else {
-          StateBeforeInstructionMap_[I] = st;
+          SetStateBeforeInstruction(I, st);
         }
       } else {
-        StateBeforeInstructionMap_[I] = st;
+        SetStateBeforeInstruction(I, st);
       }
       
       LLVM_DEBUG(errs() << "   " << *I << ", " << st.printInstructionState(I) << "\n");
@@ -196,13 +261,28 @@ void AbstractExecutionEngine<T, U>::Execute() {
                  else return false;
                });
       if (listIt != worklist.end()) {
+        int64_t oldBytes = getWorkItemBytes(listIt->second);
         listIt->second = listIt->second.mergeState(bufferIt->second);
+        memory_.add(MemoryWorklist,
+                    getWorkItemBytes(listIt->second) - oldBytes);
       } else {
         worklist.push_back(std::pair<const BasicBlock*, U>(bufferIt->first, 
                                                            bufferIt->second));
+        memory_.add(MemoryWorklist, getWorkItemBytes(bufferIt->second));
       }
     }
+    if (memory_.isEnabled()) AccountAnalysisMemory();
+  }
+  // The buffer of the last block is released when the engine is destroyed.
+  for (const auto& item : BlocksToExecuteBuffer_) {
+    memory_.add(MemoryWorklist, -getWorkItemBytes(item.second));
   }
+  BlocksToExecuteBuffer_.clear();
+  getBlockExecutionCounter().fetch_add(blocksExecuted,
+                                       std::memory_order_relaxed);
+  // The instruction states and the structures of the analysis are released
+  // with the engine.
+  memory_.recordPeaks(entryBlock_->getParent());
 }
  
 #endif /* AbstractExecutionEngine.h */
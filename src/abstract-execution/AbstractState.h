@@ -2,6 +2,7 @@
 #define ABSTRACT_STATE_H
 
 #include "AbstractValue.h"
+#include "MemoryAccounting.h"
 
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Value.h"
@@ -45,6 +46,11 @@ class AbstractState {
 
   virtual U mergeState(const U& st) const;
 
+  // Estimated heap bytes held by the state (see MemoryAccounting.h).
+  size_t getHeapBytes() const {
+    return valueMap_.size() * getMapNodeBytes<const Value*, T>();
+  }
+
   // Pretty printing 
   virtual std::string getString() const;
   virtual std::string printInstructionState(const Instruction* I) const;
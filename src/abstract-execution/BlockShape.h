@@ -0,0 +1,81 @@
+#ifndef BLOCK_SHAPE_H
+#define BLOCK_SHAPE_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Shape of the thread blocks a kernel is launched with (blockDim), if it is
+// known. Threads are numbered within a block with x varying fastest, then y,
+// then z, and consecutive threads form the warps. When the shape is unknown,
+// the analyses assume that the threads of a warp differ only in x.
+struct BlockShape {
+  // Most threads a block may have.
+  static const uint64_t MaxThreads = 1024;
+
+
+  BlockShape() : X(0), Y(1), Z(1) {}
+  BlockShape(unsigned x, unsigned y = 1, unsigned z = 1) : X(x), Y(y), Z(z) {}
+
+  // Threads along each dimension; X is 0 if the shape is unknown.
+  unsigned X, Y, Z;
+
+  bool isKnown() const { return X != 0; }
+
+  // Returns the threads along dim (0 for x, 1 for y, 2 for z).
+  unsigned getSize(unsigned dim) const {
+    return dim == 0 ? X : dim == 1 ? Y : Z;
+  }
+
+  uint64_t getNumThreads() const { return uint64_t(X) * Y * Z; }
+
+  // Can a block have this shape? An unknown shape is valid.
+  bool isValid() const {
+    if (!isKnown()) return true;
+    for (unsigned dim = 0; dim < 3; dim++) {
+      if (getSize(dim) == 0 || getSize(dim) > MaxThreads) return false;
+    }
+    return getNumThreads() <= MaxThreads;
+  }
+
+  // Returns the index (x, y, z) of the thread at position i of the block.
+  std::array<uint64_t, 3> getThreadIndex(uint64_t i) const {
+    return {{i % X, i / X % Y, i / X / Y}};
+  }
+
+  // Indices of the threads of each warp of a block.
+  typedef std::vector<std::vector<std::array<uint64_t, 3>>> Warps;
+
+  // Returns the indices of the threads of each warp of warpSize threads (the
+  // last warp may be partial). The shape must be valid.
+  Warps getWarps(unsigned warpSize) const {
+    Warps warps;
+    for (uint64_t i = 0; i < getNumThreads(); i++) {
+      if (i % warpSize == 0) warps.emplace_back();
+      warps.back().push_back(getThreadIndex(i));
+    }
+    return warps;
+  }
+
+  // Returns e.g. "16x16x1", or "unknown".
+  std::string getString() const {
+    if (!isKnown()) return "unknown";
+    return std::to_string(X) + "x" + std::to_string(Y) + "x" +
+           std::to_string(Z);
+  }
+
+  friend bool operator==(const BlockShape& a, const BlockShape& b) {
+    return a.X == b.X && a.Y == b.Y && a.Z == b.Z;
+  }
+  friend bool operator!=(const BlockShape& a, const BlockShape& b) {
+    return !(a == b);
+  }
+  friend bool operator<(const BlockShape& a, const BlockShape& b) {
+    if (a.X != b.X) return a.X < b.X;
+    if (a.Y != b.Y) return a.Y < b.Y;
+    return a.Z < b.Z;
+  }
+};
+
+#endif /* BlockShape.h */
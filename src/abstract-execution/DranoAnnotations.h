@@ -0,0 +1,219 @@
+//===- DranoAnnotations.h - Analysis results attached to the IR as metadata -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// With -uncoalesced-annotate and -bsi-annotate, the interprocedural analyses
+// attach their results to the module as metadata, so that they are written
+// out with it (e.g. opt -o annotated.bc):
+//   load/store  !drano.uncoalesced !{i32 kind, i64 stride x, i64 stride y,
+//                                    i64 stride z}
+//   function    !drano.uncoalesced !{i32 #uncoalesced accesses}
+//   instruction !drano.bsize.dependent !{i32 reasons, i32 dimensions}
+//   function    !drano.bsize.invariant !{i1 is block-size independent}
+// A function carries the function metadata only if it was analyzed. Later
+// tools read the results with DranoAnnotationReader without running the
+// analyses. Uncoalesced accesses annotated before strides along y and z were
+// recorded (!{i32 kind, i64 stride}) are read with zero strides along y and
+// z. This header only depends on LLVM IR.
+//===----------------------------------------------------------------------===//
+
+#ifndef DRANO_ANNOTATIONS_H
+#define DRANO_ANNOTATIONS_H
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Metadata.h"
+
+#include <cstdint>
+
+using namespace llvm;
+
+// Names of the metadata kinds.
+static const char* const DranoUncoalescedMD = "drano.uncoalesced";
+static const char* const DranoBSizeDependentMD = "drano.bsize.dependent";
+static const char* const DranoBSizeInvariantMD = "drano.bsize.invariant";
+
+// Why an access is uncoalesced.
+enum DranoAccessKind {
+  // Consecutive threads access consecutive elements wider than 4 bytes.
+  DranoAccessWideElements = 1,
+  // Same, in decreasing order of addresses.
+  DranoAccessReversedWideElements = 2,
+  // The distance between addresses of consecutive threads is unknown.
+  DranoAccessUnknownStride = 3,
+  // Consecutive threads access elements a constant number of elements
+  // apart (other than 1 and -1).
+  DranoAccessStrided = 4,
+  // Consecutive threads along x access addresses at most 4 bytes apart, but
+  // the warps span several rows (or planes) of the block, which access
+  // separate ranges of addresses.
+  DranoAccessSplitWarp = 5
+};
+
+// An uncoalesced access.
+struct DranoUncoalescedAccess {
+  DranoUncoalescedAccess()
+    : Kind(DranoAccessUnknownStride), Stride(0), StrideY(0), StrideZ(0) {}
+
+  DranoAccessKind Kind;
+
+  // Estimated distance in bytes between the addresses accessed by threads
+  // consecutive along x (0 if unknown).
+  int64_t Stride;
+
+  // Same, along y and z (0 if unknown or if the address does not depend on
+  // the dimension).
+  int64_t StrideY;
+  int64_t StrideZ;
+};
+
+// Reasons why an instruction is block-size dependent (bit mask).
+enum DranoBSIReason {
+  // The accessed address depends on the block size.
+  DranoBSIAddress = 1,
+  // The stored value depends on the block size.
+  DranoBSIValue = 2,
+  // Whether the access executes depends on the block size.
+  DranoBSIPath = 4,
+  // The callee is block-size dependent.
+  DranoBSICallee = 8,
+  // The callee was not analyzed.
+  DranoBSIUnknownCallee = 16,
+  // The instruction is a __syncthreads barrier.
+  DranoBSISyncThreads = 32
+};
+
+// A block-size dependent instruction.
+struct DranoBSIDependence {
+  DranoBSIDependence() : Reasons(0), Dimensions(0) {}
+
+  // Mask of DranoBSIReason.
+  unsigned Reasons;
+
+  // Mask of the thread dimensions in which the dependence was found (bit 0
+  // for x, 1 for y, 2 for z).
+  unsigned Dimensions;
+};
+
+inline ConstantAsMetadata* getDranoConstantMD(LLVMContext& C, unsigned Bits,
+                                              int64_t v) {
+  return ConstantAsMetadata::get(
+      ConstantInt::getSigned(Type::getIntNTy(C, Bits), v));
+}
+
+inline void setDranoUncoalescedAccess(const Instruction* I,
+    const DranoUncoalescedAccess& access) {
+  LLVMContext& C = I->getContext();
+  const_cast<Instruction*>(I)->setMetadata(DranoUncoalescedMD,
+      MDNode::get(C, {getDranoConstantMD(C, 32, access.Kind),
+                      getDranoConstantMD(C, 64, access.Stride),
+                      getDranoConstantMD(C, 64, access.StrideY),
+                      getDranoConstantMD(C, 64, access.StrideZ)}));
+}
+
+inline void setDranoUncoalescedAccessCount(const Function* F, unsigned count) {
+  LLVMContext& C = F->getContext();
+  const_cast<Function*>(F)->setMetadata(DranoUncoalescedMD,
+      MDNode::get(C, {getDranoConstantMD(C, 32, count)}));
+}
+
+inline void setDranoBSIDependence(const Instruction* I,
+                                  const DranoBSIDependence& dependence) {
+  LLVMContext& C = I->getContext();
+  const_cast<Instruction*>(I)->setMetadata(DranoBSizeDependentMD,
+      MDNode::get(C, {getDranoConstantMD(C, 32, dependence.Reasons),
+                      getDranoConstantMD(C, 32, dependence.Dimensions)}));
+}
+
+inline void setDranoBlockSizeIndependent(const Function* F, bool isBSI) {
+  LLVMContext& C = F->getContext();
+  const_cast<Function*>(F)->setMetadata(DranoBSizeInvariantMD,
+      MDNode::get(C, {ConstantAsMetadata::get(
+          ConstantInt::get(Type::getInt1Ty(C), isBSI))}));
+}
+
+// Reads the annotations of a module. Metadata kinds are looked up once per
+// context, so queries only cost a lookup in the metadata of the instruction
+// or function.
+class DranoAnnotationReader {
+ public:
+  explicit DranoAnnotationReader(LLVMContext& C)
+    : UncoalescedKind_(C.getMDKindID(DranoUncoalescedMD)),
+      BSizeDependentKind_(C.getMDKindID(DranoBSizeDependentMD)),
+      BSizeInvariantKind_(C.getMDKindID(DranoBSizeInvariantMD)) {}
+
+  // Returns true if I is an uncoalesced access, and sets access.
+  bool getUncoalescedAccess(const Instruction* I,
+                            DranoUncoalescedAccess& access) const {
+    const MDNode* N = I->getMetadata(UncoalescedKind_);
+    int64_t kind, stride, strideY = 0, strideZ = 0;
+    if (!N || (N->getNumOperands() != 2 && N->getNumOperands() != 4) ||
+        !getOperand(N, 0, kind) || !getOperand(N, 1, stride)) {
+      return false;
+    }
+    if (N->getNumOperands() == 4 &&
+        (!getOperand(N, 2, strideY) || !getOperand(N, 3, strideZ))) {
+      return false;
+    }
+    access.Kind = DranoAccessKind(kind);
+    access.Stride = stride;
+    access.StrideY = strideY;
+    access.StrideZ = strideZ;
+    return true;
+  }
+
+  // Returns true if F was analyzed by the uncoalesced access analysis, and
+  // sets count to the number of uncoalesced accesses within F.
+  bool getUncoalescedAccessCount(const Function* F, unsigned& count) const {
+    const MDNode* N = F->getMetadata(UncoalescedKind_);
+    int64_t v;
+    if (!N || N->getNumOperands() != 1 || !getOperand(N, 0, v)) return false;
+    count = v;
+    return true;
+  }
+
+  // Returns true if I is block-size dependent, and sets dependence.
+  bool getBSIDependence(const Instruction* I,
+                        DranoBSIDependence& dependence) const {
+    const MDNode* N = I->getMetadata(BSizeDependentKind_);
+    int64_t reasons, dimensions;
+    if (!N || N->getNumOperands() != 2 || !getOperand(N, 0, reasons) ||
+        !getOperand(N, 1, dimensions)) {
+      return false;
+    }
+    dependence.Reasons = reasons;
+    dependence.Dimensions = dimensions;
+    return true;
+  }
+
+  // Returns true if F was analyzed by the block-size invariance analysis,
+  // and sets isBSI.
+  bool getBlockSizeIndependence(const Function* F, bool& isBSI) const {
+    const MDNode* N = F->getMetadata(BSizeInvariantKind_);
+    int64_t v;
+    if (!N || N->getNumOperands() != 1 || !getOperand(N, 0, v)) return false;
+    isBSI = v != 0;
+    return true;
+  }
+
+ private:
+  static bool getOperand(const MDNode* N, unsigned i, int64_t& v) {
+    const ConstantInt* CI =
+        mdconst::dyn_extract_or_null<ConstantInt>(N->getOperand(i));
+    if (!CI) return false;
+    v = CI->getBitWidth() == 1 ? CI->getZExtValue() : CI->getSExtValue();
+    return true;
+  }
+
+  unsigned UncoalescedKind_;
+  unsigned BSizeDependentKind_;
+  unsigned BSizeInvariantKind_;
+};
+
+#endif /* DranoAnnotations.h */
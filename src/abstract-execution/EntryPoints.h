@@ -0,0 +1,97 @@
+#ifndef ENTRY_POINTS_H
+#define ENTRY_POINTS_H
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+// Returns the kernels of M, i.e. the functions annotated as "kernel" in the
+// nvvm.annotations metadata, e.g.
+//   !nvvm.annotations = !{!0}
+//   !0 = !{void (float*)* @kernel, !"kernel", i32 1}
+inline std::set<const Function*> getKernels(const Module& M) {
+  std::set<const Function*> kernels;
+  const NamedMDNode* annotations = M.getNamedMetadata("nvvm.annotations");
+  if (!annotations) return kernels;
+  for (const MDNode* node : annotations->operands()) {
+    if (node->getNumOperands() < 3) continue;
+    const MDString* kind = dyn_cast<MDString>(node->getOperand(1));
+    if (!kind || kind->getString() != "kernel") continue;
+    const auto* md = dyn_cast_or_null<ConstantAsMetadata>(node->getOperand(0));
+    if (!md) continue;
+    const Constant* C = md->getValue();
+    if (const Function* F = dyn_cast<Function>(C->stripPointerCasts())) {
+      kernels.insert(F);
+    }
+  }
+  return kernels;
+}
+
+// Returns the defined functions referenced from F (called directly or whose
+// address is taken).
+inline std::set<const Function*> getReferencedFunctions(const Function* F) {
+  std::set<const Function*> referenced;
+  for (const_inst_iterator it = inst_begin(F), ite = inst_end(F);
+                                                    it != ite; ++it) {
+    for (const Use& op : it->operands()) {
+      const Function* G = dyn_cast<Function>(op.get()->stripPointerCasts());
+      if (G && !G->isDeclaration()) referenced.insert(G);
+    }
+  }
+  return referenced;
+}
+
+// Returns the entry points of the analysis: the kernels of M and the
+// defined functions named in extra. If there are none (e.g. the module has
+// no kernel annotations), returns the defined functions that are not
+// referenced from other functions of the module, or all defined functions
+// if every function is referenced (e.g. mutual recursion).
+inline std::set<const Function*> getEntryPoints(const Module& M,
+    const std::vector<std::string>& extra) {
+  std::set<const Function*> entries = getKernels(M);
+  for (const std::string& name : extra) {
+    const Function* F = M.getFunction(name);
+    if (F && !F->isDeclaration()) entries.insert(F);
+  }
+  if (!entries.empty()) return entries;
+
+  std::set<const Function*> referenced;
+  for (const Function& F : M) {
+    if (F.isDeclaration()) continue;
+    for (const Function* G : getReferencedFunctions(&F)) {
+      if (G != &F) referenced.insert(G);
+    }
+  }
+  for (const Function& F : M) {
+    if (!F.isDeclaration() && !referenced.count(&F)) entries.insert(&F);
+  }
+  if (!entries.empty()) return entries;
+  for (const Function& F : M) {
+    if (!F.isDeclaration()) entries.insert(&F);
+  }
+  return entries;
+}
+
+// Returns the functions reachable from the entry points (including the
+// entry points themselves).
+inline std::set<const Function*> getReachableFunctions(
+    const std::set<const Function*>& entries) {
+  std::set<const Function*> reachable;
+  std::vector<const Function*> stack(entries.begin(), entries.end());
+  while (!stack.empty()) {
+    const Function* F = stack.back();
+    stack.pop_back();
+    if (!reachable.insert(F).second) continue;
+    for (const Function* G : getReferencedFunctions(F)) stack.push_back(G);
+  }
+  return reachable;
+}
+
+#endif /* EntryPoints.h */
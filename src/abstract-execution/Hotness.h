@@ -0,0 +1,88 @@
+#ifndef HOTNESS_H
+#define HOTNESS_H
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Module.h"
+#include <map>
+#include <memory>
+#include <vector>
+
+using namespace llvm;
+
+// Estimates how often instructions execute per execution of their function,
+// from the loops enclosing them: each loop multiplies the weight by its trip
+// count, as computed by ScalarEvolution, or by UnknownTripCount if it cannot
+// be computed (e.g. bounds passed as kernel arguments), so that deeper
+// nesting still ranks higher. Loop analyses are built once per function.
+class HotnessEstimator {
+ public:
+  enum { UnknownTripCount = 10 };
+
+  // Returns the number of loops enclosing I.
+  unsigned getLoopDepth(const Instruction* I) {
+    return getLoops(I->getFunction()).LI.getLoopDepth(I->getParent());
+  }
+
+  // Returns the estimated number of executions of I per execution of its
+  // function.
+  double getWeight(const Instruction* I) {
+    FunctionLoops& loops = getLoops(I->getFunction());
+    double weight = 1.0;
+    for (const Loop* L = loops.LI.getLoopFor(I->getParent()); L;
+                                                  L = L->getParentLoop()) {
+      Loop* loop = const_cast<Loop*>(L);
+      unsigned tripCount = loops.SE.getSmallConstantTripCount(loop);
+      if (tripCount == 0) {
+        tripCount = loops.SE.getSmallConstantMaxTripCount(loop);
+      }
+      weight *= tripCount ? tripCount : UnknownTripCount;
+    }
+    return weight;
+  }
+
+  // Returns the loop depth and weight of an instruction reached through a
+  // chain of calls (the instruction first, then the call sites): the depths
+  // and weights of the instruction and of each call site combined.
+  unsigned getLoopDepth(const std::vector<const Instruction*>& trace) {
+    unsigned depth = 0;
+    for (const Instruction* I : trace) depth += getLoopDepth(I);
+    return depth;
+  }
+  double getWeight(const std::vector<const Instruction*>& trace) {
+    double weight = 1.0;
+    for (const Instruction* I : trace) weight *= getWeight(I);
+    return weight;
+  }
+
+ private:
+  // Analyses of a function, in the order they are built.
+  struct FunctionLoops {
+    explicit FunctionLoops(Function& F)
+      : TLII(Triple(F.getParent()->getTargetTriple())), TLI(TLII, &F),
+        AC(F), DT(F), LI(DT), SE(F, TLI, AC, DT, LI) {}
+
+    TargetLibraryInfoImpl TLII;
+    TargetLibraryInfo TLI;
+    AssumptionCache AC;
+    DominatorTree DT;
+    LoopInfo LI;
+    ScalarEvolution SE;
+  };
+
+  FunctionLoops& getLoops(const Function* F) {
+    std::unique_ptr<FunctionLoops>& loops = Loops_[F];
+    if (!loops) loops.reset(new FunctionLoops(const_cast<Function&>(*F)));
+    return *loops;
+  }
+
+  std::map<const Function*, std::unique_ptr<FunctionLoops>> Loops_;
+};
+
+#endif /* Hotness.h */
@@ -0,0 +1,188 @@
+#ifndef LAUNCH_CONFIG_H
+#define LAUNCH_CONFIG_H
+
+#include "BlockShape.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+
+using namespace llvm;
+
+// Launch configurations of kernels, as recovered from the launch sites of a
+// host module (see DranoLaunch.h). They are handed to the device analyses in
+// process, or through a sidecar file with one kernel per line:
+//   <kernel> grid=<x>,<y>,<z> block=<x>,<y>,<z> launches=<n>
+// where each dimension is a constant ("16"), a range of constants
+// ("32..256") or unknown ("?"), joined across the launch sites of the kernel.
+// Lines starting with '#' are comments.
+
+// Values a dimension takes across the launches of a kernel.
+struct LaunchDimension {
+  LaunchDimension() : Known(false), Min(0), Max(0) {}
+  explicit LaunchDimension(uint64_t v) : Known(true), Min(v), Max(v) {}
+  LaunchDimension(uint64_t min, uint64_t max)
+    : Known(true), Min(min), Max(max) {}
+
+  // Is the dimension bounded by Min and Max?
+  bool Known;
+  uint64_t Min, Max;
+
+  bool isConstant() const { return Known && Min == Max; }
+  bool isRange() const { return Known && Min != Max; }
+
+  LaunchDimension join(const LaunchDimension& d) const {
+    if (!Known || !d.Known) return LaunchDimension();
+    return LaunchDimension(std::min(Min, d.Min), std::max(Max, d.Max));
+  }
+
+  // Returns e.g. "16", "32..256" or "?".
+  std::string getString() const {
+    if (!Known) return "?";
+    if (Min == Max) return std::to_string(Min);
+    return std::to_string(Min) + ".." + std::to_string(Max);
+  }
+
+  // Parses a dimension printed by getString. Returns false on error.
+  static bool parse(StringRef s, LaunchDimension& d) {
+    if (s == "?") {
+      d = LaunchDimension();
+      return true;
+    }
+    std::pair<StringRef, StringRef> bounds = s.split("..");
+    uint64_t min, max;
+    if (bounds.first.getAsInteger(10, min)) return false;
+    if (bounds.second.empty()) max = min;
+    else if (bounds.second.getAsInteger(10, max) || max < min) return false;
+    d = LaunchDimension(min, max);
+    return true;
+  }
+
+  friend bool operator==(const LaunchDimension& a, const LaunchDimension& b) {
+    if (!a.Known || !b.Known) return a.Known == b.Known;
+    return a.Min == b.Min && a.Max == b.Max;
+  }
+};
+
+// Grid and block dimensions a kernel is launched with, joined across its
+// launch sites.
+struct LaunchConfig {
+  LaunchDimension Grid[3], Block[3];
+
+  // Number of launch sites.
+  unsigned Launches = 0;
+
+  void join(const LaunchConfig& config) {
+    if (config.Launches == 0) return;
+    if (Launches == 0) {
+      *this = config;
+      return;
+    }
+    for (unsigned dim = 0; dim < 3; dim++) {
+      Grid[dim] = Grid[dim].join(config.Grid[dim]);
+      Block[dim] = Block[dim].join(config.Block[dim]);
+    }
+    Launches += config.Launches;
+  }
+
+  // Returns the shape of the blocks if it is the same at all launches and
+  // valid, or an unknown shape.
+  BlockShape getBlockShape() const {
+    for (unsigned dim = 0; dim < 3; dim++) {
+      if (!Block[dim].isConstant() || Block[dim].Min == 0 ||
+          Block[dim].Min > UINT32_MAX) {
+        return BlockShape();
+      }
+    }
+    BlockShape shape(Block[0].Min, Block[1].Min, Block[2].Min);
+    return shape.isValid() ? shape : BlockShape();
+  }
+
+  // Returns e.g. "grid=128,1,1 block=16,16,1 launches=2".
+  std::string getString() const {
+    std::string s = "grid=";
+    for (unsigned dim = 0; dim < 3; dim++) {
+      s += (dim ? "," : "") + Grid[dim].getString();
+    }
+    s += " block=";
+    for (unsigned dim = 0; dim < 3; dim++) {
+      s += (dim ? "," : "") + Block[dim].getString();
+    }
+    return s + " launches=" + std::to_string(Launches);
+  }
+};
+
+// Map from kernel names to their launch configurations.
+typedef std::map<std::string, LaunchConfig> LaunchConfigMap;
+
+// Parses the three dimensions of "<name>=<x>,<y>,<z>" into dims. Returns
+// false on error.
+inline bool parseLaunchDimensions(StringRef field, StringRef name,
+                                  LaunchDimension* dims) {
+  if (!field.consume_front(name) || !field.consume_front("=")) return false;
+  SmallVector<StringRef, 3> values;
+  field.split(values, ',');
+  if (values.size() != 3) return false;
+  for (unsigned dim = 0; dim < 3; dim++) {
+    if (!LaunchDimension::parse(values[dim], dims[dim])) return false;
+  }
+  return true;
+}
+
+// Reads the launch configurations in the sidecar file Path into Configs,
+// joining them with those already there. Returns false and sets Error on
+// error.
+inline bool readLaunchConfigs(StringRef Path, LaunchConfigMap& Configs,
+                              std::string& Error) {
+  auto bufferOrErr = MemoryBuffer::getFile(Path);
+  if (!bufferOrErr) {
+    Error = (Path + ": " + bufferOrErr.getError().message()).str();
+    return false;
+  }
+  SmallVector<StringRef, 16> lines;
+  (*bufferOrErr)->getBuffer().split(lines, '\n');
+  for (unsigned i = 0; i < lines.size(); i++) {
+    StringRef line = lines[i].trim();
+    if (line.empty() || line.startswith("#")) continue;
+    SmallVector<StringRef, 4> fields;
+    line.split(fields, ' ', -1, /*KeepEmpty=*/false);
+    LaunchConfig config;
+    if (fields.size() != 4 ||
+        !parseLaunchDimensions(fields[1], "grid", config.Grid) ||
+        !parseLaunchDimensions(fields[2], "block", config.Block) ||
+        !fields[3].consume_front("launches=") ||
+        fields[3].getAsInteger(10, config.Launches)) {
+      Error = (Path + ":" + Twine(i + 1) + ": malformed launch configuration")
+                  .str();
+      return false;
+    }
+    Configs[fields[0].str()].join(config);
+  }
+  return true;
+}
+
+// Writes Configs to the sidecar file Path. Returns false and sets Error on
+// error.
+inline bool writeLaunchConfigs(StringRef Path, const LaunchConfigMap& Configs,
+                               std::string& Error) {
+  std::error_code EC;
+  raw_fd_ostream os(Path, EC, sys::fs::OF_Text);
+  if (EC) {
+    Error = (Path + ": " + EC.message()).str();
+    return false;
+  }
+  os << "# kernel grid=<x>,<y>,<z> block=<x>,<y>,<z> launches=<n>\n";
+  for (const auto& pair : Configs) {
+    os << pair.first << " " << pair.second.getString() << "\n";
+  }
+  return true;
+}
+
+#endif /* LaunchConfig.h */
@@ -0,0 +1,212 @@
+#ifndef MEMORY_ACCOUNTING_H
+#define MEMORY_ACCOUNTING_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+
+// Accounts the memory held by the structures of the analyses, to find
+// which one grows on large kernels. The bytes of a structure are estimated
+// from its number of entries (nodes of standard containers) and the sizes
+// of the abstract states it holds, as the structures change. Accounting is
+// enabled per analysis (-uncoalesced-memory-stats, -bsi-memory-stats).
+
+// Structures whose memory is accounted.
+enum MemoryStructure {
+  // States before instructions recorded by the engine.
+  MemoryInstructionStates,
+  // Blocks waiting for execution, with their states.
+  MemoryWorklist,
+  // Base type sizes of pointers (uncoalesced access analysis).
+  MemoryBaseSizes,
+  // Access patterns of pointers (block-size invariance analysis).
+  MemoryAccessPatterns,
+  // Access patterns of shared memory variables (block-size invariance
+  // analysis).
+  MemorySharedAccessPatterns,
+  // Interprocedural summaries of functions.
+  MemorySummaries,
+  NumMemoryStructures
+};
+
+inline const char* getMemoryStructureName(MemoryStructure S) {
+  switch (S) {
+    case MemoryInstructionStates: return "instruction states";
+    case MemoryWorklist: return "worklist";
+    case MemoryBaseSizes: return "base sizes";
+    case MemoryAccessPatterns: return "access patterns";
+    case MemorySharedAccessPatterns: return "shared access patterns";
+    case MemorySummaries: return "summaries";
+    default: return "unknown";
+  }
+}
+
+// Estimated bytes of a node of std::map<K, V> (the tree links and color,
+// and the entry).
+template <typename K, typename V>
+size_t getMapNodeBytes() {
+  return 4 * sizeof(void*) + sizeof(std::pair<const K, V>);
+}
+
+// Estimated bytes of a node of std::set<T>.
+template <typename T>
+size_t getSetNodeBytes() {
+  return 4 * sizeof(void*) + sizeof(T);
+}
+
+// Estimated bytes of a node of std::list<T>.
+template <typename T>
+size_t getListNodeBytes() {
+  return 2 * sizeof(void*) + sizeof(T);
+}
+
+// Process-wide memory statistics of an analysis: the current and peak
+// bytes of each structure across all functions being analyzed, and the
+// peak bytes of each structure during the analysis of each function. The
+// statistics may be updated by analyses running concurrently.
+class MemoryStats {
+ public:
+  explicit MemoryStats(StringRef Analysis) : Analysis_(Analysis.str()) {
+    for (unsigned i = 0; i < NumMemoryStructures; i++) {
+      Current_[i] = 0;
+      Peak_[i] = 0;
+    }
+  }
+
+  // Adds delta bytes to the current bytes of S.
+  void add(MemoryStructure S, int64_t delta) {
+    int64_t current = Current_[S].fetch_add(delta, std::memory_order_relaxed)
+                      + delta;
+    int64_t peak = Peak_[S].load(std::memory_order_relaxed);
+    while (current > peak &&
+           !Peak_[S].compare_exchange_weak(peak, current,
+                                           std::memory_order_relaxed)) {}
+  }
+
+  // Records that S reached peak bytes during an analysis of F.
+  void recordFunction(const Function* F, MemoryStructure S, uint64_t peak) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t& functionPeak = FunctionPeaks_[F->getName().str()][S];
+    functionPeak = std::max(functionPeak, peak);
+  }
+
+  // Prints the current and peak bytes of each structure, and the peaks of
+  // the MaxFunctions functions with the largest total peak.
+  void print(raw_ostream& os, unsigned MaxFunctions = 10) const {
+    os << "Memory of the " << Analysis_ << " analysis (KiB):\n";
+    os << format("  %-24s %12s %12s\n", (const char*)"structure",
+                 (const char*)"current", (const char*)"peak");
+    for (unsigned i = 0; i < NumMemoryStructures; i++) {
+      os << format("  %-24s %12.1f %12.1f\n",
+                   getMemoryStructureName(MemoryStructure(i)),
+                   Current_[i].load() / 1024.0, Peak_[i].load() / 1024.0);
+    }
+    std::vector<std::pair<uint64_t, std::string>> functions;
+    std::map<std::string, std::array<uint64_t, NumMemoryStructures>> peaks;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      peaks = FunctionPeaks_;
+    }
+    for (const auto& pair : peaks) {
+      uint64_t total = 0;
+      for (uint64_t peak : pair.second) total += peak;
+      functions.emplace_back(total, pair.first);
+    }
+    std::sort(functions.begin(), functions.end(),
+              [](const std::pair<uint64_t, std::string>& a,
+                 const std::pair<uint64_t, std::string>& b) {
+      return a.first != b.first ? a.first > b.first : a.second < b.second;
+    });
+    if (functions.size() > MaxFunctions) functions.resize(MaxFunctions);
+    if (functions.empty()) return;
+    os << "  Peak per function (KiB):\n";
+    for (const auto& function : functions) {
+      os << "    " << function.second << ":";
+      const auto& functionPeaks = peaks.at(function.second);
+      for (unsigned i = 0; i < NumMemoryStructures; i++) {
+        if (functionPeaks[i] == 0) continue;
+        os << " " << getMemoryStructureName(MemoryStructure(i))
+           << format(" %.1f,", functionPeaks[i] / 1024.0);
+      }
+      os << format(" total %.1f\n", function.first / 1024.0);
+    }
+  }
+
+ private:
+  std::string Analysis_;
+  std::atomic<int64_t> Current_[NumMemoryStructures];
+  std::atomic<int64_t> Peak_[NumMemoryStructures];
+  mutable std::mutex mutex_;
+  std::map<std::string, std::array<uint64_t, NumMemoryStructures>>
+      FunctionPeaks_;
+};
+
+// Bytes of the structures of a single analysis of a function. Updates are
+// ignored unless statistics are attached.
+class MemoryAccount {
+ public:
+  MemoryAccount() : Stats_(nullptr) {
+    Current_.fill(0);
+    Peak_.fill(0);
+  }
+  ~MemoryAccount() { release(); }
+
+  MemoryAccount(const MemoryAccount&) = delete;
+  MemoryAccount& operator=(const MemoryAccount&) = delete;
+
+  void setStats(MemoryStats* Stats) { Stats_ = Stats; }
+  bool isEnabled() const { return Stats_ != nullptr; }
+
+  // Adds delta bytes to S.
+  void add(MemoryStructure S, int64_t delta) {
+    if (!Stats_) return;
+    Current_[S] += delta;
+    Peak_[S] = std::max(Peak_[S], Current_[S]);
+    Stats_->add(S, delta);
+  }
+
+  // Sets the bytes of S (for structures measured as a whole).
+  void set(MemoryStructure S, int64_t bytes) { add(S, bytes - Current_[S]); }
+
+  // Records the peaks of the analysis of F in the statistics. The bytes of
+  // the structures stay accounted until they are released.
+  void recordPeaks(const Function* F) {
+    if (!Stats_) return;
+    for (unsigned i = 0; i < NumMemoryStructures; i++) {
+      if (Peak_[i] > 0) {
+        Stats_->recordFunction(F, MemoryStructure(i), Peak_[i]);
+      }
+    }
+    Peak_ = Current_;
+  }
+
+  // Releases the bytes of all structures (when the analysis is destroyed).
+  void release() {
+    if (!Stats_) return;
+    for (unsigned i = 0; i < NumMemoryStructures; i++) {
+      Stats_->add(MemoryStructure(i), -Current_[i]);
+    }
+    Current_.fill(0);
+    Peak_.fill(0);
+  }
+
+ private:
+  MemoryStats* Stats_;
+  std::array<int64_t, NumMemoryStructures> Current_;
+  std::array<int64_t, NumMemoryStructures> Peak_;
+};
+
+#endif /* MemoryAccounting.h */
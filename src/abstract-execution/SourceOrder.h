@@ -0,0 +1,78 @@
+#ifndef SOURCE_ORDER_H
+#define SOURCE_ORDER_H
+
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instruction.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace llvm;
+
+// Results are kept in sets ordered by pointer, which differs between runs.
+// These helpers order them by source location instead, so that they are
+// printed in the same order in every run.
+
+// Returns the position of I within its function.
+inline unsigned getInstructionPosition(const Instruction* I) {
+  unsigned position = 0;
+  for (const_inst_iterator it = inst_begin(I->getFunction()),
+                           ite = inst_end(I->getFunction());
+                                                 it != ite; ++it, ++position) {
+    if (&*it == I) break;
+  }
+  return position;
+}
+
+// Orders instructions by file, line and column, then by function name and
+// position within the function.
+inline bool compareSourceOrder(const Instruction* a, const Instruction* b) {
+  if (a == b) return false;
+  const DILocation* la = a->getDebugLoc().get();
+  const DILocation* lb = b->getDebugLoc().get();
+  auto key = [](const DILocation* L) {
+    return L ? std::make_tuple(L->getFilename(), L->getLine(), L->getColumn())
+             : std::make_tuple(StringRef(), 0u, 0u);
+  };
+  if (key(la) != key(lb)) return key(la) < key(lb);
+  StringRef fa = a->getFunction()->getName();
+  StringRef fb = b->getFunction()->getName();
+  if (fa != fb) return fa < fb;
+  return getInstructionPosition(a) < getInstructionPosition(b);
+}
+
+// Orders traces of instructions lexicographically by compareSourceOrder.
+inline bool compareSourceOrder(const std::vector<const Instruction*>& a,
+                               const std::vector<const Instruction*>& b) {
+  for (unsigned i = 0; i < a.size() && i < b.size(); i++) {
+    if (compareSourceOrder(a[i], b[i])) return true;
+    if (compareSourceOrder(b[i], a[i])) return false;
+  }
+  return a.size() < b.size();
+}
+
+// Returns the elements of a set of instructions (or traces) in source order.
+template <typename T, typename SetT>
+std::vector<T> getInSourceOrder(const SetT& set) {
+  std::vector<T> sorted(set.begin(), set.end());
+  std::sort(sorted.begin(), sorted.end(),
+            [](const T& a, const T& b) { return compareSourceOrder(a, b); });
+  return sorted;
+}
+
+// Returns the demangled form of name, or name itself if it is not a mangled
+// C++ name.
+inline std::string demangle(const char* name) {
+  int status = -1;
+  std::unique_ptr<char, void(*)(void*)> res {
+      abi::__cxa_demangle(name, NULL, NULL, &status), std::free };
+  return (status == 0) ? res.get() : std::string(name);
+}
+
+#endif /* SourceOrder.h */
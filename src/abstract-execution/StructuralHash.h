@@ -0,0 +1,202 @@
+#ifndef STRUCTURAL_HASH_H
+#define STRUCTURAL_HASH_H
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/raw_ostream.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+// Computes stable structural hashes of functions. The hash of a function
+// covers its name, the opcodes, types and operands of its instructions, and
+// the hashes of all functions it (transitively) calls. Debug locations,
+// debug intrinsics and value names of local values are ignored, so the hash
+// only changes when the analyzed code changes. The analysis version is mixed
+// in so that results of older analyses are never reused.
+class StructuralHasher {
+ public:
+  StructuralHasher(StringRef Analysis, unsigned Version)
+    : Analysis_(Analysis), Version_(Version) {}
+
+  // Returns the hash of F (as a hex string).
+  std::string getHash(const Function* F) {
+    auto it = HashMap_.find(F);
+    if (it != HashMap_.end()) return it->second;
+
+    // Collect functions reachable from F, ordered by name.
+    std::map<std::string, const Function*> reachable;
+    std::vector<const Function*> stack(1, F);
+    while (!stack.empty()) {
+      const Function* G = stack.back();
+      stack.pop_back();
+      if (!reachable.emplace(G->getName().str(), G).second) continue;
+      for (const Function* callee : getCallees(G)) stack.push_back(callee);
+    }
+
+    MD5 Hash;
+    Hash.update(Analysis_);
+    Hash.update(std::to_string(Version_));
+    Hash.update(F->getParent()->getDataLayoutStr());
+    Hash.update(getLocalHash(F));
+    for (auto& pair : reachable) {
+      Hash.update(pair.first);
+      Hash.update(getLocalHash(pair.second));
+    }
+    return HashMap_[F] = finalize(Hash);
+  }
+
+  // Does F only (transitively) call functions defined in its module, apart
+  // from intrinsics? Results of other functions depend on code outside the
+  // module (e.g. in another translation unit linked later), so they must
+  // not be cached.
+  bool isSelfContained(const Function* F) {
+    auto it = SelfContainedMap_.find(F);
+    if (it != SelfContainedMap_.end()) return it->second;
+    std::set<const Function*> visited;
+    std::vector<const Function*> stack(1, F);
+    bool selfContained = true;
+    while (!stack.empty() && selfContained) {
+      const Function* G = stack.back();
+      stack.pop_back();
+      if (!visited.insert(G).second) continue;
+      for (const_inst_iterator iit = inst_begin(G), iite = inst_end(G);
+                                                       iit != iite; ++iit) {
+        const CallInst* CI = dyn_cast<CallInst>(&*iit);
+        const Function* calledF = CI ? CI->getCalledFunction() : nullptr;
+        if (calledF && calledF->isDeclaration() && !calledF->isIntrinsic()) {
+          selfContained = false;
+          break;
+        }
+      }
+      for (const Function* callee : getCallees(G)) stack.push_back(callee);
+    }
+    return SelfContainedMap_[F] = selfContained;
+  }
+
+ private:
+  static std::string finalize(MD5& Hash) {
+    MD5::MD5Result Result;
+    Hash.final(Result);
+    SmallString<32> Str;
+    MD5::stringifyResult(Result, Str);
+    return Str.str().str();
+  }
+
+  // Returns the defined functions called directly from F.
+  static std::set<const Function*> getCallees(const Function* F) {
+    std::set<const Function*> callees;
+    for (const_inst_iterator it = inst_begin(F), ite = inst_end(F);
+                                                      it != ite; ++it) {
+      if (const CallInst* CI = dyn_cast<CallInst>(&*it)) {
+        const Function* calledF = CI->getCalledFunction();
+        if (calledF && !calledF->isDeclaration()) callees.insert(calledF);
+      }
+    }
+    return callees;
+  }
+
+  // Adds the operand V to the hash. Local values are identified by their
+  // position in the function; constants by their printed form.
+  static void hashOperand(MD5& Hash, const Value* V,
+                          const std::map<const Value*, unsigned>& numbering) {
+    std::string s;
+    raw_string_ostream os(s);
+    auto it = numbering.find(V);
+    if (!V) {
+      os << "null";
+    } else if (it != numbering.end()) {
+      os << "%" << it->second;
+    } else if (const InlineAsm* IA = dyn_cast<InlineAsm>(V)) {
+      os << "asm " << IA->getAsmString() << " " << IA->getConstraintString();
+    } else if (isa<Constant>(V)) {
+      V->printAsOperand(os, true);
+    } else {
+      os << "value";
+    }
+    Hash.update(os.str());
+    Hash.update(StringRef(";"));
+  }
+
+  // Returns the hash of the body of F.
+  std::string getLocalHash(const Function* F) {
+    auto it = LocalHashMap_.find(F);
+    if (it != LocalHashMap_.end()) return it->second;
+
+    // Number arguments, blocks and instructions. Debug intrinsics are not
+    // numbered, so that they do not shift the numbers of the instructions
+    // after them.
+    std::map<const Value*, unsigned> numbering;
+    for (const Argument& arg : F->args()) {
+      numbering.emplace(&arg, numbering.size());
+    }
+    for (const BasicBlock& BB : *F) {
+      numbering.emplace(&BB, numbering.size());
+      for (const Instruction& I : BB) {
+        if (isa<DbgInfoIntrinsic>(&I)) continue;
+        numbering.emplace(&I, numbering.size());
+      }
+    }
+
+    MD5 Hash;
+    std::string s;
+    raw_string_ostream os(s);
+    os << F->getName() << " ";
+    F->getFunctionType()->print(os);
+    Hash.update(os.str());
+    for (const BasicBlock& BB : *F) {
+      Hash.update(StringRef("bb"));
+      for (const Instruction& I : BB) {
+        if (isa<DbgInfoIntrinsic>(&I)) continue;
+        std::string is;
+        raw_string_ostream ios(is);
+        ios << I.getOpcodeName() << " ";
+        I.getType()->print(ios);
+        if (const CmpInst* CI = dyn_cast<CmpInst>(&I)) {
+          ios << " pred" << CI->getPredicate();
+        } else if (const AllocaInst* AI = dyn_cast<AllocaInst>(&I)) {
+          ios << " ";
+          AI->getAllocatedType()->print(ios);
+        } else if (const GetElementPtrInst* GEPI =
+                       dyn_cast<GetElementPtrInst>(&I)) {
+          ios << " ";
+          GEPI->getSourceElementType()->print(ios);
+        }
+        Hash.update(ios.str());
+        for (const Use& op : I.operands()) {
+          hashOperand(Hash, op.get(), numbering);
+        }
+        if (const PHINode* PHI = dyn_cast<PHINode>(&I)) {
+          for (unsigned i = 0; i < PHI->getNumIncomingValues(); i++) {
+            hashOperand(Hash, PHI->getIncomingBlock(i), numbering);
+          }
+        }
+      }
+    }
+    return LocalHashMap_[F] = finalize(Hash);
+  }
+
+  // Name of the analysis.
+  std::string Analysis_;
+
+  // Version of the analysis.
+  unsigned Version_;
+
+  // Memoized hashes.
+  std::map<const Function*, std::string> HashMap_;
+  std::map<const Function*, std::string> LocalHashMap_;
+  std::map<const Function*, bool> SelfContainedMap_;
+};
+
+#endif /* StructuralHash.h */
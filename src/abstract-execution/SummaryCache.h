@@ -0,0 +1,219 @@
+#ifndef SUMMARY_CACHE_H
+#define SUMMARY_CACHE_H
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+// Helpers for the cache of function summaries. Each cache entry is keyed by
+// the structural hash of a function (see StructuralHash.h) and holds the
+// analysis results for that function in a compact little-endian binary
+// format. Entries are kept in a SummaryStore: either a directory, where
+// entries are written to a temporary file and renamed so that concurrent
+// analyses can share it, or memory, for long-running processes.
+
+// Serializes values into a binary buffer.
+class CacheWriter {
+ public:
+  void writeU8(uint8_t v) { buffer_.push_back(static_cast<char>(v)); }
+
+  void writeU32(uint32_t v) {
+    for (unsigned i = 0; i < 4; i++) writeU8((v >> (8 * i)) & 0xff);
+  }
+
+  void writeString(StringRef s) {
+    writeU32(s.size());
+    buffer_.append(s.begin(), s.end());
+  }
+
+  const std::string& getBuffer() const { return buffer_; }
+
+ private:
+  std::string buffer_;
+};
+
+// Deserializes values from a binary buffer. Reading past the end of the
+// buffer sets the error flag and returns zero values.
+class CacheReader {
+ public:
+  explicit CacheReader(StringRef buffer) : buffer_(buffer), error_(false) {}
+
+  uint8_t readU8() {
+    if (buffer_.empty()) { error_ = true; return 0; }
+    uint8_t v = static_cast<uint8_t>(buffer_[0]);
+    buffer_ = buffer_.drop_front(1);
+    return v;
+  }
+
+  uint32_t readU32() {
+    uint32_t v = 0;
+    for (unsigned i = 0; i < 4; i++) v |= uint32_t(readU8()) << (8 * i);
+    return v;
+  }
+
+  std::string readString() {
+    uint32_t size = readU32();
+    if (size > buffer_.size()) { error_ = true; return std::string(); }
+    std::string s = buffer_.substr(0, size).str();
+    buffer_ = buffer_.drop_front(size);
+    return s;
+  }
+
+  bool hasError() const { return error_; }
+  bool atEnd() const { return buffer_.empty(); }
+
+ private:
+  StringRef buffer_;
+  bool error_;
+};
+
+// Returns the key of the cache entry for a hash.
+inline std::string getCacheKey(StringRef hash, StringRef extension) {
+  return (hash + "." + extension).str();
+}
+
+// Returns the path of the cache entry for a key.
+inline std::string getCacheEntryPath(StringRef dir, StringRef key) {
+  SmallString<256> path(dir);
+  sys::path::append(path, key);
+  return path.str().str();
+}
+
+// Reads a cache entry. Returns false if the entry does not exist.
+inline bool readCacheEntry(StringRef path, std::string& contents) {
+  auto bufferOrErr = MemoryBuffer::getFile(path);
+  if (!bufferOrErr) return false;
+  contents = (*bufferOrErr)->getBuffer().str();
+  return true;
+}
+
+// Writes a cache entry atomically. Failures are ignored, since a missing
+// entry only means that the function is analyzed again.
+inline void writeCacheEntry(StringRef dir, StringRef path,
+                            const std::string& contents) {
+  if (sys::fs::create_directories(dir)) return;
+  int FD;
+  SmallString<256> tmpPath;
+  if (sys::fs::createUniqueFile(path + ".tmp%%%%%%", FD, tmpPath)) return;
+  {
+    raw_fd_ostream os(FD, /*shouldClose=*/true);
+    os << contents;
+  }
+  if (sys::fs::rename(tmpPath, path)) sys::fs::remove(tmpPath);
+}
+
+// Storage of cache entries.
+class SummaryStore {
+ public:
+  virtual ~SummaryStore() {}
+
+  // Reads the entry for key. Returns false if there is no such entry.
+  virtual bool lookup(StringRef key, std::string& contents) = 0;
+
+  // Stores the entry for key, replacing any previous entry.
+  virtual void store(StringRef key, const std::string& contents) = 0;
+};
+
+// Cache entries stored as files in a directory.
+class DirectorySummaryStore : public SummaryStore {
+ public:
+  explicit DirectorySummaryStore(StringRef dir) : dir_(dir) {}
+
+  bool lookup(StringRef key, std::string& contents) override {
+    return readCacheEntry(getCacheEntryPath(dir_, key), contents);
+  }
+
+  void store(StringRef key, const std::string& contents) override {
+    writeCacheEntry(dir_, getCacheEntryPath(dir_, key), contents);
+  }
+
+ private:
+  std::string dir_;
+};
+
+// Cache entries kept in memory. The store may be shared by analyses running
+// concurrently.
+class MemorySummaryStore : public SummaryStore {
+ public:
+  bool lookup(StringRef key, std::string& contents) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key.str());
+    if (it == entries_.end()) return false;
+    contents = it->second;
+    return true;
+  }
+
+  void store(StringRef key, const std::string& contents) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_[key.str()] = contents;
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+  // Returns a copy of the entries, ordered by key.
+  std::map<std::string, std::string> getEntries() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::map<std::string, std::string> entries_;
+};
+
+// Maps instructions to their position within their function and back. Debug
+// intrinsics are skipped, as in the structural hash of the function, which
+// covers all other instructions. Positions stored in a cache entry thus
+// resolve to the same instructions on a cache hit, with or without debug
+// information.
+class InstructionNumbering {
+ public:
+  uint32_t getIndex(const Instruction* I) {
+    number(I->getFunction());
+    return IndexMap_.at(I);
+  }
+
+  // Returns the instruction at position idx in F, or nullptr if there is no
+  // such instruction.
+  const Instruction* getInstruction(const Function* F, uint32_t idx) {
+    const auto& insts = number(F);
+    return idx < insts.size() ? insts[idx] : nullptr;
+  }
+
+ private:
+  const std::vector<const Instruction*>& number(const Function* F) {
+    auto it = InstructionsMap_.find(F);
+    if (it != InstructionsMap_.end()) return it->second;
+    auto& insts = InstructionsMap_[F];
+    for (const_inst_iterator iit = inst_begin(F), iite = inst_end(F);
+                                                     iit != iite; ++iit) {
+      if (isa<DbgInfoIntrinsic>(&*iit)) continue;
+      IndexMap_[&*iit] = insts.size();
+      insts.push_back(&*iit);
+    }
+    return insts;
+  }
+
+  std::map<const Function*, std::vector<const Instruction*>> InstructionsMap_;
+  std::map<const Instruction*, uint32_t> IndexMap_;
+};
+
+#endif /* SummaryCache.h */
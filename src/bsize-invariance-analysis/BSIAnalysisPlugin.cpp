@@ -0,0 +1,68 @@
+//===- BSIAnalysisPlugin.cpp - New pass manager plugin for the block-size invariance analysis -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// Registers the block-size invariance analyses with the new pass manager:
+//   opt -load-pass-plugin=LLVMBlockSizeInvarianceAnalysis.so \
+//       -passes=interproc-bsize-invariance-analysis
+// The printer passes are available as "bsize-invariance-analysis" (function)
+// and "interproc-bsize-invariance-analysis" (module). The analyses themselves
+// can be requested with "require<bsize-invariance-analysis>" and
+// "require<interproc-bsize-invariance-analysis>".
+//===----------------------------------------------------------------------===//
+
+#include "BlockSizeInvarianceAnalysisPass.h"
+#include "InterprocBSIAnalysisPass.h"
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+using namespace llvm;
+
+static void registerBSIAnalysisPasses(PassBuilder &PB) {
+  PB.registerAnalysisRegistrationCallback(
+      [](FunctionAnalysisManager &FAM) {
+        FAM.registerPass([] { return BlockSizeDependenceAnalysis(); });
+      });
+  PB.registerAnalysisRegistrationCallback(
+      [](ModuleAnalysisManager &MAM) {
+        MAM.registerPass([] { return InterprocBlockSizeDependenceAnalysis(); });
+      });
+  PB.registerPipelineParsingCallback(
+      [](StringRef Name, FunctionPassManager &FPM,
+         ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name == "bsize-invariance-analysis") {
+          FPM.addPass(BlockSizeDependencePrinterPass(errs()));
+          return true;
+        }
+        if (Name == "require<bsize-invariance-analysis>") {
+          FPM.addPass(RequireAnalysisPass<BlockSizeDependenceAnalysis, Function>());
+          return true;
+        }
+        return false;
+      });
+  PB.registerPipelineParsingCallback(
+      [](StringRef Name, ModulePassManager &MPM,
+         ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name == "interproc-bsize-invariance-analysis") {
+          MPM.addPass(InterprocBlockSizeDependencePrinterPass(errs()));
+          return true;
+        }
+        if (Name == "require<interproc-bsize-invariance-analysis>") {
+          MPM.addPass(RequireAnalysisPass<InterprocBlockSizeDependenceAnalysis,
+                                          Module>());
+          return true;
+        }
+        return false;
+      });
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "BlockSizeInvarianceAnalysis", LLVM_VERSION_STRING,
+          registerBSIAnalysisPasses};
+}
@@ -5,10 +5,37 @@
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
 using namespace llvm;
 
+static cl::opt<bool> MemoryStatsEnabled("bsi-memory-stats",
+    cl::desc("Account the memory of the structures of the block-size "
+             "invariance analysis and print it with the results"));
+
+MemoryStats* getBSIMemoryStats() {
+  static MemoryStats Stats("block-size invariance");
+  return MemoryStatsEnabled ? &Stats : nullptr;
+}
+
+void BlockSizeInvarianceAnalysis::AccountAnalysisMemory() {
+  typedef std::vector<BSizeDependenceValue> Pattern;
+  int64_t shared = 0;
+  for (const auto& pair : SharedMemoryAccessPatternMap_) {
+    shared += getMapNodeBytes<const Value*, Pattern>() +
+              pair.second.capacity() * sizeof(BSizeDependenceValue);
+  }
+  memory_.set(MemorySharedAccessPatterns, shared);
+  int64_t current = 0;
+  for (const auto& pair : CurrentAccessPatternMap_) {
+    current += getMapNodeBytes<const Value*,
+                               std::pair<const Value*, Pattern>>() +
+               pair.second.second.capacity() * sizeof(BSizeDependenceValue);
+  }
+  memory_.set(MemoryAccessPatterns, current);
+}
+
 // Builds state with (const) for all arguments.
 BSizeGPUState BlockSizeInvarianceAnalysis::BuildInitialState() const {
   BSizeGPUState st;
@@ -113,6 +140,7 @@ BlockSizeInvarianceAnalysis::getCalledFunctionValue(const StringRef& name,
   } else if (name == "llvm.nvvm.barrier0") {
     // syncthreads barrier found!
     SyncThreads_.insert(I);
+    DependenceReasons_[I] |= DranoBSISyncThreads;
     LLVM_DEBUG(errs() << "SYNCTHREADS FOUND at ");
     LLVM_DEBUG(cast<Instruction>(I)->getDebugLoc().print(errs()));
     LLVM_DEBUG(errs() << " in \n      " << *I << "\n\n");
@@ -324,6 +352,7 @@ BSizeGPUState BlockSizeInvarianceAnalysis::ExecuteInstruction(
         if (!FunctionBSIMap_->at(calledF) &&
             !isBSILibraryCall(calledF->getName())) {
           BlockSizeDependentAccesses_.insert(CI);
+          DependenceReasons_[CI] |= DranoBSICallee;
           LLVM_DEBUG(errs() << "BLOCK-SIZE DEPENDENT FUNCTION-CALL FOUND in access at ");
           LLVM_DEBUG(cast<Instruction>(CI)->getDebugLoc().print(errs()));
           LLVM_DEBUG(errs() << " in \n      " << *CI << "\n\n");
@@ -333,6 +362,7 @@ BSizeGPUState BlockSizeInvarianceAnalysis::ExecuteInstruction(
       else if (!calledF || !calledF->hasName() ||
                !isBSILibraryCall(calledF->getName())) {
         BlockSizeDependentAccesses_.insert(CI);
+        DependenceReasons_[CI] |= DranoBSIUnknownCallee;
         LLVM_DEBUG(errs() << "BLOCK-SIZE DEPENDENT FUNCTION-CALL FOUND in access at ");
         LLVM_DEBUG(cast<Instruction>(CI)->getDebugLoc().print(errs()));
         LLVM_DEBUG(errs() << " in \n      " << *CI << "\n\n");
@@ -467,6 +497,13 @@ BSizeGPUState BlockSizeInvarianceAnalysis::ExecuteInstruction(
             || (st.getNumThreads().getType() != B_CONST
                 && st.getNumThreads().getType() != CONST))) {
       BlockSizeDependentAccesses_.insert(SI);
+      unsigned& reasons = DependenceReasons_[SI];
+      if (v.getType() != CONST) reasons |= DranoBSIAddress;
+      if (vVal.getType() != CONST) reasons |= DranoBSIValue;
+      if (st.getNumThreads().getType() != B_CONST &&
+          st.getNumThreads().getType() != CONST) {
+        reasons |= DranoBSIPath;
+      }
       LLVM_DEBUG(errs() << "BLOCK-SIZE DEPENDENT ACCESS FOUND in access at ");
       LLVM_DEBUG(cast<Instruction>(SI)->getDebugLoc().print(errs()));
       LLVM_DEBUG(errs() << " in \n      " << *SI << "\n\n");
@@ -567,6 +604,10 @@ BSizeGPUState BlockSizeInvarianceAnalysis::ExecuteInstruction(
 
 void BlockSizeInvarianceAnalysis::BuildAnalysisInfo(BSizeGPUState st) {
   BlockSizeDependentAccesses_.clear();
+  DependenceReasons_.clear();
+  for (const Instruction* I : SyncThreads_) {
+    DependenceReasons_[I] = DranoBSISyncThreads;
+  }
   LLVM_DEBUG(errs() << "Analysis for thread dimension " << ThreadDim_ << "\n");
   initialState_ = st;
   entryBlock_ = &F_->getEntryBlock();
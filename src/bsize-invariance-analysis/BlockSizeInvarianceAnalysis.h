@@ -4,6 +4,7 @@
 #include "AbstractExecutionEngine.h"
 #include "BSizeDependenceValue.h"
 #include "BSizeGPUState.h"
+#include "DranoAnnotations.h"
 
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/Instruction.h"
@@ -15,6 +16,10 @@
 
 using namespace llvm;
 
+// Returns the memory statistics of the block-size invariance analysis, or
+// null unless -bsi-memory-stats is given.
+MemoryStats* getBSIMemoryStats();
+
 // Class to compute dependences of variables on thread ID and hence,
 // the uncoalesced accesses.
 class BlockSizeInvarianceAnalysis
@@ -24,7 +29,9 @@ class BlockSizeInvarianceAnalysis
        const Function* F, const DominatorTree* DomTree, int ThreadDim)
     : F_(F), DT_(DomTree), ThreadDim_(ThreadDim),
       FunctionReturnValueMap_(nullptr),
-      FunctionBSIMap_(nullptr) {}
+      FunctionBSIMap_(nullptr) {
+    setMemoryStats(getBSIMemoryStats());
+  }
 
   BlockSizeInvarianceAnalysis(
        const Function* F, const DominatorTree* DomTree, int ThreadDim,
@@ -32,7 +39,9 @@ class BlockSizeInvarianceAnalysis
        const std::map<const Function *, bool>* FunctionBSIMap)
     : F_(F), DT_(DomTree), ThreadDim_(ThreadDim),
       FunctionReturnValueMap_(FunctionReturnValueMap),
-      FunctionBSIMap_(FunctionBSIMap) {}
+      FunctionBSIMap_(FunctionBSIMap) {
+    setMemoryStats(getBSIMemoryStats());
+  }
 
 
   // Getters 
@@ -43,6 +52,11 @@ class BlockSizeInvarianceAnalysis
   const std::set<const Instruction*>& getSyncThreads() const {
     return SyncThreads_;
   } 
+  // Map from block-size dependent accesses and syncthreads to the reasons
+  // (mask of DranoBSIReason) why they are block-size dependent.
+  const std::map<const Instruction*, unsigned>& getDependenceReasons() const {
+    return DependenceReasons_;
+  }
 
   // Builds initial GPU state for the function. Assumes all arguments are
   // block-size independent.
@@ -54,6 +68,10 @@ class BlockSizeInvarianceAnalysis
   // Implements execution of different instructions on the abstract state.
   BSizeGPUState ExecuteInstruction(const Instruction* I, BSizeGPUState st);
 
+ protected:
+  // Measures the access pattern maps.
+  void AccountAnalysisMemory() override;
+
  private:
   // Prints access pattern for an access.
   std::string printAccessPattern(const Value* root,
@@ -97,6 +115,9 @@ class BlockSizeInvarianceAnalysis
   // Set of syncthread statements. 
   std::set<const Instruction*> SyncThreads_;
 
+  // Reasons why accesses and syncthreads are block-size dependent.
+  std::map<const Instruction*, unsigned> DependenceReasons_;
+
   // Map to track access patterns for shared memory variables.
   // Maps each root shared memory variable to a unique access pattern.
   // If the access pattern is not unique and consists of values other than
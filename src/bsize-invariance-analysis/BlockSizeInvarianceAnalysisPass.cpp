@@ -1,60 +1,73 @@
 #define DEBUG_TYPE "bsize-invariance-analysis"
 
 #include "BlockSizeInvarianceAnalysisPass.h"
-
-#include <cxxabi.h>
+#include "SourceOrder.h"
 
 using namespace llvm;
 
-inline std::string demangle(const char* name) 
-{
-  int status = -1; 
-
-  std::unique_ptr<char, void(*)(void*)> res {
-      abi::__cxa_demangle(name, NULL, NULL, &status), std::free };
-  return (status == 0) ? res.get() : std::string(name);
-}
-
-
-bool BlockSizeInvarianceAnalysisPass::runOnFunction(Function &F) {
-  // BSizeDependenceValue::testBSizeDependenceValue();
-  // BSizeGPUState::testBSizeGPUState();
-
-  LLVM_DEBUG(errs() << "-------------- Computing Block-size Invariance ------------------\n");
-  errs() << "Function: " << demangle(F.getName().data()) << "\n";
-
-  std::set<const Instruction*> dependentAccesses;
-  std::set<const Instruction*> syncthreads;
-  auto &DomTree = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+// Computes block-size dependent accesses and syncthreads for each thread
+// dimension.
+static BlockSizeDependenceResult computeBlockSizeDependence(
+    const Function& F, const DominatorTree& DomTree) {
+  BlockSizeDependenceResult result;
+  result.F = &F;
   for (int i = 0; i < 3; i++) {
     BlockSizeInvarianceAnalysis BDA(&F, &DomTree, i);
     BSizeGPUState st = BDA.BuildInitialState();
     BDA.BuildAnalysisInfo(st);
     auto depSet = BDA.getBlockSizeDependentAccesses();
     auto syncSet = BDA.getSyncThreads();
-    dependentAccesses.insert(depSet.begin(), depSet.end());
-    syncthreads.insert(syncSet.begin(), syncSet.end());
+    result.DependentAccesses.insert(depSet.begin(), depSet.end());
+    result.SyncThreads.insert(syncSet.begin(), syncSet.end());
   }
+  return result;
+}
 
+void BlockSizeDependenceResult::print(raw_ostream& os) const {
+  os << "Function: " << demangle(F->getName().data()) << "\n";
   // If block-size dependent accesses is empty, print block-size invariance.
-  if (dependentAccesses.empty() && syncthreads.empty()) {
-    errs() << "Function " << demangle(F.getName().data()) << " is block-size independent!\n";
-    return false;
+  if (DependentAccesses.empty() && SyncThreads.empty()) {
+    os << "Function " << demangle(F->getName().data()) << " is block-size independent!\n";
+    return;
   }
   // Print block-size dependent accesses found by the analysis.
-  errs() << "  Block-size dependent accesses: #" 
-      << dependentAccesses.size() << "\n";
-  for (auto it = dependentAccesses.begin(), ite = dependentAccesses.end();
-           it != ite; ++it) {
-    errs() << "  -- ";
-    (*it)->getDebugLoc().print(errs());
-    errs() << "\n";
+  os << "  Block-size dependent accesses: #" 
+      << DependentAccesses.size() << "\n";
+  for (const Instruction* I :
+           getInSourceOrder<const Instruction*>(DependentAccesses)) {
+    os << "  -- ";
+    I->getDebugLoc().print(os);
+    os << "\n";
   }
-  errs() << "\n";
+  os << "\n";
+}
+
+bool BlockSizeInvarianceAnalysisPass::runOnFunction(Function &F) {
+  // BSizeDependenceValue::testBSizeDependenceValue();
+  // BSizeGPUState::testBSizeGPUState();
 
+  LLVM_DEBUG(errs() << "-------------- Computing Block-size Invariance ------------------\n");
+  auto &DomTree = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+  BlockSizeDependenceResult result = computeBlockSizeDependence(F, DomTree);
+  result.print(errs());
+  BlockSizeDependentAccesses_ = result.DependentAccesses;
   return false;
 }
 
 char BlockSizeInvarianceAnalysisPass::ID = 0;
 static RegisterPass<BlockSizeInvarianceAnalysisPass>
 Y("bsize-invariance-analysis", "Pass to check block-size invariance of GPU kernels.");
+
+AnalysisKey BlockSizeDependenceAnalysis::Key;
+
+BlockSizeDependenceResult BlockSizeDependenceAnalysis::run(
+    Function &F, FunctionAnalysisManager &FAM) {
+  return computeBlockSizeDependence(F, FAM.getResult<DominatorTreeAnalysis>(F));
+}
+
+PreservedAnalyses BlockSizeDependencePrinterPass::run(
+    Function &F, FunctionAnalysisManager &FAM) {
+  if (F.isDeclaration()) return PreservedAnalyses::all();
+  FAM.getResult<BlockSizeDependenceAnalysis>(F).print(OS);
+  return PreservedAnalyses::all();
+}
@@ -55,6 +55,44 @@ struct BlockSizeInvarianceAnalysisPass : public FunctionPass {
   }
 };
 
+// Results of the intra-procedural analysis of a function.
+struct BlockSizeDependenceResult {
+  // Analyzed function.
+  const Function* F;
+
+  // Block-size dependent accesses and syncthreads within the function.
+  std::set<const Instruction*> DependentAccesses;
+  std::set<const Instruction*> SyncThreads;
+
+  // Prints block-size dependent accesses.
+  void print(raw_ostream& os) const;
+};
+
+// Intra-procedural analysis for the new pass manager. The dominator tree is
+// taken from the function analysis manager, and the result is cached until
+// a pass invalidates it.
+class BlockSizeDependenceAnalysis
+  : public AnalysisInfoMixin<BlockSizeDependenceAnalysis> {
+  friend AnalysisInfoMixin<BlockSizeDependenceAnalysis>;
+  static AnalysisKey Key;
+
+ public:
+  typedef BlockSizeDependenceResult Result;
+
+  Result run(Function &F, FunctionAnalysisManager &FAM);
+};
+
+// Prints the results of BlockSizeDependenceAnalysis.
+class BlockSizeDependencePrinterPass
+  : public PassInfoMixin<BlockSizeDependencePrinterPass> {
+  raw_ostream &OS;
+
+ public:
+  explicit BlockSizeDependencePrinterPass(raw_ostream &OS) : OS(OS) {}
+
+  PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM);
+};
+
 }
 
 #endif /* BlockSizeInvarianceAnalysisPass.h */
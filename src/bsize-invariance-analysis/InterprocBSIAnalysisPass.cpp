@@ -1,42 +1,121 @@
 #define DEBUG_TYPE "bsize-invariance-analysis"
 
 #include "InterprocBSIAnalysisPass.h"
+#include "SourceOrder.h"
 
-#include <cxxabi.h>
+#include "llvm/Support/CommandLine.h"
 
-// Print only entrypoints into the callgraph.
-#define ENTRYPOINTS_ONLY
+#include <chrono>
 
 using namespace llvm;
 
-inline std::string demangle(const char* name) 
-{
-  int status = -1; 
+static cl::opt<std::string> CacheDir("bsi-cache-dir",
+    cl::desc("Directory to cache function summaries of the block-size "
+             "invariance analysis across runs"),
+    cl::value_desc("directory"), cl::init(""));
 
-  std::unique_ptr<char, void(*)(void*)> res {
-      abi::__cxa_demangle(name, NULL, NULL, &status), std::free };
-  return (status == 0) ? res.get() : std::string(name);
+static cl::opt<bool> Annotate("bsi-annotate",
+    cl::desc("Attach the results of the block-size invariance analysis to "
+             "the module as metadata"));
+
+static cl::list<std::string> EntryPoints("bsi-entry-points",
+    cl::desc("Functions to analyze and report in addition to the kernels of "
+             "the module"),
+    cl::value_desc("function"), cl::CommaSeparated);
+
+std::vector<std::string> llvm::getBSIEntryPointNames() {
+  return std::vector<std::string>(EntryPoints.begin(), EntryPoints.end());
 }
 
-inline bool isEntryPoint(const CallGraph& CG, const CallGraphNode* node) {
-  if (node->getNumReferences() > 1) return false;
-  if (node->getNumReferences() == 0) return true;
-  const auto* root = CG.getExternalCallingNode();
-  // If the calling function for node is root, return true.
-  for (unsigned i = 0; i < root->size(); i++) {
-    if ((*root)[i] == node) return true;
+// Cache entry layout:
+//   u8 is block-size independent
+//   u8 has return value, u8 return value type, u8 return value is negative
+//   u32 #dependent accesses, u32 position of each access
+//   u32 #syncthreads, u32 position of each syncthreads
+//   u32 #dependences
+//   for each dependence: u32 position, u8 reasons, u8 thread dimensions
+static bool loadCachedResult(SummaryStore* Store, const std::string& key,
+    const Function* F, InstructionNumbering& Numbering,
+    BSIFunctionResult& result) {
+  std::string contents;
+  if (!Store->lookup(key, contents)) return false;
+  CacheReader R(contents);
+  result.IsBSI = R.readU8();
+  result.HasReturnValue = R.readU8();
+  auto type = BSizeDependenceValueType(R.readU8());
+  bool isNegative = R.readU8();
+  result.ReturnValue = BSizeDependenceValue(type, isNegative);
+  for (auto* set : {&result.DependentAccesses, &result.SyncThreads}) {
+    uint32_t size = R.readU32();
+    for (uint32_t i = 0; i < size && !R.hasError(); i++) {
+      const Instruction* I = Numbering.getInstruction(F, R.readU32());
+      if (!I) return false;
+      set->insert(I);
+    }
+  }
+  uint32_t numDependences = R.readU32();
+  for (uint32_t i = 0; i < numDependences && !R.hasError(); i++) {
+    const Instruction* I = Numbering.getInstruction(F, R.readU32());
+    if (!I) return false;
+    DranoBSIDependence& dependence = result.Dependences[I];
+    dependence.Reasons = R.readU8();
+    dependence.Dimensions = R.readU8();
   }
-  return false;
+  return !R.hasError();
 }
 
-bool InterproceduralBlockSizeInvarianceAnalysisPass::runOnModule(Module &M) {
-  auto &CG = getAnalysis<CallGraphWrapperPass>().getCallGraph();
+static void saveCachedResult(SummaryStore* Store, const std::string& key,
+    InstructionNumbering& Numbering, const BSIFunctionResult& result) {
+  CacheWriter W;
+  W.writeU8(result.IsBSI);
+  W.writeU8(result.HasReturnValue);
+  W.writeU8(result.ReturnValue.getType());
+  W.writeU8(result.ReturnValue.isNegative());
+  for (const auto* set : {&result.DependentAccesses, &result.SyncThreads}) {
+    W.writeU32(set->size());
+    for (const Instruction* I : *set) W.writeU32(Numbering.getIndex(I));
+  }
+  W.writeU32(result.Dependences.size());
+  for (const auto& pair : result.Dependences) {
+    W.writeU32(Numbering.getIndex(pair.first));
+    W.writeU8(pair.second.Reasons);
+    W.writeU8(pair.second.Dimensions);
+  }
+  Store->store(key, W.getBuffer());
+}
+
+// Estimated bytes of the result of a function, with its entries in the
+// return value and block-size independence maps.
+static int64_t getBSIResultBytes(const BSIFunctionResult& result) {
+  typedef const Instruction* InstPtr;
+  return getMapNodeBytes<const Function*, BSIFunctionResult>() +
+         getMapNodeBytes<const Function*, BSizeDependenceValue>() +
+         getMapNodeBytes<const Function*, bool>() +
+         (result.DependentAccesses.size() + result.SyncThreads.size()) *
+             getSetNodeBytes<InstPtr>() +
+         result.Dependences.size() *
+             getMapNodeBytes<InstPtr, DranoBSIDependence>();
+}
+
+InterprocBSIResult llvm::runInterprocBSIAnalysis(Module& M, CallGraph& CG,
+    DomTreeGetter GetDomTree, SummaryStore* Store,
+    BSIFunctionCallback OnFunction, const BSILinkContext* Link) {
+  InterprocBSIResult results;
+
+  // Entry points into the call-graph (kernels and functions named with
+  // -bsi-entry-points). Results are reported only for entry points, and
+  // only functions reachable from them are analyzed.
+  results.EntryPoints = getEntryPoints(M, getBSIEntryPointNames());
+  std::set<const Function *> roots = results.EntryPoints;
+  if (Link) {
+    roots.insert(Link->ExportedFunctions.begin(),
+                 Link->ExportedFunctions.end());
+  }
+  std::set<const Function *> reachable = getReachableFunctions(roots);
 
   // Generate topological order of visiting function nodes.
   // Sequence of functions.
   std::vector<Function *> functionList;
-  // Set of global entrypoints into the call-graph.
-  std::set<Function *> entrypoints;
 
   // Iterating over the SCCs.
   for (scc_iterator<CallGraph *> I = scc_begin(&CG), IE = scc_end(&CG);
@@ -46,13 +125,12 @@ bool InterproceduralBlockSizeInvarianceAnalysisPass::runOnModule(Module &M) {
     for (std::vector<CallGraphNode *>::const_iterator CGNI = SCCCGNs.begin(),
 					            CGNIE = SCCCGNs.end(); CGNI != CGNIE; ++CGNI) {
       Function *F = (*CGNI)->getFunction();
-      // Insert function only if it is present and is not a declaration.
-      if (!F || F->isDeclaration()) { continue; }
+      // Insert function only if it is present, is not a declaration and is
+      // reachable from an entry point.
+      if (!F || F->isDeclaration() || !reachable.count(F)) { continue; }
       functionList.insert(functionList.end(), F);
       LLVM_DEBUG(errs() << "Inserting function: " << F->getName()
             << " with " << (*CGNI)->getNumReferences() << " refs\n");
-      // Add as entrypoint if it has at most single reference.
-      if (isEntryPoint(CG, (*CGNI))) { entrypoints.insert(F); }
     }
   }
 
@@ -63,63 +141,187 @@ bool InterproceduralBlockSizeInvarianceAnalysisPass::runOnModule(Module &M) {
 
   // Is function block-size independent?
   std::map<const Function *, bool> FunctionBSIMap;
+
+  // Functions defined in other modules are treated like analyzed callees.
+  if (Link) {
+    for (const Function& F : M) {
+      if (!F.isDeclaration()) { continue; }
+      auto it = Link->ExternalResults.find(F.getName().str());
+      if (it == Link->ExternalResults.end()) { continue; }
+      FunctionBSIMap[&F] = it->second.IsBSI;
+      if (it->second.HasReturnValue) {
+        FunctionReturnValueMap.emplace(&F, it->second.ReturnValue);
+      }
+    }
+  }
+
+  // Structural hashes of functions and positions of instructions, used to
+  // look up and store results in the cache.
+  StructuralHasher Hasher("bsize-invariance-analysis", BSI_ANALYSIS_VERSION);
+  InstructionNumbering Numbering;
+  std::unique_ptr<SummaryStore> DirectoryStore;
+  if (!Store && !CacheDir.empty()) {
+    DirectoryStore.reset(new DirectorySummaryStore(CacheDir));
+    Store = DirectoryStore.get();
+  }
  
+  // Bytes of the results (see MemoryAccounting.h).
+  int64_t summaryBytes = 0;
+
   // Run analysis on functions.
   for (Function *F : functionList) {
     LLVM_DEBUG(errs() << "-------------- Computing Block-size Invariance ------------------\n");
-#ifdef ENTRYPOINTS_ONLY
-    if (entrypoints.find(F) != entrypoints.end()) {
-#endif
-      errs() << "Function: " << demangle(F->getName().data()) << "\n";
-#ifdef ENTRYPOINTS_ONLY
-    }
-#endif
-  
-    std::set<const Instruction*> dependentAccesses;
-    std::set<const Instruction*> syncthreads;
-    DominatorTree DT(*F);
-    for (int i = 0; i < 3; i++) {
-      BlockSizeInvarianceAnalysis BDA(F, &DT, i,
-          &FunctionReturnValueMap, &FunctionBSIMap);
-      BSizeGPUState st = BDA.BuildInitialState();
-      BDA.BuildAnalysisInfo(st);
-      auto depSet = BDA.getBlockSizeDependentAccesses();
-      auto syncSet = BDA.getSyncThreads();
-      dependentAccesses.insert(depSet.begin(), depSet.end());
-      syncthreads.insert(syncSet.begin(), syncSet.end());
-    }
+    LLVM_DEBUG(errs() << "Function: " << demangle(F->getName().data()) << "\n");
   
-    // If block-size dependent accesses is empty, print block-size invariance.
-    if (dependentAccesses.empty() && syncthreads.empty()) {
-      FunctionBSIMap[F] = true;
-      // Adding method to the set of block-size independent methods!!!!
-      BlockSizeIndependentMethods_.insert(F);
+    auto start = std::chrono::steady_clock::now();
 
-#ifdef ENTRYPOINTS_ONLY
-      if (entrypoints.find(F) == entrypoints.end()) { continue; }
-#endif
-      errs() << "Function " << demangle(F->getName().data()) << " is block-size independent!\n";
+    // Reuse cached results if the function and its callees are unchanged.
+    // Results of functions calling functions outside M are not cached.
+    std::string cacheKey;
+    BSIFunctionResult result;
+    bool cacheable = Store && Hasher.isSelfContained(F);
+    if (cacheable) {
+      cacheKey = getCacheKey(Hasher.getHash(F), "bsi");
+    }
+    if (cacheable && loadCachedResult(Store, cacheKey, F, Numbering, result)) {
+      LLVM_DEBUG(errs() << "Loaded cached results for " << F->getName() << "\n");
+      if (result.HasReturnValue) {
+        FunctionReturnValueMap.emplace(F, result.ReturnValue);
+      }
     } else {
-      FunctionBSIMap[F] = false;
-
-#ifdef ENTRYPOINTS_ONLY
-      if (entrypoints.find(F) == entrypoints.end()) { continue; }
-#endif
-      // Print block-size dependent accesses found by the analysis.
-      errs() << "  Block-size dependent accesses: #" 
-          << dependentAccesses.size() << "\n";
-      for (auto it = dependentAccesses.begin(), ite = dependentAccesses.end();
-               it != ite; ++it) {
-        errs() << "  -- ";
-        (*it)->getDebugLoc().print(errs());
-        errs() << "\n";
+      result = BSIFunctionResult();
+      std::unique_ptr<DominatorTree> ownDT;
+      const DominatorTree* DT = nullptr;
+      if (GetDomTree) {
+        DT = GetDomTree(F);
+      } else {
+        ownDT.reset(new DominatorTree(*F));
+        DT = ownDT.get();
       }
-      errs() << "\n";
+      for (int i = 0; i < 3; i++) {
+        BlockSizeInvarianceAnalysis BDA(F, DT, i,
+            &FunctionReturnValueMap, &FunctionBSIMap);
+        BSizeGPUState st = BDA.BuildInitialState();
+        BDA.BuildAnalysisInfo(st);
+        auto depSet = BDA.getBlockSizeDependentAccesses();
+        auto syncSet = BDA.getSyncThreads();
+        result.DependentAccesses.insert(depSet.begin(), depSet.end());
+        result.SyncThreads.insert(syncSet.begin(), syncSet.end());
+        for (const auto& pair : BDA.getDependenceReasons()) {
+          DranoBSIDependence& dependence = result.Dependences[pair.first];
+          dependence.Reasons |= pair.second;
+          dependence.Dimensions |= 1 << i;
+        }
+      }
+      result.IsBSI = result.DependentAccesses.empty() &&
+                     result.SyncThreads.empty();
+      result.HasReturnValue = FunctionReturnValueMap.find(F) !=
+                              FunctionReturnValueMap.end();
+      if (result.HasReturnValue) {
+        result.ReturnValue = FunctionReturnValueMap.at(F);
+      }
+      if (cacheable) saveCachedResult(Store, cacheKey, Numbering, result);
     }
+    FunctionBSIMap[F] = result.IsBSI;
+    results.Functions.push_back(F);
+    results.FunctionResults.emplace(F, result);
+    if (MemoryStats* stats = getBSIMemoryStats()) {
+      int64_t bytes = getBSIResultBytes(result);
+      stats->add(MemorySummaries, bytes);
+      stats->recordFunction(F, MemorySummaries, bytes);
+      summaryBytes += bytes;
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    results.AnalysisTimeMap.emplace(F, elapsed.count());
+    if (OnFunction && !OnFunction(results, F)) { break; }
+  }
+  // The results are handed over to the caller.
+  if (MemoryStats* stats = getBSIMemoryStats()) {
+    stats->add(MemorySummaries, -summaryBytes);
+  }
+  return results;
+}
+
+void InterprocBSIResult::printFunction(const Function* F,
+                                       raw_ostream& os) const {
+  os << "Function: " << demangle(F->getName().data()) << "\n";
+  const BSIFunctionResult& result = FunctionResults.at(F);
+  // If block-size dependent accesses is empty, print block-size invariance.
+  if (result.IsBSI) {
+    os << "Function " << demangle(F->getName().data()) << " is block-size independent!\n";
+    return;
+  }
+  // Print block-size dependent accesses found by the analysis.
+  const std::set<const Instruction*>& dependentAccesses =
+      result.DependentAccesses;
+  os << "  Block-size dependent accesses: #" 
+      << dependentAccesses.size() << "\n";
+  for (const Instruction* I :
+           getInSourceOrder<const Instruction*>(dependentAccesses)) {
+    os << "  -- ";
+    I->getDebugLoc().print(os);
+    os << "\n";
+  }
+  os << "\n";
+}
+
+void InterprocBSIResult::print(raw_ostream& os) const {
+  for (const Function* F : Functions) {
+    // Print results only for entrypoints.
+    if (EntryPoints.find(F) == EntryPoints.end()) { continue; }
+    printFunction(F, os);
   }
-  return false;
+}
+
+void InterprocBSIResult::annotate() const {
+  for (const Function* F : Functions) {
+    const BSIFunctionResult& result = FunctionResults.at(F);
+    setDranoBlockSizeIndependent(F, result.IsBSI);
+    for (const auto& pair : result.Dependences) {
+      setDranoBSIDependence(pair.first, pair.second);
+    }
+  }
+}
+
+bool InterproceduralBlockSizeInvarianceAnalysisPass::runOnModule(Module &M) {
+  auto &CG = getAnalysis<CallGraphWrapperPass>().getCallGraph();
+  InterprocBSIResult results = runInterprocBSIAnalysis(M, CG);
+  results.print(errs());
+  if (MemoryStats* stats = getBSIMemoryStats()) stats->print(errs());
+  for (const Function* F : results.Functions) {
+    if (results.FunctionResults.at(F).IsBSI) {
+      // Adding method to the set of block-size independent methods!!!!
+      BlockSizeIndependentMethods_.insert(const_cast<Function*>(F));
+    }
+  }
+  if (Annotate) { results.annotate(); }
+  return Annotate;
 }
 
 char InterproceduralBlockSizeInvarianceAnalysisPass::ID = 0;
 static RegisterPass<InterproceduralBlockSizeInvarianceAnalysisPass>
 Y("interproc-bsize-invariance-analysis", "Interprocedural analysis to identify block-size independent GPU kernels.");
+
+AnalysisKey InterprocBlockSizeDependenceAnalysis::Key;
+
+InterprocBSIResult InterprocBlockSizeDependenceAnalysis::run(
+    Module &M, ModuleAnalysisManager &MAM) {
+  auto &CG = MAM.getResult<CallGraphAnalysis>(M);
+  auto &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  return runInterprocBSIAnalysis(M, CG,
+      [&FAM](const Function* F) -> const DominatorTree* {
+        return &FAM.getResult<DominatorTreeAnalysis>(const_cast<Function&>(*F));
+      });
+}
+
+PreservedAnalyses InterprocBlockSizeDependencePrinterPass::run(
+    Module &M, ModuleAnalysisManager &MAM) {
+  const InterprocBSIResult& results =
+      MAM.getResult<InterprocBlockSizeDependenceAnalysis>(M);
+  results.print(OS);
+  if (MemoryStats* stats = getBSIMemoryStats()) stats->print(OS);
+  // Metadata does not change the results of any analysis.
+  if (Annotate) { results.annotate(); }
+  return PreservedAnalyses::all();
+}
@@ -14,6 +14,10 @@
 
 #include "BSizeDependenceValue.h"
 #include "BlockSizeInvarianceAnalysis.h"
+#include "DranoAnnotations.h"
+#include "EntryPoints.h"
+#include "StructuralHash.h"
+#include "SummaryCache.h"
 
 #include "llvm/ADT/SCCIterator.h"
 #include "llvm/ADT/Statistic.h"
@@ -23,15 +27,98 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
 #include "llvm/IR/Type.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <functional>
 #include <list>
 
+// Version of the block-size invariance analysis; must be bumped whenever a
+// change to the analysis may change its results, to invalidate cached
+// summaries.
+#define BSI_ANALYSIS_VERSION 4
+
 namespace llvm {
 
+// Results of the analysis of a single function.
+struct BSIFunctionResult {
+  BSIFunctionResult() : IsBSI(false), HasReturnValue(false) {}
+
+  // Is the function block-size independent?
+  bool IsBSI;
+
+  // Value returned by the function (if it returns).
+  bool HasReturnValue;
+  BSizeDependenceValue ReturnValue;
+
+  // Block-size dependent accesses and syncthreads within the function.
+  std::set<const Instruction*> DependentAccesses;
+  std::set<const Instruction*> SyncThreads;
+
+  // Why the dependent accesses and syncthreads are block-size dependent, and
+  // in which thread dimensions.
+  std::map<const Instruction*, DranoBSIDependence> Dependences;
+};
+
+// Results of the interprocedural analysis of a module.
+struct InterprocBSIResult {
+  // Analyzed functions (callees before callers).
+  std::vector<const Function*> Functions;
+
+  // Entry points into the call-graph.
+  std::set<const Function*> EntryPoints;
+
+  // Map from analyzed functions to their results.
+  std::map<const Function*, BSIFunctionResult> FunctionResults;
+
+  // Map from analyzed functions to the time spent analyzing them, excluding
+  // their callees (in seconds).
+  std::map<const Function*, double> AnalysisTimeMap;
+
+  // Prints results for the analyzed function F.
+  void printFunction(const Function* F, raw_ostream& os) const;
+
+  // Prints results for entry points.
+  void print(raw_ostream& os) const;
+
+  // Attaches the results to the analyzed functions and the block-size
+  // dependent instructions as metadata (see DranoAnnotations.h).
+  void annotate() const;
+};
+
+// Module analyzed as part of a program made of several modules (e.g. the
+// translation units of a program compiled with separate compilation).
+struct BSILinkContext {
+  // Results of functions defined in other modules, by name.
+  std::map<std::string, BSIFunctionResult> ExternalResults;
+
+  // Functions of the module called from other modules. They are analyzed
+  // (but not reported) even if no entry point reaches them.
+  std::set<const Function*> ExportedFunctions;
+};
+
+// Called after each function is analyzed, with the results so far.
+// Returning false stops the analysis.
+typedef std::function<bool(const InterprocBSIResult&, const Function*)>
+    BSIFunctionCallback;
+
+// Runs the interprocedural analysis on M. Dominator trees are obtained from
+// GetDomTree if provided, and are built by the analysis otherwise. Results
+// are cached in Store if provided, and in the directory given with
+// -bsi-cache-dir otherwise. If Link is provided, calls to functions declared
+// in M take their results from Link->ExternalResults. Results of functions
+// calling functions outside M are not cached.
+InterprocBSIResult runInterprocBSIAnalysis(Module& M, CallGraph& CG,
+    DomTreeGetter GetDomTree = nullptr, SummaryStore* Store = nullptr,
+    BSIFunctionCallback OnFunction = nullptr,
+    const BSILinkContext* Link = nullptr);
+
+// Returns the functions named with -bsi-entry-points.
+std::vector<std::string> getBSIEntryPointNames();
+
 struct InterproceduralBlockSizeInvarianceAnalysisPass : public ModulePass {
   std::set<Function *> BlockSizeIndependentMethods_;
 
@@ -47,13 +134,40 @@ struct InterproceduralBlockSizeInvarianceAnalysisPass : public ModulePass {
             BlockSizeIndependentMethods_.end());
   }
 
-  // We don't modify the program, so we preserve all analyses.
+  // We only add metadata to the program, so we preserve all analyses.
   void getAnalysisUsage(AnalysisUsage &AU) const override {
     AU.addRequired<CallGraphWrapperPass>();
     AU.setPreservesAll();
   }
 };
 
+// Interprocedural analysis for the new pass manager. Dominator trees are
+// taken from the function analysis manager, and the result is cached until
+// a pass invalidates it.
+class InterprocBlockSizeDependenceAnalysis
+  : public AnalysisInfoMixin<InterprocBlockSizeDependenceAnalysis> {
+  friend AnalysisInfoMixin<InterprocBlockSizeDependenceAnalysis>;
+  static AnalysisKey Key;
+
+ public:
+  typedef InterprocBSIResult Result;
+
+  Result run(Module &M, ModuleAnalysisManager &MAM);
+};
+
+// Prints the results of InterprocBlockSizeDependenceAnalysis, and attaches
+// them to the module with -bsi-annotate.
+class InterprocBlockSizeDependencePrinterPass
+  : public PassInfoMixin<InterprocBlockSizeDependencePrinterPass> {
+  raw_ostream &OS;
+
+ public:
+  explicit InterprocBlockSizeDependencePrinterPass(raw_ostream &OS)
+    : OS(OS) {}
+
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+};
+
 }
 
 #endif /* InterproceduralBlockSizeInvarianceAnalysisPass.h */
@@ -0,0 +1,286 @@
+#include "SyntheticKernel.h"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<unsigned> Blocks("synth-blocks",
+    cl::desc("Number of segments of the kernel body and of each callee"),
+    cl::init(8));
+
+static cl::opt<unsigned> LoopDepth("synth-loop-depth",
+    cl::desc("Number of loops nesting the kernel body"), cl::init(1));
+
+static cl::opt<unsigned> BranchPercent("synth-branch-percent",
+    cl::desc("Percentage of segments branching on a threadIdx.x-dependent "
+             "condition"),
+    cl::init(25));
+
+static cl::opt<unsigned> LiveValues("synth-live-values",
+    cl::desc("Number of variables live across the body"), cl::init(4));
+
+static cl::opt<unsigned> CallDepth("synth-call-depth",
+    cl::desc("Length of the chain of device functions called from the "
+             "body"),
+    cl::init(0));
+
+static cl::opt<SyntheticAccessPattern> Pattern("synth-access-pattern",
+    cl::desc("Index of the memory accesses"),
+    cl::values(clEnumValN(SyntheticAccessCoalesced, "coalesced",
+                          "threadIdx.x"),
+               clEnumValN(SyntheticAccessStrided, "strided",
+                          "32 * threadIdx.x"),
+               clEnumValN(SyntheticAccessBroadcast, "broadcast",
+                          "The same element for all threads"),
+               clEnumValN(SyntheticAccessIndirect, "indirect",
+                          "An element loaded from memory")),
+    cl::init(SyntheticAccessCoalesced));
+
+static cl::opt<unsigned> Seed("synth-seed",
+    cl::desc("Seed of the choices of the generator"), cl::init(1));
+
+// Number of elements of the shared array.
+static const unsigned SharedSize = 1024;
+
+unsigned* SyntheticKernelParams::getParam(StringRef Name) {
+  if (Name == "blocks") return &Blocks;
+  if (Name == "loop-depth") return &LoopDepth;
+  if (Name == "branch-percent") return &BranchPercent;
+  if (Name == "live-values") return &LiveValues;
+  if (Name == "call-depth") return &CallDepth;
+  return nullptr;
+}
+
+SyntheticKernelParams llvm::getSyntheticKernelParams() {
+  SyntheticKernelParams params;
+  params.Blocks = Blocks;
+  params.LoopDepth = LoopDepth;
+  params.BranchPercent = BranchPercent;
+  params.LiveValues = LiveValues;
+  params.CallDepth = CallDepth;
+  params.Pattern = Pattern;
+  params.Seed = Seed;
+  return params;
+}
+
+namespace {
+
+// Builds the functions of a synthetic module.
+class SyntheticKernelBuilder {
+ public:
+  SyntheticKernelBuilder(Module& M, const SyntheticKernelParams& Params)
+    : M_(M), Params_(Params), C_(M.getContext()), B_(C_),
+      State_(Params.Seed) {}
+
+  void build();
+
+ private:
+  // Returns a pseudo-random number in [0, n).
+  unsigned choose(unsigned n) {
+    State_ = State_ * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (State_ >> 33) % n;
+  }
+
+  Function* getIntrinsic(StringRef Name, Type* RetTy) {
+    return cast<Function>(M_.getOrInsertFunction(Name,
+        FunctionType::get(RetTy, false)).getCallee());
+  }
+
+  // Creates a function with the given name and the arguments of kernels:
+  // (float* in, float* out, i32 n).
+  Function* createFunction(StringRef Name);
+
+  // Emits the body of F: allocas for the live values, then the segments in
+  // LoopDepth loops, with a call to Callee (if any) after them.
+  void emitBody(Function* F, unsigned LoopDepth, Function* Callee);
+
+  // Emits depth nested loops at the insertion point, with the segments and
+  // the call in the innermost body. The induction variables are added to
+  // index.
+  void emitLoops(Function* F, unsigned depth, Value* index, Function* Callee);
+
+  // Emits one segment at the insertion point.
+  void emitSegment(Function* F, Value* index);
+
+  // Emits the updates of the live values and the memory accesses of a
+  // segment at the insertion point.
+  void emitWork(Value* index);
+
+  Module& M_;
+  const SyntheticKernelParams& Params_;
+  LLVMContext& C_;
+  IRBuilder<> B_;
+  uint64_t State_;
+
+  GlobalVariable* Shared_ = nullptr;
+
+  // Values of the function being built.
+  Value* In_ = nullptr;
+  Value* Out_ = nullptr;
+  Value* N_ = nullptr;
+  Value* Tid_ = nullptr;
+  std::vector<AllocaInst*> Live_;
+};
+
+}
+
+Function* SyntheticKernelBuilder::createFunction(StringRef Name) {
+  Type* floatPtr = Type::getFloatPtrTy(C_, 1);
+  FunctionType* FT = FunctionType::get(Type::getVoidTy(C_),
+      {floatPtr, floatPtr, Type::getInt32Ty(C_)}, false);
+  Function* F = Function::Create(FT, GlobalValue::ExternalLinkage, Name, M_);
+  auto argIt = F->arg_begin();
+  (argIt++)->setName("in");
+  (argIt++)->setName("out");
+  argIt->setName("n");
+  return F;
+}
+
+void SyntheticKernelBuilder::build() {
+  ArrayType* sharedTy = ArrayType::get(Type::getFloatTy(C_), SharedSize);
+  Shared_ = new GlobalVariable(M_, sharedTy, false,
+      GlobalValue::InternalLinkage, UndefValue::get(sharedTy), "shared",
+      nullptr, GlobalValue::NotThreadLocal, 3);
+
+  // Callees first, so that each function calls the next one in the chain.
+  Function* callee = nullptr;
+  for (unsigned depth = Params_.CallDepth; depth > 0; depth--) {
+    Function* F = createFunction("device_" + std::to_string(depth));
+    emitBody(F, 0, callee);
+    callee = F;
+  }
+  Function* kernel = createFunction("kernel");
+  emitBody(kernel, Params_.LoopDepth, callee);
+
+  Metadata* ops[] = {ValueAsMetadata::get(kernel), MDString::get(C_, "kernel"),
+      ValueAsMetadata::get(ConstantInt::get(Type::getInt32Ty(C_), 1))};
+  M_.getOrInsertNamedMetadata("nvvm.annotations")->addOperand(
+      MDNode::get(C_, ops));
+}
+
+void SyntheticKernelBuilder::emitBody(Function* F, unsigned LoopDepth,
+                                      Function* Callee) {
+  auto argIt = F->arg_begin();
+  In_ = &*argIt++;
+  Out_ = &*argIt++;
+  N_ = &*argIt;
+  B_.SetInsertPoint(BasicBlock::Create(C_, "entry", F));
+  Tid_ = B_.CreateCall(getIntrinsic("llvm.nvvm.read.ptx.sreg.tid.x",
+                                    Type::getInt32Ty(C_)), {}, "tid");
+  Live_.clear();
+  for (unsigned i = 0; i < Params_.LiveValues; i++) {
+    AllocaInst* AI = B_.CreateAlloca(Type::getInt32Ty(C_), nullptr,
+                                     "v" + std::to_string(i));
+    B_.CreateStore(i % 2 ? Tid_ : N_, AI);
+    Live_.push_back(AI);
+  }
+  emitLoops(F, LoopDepth, Tid_, Callee);
+  B_.CreateRetVoid();
+}
+
+void SyntheticKernelBuilder::emitLoops(Function* F, unsigned depth,
+                                       Value* index, Function* Callee) {
+  if (depth == 0) {
+    for (unsigned i = 0; i < Params_.Blocks; i++) emitSegment(F, index);
+    if (Callee) B_.CreateCall(Callee, {In_, Out_, index});
+    return;
+  }
+  BasicBlock* preheader = B_.GetInsertBlock();
+  BasicBlock* header = BasicBlock::Create(C_, "loop", F);
+  BasicBlock* body = BasicBlock::Create(C_, "loop.body", F);
+  BasicBlock* exit = BasicBlock::Create(C_, "loop.exit", F);
+  B_.CreateBr(header);
+
+  B_.SetInsertPoint(header);
+  PHINode* i = B_.CreatePHI(Type::getInt32Ty(C_), 2, "i");
+  i->addIncoming(B_.getInt32(0), preheader);
+  B_.CreateCondBr(B_.CreateICmpSLT(i, N_), body, exit);
+
+  B_.SetInsertPoint(body);
+  emitLoops(F, depth - 1, B_.CreateAdd(index, i), Callee);
+  Value* next = B_.CreateAdd(i, B_.getInt32(1), "i.next");
+  i->addIncoming(next, B_.GetInsertBlock());
+  B_.CreateBr(header);
+
+  B_.SetInsertPoint(exit);
+}
+
+void SyntheticKernelBuilder::emitSegment(Function* F, Value* index) {
+  if (choose(100) >= Params_.BranchPercent || Live_.empty()) {
+    emitWork(index);
+    return;
+  }
+  AllocaInst* v = Live_[choose(Live_.size())];
+  Value* cond = B_.CreateICmpSLT(Tid_,
+      B_.CreateLoad(Type::getInt32Ty(C_), v), "cond");
+  BasicBlock* thenBB = BasicBlock::Create(C_, "then", F);
+  BasicBlock* elseBB = BasicBlock::Create(C_, "else", F);
+  BasicBlock* join = BasicBlock::Create(C_, "join", F);
+  B_.CreateCondBr(cond, thenBB, elseBB);
+  B_.SetInsertPoint(thenBB);
+  emitWork(index);
+  B_.CreateBr(join);
+  B_.SetInsertPoint(elseBB);
+  emitWork(index);
+  B_.CreateBr(join);
+  B_.SetInsertPoint(join);
+}
+
+void SyntheticKernelBuilder::emitWork(Value* index) {
+  Type* i32 = Type::getInt32Ty(C_);
+  Type* floatTy = Type::getFloatTy(C_);
+  for (unsigned i = 0; i < Live_.size(); i++) {
+    Value* a = B_.CreateLoad(i32, Live_[i]);
+    Value* b = B_.CreateLoad(i32, Live_[(i + 1) % Live_.size()]);
+    B_.CreateStore(B_.CreateAdd(a, b), Live_[i]);
+  }
+
+  Value* idx = index;
+  switch (Params_.Pattern) {
+    case SyntheticAccessCoalesced:
+      break;
+    case SyntheticAccessStrided:
+      idx = B_.CreateMul(index, B_.getInt32(32));
+      break;
+    case SyntheticAccessBroadcast:
+      idx = B_.getInt32(0);
+      break;
+    case SyntheticAccessIndirect:
+      idx = B_.CreateFPToSI(B_.CreateLoad(floatTy,
+          B_.CreateGEP(floatTy, In_, B_.CreateSExt(index, B_.getInt64Ty()))),
+          i32);
+      break;
+  }
+  Value* idx64 = B_.CreateSExt(idx, B_.getInt64Ty());
+  Value* x = B_.CreateLoad(floatTy, B_.CreateGEP(floatTy, In_, idx64));
+  Value* sharedPtr = B_.CreateGEP(Shared_->getValueType(), Shared_,
+      {B_.getInt64(0), B_.CreateURem(idx64, B_.getInt64(SharedSize))});
+  B_.CreateStore(x, sharedPtr);
+  B_.CreateCall(getIntrinsic("llvm.nvvm.barrier0", Type::getVoidTy(C_)), {});
+  Value* y = B_.CreateLoad(floatTy, sharedPtr);
+  B_.CreateStore(y, B_.CreateGEP(floatTy, Out_, idx64));
+}
+
+std::unique_ptr<Module> llvm::generateSyntheticModule(LLVMContext& Context,
+    const SyntheticKernelParams& Params) {
+  std::unique_ptr<Module> M(new Module("synthetic", Context));
+  M->setTargetTriple("nvptx64-nvidia-cuda");
+  M->setDataLayout("e-i64:64-i128:128-v16:16-v32:32-n16:32:64");
+  SyntheticKernelBuilder(*M, Params).build();
+  std::string errors;
+  raw_string_ostream os(errors);
+  if (verifyModule(*M, &os)) {
+    report_fatal_error(Twine("invalid synthetic module: ") + os.str());
+  }
+  return M;
+}
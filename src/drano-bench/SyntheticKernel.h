@@ -0,0 +1,77 @@
+//===- SyntheticKernel.h - Generator of synthetic device modules -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// The kernels of the real corpora are too small to show how the analyses
+// scale. generateSyntheticModule builds an NVPTX module with a single kernel
+// shaped by SyntheticKernelParams, in the style of clang -O0 output (local
+// variables in allocas):
+//   - the kernel body is a sequence of Blocks segments, nested in LoopDepth
+//     loops bounded by a kernel argument;
+//   - a segment is a straight block or, for BranchPercent percent of the
+//     segments, a diamond on a condition comparing threadIdx.x with a live
+//     value;
+//   - each segment updates LiveValues variables, each from the next one, so
+//     that all of them stay live across the body;
+//   - each segment loads from and stores to global and shared memory with
+//     the index given by Pattern, followed by __syncthreads;
+//   - the innermost body calls a chain of CallDepth device functions, each
+//     made of Blocks segments.
+// Segment kinds and compared values are drawn from a generator seeded by
+// Seed, so the same parameters always give the same module.
+//
+// The parameters are read from the -synth-* options by
+// getSyntheticKernelParams, shared by drano-gen and drano-bench -sweep.
+//===----------------------------------------------------------------------===//
+
+#ifndef SYNTHETIC_KERNEL_H
+#define SYNTHETIC_KERNEL_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+
+#include <memory>
+
+namespace llvm {
+
+// Index of the memory accesses of each segment.
+enum SyntheticAccessPattern {
+  // threadIdx.x (plus the induction variables of the enclosing loops).
+  SyntheticAccessCoalesced,
+  // 32 * threadIdx.x.
+  SyntheticAccessStrided,
+  // The same element for all threads.
+  SyntheticAccessBroadcast,
+  // An element loaded from memory (unknown stride).
+  SyntheticAccessIndirect
+};
+
+struct SyntheticKernelParams {
+  unsigned Blocks = 8;
+  unsigned LoopDepth = 1;
+  unsigned BranchPercent = 25;
+  unsigned LiveValues = 4;
+  unsigned CallDepth = 0;
+  SyntheticAccessPattern Pattern = SyntheticAccessCoalesced;
+  unsigned Seed = 1;
+
+  // Returns a reference to the parameter named Name (e.g. "blocks"), or null
+  // if there is no such integer parameter.
+  unsigned* getParam(StringRef Name);
+};
+
+// Returns the parameters given with the -synth-* options.
+SyntheticKernelParams getSyntheticKernelParams();
+
+// Returns a module with a kernel shaped by Params. The module is verified.
+std::unique_ptr<Module> generateSyntheticModule(LLVMContext& Context,
+    const SyntheticKernelParams& Params);
+
+}
+
+#endif /* SyntheticKernel.h */
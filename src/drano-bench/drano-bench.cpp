@@ -0,0 +1,497 @@
+//===- drano-bench.cpp - Throughput benchmark of the GPU Drano analyses -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// drano-bench measures the analyses themselves, without process start-up or
+// plugin loading. It runs each analysis mode N times in-process on each
+// module and reports, per module and mode, the median and 95th percentile
+// of the wall time of an analysis run, the instructions analyzed per second,
+// the blocks executed by the abstract execution engines and the peak RSS:
+//   (cd rodinia_3.1/cuda && ./compile.sh)
+//   (cd NVIDIA_CUDA-8.0_Samples && ./compile.sh)
+//   drano-bench -corpus=rodinia_3.1/cuda -corpus=NVIDIA_CUDA-8.0_Samples \
+//       -n 10 -baseline=drano-bench.baseline
+// -corpus finds the device modules generated by compile.sh (files named
+// *-cuda-nvptx64-nvidia-cuda-*.ll) under a directory; modules can also be
+// given as inputs. Each run loads the module again in a new context, since
+// the block-size invariance analysis inlines callees, and only the analysis
+// is timed. No summaries are cached.
+//
+// -baseline-out=<file> writes the results as a baseline, to be committed
+// with the sources. -baseline=<file> compares the results with a baseline
+// and exits with code 1 if, for a module and mode of the baseline, the
+// median time, the blocks executed or the peak RSS grew by more than
+// -threshold percent. Medians shorter than -min-time in the baseline are
+// not compared, as they are dominated by noise.
+//
+// -sweep=<parameter> measures synthetic modules (see SyntheticKernel.h)
+// instead, for each value of the parameter given with -sweep-values, the
+// other parameters being set by the -synth-* options:
+//   drano-bench -sweep=blocks -sweep-values=16,32,64,128,256 \
+//       -synth-loop-depth=2 -o blocks.csv -plot=blocks.gp
+// The results are written as CSV, and -plot=<file> writes a gnuplot script
+// plotting the median time and the peak RSS against the number of
+// instructions, so that superlinear growth stands out.
+//
+// Baseline file layout (text, one line per module and mode):
+//   module <tab> mode <tab> median seconds <tab> p95 seconds <tab> blocks
+//   <tab> peak RSS in KiB
+//===----------------------------------------------------------------------===//
+
+#include "AbstractExecutionEngine.h"
+#include "DranoDriver.h"
+#include "SyntheticKernel.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ToolOutputFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+using namespace llvm;
+
+static cl::list<std::string> InputFilenames(cl::Positional, cl::ZeroOrMore,
+    cl::desc("<input .ll/.bc files>"));
+
+static cl::list<std::string> CorpusDirs("corpus",
+    cl::desc("Directory searched for device modules generated by "
+             "compile.sh"),
+    cl::value_desc("directory"));
+
+static cl::opt<std::string> OutputFilename("o",
+    cl::desc("Output report file (default: standard output)"),
+    cl::value_desc("filename"), cl::init("-"));
+
+static cl::opt<unsigned> Iterations("n",
+    cl::desc("Number of runs of each analysis mode on each module"),
+    cl::init(5));
+
+static cl::list<DranoAnalysisFlags> Modes("mode",
+    cl::desc("Analysis modes to measure (default: all three)"),
+    cl::values(clEnumValN(DranoAnalysisUncoalesced, "uncoalesced",
+                          "Uncoalesced access analysis"),
+               clEnumValN(DranoAnalysisBSI, "bsi",
+                          "Block-size invariance analysis"),
+               clEnumValN(DranoAnalysisAll, "all", "Both analyses")));
+
+static cl::opt<std::string> Baseline("baseline",
+    cl::desc("Compare with a baseline and fail on regressions"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<std::string> BaselineOut("baseline-out",
+    cl::desc("Write the results as a baseline"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<double> Threshold("threshold",
+    cl::desc("Growth, in percent, above which a measure regressed"),
+    cl::init(10.0));
+
+static cl::opt<double> MinTime("min-time",
+    cl::desc("Baseline medians below this time (in seconds) are not "
+             "compared"),
+    cl::init(0.005));
+
+static cl::opt<std::string> Sweep("sweep",
+    cl::desc("Measure synthetic modules for each value of this parameter "
+             "(blocks, loop-depth, branch-percent, live-values, call-depth)"),
+    cl::value_desc("parameter"), cl::init(""));
+
+static cl::list<unsigned> SweepValues("sweep-values",
+    cl::desc("Values of the swept parameter"), cl::CommaSeparated);
+
+static cl::opt<std::string> Plot("plot",
+    cl::desc("Write a gnuplot script plotting the results of -sweep"),
+    cl::value_desc("filename"), cl::init(""));
+
+namespace {
+
+// Measures of an analysis mode on a module.
+struct BenchResult {
+  std::string Module;
+  std::string Mode;
+  double Median = 0;
+  double P95 = 0;
+  uint64_t Instructions = 0;
+  uint64_t Blocks = 0;
+  uint64_t PeakRSS = 0;
+  std::string Error;
+};
+
+}
+
+static const char* getModeName(DranoAnalysisFlags Mode) {
+  switch (Mode) {
+    case DranoAnalysisUncoalesced: return "uncoalesced";
+    case DranoAnalysisBSI: return "bsi";
+    default: return "all";
+  }
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Resets the peak RSS of the process to its current RSS, where the system
+// allows it (Linux), so that the peak of each module is measured alone.
+static void resetPeakRSS() {
+#ifdef __linux__
+  std::ofstream clearRefs("/proc/self/clear_refs");
+  clearRefs << "5";
+#endif
+}
+
+// Returns the peak RSS of the process in KiB.
+static uint64_t getPeakRSS() {
+#ifdef __linux__
+  // VmHWM follows resets through clear_refs, unlike getrusage.
+  auto bufferOrErr = MemoryBuffer::getFileAsStream("/proc/self/status");
+  if (bufferOrErr) {
+    SmallVector<StringRef, 0> lines;
+    (*bufferOrErr)->getBuffer().split(lines, '\n');
+    for (StringRef line : lines) {
+      uint64_t kib;
+      if (line.consume_front("VmHWM:") &&
+          !line.trim().rtrim("kB").trim().getAsInteger(10, kib)) {
+        return kib;
+      }
+    }
+  }
+#endif
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / 1024;
+#else
+  return usage.ru_maxrss;
+#endif
+}
+
+// Returns the element of sorted at the given percentile (nearest rank).
+static double getPercentile(const std::vector<double>& sorted,
+                            double percentile) {
+  size_t rank = std::ceil(percentile / 100 * sorted.size());
+  return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+static uint64_t countInstructions(const Module& M) {
+  uint64_t count = 0;
+  for (const Function& F : M) count += F.getInstructionCount();
+  return count;
+}
+
+// Loads (or generates) the module to measure.
+typedef std::function<std::unique_ptr<Module>(LLVMContext&, SMDiagnostic&)>
+    ModuleLoader;
+
+static BenchResult runBenchmark(const std::string& Filename,
+                                DranoAnalysisFlags Mode, ModuleLoader Load) {
+  BenchResult result;
+  result.Module = Filename;
+  result.Mode = getModeName(Mode);
+  std::vector<double> times;
+  resetPeakRSS();
+  for (unsigned i = 0; i < Iterations; i++) {
+    // The module must be destroyed before its context.
+    LLVMContext Context;
+    SMDiagnostic Err;
+    std::unique_ptr<Module> M = Load(Context, Err);
+    if (!M) {
+      raw_string_ostream os(result.Error);
+      Err.print("drano-bench", os);
+      return result;
+    }
+    result.Instructions = countInstructions(*M);
+    ModuleReport report;
+    report.Filename = Filename;
+    uint64_t blocks = getBlockExecutionCounter().load();
+    auto start = std::chrono::steady_clock::now();
+    analyzeModule(*M, Mode, report);
+    times.push_back(secondsSince(start));
+    result.Blocks = getBlockExecutionCounter().load() - blocks;
+  }
+  result.PeakRSS = getPeakRSS();
+  std::sort(times.begin(), times.end());
+  result.Median = getPercentile(times, 50);
+  result.P95 = getPercentile(times, 95);
+  return result;
+}
+
+// Returns the device modules generated by compile.sh under Dir, sorted.
+static std::vector<std::string> findCorpusModules(StringRef Dir) {
+  std::vector<std::string> modules;
+  std::error_code EC;
+  for (sys::fs::recursive_directory_iterator it(Dir, EC), ite;
+                                             it != ite && !EC; it.increment(EC)) {
+    StringRef name = sys::path::filename(it->path());
+    if (name.endswith(".ll") && name.contains("-cuda-nvptx64-nvidia-cuda-")) {
+      modules.push_back(it->path());
+    }
+  }
+  if (EC) errs() << "drano-bench: " << Dir << ": " << EC.message() << "\n";
+  std::sort(modules.begin(), modules.end());
+  return modules;
+}
+
+// Reads the baseline in Path, by module and mode. Returns false on error.
+static bool readBaseline(StringRef Path,
+    std::map<std::pair<std::string, std::string>, BenchResult>& results) {
+  auto bufferOrErr = MemoryBuffer::getFile(Path, /*IsText=*/true);
+  if (std::error_code EC = bufferOrErr.getError()) {
+    errs() << "drano-bench: " << Path << ": " << EC.message() << "\n";
+    return false;
+  }
+  SmallVector<StringRef, 0> lines;
+  (*bufferOrErr)->getBuffer().split(lines, '\n', -1, /*KeepEmpty=*/false);
+  for (StringRef line : lines) {
+    SmallVector<StringRef, 6> fields;
+    line.split(fields, '\t');
+    BenchResult result;
+    if (fields.size() != 6 || fields[2].getAsDouble(result.Median) ||
+        fields[3].getAsDouble(result.P95) ||
+        fields[4].getAsInteger(10, result.Blocks) ||
+        fields[5].getAsInteger(10, result.PeakRSS)) {
+      errs() << "drano-bench: " << Path << ": malformed line: " << line
+             << "\n";
+      return false;
+    }
+    result.Module = fields[0].str();
+    result.Mode = fields[1].str();
+    results[std::make_pair(result.Module, result.Mode)] = result;
+  }
+  return true;
+}
+
+static bool writeBaseline(StringRef Path, ArrayRef<BenchResult> Results) {
+  std::error_code EC;
+  raw_fd_ostream out(Path, EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << "drano-bench: " << Path << ": " << EC.message() << "\n";
+    return false;
+  }
+  for (const BenchResult& result : Results) {
+    if (!result.Error.empty()) continue;
+    out << result.Module << "\t" << result.Mode << "\t"
+        << format("%.6f\t%.6f", result.Median, result.P95) << "\t"
+        << result.Blocks << "\t" << result.PeakRSS << "\n";
+  }
+  return true;
+}
+
+// Returns true if current grew by more than Threshold percent over base.
+static bool hasRegressed(double current, double base) {
+  return current > base * (1 + Threshold / 100);
+}
+
+// Prints the regressions of Results over the baseline. Returns the number of
+// regressions.
+static unsigned compareWithBaseline(ArrayRef<BenchResult> Results,
+    const std::map<std::pair<std::string, std::string>, BenchResult>& base,
+    raw_ostream& os) {
+  unsigned regressions = 0;
+  for (const BenchResult& result : Results) {
+    auto it = base.find(std::make_pair(result.Module, result.Mode));
+    if (it == base.end() || !result.Error.empty()) continue;
+    const BenchResult& old = it->second;
+    auto report = [&](StringRef measure, double current, double previous) {
+      os << "Regression: " << result.Module << " " << result.Mode << " "
+         << measure << format(" %.6g -> %.6g (%+.1f%%)", previous, current,
+                              100 * (current - previous) / previous)
+         << "\n";
+      regressions++;
+    };
+    if (old.Median >= MinTime && hasRegressed(result.Median, old.Median)) {
+      report("median", result.Median, old.Median);
+    }
+    if (hasRegressed(result.Blocks, old.Blocks)) {
+      report("blocks", result.Blocks, old.Blocks);
+    }
+    if (hasRegressed(result.PeakRSS, old.PeakRSS)) {
+      report("peak RSS", result.PeakRSS, old.PeakRSS);
+    }
+  }
+  return regressions;
+}
+
+// Returns the modes given with -mode, or all three.
+static std::vector<DranoAnalysisFlags> getModes() {
+  std::vector<DranoAnalysisFlags> modes(Modes.begin(), Modes.end());
+  if (modes.empty()) {
+    modes = {DranoAnalysisUncoalesced, DranoAnalysisBSI, DranoAnalysisAll};
+  }
+  return modes;
+}
+
+static bool writePlot(StringRef Path, StringRef CSVPath) {
+  std::error_code EC;
+  raw_fd_ostream out(Path, EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << "drano-bench: " << Path << ": " << EC.message() << "\n";
+    return false;
+  }
+  out << "# Results of drano-bench -sweep=" << Sweep << "\n"
+      << "set datafile separator ','\n"
+      << "set key top left\n"
+      << "set xlabel 'instructions'\n"
+      << "set terminal pngcairo size 1200,500\n"
+      << "set output '" << CSVPath << ".png'\n"
+      << "set multiplot layout 1,2\n";
+  const char* columns[][2] = {{"6", "median time (s)"},
+                              {"8", "peak RSS (KiB)"}};
+  for (const auto& column : columns) {
+    out << "set ylabel '" << column[1] << "'\nplot";
+    std::vector<DranoAnalysisFlags> modes = getModes();
+    for (unsigned i = 0; i < modes.size(); i++) {
+      out << (i ? ", \\\n    " : " ") << "'" << CSVPath
+          << "' using 4:(strcol(3) eq '" << getModeName(modes[i]) << "' ? $"
+          << column[0] << " : 1/0) skip 1 with linespoints title '"
+          << getModeName(modes[i]) << "'";
+    }
+    out << "\n";
+  }
+  out << "unset multiplot\n";
+  return true;
+}
+
+// Measures synthetic modules for each value of the swept parameter, and
+// writes the results as CSV to os.
+static bool runSweep(raw_ostream& os) {
+  SyntheticKernelParams params = getSyntheticKernelParams();
+  unsigned* param = params.getParam(Sweep);
+  if (!param) {
+    errs() << "drano-bench: unknown parameter " << Sweep << "\n";
+    return false;
+  }
+  if (SweepValues.empty()) {
+    errs() << "drano-bench: -sweep requires -sweep-values\n";
+    return false;
+  }
+  os << "parameter,value,mode,instructions,blocks,median,p95,peak_rss_kib\n";
+  for (unsigned value : SweepValues) {
+    *param = value;
+    std::string name = Sweep + "=" + std::to_string(value);
+    for (DranoAnalysisFlags mode : getModes()) {
+      BenchResult result = runBenchmark(name, mode,
+          [&params](LLVMContext& Context, SMDiagnostic&) {
+            return generateSyntheticModule(Context, params);
+          });
+      os << Sweep << "," << value << "," << result.Mode << ","
+         << result.Instructions << "," << result.Blocks << ","
+         << format("%.6f,%.6f", result.Median, result.P95) << ","
+         << result.PeakRSS << "\n";
+      os.flush();
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  InitLLVM X(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv,
+      "GPU Drano: throughput benchmark of the analyses\n");
+
+  if (Iterations == 0) {
+    errs() << "drano-bench: -n must be positive\n";
+    return 1;
+  }
+  if (!Sweep.empty()) {
+    std::error_code EC;
+    ToolOutputFile Out(OutputFilename, EC, sys::fs::OF_Text);
+    if (EC) {
+      errs() << "drano-bench: " << OutputFilename << ": " << EC.message()
+             << "\n";
+      return 1;
+    }
+    if (!runSweep(Out.os())) return 1;
+    Out.keep();
+    if (!Plot.empty()) {
+      if (OutputFilename == "-") {
+        errs() << "drano-bench: -plot requires -o\n";
+        return 1;
+      }
+      if (!writePlot(Plot, OutputFilename)) return 1;
+    }
+    return 0;
+  }
+
+  std::vector<std::string> modules(InputFilenames.begin(),
+                                   InputFilenames.end());
+  for (const std::string& dir : CorpusDirs) {
+    std::vector<std::string> found = findCorpusModules(dir);
+    modules.insert(modules.end(), found.begin(), found.end());
+  }
+  if (modules.empty()) {
+    errs() << "drano-bench: no input modules\n";
+    return 1;
+  }
+  std::vector<DranoAnalysisFlags> modes = getModes();
+  std::map<std::pair<std::string, std::string>, BenchResult> base;
+  if (!Baseline.empty() && !readBaseline(Baseline, base)) return 1;
+
+  std::error_code EC;
+  ToolOutputFile Out(OutputFilename, EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << "drano-bench: " << OutputFilename << ": " << EC.message()
+           << "\n";
+    return 1;
+  }
+
+  // Modules are measured one at a time, so that runs do not compete for
+  // cores or memory.
+  std::vector<BenchResult> results;
+  bool failed = false;
+  for (const std::string& Filename : modules) {
+    Out.os() << "Module: " << Filename << "\n";
+    for (DranoAnalysisFlags mode : modes) {
+      BenchResult result = runBenchmark(Filename, mode,
+          [&Filename](LLVMContext& Context, SMDiagnostic& Err) {
+            return loadModule(Filename, Context, Err);
+          });
+      results.push_back(result);
+      if (!result.Error.empty()) {
+        errs() << result.Error;
+        failed = true;
+        break;
+      }
+      double throughput = result.Median > 0 ?
+          result.Instructions / result.Median : 0;
+      Out.os() << "  " << result.Mode
+               << format("  median %.6f  p95 %.6f  instructions/s %.0f",
+                         result.Median, result.P95, throughput)
+               << "  blocks " << result.Blocks
+               << format("  peak RSS %.1f MiB", result.PeakRSS / 1024.0)
+               << "\n";
+    }
+  }
+
+  unsigned regressions = 0;
+  if (!Baseline.empty()) {
+    regressions = compareWithBaseline(results, base, Out.os());
+    Out.os() << "Regressions: " << regressions
+             << format(" (threshold %.1f%%)", Threshold.getValue()) << "\n";
+  }
+  if (!BaselineOut.empty() && !writeBaseline(BaselineOut, results)) {
+    failed = true;
+  }
+  Out.keep();
+  return failed || regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,592 @@
+//===- drano-difftest.cpp - Differential testing of the GPU Drano analyses -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// drano-difftest checks that a configuration of the analyses (the candidate)
+// gives exactly the results of another one (the reference), on the modules of
+// a corpus or on random synthetic modules (see SyntheticKernel.h):
+//   drano-difftest -corpus=rodinia_3.1/cuda -candidate=cache
+//   drano-difftest -random=200 -candidate=lazy -reduce
+//   drano-difftest -corpus=rodinia_3.1/cuda -candidate=debug-cache
+// For each module, both configurations analyze their own copy and are
+// compared on:
+//   - the entry state of each block of the functions reachable from the
+//     entry points, as computed by the engines of both analyses (only for
+//     configurations which run the engines on every function);
+//   - the uncoalesced accesses of each root and of each function, with their
+//     multipliers and element sizes;
+//   - the block-size dependence of each function, its block-size dependent
+//     accesses and its barriers, with the reasons of their dependence.
+// Accesses are identified by their fingerprints (see DranoBaseline.h), so
+// that results of different copies of a module can be compared.
+//
+// With -reduce, a module on which the configurations disagree is reduced by
+// deleting function bodies, instructions and conditional branches, in
+// chunks halved until single ones, for as long as the configurations still
+// disagree. The reduced module is written to -reduced-dir.
+//
+// New configurations (e.g. a new engine) are added to DiffConfigurationKind
+// and runConfiguration. The tool exits with code 1 if the configurations
+// disagree on any module.
+//===----------------------------------------------------------------------===//
+
+#include "DranoBaseline.h"
+#include "DranoDriver.h"
+#include "EntryPoints.h"
+#include "InterprocBSIAnalysisPass.h"
+#include "InterprocUncoalescedAnalysisPass.h"
+#include "SyntheticKernel.h"
+
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+// Configurations of the analyses.
+enum DiffConfigurationKind {
+  // Fresh analysis of each module, with memoized summaries kept in memory
+  // for the duration of the analysis only.
+  DiffReference,
+  // Analysis with the summaries of a previous analysis of the same module,
+  // read back from a summary cache.
+  DiffCache,
+  // Analysis of the module written as bitcode and loaded lazily, as drano
+  // does for bitcode inputs.
+  DiffLazy,
+  // Analysis in streaming mode, with the summaries of each function released
+  // once its results are final (see -uncoalesced-stream).
+  DiffStream,
+  // Analysis with the summaries of the same module without debug
+  // information (as if built without -g), read back from a summary cache.
+  // The corpus is built with -g, so this checks that cached summaries do
+  // not depend on debug information.
+  DiffDebugCache
+};
+
+}
+
+static cl::list<std::string> InputFilenames(cl::Positional, cl::ZeroOrMore,
+    cl::desc("<input .ll/.bc files>"));
+
+static cl::list<std::string> CorpusDirs("corpus",
+    cl::desc("Directory searched for device modules generated by "
+             "compile.sh"),
+    cl::value_desc("directory"));
+
+static cl::opt<unsigned> RandomModules("random",
+    cl::desc("Number of random synthetic modules to test"), cl::init(0));
+
+static cl::opt<unsigned> RandomSeed("random-seed",
+    cl::desc("Seed of the parameters of the random modules"), cl::init(1));
+
+static cl::opt<DiffConfigurationKind> Reference("reference",
+    cl::desc("Reference configuration"),
+    cl::values(clEnumValN(DiffReference, "reference", "Fresh analysis"),
+               clEnumValN(DiffCache, "cache", "Cached summaries"),
+               clEnumValN(DiffLazy, "lazy", "Lazily loaded bitcode"),
+               clEnumValN(DiffStream, "stream", "Streaming mode"),
+               clEnumValN(DiffDebugCache, "debug-cache",
+                          "Summaries cached without debug information")),
+    cl::init(DiffReference));
+
+static cl::opt<DiffConfigurationKind> Candidate("candidate",
+    cl::desc("Candidate configuration"),
+    cl::values(clEnumValN(DiffReference, "reference", "Fresh analysis"),
+               clEnumValN(DiffCache, "cache", "Cached summaries"),
+               clEnumValN(DiffLazy, "lazy", "Lazily loaded bitcode"),
+               clEnumValN(DiffStream, "stream", "Streaming mode"),
+               clEnumValN(DiffDebugCache, "debug-cache",
+                          "Summaries cached without debug information")),
+    cl::init(DiffCache));
+
+static cl::opt<bool> Reduce("reduce",
+    cl::desc("Reduce the modules on which the configurations disagree"));
+
+static cl::opt<std::string> ReducedDir("reduced-dir",
+    cl::desc("Directory of the reduced modules"),
+    cl::value_desc("directory"), cl::init("."));
+
+static cl::opt<unsigned> MaxDiffs("max-diffs",
+    cl::desc("Maximum number of differences printed per module"),
+    cl::init(20));
+
+namespace {
+
+// Results of a configuration on a module, as text keyed by what they
+// describe (e.g. "uncoalesced <root> <fingerprint>").
+struct DiffSnapshot {
+  std::map<std::string, std::string> Entries;
+  // Does the snapshot include the entry states of the blocks?
+  bool HasEntryStates = false;
+};
+
+}
+
+// Returns the names of the values that may be held in the states of F: its
+// arguments, its instructions (by position) and the globals of its module.
+static std::vector<std::pair<const Value*, std::string>> getStateValueNames(
+    const Function& F) {
+  std::vector<std::pair<const Value*, std::string>> names;
+  for (const Argument& A : F.args()) {
+    names.emplace_back(&A, "arg" + std::to_string(A.getArgNo()));
+  }
+  unsigned position = 0;
+  for (const BasicBlock& BB : F) {
+    for (const Instruction& I : BB) {
+      names.emplace_back(&I, "%" + std::to_string(position++));
+    }
+  }
+  for (const GlobalVariable& G : F.getParent()->globals()) {
+    names.emplace_back(&G, "@" + G.getName().str());
+  }
+  return names;
+}
+
+// Records the entry state of each block of F reached by engine, keyed by
+// Prefix, the function and the position of the block.
+template <typename EngineT>
+static void addEntryStates(StringRef Prefix, const Function& F,
+    EngineT& engine,
+    ArrayRef<std::pair<const Value*, std::string>> names,
+    DiffSnapshot& snapshot) {
+  unsigned position = 0;
+  for (const BasicBlock& BB : F) {
+    std::string key = Prefix.str() + " " + F.getName().str() + " block " +
+                      std::to_string(position++);
+    if (!engine.hasStateBeforeInstruction(&BB.front())) {
+      snapshot.Entries[key] = "unreached";
+      continue;
+    }
+    const auto& st = engine.getStateBeforeInstruction(&BB.front());
+    std::string state;
+    for (const auto& name : names) {
+      if (!st.hasValue(name.first)) continue;
+      state += name.second + ":" + st.getValue(name.first).getString() + " ";
+    }
+    state += "#t:" + st.getNumThreads().getString();
+    snapshot.Entries[key] = state;
+  }
+}
+
+// Records the entry states computed by the engines of both analyses for the
+// functions of M reachable from the entry points, each analyzed alone with
+// its initial state.
+static void addEntryStates(const Module& M, DiffSnapshot& snapshot) {
+  for (const Function* F : getReachableFunctions(getDranoEntryPoints(M))) {
+    if (F->isDeclaration()) continue;
+    std::vector<std::pair<const Value*, std::string>> names =
+        getStateValueNames(*F);
+    DominatorTree DT(const_cast<Function&>(*F));
+    UncoalescedAnalysis uncoalesced(F, &DT);
+    uncoalesced.ComputeUncoalescedAccesses(uncoalesced.BuildInitialState());
+    addEntryStates("entry-state uncoalesced", *F, uncoalesced, names,
+                   snapshot);
+    for (int dim = 0; dim < 3; dim++) {
+      BlockSizeInvarianceAnalysis bsi(F, &DT, dim);
+      bsi.BuildAnalysisInfo(bsi.BuildInitialState());
+      addEntryStates("entry-state bsi." + std::to_string(dim), *F, bsi,
+                     names, snapshot);
+    }
+  }
+  snapshot.HasEntryStates = true;
+}
+
+// Records the results of the interprocedural uncoalesced access analysis.
+static void addUncoalescedResults(const InterprocUncoalescedResult& result,
+                                  AccessFingerprinter& fingerprinter,
+                                  DiffSnapshot& snapshot) {
+  for (const Function* F : result.Roots) {
+    for (const AccessTrace& trace : result.RootAccessMap.at(F)) {
+      auto it = result.AccessInfoMap.find(trace[0]);
+      UncoalescedAccessInfo info = it != result.AccessInfoMap.end() ?
+          it->second : UncoalescedAccessInfo();
+      snapshot.Entries["uncoalesced " + F->getName().str() + " " +
+                       fingerprinter.getFingerprint(trace)] =
+          info.getMultiplierValue().getString() + " size " +
+          std::to_string(info.ElementSize);
+    }
+  }
+  for (const auto& pair : result.UncoalescedAccessMap) {
+    for (const Instruction* I : pair.second) {
+      snapshot.Entries["uncoalesced-in " + pair.first->getName().str() +
+                       " " + fingerprinter.getFingerprint(I)] = "";
+    }
+  }
+}
+
+// Runs both interprocedural analyses on M (which is modified, as callees
+// are inlined before the block-size invariance analysis) and records their
+// results. The uncoalesced access analysis runs in streaming mode if
+// Stream is set.
+static void addResults(Module& M, SummaryStore* Store,
+                       DiffSnapshot& snapshot, bool Stream = false) {
+  {
+    AccessFingerprinter fingerprinter;
+    CallGraph CG(M);
+    if (Stream) {
+      streamInterprocUncoalescedAnalysis(M, CG,
+          [&](const InterprocUncoalescedResult& result, const Function*) {
+            addUncoalescedResults(result, fingerprinter, snapshot);
+            return true;
+          },
+          nullptr, Store);
+    } else {
+      addUncoalescedResults(
+          runInterprocUncoalescedAnalysis(M, CG, nullptr, Store),
+          fingerprinter, snapshot);
+    }
+  }
+
+  legacy::PassManager PM;
+  PM.add(createAlwaysInlinerLegacyPass());
+  PM.run(M);
+  AccessFingerprinter fingerprinter;
+  CallGraph CG(M);
+  InterprocBSIResult result = runInterprocBSIAnalysis(M, CG, nullptr, Store);
+  for (const Function* F : result.Functions) {
+    const BSIFunctionResult& functionResult = result.FunctionResults.at(F);
+    std::string name = F->getName().str();
+    snapshot.Entries["bsi-function " + name] =
+        std::string(functionResult.IsBSI ? "independent" : "dependent") +
+        (functionResult.HasReturnValue ?
+             " returns " + functionResult.ReturnValue.getString() : "");
+    auto getDependence = [&functionResult](const Instruction* I) {
+      auto it = functionResult.Dependences.find(I);
+      if (it == functionResult.Dependences.end()) return std::string();
+      return "reasons " + std::to_string(it->second.Reasons) + " dims " +
+             std::to_string(it->second.Dimensions);
+    };
+    for (const Instruction* I : functionResult.DependentAccesses) {
+      snapshot.Entries["bsi " + name + " " +
+                       fingerprinter.getFingerprint(I)] = getDependence(I);
+    }
+    for (const Instruction* I : functionResult.SyncThreads) {
+      snapshot.Entries["barrier " + name + " " +
+                       fingerprinter.getFingerprint(I)] = getDependence(I);
+    }
+  }
+}
+
+// Analyzes a copy of M with the configuration Kind.
+static DiffSnapshot runConfiguration(DiffConfigurationKind Kind,
+                                     const Module& M) {
+  DiffSnapshot snapshot;
+  switch (Kind) {
+    case DiffReference: {
+      std::unique_ptr<Module> copy = CloneModule(M);
+      addEntryStates(*copy, snapshot);
+      addResults(*copy, nullptr, snapshot);
+      break;
+    }
+    case DiffCache: {
+      // The first analysis fills the cache, and the second one takes all
+      // its summaries from the cache.
+      MemorySummaryStore Store;
+      DiffSnapshot warmUp;
+      addResults(*CloneModule(M), &Store, warmUp);
+      addResults(*CloneModule(M), &Store, snapshot);
+      break;
+    }
+    case DiffLazy: {
+      SmallVector<char, 0> buffer;
+      raw_svector_ostream os(buffer);
+      WriteBitcodeToFile(M, os);
+      LLVMContext Context;
+      SMDiagnostic Err;
+      std::unique_ptr<Module> loaded = loadModule(
+          MemoryBuffer::getMemBufferCopy(StringRef(buffer.data(),
+                                                   buffer.size())),
+          Context, Err);
+      if (!loaded) {
+        std::string message;
+        raw_string_ostream errOS(message);
+        Err.print("drano-difftest", errOS);
+        snapshot.Entries["load-error"] = errOS.str();
+        break;
+      }
+      addEntryStates(*loaded, snapshot);
+      addResults(*loaded, nullptr, snapshot);
+      break;
+    }
+    case DiffStream: {
+      addResults(*CloneModule(M), nullptr, snapshot, /*Stream=*/true);
+      break;
+    }
+    case DiffDebugCache: {
+      // The cache is filled from a copy without debug intrinsics and
+      // locations, and the module itself takes all its summaries from it.
+      MemorySummaryStore Store;
+      DiffSnapshot warmUp;
+      std::unique_ptr<Module> stripped = CloneModule(M);
+      StripDebugInfo(*stripped);
+      addResults(*stripped, &Store, warmUp);
+      addResults(*CloneModule(M), &Store, snapshot);
+      break;
+    }
+  }
+  return snapshot;
+}
+
+// Returns the differences between the snapshots (entry states are only
+// compared if both snapshots include them).
+static std::vector<std::string> compareSnapshots(const DiffSnapshot& ref,
+                                                 const DiffSnapshot& cand) {
+  bool compareStates = ref.HasEntryStates && cand.HasEntryStates;
+  auto isCompared = [compareStates](const std::string& key) {
+    return compareStates || !StringRef(key).startswith("entry-state ");
+  };
+  std::vector<std::string> diffs;
+  for (const auto& pair : ref.Entries) {
+    if (!isCompared(pair.first)) continue;
+    auto it = cand.Entries.find(pair.first);
+    if (it == cand.Entries.end()) {
+      diffs.push_back("- " + pair.first + ": " + pair.second);
+    } else if (it->second != pair.second) {
+      diffs.push_back("! " + pair.first + ": " + pair.second + " -> " +
+                      it->second);
+    }
+  }
+  for (const auto& pair : cand.Entries) {
+    if (!isCompared(pair.first) || ref.Entries.count(pair.first)) continue;
+    diffs.push_back("+ " + pair.first + ": " + pair.second);
+  }
+  return diffs;
+}
+
+static std::vector<std::string> getDifferences(const Module& M) {
+  return compareSnapshots(runConfiguration(Reference, M),
+                          runConfiguration(Candidate, M));
+}
+
+namespace {
+
+// Kinds of reductions, each applied to a range of candidates in module
+// order.
+enum ReductionKind {
+  // Defined functions, whose bodies are deleted.
+  ReduceFunctions,
+  // Instructions other than terminators, which are erased (their uses are
+  // replaced with undef).
+  ReduceInstructions,
+  // Conditional branches, which are replaced by a branch to their first
+  // successor.
+  ReduceBranches
+};
+
+}
+
+// Returns the candidates of Kind in M, in module order.
+static std::vector<Value*> getReductionCandidates(Module& M,
+                                                  ReductionKind Kind) {
+  std::vector<Value*> candidates;
+  for (Function& F : M) {
+    if (F.isDeclaration()) continue;
+    if (Kind == ReduceFunctions) {
+      candidates.push_back(&F);
+      continue;
+    }
+    for (BasicBlock& BB : F) {
+      for (Instruction& I : BB) {
+        if (Kind == ReduceInstructions && !I.isTerminator() && !I.isEHPad()) {
+          candidates.push_back(&I);
+        }
+        BranchInst* BI = dyn_cast<BranchInst>(&I);
+        if (Kind == ReduceBranches && BI && BI->isConditional()) {
+          candidates.push_back(BI);
+        }
+      }
+    }
+  }
+  return candidates;
+}
+
+// Applies the reduction Kind to the candidates [begin, end) of M.
+static void applyReduction(Module& M, ReductionKind Kind, unsigned begin,
+                           unsigned end) {
+  std::vector<Value*> candidates = getReductionCandidates(M, Kind);
+  std::set<Function*> changed;
+  for (unsigned i = begin; i < end && i < candidates.size(); i++) {
+    if (Kind == ReduceFunctions) {
+      cast<Function>(candidates[i])->deleteBody();
+    } else if (Kind == ReduceInstructions) {
+      Instruction* I = cast<Instruction>(candidates[i]);
+      if (!I->getType()->isVoidTy()) {
+        I->replaceAllUsesWith(UndefValue::get(I->getType()));
+      }
+      I->eraseFromParent();
+    } else {
+      BranchInst* BI = cast<BranchInst>(candidates[i]);
+      BasicBlock* BB = BI->getParent();
+      BasicBlock* kept = BI->getSuccessor(0);
+      BasicBlock* dropped = BI->getSuccessor(1);
+      if (dropped != kept) dropped->removePredecessor(BB);
+      BranchInst::Create(kept, BI);
+      BI->eraseFromParent();
+      changed.insert(BB->getParent());
+    }
+  }
+  for (Function* F : changed) removeUnreachableBlocks(*F);
+}
+
+// Reduces M while the configurations disagree on it.
+static std::unique_ptr<Module> reduceModule(const Module& M) {
+  std::unique_ptr<Module> current = CloneModule(M);
+  bool progress = true;
+  while (progress) {
+    progress = false;
+    for (ReductionKind Kind : {ReduceFunctions, ReduceBranches,
+                               ReduceInstructions}) {
+      unsigned count = getReductionCandidates(*current, Kind).size();
+      for (unsigned chunk = count; chunk > 0; chunk /= 2) {
+        for (unsigned begin = 0; begin < count;) {
+          std::unique_ptr<Module> trial = CloneModule(*current);
+          applyReduction(*trial, Kind, begin, begin + chunk);
+          if (!verifyModule(*trial) && !getDifferences(*trial).empty()) {
+            // The candidates after the range moved down to begin.
+            current = std::move(trial);
+            count = getReductionCandidates(*current, Kind).size();
+            progress = true;
+          } else {
+            begin += chunk;
+          }
+        }
+      }
+    }
+  }
+  return current;
+}
+
+// Returns the device modules generated by compile.sh under Dir, sorted.
+static std::vector<std::string> findCorpusModules(StringRef Dir) {
+  std::vector<std::string> modules;
+  std::error_code EC;
+  for (sys::fs::recursive_directory_iterator it(Dir, EC), ite;
+                                             it != ite && !EC; it.increment(EC)) {
+    StringRef name = sys::path::filename(it->path());
+    if (name.endswith(".ll") && name.contains("-cuda-nvptx64-nvidia-cuda-")) {
+      modules.push_back(it->path());
+    }
+  }
+  if (EC) errs() << "drano-difftest: " << Dir << ": " << EC.message() << "\n";
+  std::sort(modules.begin(), modules.end());
+  return modules;
+}
+
+// Returns random parameters of a synthetic module.
+static SyntheticKernelParams getRandomParams(std::mt19937& rng) {
+  auto pick = [&rng](unsigned lo, unsigned hi) {
+    return std::uniform_int_distribution<unsigned>(lo, hi)(rng);
+  };
+  SyntheticKernelParams params;
+  params.Blocks = pick(1, 12);
+  params.LoopDepth = pick(0, 3);
+  params.BranchPercent = pick(0, 100);
+  params.LiveValues = pick(0, 6);
+  params.CallDepth = pick(0, 3);
+  params.Pattern = SyntheticAccessPattern(pick(0, 3));
+  params.Seed = pick(1, 1000000);
+  return params;
+}
+
+// Compares the configurations on M, reducing it if they disagree. Returns
+// false if they disagree.
+static bool testModule(const Module& M, StringRef Name) {
+  std::vector<std::string> diffs = getDifferences(M);
+  if (diffs.empty()) {
+    outs() << "OK " << Name << "\n";
+    return true;
+  }
+  outs() << "MISMATCH " << Name << " (" << diffs.size() << " differences)\n";
+  for (unsigned i = 0; i < diffs.size() && i < MaxDiffs; i++) {
+    outs() << "  " << diffs[i] << "\n";
+  }
+  if (!Reduce) return false;
+
+  std::unique_ptr<Module> reduced = reduceModule(M);
+  SmallString<128> path(ReducedDir);
+  sys::path::append(path, sys::path::stem(Name) + ".reduced.ll");
+  std::error_code EC;
+  ToolOutputFile Out(path, EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << "drano-difftest: " << path << ": " << EC.message() << "\n";
+    return false;
+  }
+  reduced->print(Out.os(), nullptr);
+  Out.keep();
+  diffs = getDifferences(*reduced);
+  outs() << "  reduced to " << reduced->getInstructionCount()
+         << " instructions in " << path << "\n";
+  for (unsigned i = 0; i < diffs.size() && i < MaxDiffs; i++) {
+    outs() << "    " << diffs[i] << "\n";
+  }
+  return false;
+}
+
+int main(int argc, char** argv) {
+  InitLLVM X(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv,
+      "Differential testing of configurations of the GPU Drano analyses\n");
+
+  std::vector<std::string> modules(InputFilenames.begin(),
+                                   InputFilenames.end());
+  for (const std::string& Dir : CorpusDirs) {
+    std::vector<std::string> found = findCorpusModules(Dir);
+    modules.insert(modules.end(), found.begin(), found.end());
+  }
+  if (modules.empty() && RandomModules == 0) {
+    errs() << "drano-difftest: no module (give files, -corpus or -random)\n";
+    return 1;
+  }
+
+  unsigned mismatches = 0, tested = 0;
+  for (const std::string& Filename : modules) {
+    LLVMContext Context;
+    SMDiagnostic Err;
+    std::unique_ptr<Module> M = loadModule(Filename, Context, Err);
+    if (!M) {
+      Err.print("drano-difftest", errs());
+      return 1;
+    }
+    if (!testModule(*M, Filename)) mismatches++;
+    tested++;
+  }
+  std::mt19937 rng(RandomSeed);
+  for (unsigned i = 0; i < RandomModules; i++) {
+    SyntheticKernelParams params = getRandomParams(rng);
+    LLVMContext Context;
+    std::unique_ptr<Module> M = generateSyntheticModule(Context, params);
+    std::string name = "random-" + std::to_string(RandomSeed) + "-" +
+                       std::to_string(i);
+    if (!testModule(*M, name)) mismatches++;
+    tested++;
+  }
+  outs() << "Modules: " << tested << " tested, " << mismatches
+         << " mismatching\n";
+  return mismatches > 0 ? 1 : 0;
+}
@@ -0,0 +1,55 @@
+//===- drano-gen.cpp - Generator of synthetic device modules -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// drano-gen writes a synthetic device module shaped by the -synth-* options
+// (see SyntheticKernel.h), e.g.
+//   drano-gen -synth-blocks=64 -synth-loop-depth=3 -o big.ll
+//   opt -load-pass-plugin=... -passes=... big.ll
+// Use drano-bench -sweep to measure the analyses on a range of modules.
+//===----------------------------------------------------------------------===//
+
+#include "SyntheticKernel.h"
+
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/ToolOutputFile.h"
+
+using namespace llvm;
+
+static cl::opt<std::string> OutputFilename("o",
+    cl::desc("Output file (default: standard output)"),
+    cl::value_desc("filename"), cl::init("-"));
+
+static cl::opt<bool> EmitBitcode("emit-bitcode",
+    cl::desc("Write bitcode instead of textual IR"));
+
+int main(int argc, char** argv) {
+  InitLLVM X(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv,
+      "GPU Drano: generator of synthetic device modules\n");
+
+  LLVMContext Context;
+  std::unique_ptr<Module> M =
+      generateSyntheticModule(Context, getSyntheticKernelParams());
+  std::error_code EC;
+  ToolOutputFile Out(OutputFilename, EC,
+                     EmitBitcode ? sys::fs::OF_None : sys::fs::OF_Text);
+  if (EC) {
+    errs() << "drano-gen: " << OutputFilename << ": " << EC.message() << "\n";
+    return 1;
+  }
+  if (EmitBitcode) {
+    WriteBitcodeToFile(*M, Out.os());
+  } else {
+    M->print(Out.os(), nullptr);
+  }
+  Out.keep();
+  return 0;
+}
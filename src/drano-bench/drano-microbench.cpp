@@ -0,0 +1,388 @@
+//===- drano-microbench.cpp - Micro-benchmarks of the abstract domains -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// drano-microbench measures the innermost operations of the analyses, which
+// the abstract execution engines run for every instruction and block:
+//   - join and the arithmetic of MultiplierValue and BSizeDependenceValue;
+//   - copy, mergeState, operator==, getValue and setValue of GPUState and
+//     BSizeGPUState, for states of each of the -sizes (10 to 100000 entries
+//     by default).
+// The states are keyed by synthetic values (globals of an empty module).
+// Each operation is repeated for at least -min-time seconds, and its cost is
+// reported in nanoseconds and in bytes allocated per operation:
+//   drano-microbench -baseline-out=drano-microbench.baseline
+//   drano-microbench -baseline=drano-microbench.baseline
+// -baseline compares the results with a baseline written by -baseline-out,
+// and exits with code 1 if the time of an operation grew by more than
+// -threshold percent, or if it allocates more bytes than in the baseline.
+// Changes of the data structures of AbstractState should come with the
+// numbers before and after.
+//
+// Baseline file layout (text, one line per operation and size):
+//   operation <tab> size <tab> ns per op <tab> bytes per op
+//===----------------------------------------------------------------------===//
+
+#include "BSizeGPUState.h"
+#include "GPUState.h"
+
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ToolOutputFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::list<unsigned> Sizes("sizes",
+    cl::desc("Numbers of entries of the measured states"),
+    cl::CommaSeparated);
+
+static cl::opt<double> MinTime("min-time",
+    cl::desc("Time (in seconds) during which each operation is repeated"),
+    cl::init(0.2));
+
+static cl::opt<std::string> Filter("filter",
+    cl::desc("Only measure the operations whose name contains this string"),
+    cl::init(""));
+
+static cl::opt<std::string> OutputFilename("o",
+    cl::desc("Output report file (default: standard output)"),
+    cl::value_desc("filename"), cl::init("-"));
+
+static cl::opt<std::string> Baseline("baseline",
+    cl::desc("Compare with a baseline and fail on regressions"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<std::string> BaselineOut("baseline-out",
+    cl::desc("Write the results as a baseline"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<double> Threshold("threshold",
+    cl::desc("Growth of the time per operation, in percent, above which an "
+             "operation regressed"),
+    cl::init(25.0));
+
+// Bytes allocated through operator new since the start of the process.
+static std::atomic<uint64_t> AllocatedBytes(0);
+
+void* operator new(size_t size) {
+  AllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) return p;
+  report_bad_alloc_error("drano-microbench: out of memory");
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+// Cost of an operation.
+struct MicroResult {
+  std::string Operation;
+  unsigned Size = 0;
+  double Nanoseconds = 0;
+  double Bytes = 0;
+};
+
+}
+
+// Keeps the compiler from discarding the computation of v.
+template <typename T>
+static void keep(const T& v) {
+  asm volatile("" : : "r"(&v) : "memory");
+}
+
+// Measures op, which runs opsPerCall operations, repeating it for at least
+// MinTime seconds.
+static MicroResult measure(StringRef Operation, unsigned Size,
+                           unsigned opsPerCall, std::function<void()> op) {
+  MicroResult result;
+  result.Operation = Operation.str();
+  result.Size = Size;
+  op(); // Warm up the caches and the allocator.
+  uint64_t calls = 0;
+  uint64_t bytes = AllocatedBytes.load();
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed(0);
+  // Check the clock every batch of calls, doubling the batch until the
+  // clock is negligible.
+  for (uint64_t batch = 1; elapsed.count() < MinTime; batch *= 2) {
+    for (uint64_t i = 0; i < batch; i++) op();
+    calls += batch;
+    elapsed = std::chrono::steady_clock::now() - start;
+  }
+  double ops = double(calls) * opsPerCall;
+  result.Nanoseconds = elapsed.count() * 1e9 / ops;
+  result.Bytes = (AllocatedBytes.load() - bytes) / ops;
+  return result;
+}
+
+static bool isSelected(StringRef Operation) {
+  return Filter.empty() || Operation.contains(Filter);
+}
+
+// Measures the lattice operations ops (name, binary operation) over all the
+// pairs of values.
+template <typename T>
+static void measureLattice(StringRef Prefix, const std::vector<T>& values,
+    const std::vector<std::pair<const char*,
+                                std::function<T(const T&, const T&)>>>& ops,
+    std::vector<MicroResult>& results) {
+  for (const auto& op : ops) {
+    std::string name = Prefix.str() + "." + op.first;
+    if (!isSelected(name)) continue;
+    auto& f = op.second;
+    results.push_back(measure(name, values.size(),
+        values.size() * values.size(), [&]() {
+      for (const T& a : values) {
+        for (const T& b : values) keep(f(a, b));
+      }
+    }));
+  }
+}
+
+static void measureMultiplierValue(std::vector<MicroResult>& results) {
+  std::vector<MultiplierValue> values;
+  for (MultiplierValueType t : {MultiplierValueType::BOT,
+                                MultiplierValueType::ZERO,
+                                MultiplierValueType::ONE,
+                                MultiplierValueType::NEGONE,
+                                MultiplierValueType::TOP}) {
+    values.push_back(MultiplierValue(t));
+    values.push_back(MultiplierValue(t, /*isBool=*/true));
+  }
+  typedef MultiplierValue V;
+  measureLattice<V>("MultiplierValue", values, {
+      {"join", [](const V& a, const V& b) { return a.join(b); }},
+      {"add", [](const V& a, const V& b) { return a + b; }},
+      {"mul", [](const V& a, const V& b) { return a * b; }},
+      {"and", [](const V& a, const V& b) { return a && b; }},
+      {"eq", [](const V& a, const V& b) { return eq(a, b); }},
+  }, results);
+}
+
+static void measureBSizeDependenceValue(const Value* k,
+                                        std::vector<MicroResult>& results) {
+  std::vector<BSizeDependenceValue> values;
+  for (BSizeDependenceValueType t : {BSizeDependenceValueType::BOT,
+                                     BSizeDependenceValueType::CONST,
+                                     BSizeDependenceValueType::TID,
+                                     BSizeDependenceValueType::BID,
+                                     BSizeDependenceValueType::BSIZE,
+                                     BSizeDependenceValueType::BIDBSIZE,
+                                     BSizeDependenceValueType::B_CONST,
+                                     BSizeDependenceValueType::B_BSIZE,
+                                     BSizeDependenceValueType::TOP}) {
+    values.push_back(BSizeDependenceValue(t));
+    values.push_back(BSizeDependenceValue(t, /*isNegative=*/true, k));
+  }
+  typedef BSizeDependenceValue V;
+  measureLattice<V>("BSizeDependenceValue", values, {
+      {"join", [](const V& a, const V& b) { return a.join(b); }},
+      {"sum", [k](const V& a, const V& b) { return abstractSum(a, b, k); }},
+      {"prod", [k](const V& a, const V& b) { return abstractProd(a, b, k); }},
+      {"and", [](const V& a, const V& b) { return a && b; }},
+      {"rel", [](const V& a, const V& b) { return abstractRel(a, b); }},
+  }, results);
+}
+
+// Measures the operations of states of type StateT with the first size keys,
+// values[i] being the value of keys[i] in the first state and other[i] in
+// the second one.
+template <typename StateT, typename T>
+static void measureState(StringRef Prefix, ArrayRef<const Value*> keys,
+                         const std::vector<T>& values,
+                         const std::vector<T>& other,
+                         std::vector<MicroResult>& results) {
+  unsigned size = keys.size();
+  StateT st1, st2;
+  for (unsigned i = 0; i < size; i++) {
+    st1.setValue(keys[i], values[i % values.size()]);
+    st2.setValue(keys[i], other[i % other.size()]);
+  }
+  StateT st3 = st1;
+  auto run = [&](StringRef op, unsigned opsPerCall,
+                 std::function<void()> f) {
+    std::string name = Prefix.str() + "." + op.str();
+    if (isSelected(name)) results.push_back(measure(name, size, opsPerCall, f));
+  };
+  run("copy", 1, [&]() {
+    StateT copy = st1;
+    keep(copy);
+  });
+  run("mergeState", 1, [&]() { keep(st1.mergeState(st2)); });
+  // Equal states, which are compared entry by entry.
+  run("operator==", 1, [&]() { keep(st1 == st3); });
+  run("getValue", size, [&]() {
+    for (const Value* key : keys) keep(st1.getValue(key));
+  });
+  run("setValue", size, [&]() {
+    for (unsigned i = 0; i < size; i++) {
+      st3.setValue(keys[i], values[(i + 1) % values.size()]);
+    }
+  });
+}
+
+// Reads the baseline in Path, by operation and size. Returns false on error.
+static bool readBaseline(StringRef Path,
+    std::map<std::pair<std::string, unsigned>, MicroResult>& results) {
+  auto bufferOrErr = MemoryBuffer::getFile(Path, /*IsText=*/true);
+  if (std::error_code EC = bufferOrErr.getError()) {
+    errs() << "drano-microbench: " << Path << ": " << EC.message() << "\n";
+    return false;
+  }
+  SmallVector<StringRef, 0> lines;
+  (*bufferOrErr)->getBuffer().split(lines, '\n', -1, /*KeepEmpty=*/false);
+  for (StringRef line : lines) {
+    SmallVector<StringRef, 4> fields;
+    line.split(fields, '\t');
+    MicroResult result;
+    if (fields.size() != 4 || fields[1].getAsInteger(10, result.Size) ||
+        fields[2].getAsDouble(result.Nanoseconds) ||
+        fields[3].getAsDouble(result.Bytes)) {
+      errs() << "drano-microbench: " << Path << ": malformed line: " << line
+             << "\n";
+      return false;
+    }
+    result.Operation = fields[0].str();
+    results[std::make_pair(result.Operation, result.Size)] = result;
+  }
+  return true;
+}
+
+static bool writeBaseline(StringRef Path, ArrayRef<MicroResult> Results) {
+  std::error_code EC;
+  raw_fd_ostream out(Path, EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << "drano-microbench: " << Path << ": " << EC.message() << "\n";
+    return false;
+  }
+  for (const MicroResult& result : Results) {
+    out << result.Operation << "\t" << result.Size << "\t"
+        << format("%.3f\t%.3f", result.Nanoseconds, result.Bytes) << "\n";
+  }
+  return true;
+}
+
+// Prints the regressions of Results over the baseline. Returns the number of
+// regressions.
+static unsigned compareWithBaseline(ArrayRef<MicroResult> Results,
+    const std::map<std::pair<std::string, unsigned>, MicroResult>& base,
+    raw_ostream& os) {
+  unsigned regressions = 0;
+  for (const MicroResult& result : Results) {
+    auto it = base.find(std::make_pair(result.Operation, result.Size));
+    if (it == base.end()) continue;
+    const MicroResult& old = it->second;
+    if (result.Nanoseconds > old.Nanoseconds * (1 + Threshold / 100)) {
+      os << "Regression: " << result.Operation << " " << result.Size
+         << format(" %.3f -> %.3f ns/op (%+.1f%%)", old.Nanoseconds,
+                   result.Nanoseconds,
+                   100 * (result.Nanoseconds - old.Nanoseconds) /
+                       old.Nanoseconds)
+         << "\n";
+      regressions++;
+    }
+    // Allocations do not depend on the machine; any growth is a regression.
+    if (result.Bytes > old.Bytes + 0.5) {
+      os << "Regression: " << result.Operation << " " << result.Size
+         << format(" %.1f -> %.1f bytes/op", old.Bytes, result.Bytes) << "\n";
+      regressions++;
+    }
+  }
+  return regressions;
+}
+
+int main(int argc, char** argv) {
+  InitLLVM X(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv,
+      "Micro-benchmarks of the abstract values and states of GPU Drano\n");
+
+  std::vector<unsigned> sizes(Sizes.begin(), Sizes.end());
+  if (sizes.empty()) sizes = {10, 100, 1000, 10000, 100000};
+  unsigned maxSize = *std::max_element(sizes.begin(), sizes.end());
+
+  // Synthetic keys; the states only compare and order their addresses.
+  LLVMContext Context;
+  Module M("drano-microbench", Context);
+  std::vector<const Value*> keys;
+  for (unsigned i = 0; i < std::max(maxSize, 1u); i++) {
+    keys.push_back(new GlobalVariable(M, Type::getInt32Ty(Context),
+        /*isConstant=*/false, GlobalValue::CommonLinkage, nullptr,
+        "g" + std::to_string(i)));
+  }
+
+  std::vector<MicroResult> results;
+  measureMultiplierValue(results);
+  measureBSizeDependenceValue(keys[0], results);
+  std::vector<MultiplierValue> multipliers = {
+      MultiplierValue(MultiplierValueType::ZERO),
+      MultiplierValue(MultiplierValueType::ONE),
+      MultiplierValue(MultiplierValueType::TOP)};
+  std::vector<MultiplierValue> otherMultipliers = {
+      MultiplierValue(MultiplierValueType::ZERO),
+      MultiplierValue(MultiplierValueType::NEGONE)};
+  std::vector<BSizeDependenceValue> dependences = {
+      BSizeDependenceValue(BSizeDependenceValueType::CONST),
+      BSizeDependenceValue(BSizeDependenceValueType::TID),
+      BSizeDependenceValue(BSizeDependenceValueType::BIDBSIZE)};
+  std::vector<BSizeDependenceValue> otherDependences = {
+      BSizeDependenceValue(BSizeDependenceValueType::CONST),
+      BSizeDependenceValue(BSizeDependenceValueType::BSIZE)};
+  for (unsigned size : sizes) {
+    ArrayRef<const Value*> stateKeys = makeArrayRef(keys).take_front(size);
+    measureState<GPUState>("GPUState", stateKeys, multipliers,
+                           otherMultipliers, results);
+    measureState<BSizeGPUState>("BSizeGPUState", stateKeys, dependences,
+                                otherDependences, results);
+  }
+
+  std::error_code EC;
+  ToolOutputFile Out(OutputFilename, EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << "drano-microbench: " << OutputFilename << ": " << EC.message()
+           << "\n";
+    return 1;
+  }
+  raw_ostream& os = Out.os();
+  os << format("%-32s %8s %12s %12s\n", (const char*)"Operation",
+               (const char*)"Size", (const char*)"ns/op",
+               (const char*)"bytes/op");
+  for (const MicroResult& result : results) {
+    os << format("%-32s %8u %12.2f %12.1f\n", result.Operation.c_str(),
+                 result.Size, result.Nanoseconds, result.Bytes);
+  }
+  Out.keep();
+
+  if (!BaselineOut.empty() && !writeBaseline(BaselineOut, results)) return 1;
+  if (!Baseline.empty()) {
+    std::map<std::pair<std::string, unsigned>, MicroResult> base;
+    if (!readBaseline(Baseline, base)) return 1;
+    if (compareWithBaseline(results, base, errs()) > 0) return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,126 @@
+//===- drano-client.cpp - Client of the drano analysis server -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// drano-client sends a device module to a running server (drano -serve) and
+// prints the results the same way opt does, e.g.
+//   drano-client -interproc-uncoalesced-analysis < kernel.ll > /dev/null \
+//       2> gpuDranoResults.txt
+// Results of each kernel are printed as soon as the server has analyzed it.
+// Interrupting the client cancels the request on the server.
+//===----------------------------------------------------------------------===//
+
+#include "DranoProtocol.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static cl::opt<std::string> InputFilename(cl::Positional,
+    cl::desc("<input .ll/.bc file>"), cl::init("-"));
+
+static cl::opt<std::string> SocketPath("socket",
+    cl::desc("Socket of the server (default: drano-<uid>.sock in the "
+             "temporary directory)"),
+    cl::value_desc("path"), cl::init(""));
+
+static cl::opt<bool> Uncoalesced("interproc-uncoalesced-analysis",
+    cl::desc("Run the uncoalesced access analysis (default)"));
+
+static cl::opt<bool> BSI("interproc-bsize-invariance-analysis",
+    cl::desc("Run the block-size invariance analysis"));
+
+static cl::opt<bool> PrintTimings("print-timings",
+    cl::desc("Print the time spent on the module and on each kernel"));
+
+// Builds the request for the input. Files are sent by path, so that the
+// server can map them and load bitcode lazily; standard input is sent as a
+// buffer.
+static bool buildRequest(std::string& request) {
+  CacheWriter W;
+  W.writeU8((Uncoalesced || !BSI ? DranoAnalysisUncoalesced : 0) |
+            (BSI ? DranoAnalysisBSI : 0));
+  if (InputFilename == "-") {
+    auto bufferOrErr = MemoryBuffer::getSTDIN();
+    if (std::error_code EC = bufferOrErr.getError()) {
+      errs() << "drano-client: <stdin>: " << EC.message() << "\n";
+      return false;
+    }
+    W.writeU8(DranoInputBuffer);
+    W.writeString("<stdin>");
+    W.writeString((*bufferOrErr)->getBuffer());
+  } else {
+    SmallString<256> path(InputFilename);
+    if (std::error_code EC = sys::fs::make_absolute(path)) {
+      errs() << "drano-client: " << InputFilename << ": " << EC.message()
+             << "\n";
+      return false;
+    }
+    W.writeU8(DranoInputPath);
+    W.writeString(InputFilename);
+    W.writeString(path);
+  }
+  request = W.getBuffer();
+  if (request.size() > MaxDranoMessageSize) {
+    errs() << "drano-client: <stdin>: module too large to send, pass its "
+              "file instead\n";
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  InitLLVM X(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv,
+      "GPU Drano: client of the analysis server\n");
+
+  std::string request;
+  if (!buildRequest(request)) return 1;
+
+  std::string socketPath =
+      SocketPath.empty() ? getDefaultDranoSocketPath() : SocketPath;
+  sockaddr_un addr;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || !getDranoSocketAddress(socketPath, addr) ||
+      connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+    errs() << "drano-client: cannot connect to " << socketPath
+           << " (is drano -serve running?)\n";
+    return 1;
+  }
+  if (!sendDranoMessage(fd, request)) {
+    errs() << "drano-client: connection closed by the server\n";
+    close(fd);
+    return 1;
+  }
+
+  std::string response;
+  while (receiveDranoMessage(fd, response)) {
+    CacheReader R(response);
+    unsigned kind = R.readU8();
+    std::string text = R.readString();
+    if (R.hasError()) break;
+    if (kind == DranoResult) {
+      errs() << text;
+      errs().flush();
+    } else if (kind == DranoDone) {
+      if (PrintTimings) errs() << text;
+      close(fd);
+      return 0;
+    } else {
+      errs() << text;
+      close(fd);
+      return 1;
+    }
+  }
+  errs() << "drano-client: connection closed by the server\n";
+  close(fd);
+  return 1;
+}
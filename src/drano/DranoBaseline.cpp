@@ -0,0 +1,227 @@
+#include "DranoBaseline.h"
+
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/GlobalValue.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/FileSystem.h"
+
+using namespace llvm;
+
+// Baseline file layout:
+//   string "drano-baseline", u32 version
+//   u32 #modules
+//   for each module: string filename, u32 #findings,
+//     (string key, string printed finding)*
+//   u32 #summaries
+//   for each summary: string cache key, string cache entry
+
+static const char* const BaselineMagic = "drano-baseline";
+
+// Returns the provenance of I: its opcode, and the object and type it
+// accesses (or the function it calls).
+static std::string getProvenance(const Instruction* I) {
+  std::string provenance;
+  raw_string_ostream os(provenance);
+  os << I->getOpcodeName();
+  const Value* p = nullptr;
+  const Type* type = nullptr;
+  if (const LoadInst* LI = dyn_cast<LoadInst>(I)) {
+    p = LI->getPointerOperand();
+    type = LI->getType();
+  } else if (const StoreInst* SI = dyn_cast<StoreInst>(I)) {
+    p = SI->getPointerOperand();
+    type = SI->getValueOperand()->getType();
+  } else if (const CallInst* CI = dyn_cast<CallInst>(I)) {
+    const Function* calledF = CI->getCalledFunction();
+    if (calledF && calledF->hasName()) os << " @" << calledF->getName();
+  }
+  if (p) {
+    const Value* base = getUnderlyingObject(p);
+    if (const Argument* A = dyn_cast<Argument>(base)) {
+      os << " arg" << A->getArgNo();
+    } else if (const GlobalValue* G = dyn_cast<GlobalValue>(base)) {
+      os << " @" << G->getName();
+    } else if (isa<AllocaInst>(base)) {
+      os << " alloca";
+    } else if (const CallInst* CI = dyn_cast<CallInst>(base)) {
+      const Function* calledF = CI->getCalledFunction();
+      os << " call" << (calledF ? " @" + calledF->getName().str() : "");
+    } else {
+      os << " " << (isa<Instruction>(base) ?
+          cast<Instruction>(base)->getOpcodeName() : "value");
+    }
+  }
+  if (type) os << " " << *type;
+  return os.str();
+}
+
+std::string AccessFingerprinter::getFingerprint(const Instruction* I) {
+  auto it = Fingerprints_.find(I);
+  if (it != Fingerprints_.end()) return it->second;
+  // Number the instructions of the function with the same provenance, in
+  // order.
+  const Function* F = I->getFunction();
+  std::map<std::string, unsigned> counts;
+  for (const_inst_iterator iit = inst_begin(F), iite = inst_end(F);
+                                                     iit != iite; ++iit) {
+    std::string provenance = getProvenance(&*iit);
+    unsigned n = counts[provenance]++;
+    Fingerprints_[&*iit] = F->getName().str() + ":" + provenance + "#" +
+                           std::to_string(n);
+  }
+  return Fingerprints_.at(I);
+}
+
+std::string AccessFingerprinter::getFingerprint(const AccessTrace& trace) {
+  std::string fingerprint;
+  for (unsigned i = 0; i < trace.size(); i++) {
+    if (i > 0) fingerprint += " @ ";
+    fingerprint += getFingerprint(trace[i]);
+  }
+  return fingerprint;
+}
+
+bool RecordingSummaryStore::lookup(StringRef key, std::string& contents) {
+  if (!Store_.lookup(key, contents)) return false;
+  std::lock_guard<std::mutex> lock(mutex_);
+  UsedKeys_.insert(key.str());
+  return true;
+}
+
+void RecordingSummaryStore::store(StringRef key, const std::string& contents) {
+  Store_.store(key, contents);
+  std::lock_guard<std::mutex> lock(mutex_);
+  UsedKeys_.insert(key.str());
+}
+
+std::map<std::string, std::string> RecordingSummaryStore::getUsedEntries() {
+  std::set<std::string> keys;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    keys = UsedKeys_;
+  }
+  std::map<std::string, std::string> entries;
+  for (const std::string& key : keys) {
+    std::string contents;
+    if (Store_.lookup(key, contents)) entries.emplace(key, contents);
+  }
+  return entries;
+}
+
+static const char* getAnalysisName(DranoAnalysisFlags Analysis) {
+  return Analysis == DranoAnalysisBSI ? "bsi" : "uncoalesced";
+}
+
+// Returns the findings of report, by key.
+static std::map<std::string, std::string> getFindings(
+    const ModuleReport& report) {
+  std::map<std::string, std::string> findings;
+  for (const DranoFinding& finding : report.Findings) {
+    std::string name = getAnalysisName(finding.Analysis);
+    findings.emplace(name + " " + finding.Kernel + " " + finding.Fingerprint,
+                     name + " " + finding.Kernel + ": " + finding.Text);
+  }
+  return findings;
+}
+
+bool DranoBaseline::read(StringRef Path, SummaryStore& Store) {
+  std::string contents;
+  if (!readCacheEntry(Path, contents)) {
+    errs() << "drano: cannot read baseline " << Path << "\n";
+    return false;
+  }
+  CacheReader R(contents);
+  if (R.readString() != BaselineMagic ||
+      R.readU32() != DRANO_BASELINE_VERSION) {
+    errs() << "drano: " << Path << ": not a baseline of this version of "
+           << "drano\n";
+    return false;
+  }
+  uint32_t numModules = R.readU32();
+  for (uint32_t m = 0; m < numModules && !R.hasError(); m++) {
+    auto& findings = Findings_[R.readString()];
+    uint32_t numFindings = R.readU32();
+    for (uint32_t i = 0; i < numFindings && !R.hasError(); i++) {
+      std::string key = R.readString();
+      findings[key] = R.readString();
+    }
+  }
+  uint32_t numEntries = R.readU32();
+  for (uint32_t i = 0; i < numEntries && !R.hasError(); i++) {
+    std::string key = R.readString();
+    std::string entry = R.readString();
+    if (!R.hasError()) Store.store(key, entry);
+  }
+  if (R.hasError()) {
+    errs() << "drano: malformed baseline " << Path << "\n";
+    return false;
+  }
+  return true;
+}
+
+unsigned DranoBaseline::printDiff(ArrayRef<ModuleReport> Reports,
+                                  raw_ostream& os) const {
+  static const std::map<std::string, std::string> NoFindings;
+  unsigned added = 0, removed = 0;
+  for (const ModuleReport& report : Reports) {
+    if (!report.Error.empty()) continue;
+    std::map<std::string, std::string> findings = getFindings(report);
+    auto it = Findings_.find(report.Filename);
+    const auto& baseline = it != Findings_.end() ? it->second : NoFindings;
+    std::string diff;
+    raw_string_ostream diffOS(diff);
+    for (const auto& pair : findings) {
+      if (baseline.count(pair.first)) continue;
+      diffOS << "  + " << pair.second << "\n";
+      added++;
+    }
+    for (const auto& pair : baseline) {
+      if (findings.count(pair.first)) continue;
+      diffOS << "  - " << pair.second << "\n";
+      removed++;
+    }
+    if (!diffOS.str().empty()) {
+      os << "Module: " << report.Filename << "\n" << diffOS.str();
+    }
+  }
+  os << "Findings: " << added << " added, " << removed << " removed\n";
+  return added;
+}
+
+bool llvm::writeDranoBaseline(StringRef Path, ArrayRef<ModuleReport> Reports,
+                              RecordingSummaryStore& Store) {
+  CacheWriter W;
+  W.writeString(BaselineMagic);
+  W.writeU32(DRANO_BASELINE_VERSION);
+  uint32_t numModules = 0;
+  for (const ModuleReport& report : Reports) {
+    if (report.Error.empty()) numModules++;
+  }
+  W.writeU32(numModules);
+  for (const ModuleReport& report : Reports) {
+    if (!report.Error.empty()) continue;
+    std::map<std::string, std::string> findings = getFindings(report);
+    W.writeString(report.Filename);
+    W.writeU32(findings.size());
+    for (const auto& pair : findings) {
+      W.writeString(pair.first);
+      W.writeString(pair.second);
+    }
+  }
+  std::map<std::string, std::string> entries = Store.getUsedEntries();
+  W.writeU32(entries.size());
+  for (const auto& entry : entries) {
+    W.writeString(entry.first);
+    W.writeString(entry.second);
+  }
+
+  std::error_code EC;
+  raw_fd_ostream out(Path, EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << "drano: " << Path << ": " << EC.message() << "\n";
+    return false;
+  }
+  out << W.getBuffer();
+  return true;
+}
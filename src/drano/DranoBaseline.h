@@ -0,0 +1,102 @@
+//===- DranoBaseline.h - Comparison of drano results with a baseline -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// For continuous integration, drano compares its findings with those of a
+// previous run:
+//   drano -analysis=all -drano-baseline-out=base.drb *.ll       (old commit)
+//   drano -analysis=all -drano-baseline=base.drb *.ll           (new commit)
+// A baseline holds the findings of each module keyed by a fingerprint that
+// does not depend on debug locations: the name of the enclosing function
+// and the provenance of the access (opcode, accessed object and type,
+// numbered among accesses of the same function with the same provenance),
+// for the access and each call site through which it is reached. It also
+// holds the summaries used by the run, keyed by the structural hash of each
+// function, so that functions that did not change are not analyzed again.
+// With -drano-baseline, drano prints the added and removed findings instead
+// of all findings, and exits with code 2 if there are added findings.
+//===----------------------------------------------------------------------===//
+
+#ifndef DRANO_BASELINE_H
+#define DRANO_BASELINE_H
+
+#include "DranoDriver.h"
+#include "SummaryCache.h"
+#include "UncoalescedAnalysis.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+// Version of the baseline file format.
+#define DRANO_BASELINE_VERSION 1
+
+namespace llvm {
+
+// Computes fingerprints of findings.
+class AccessFingerprinter {
+ public:
+  // Returns the fingerprint of the access (or call) I.
+  std::string getFingerprint(const Instruction* I);
+
+  // Returns the fingerprint of an access reached through a chain of calls.
+  std::string getFingerprint(const AccessTrace& trace);
+
+ private:
+  // Map from instructions to their fingerprints, filled for a whole
+  // function at a time.
+  std::map<const Instruction*, std::string> Fingerprints_;
+};
+
+// Summary store recording the keys of the summaries used in a run.
+class RecordingSummaryStore : public SummaryStore {
+ public:
+  explicit RecordingSummaryStore(SummaryStore& Store) : Store_(Store) {}
+
+  bool lookup(StringRef key, std::string& contents) override;
+  void store(StringRef key, const std::string& contents) override;
+
+  // Returns the summaries found or stored in this run, by key.
+  std::map<std::string, std::string> getUsedEntries();
+
+ private:
+  SummaryStore& Store_;
+  std::mutex mutex_;
+  std::set<std::string> UsedKeys_;
+};
+
+// Findings of a previous run.
+class DranoBaseline {
+ public:
+  // Reads the baseline in Path and adds its summaries to Store. Returns
+  // false on error.
+  bool read(StringRef Path, SummaryStore& Store);
+
+  // Prints the findings of Reports that are not in the baseline and the
+  // findings of the baseline that are no longer found (for the modules in
+  // Reports). Returns the number of added findings.
+  unsigned printDiff(ArrayRef<ModuleReport> Reports, raw_ostream& os) const;
+
+ private:
+  // Map from modules to the printed findings, by key.
+  std::map<std::string, std::map<std::string, std::string>> Findings_;
+};
+
+// Writes a baseline with the findings of Reports and the summaries used in
+// this run. Returns false on error.
+bool writeDranoBaseline(StringRef Path, ArrayRef<ModuleReport> Reports,
+                        RecordingSummaryStore& Store);
+
+}
+
+#endif /* DranoBaseline.h */
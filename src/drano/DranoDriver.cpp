@@ -0,0 +1,223 @@
+#include "DranoDriver.h"
+
+#include "DranoBaseline.h"
+#include "DranoReport.h"
+#include "EntryPoints.h"
+#include "InterprocBSIAnalysisPass.h"
+#include "InterprocUncoalescedAnalysisPass.h"
+
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+
+#include <chrono>
+
+using namespace llvm;
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+KernelTiming& ModuleReport::getKernelTiming(StringRef Name) {
+  auto it = KernelIndex.find(Name.str());
+  if (it != KernelIndex.end()) return Kernels[it->second];
+  KernelIndex.emplace(Name.str(), Kernels.size());
+  Kernels.push_back(KernelTiming());
+  Kernels.back().Name = Name.str();
+  return Kernels.back();
+}
+
+void ModuleReport::printTimings(unsigned Analyses, raw_ostream& os) const {
+  os << "Module: " << Filename << format("  parse %.3f", ParseTime);
+  if (Analyses & DranoAnalysisUncoalesced) {
+    os << format("  uncoalesced %.3f", UncoalescedTime);
+  }
+  if (Analyses & DranoAnalysisBSI) {
+    os << format("  bsi %.3f", BSITime);
+  }
+  os << "\n";
+  for (const KernelTiming& kernel : Kernels) {
+    os << "  Kernel: " << kernel.Name;
+    if (Analyses & DranoAnalysisUncoalesced) {
+      os << format("  uncoalesced %.3f", kernel.UncoalescedTime);
+    }
+    if (Analyses & DranoAnalysisBSI) {
+      os << format("  bsi %.3f", kernel.BSITime);
+    }
+    os << "\n";
+  }
+}
+
+std::set<const Function*> llvm::getNamedFunctions(const Module& M,
+    ArrayRef<std::string> Names) {
+  std::set<const Function*> functions;
+  for (const std::string& name : Names) {
+    const Function* F = M.getFunction(name);
+    if (F && !F->isDeclaration()) functions.insert(F);
+  }
+  return functions;
+}
+
+std::set<const Function*> llvm::getDranoEntryPoints(const Module& M) {
+  std::vector<std::string> names = getUncoalescedEntryPointNames();
+  std::vector<std::string> bsiNames = getBSIEntryPointNames();
+  names.insert(names.end(), bsiNames.begin(), bsiNames.end());
+  std::set<const Function*> entries = getKernels(M);
+  std::set<const Function*> named = getNamedFunctions(M, names);
+  entries.insert(named.begin(), named.end());
+  return entries;
+}
+
+// Materializes the bodies of the functions reachable from the entry points
+// of M (or from the functions returned by GetRoots, if provided). Other
+// functions are turned into declarations, without reading their bodies if M
+// is loaded lazily, since the analyses never look at them. Modules without
+// entry points are materialized entirely (see getEntryPoints).
+static Error materializeReachableFunctions(Module& M, RootSelector GetRoots) {
+  if (Error E = M.materializeMetadata()) return E;
+  std::set<const Function*> entries =
+      GetRoots ? GetRoots(M) : getDranoEntryPoints(M);
+  if (entries.empty()) return M.materializeAll();
+
+  std::set<const Function*> visited;
+  std::vector<const Function*> stack(entries.begin(), entries.end());
+  while (!stack.empty()) {
+    Function* F = const_cast<Function*>(stack.back());
+    stack.pop_back();
+    if (!visited.insert(F).second) continue;
+    if (Error E = F->materialize()) return E;
+    for (const Function* G : getReferencedFunctions(F)) stack.push_back(G);
+  }
+  for (Function& F : M) {
+    if (!F.isDeclaration() && !visited.count(&F)) F.deleteBody();
+  }
+  return Error::success();
+}
+
+static bool isBitcodeBuffer(const MemoryBuffer& Buffer) {
+  return isBitcode(
+      reinterpret_cast<const unsigned char*>(Buffer.getBufferStart()),
+      reinterpret_cast<const unsigned char*>(Buffer.getBufferEnd()));
+}
+
+std::unique_ptr<Module> llvm::loadModule(StringRef Filename,
+                                         LLVMContext& Context,
+                                         SMDiagnostic& Err,
+                                         RootSelector GetRoots) {
+  auto bufferOrErr = MemoryBuffer::getFileOrSTDIN(Filename, /*IsText=*/false,
+      /*RequiresNullTerminator=*/false);
+  if (std::error_code EC = bufferOrErr.getError()) {
+    Err = SMDiagnostic(Filename, SourceMgr::DK_Error, EC.message());
+    return nullptr;
+  }
+  // The memory-mapped buffer of a file is not null-terminated, so textual IR
+  // is read again by the IR parser. Standard input can only be read once,
+  // but it is read into a null-terminated copy, which is parsed as is.
+  if (!isBitcodeBuffer(**bufferOrErr) && Filename != "-") {
+    std::unique_ptr<Module> M = parseIRFile(Filename, Err, Context);
+    if (M) cantFail(materializeReachableFunctions(*M, GetRoots));
+    return M;
+  }
+  return loadModule(std::move(*bufferOrErr), Context, Err, GetRoots);
+}
+
+std::unique_ptr<Module> llvm::loadModule(std::unique_ptr<MemoryBuffer> Buffer,
+                                         LLVMContext& Context,
+                                         SMDiagnostic& Err,
+                                         RootSelector GetRoots) {
+  if (!isBitcodeBuffer(*Buffer)) {
+    std::unique_ptr<Module> M = parseIR(Buffer->getMemBufferRef(), Err,
+                                        Context);
+    if (M) cantFail(materializeReachableFunctions(*M, GetRoots));
+    return M;
+  }
+  std::string Filename = Buffer->getBufferIdentifier().str();
+  Expected<std::unique_ptr<Module>> M =
+      getOwningLazyBitcodeModule(std::move(Buffer), Context);
+  Error E = M ? materializeReachableFunctions(**M, GetRoots) : M.takeError();
+  if (E) {
+    Err = SMDiagnostic(Filename, SourceMgr::DK_Error, toString(std::move(E)));
+    return nullptr;
+  }
+  return std::move(*M);
+}
+
+bool llvm::analyzeModule(Module& M, unsigned Analyses, ModuleReport& report,
+                         SummaryStore* Store, KernelResultCallback OnKernel) {
+  bool completed = true;
+  // Records the results of a kernel and passes them to OnKernel.
+  auto addKernelResults = [&](DranoAnalysisFlags Analysis, StringRef Kernel,
+                              const std::string& results) {
+    report.Results += results;
+    if (OnKernel && !OnKernel(Analysis, Kernel, results)) completed = false;
+    return completed;
+  };
+
+  AccessFingerprinter fingerprinter;
+
+  if (Analyses & DranoAnalysisUncoalesced) {
+    auto start = std::chrono::steady_clock::now();
+    CallGraph CG(M);
+    // Records the timing and the printed results of the top-most function F.
+    auto addRootResults = [&](const InterprocUncoalescedResult& result,
+                              const Function* F) {
+      report.getKernelTiming(F->getName()).UncoalescedTime =
+          result.AnalysisTimeMap.at(F);
+      std::string results;
+      raw_string_ostream os(results);
+      result.printRoot(F, os);
+      return addKernelResults(DranoAnalysisUncoalesced, F->getName(),
+                              os.str());
+    };
+    if (isUncoalescedStreamingEnabled()) {
+      // Findings are collected from the results of each function, which
+      // are then freed.
+      streamInterprocUncoalescedAnalysis(M, CG,
+          [&](const InterprocUncoalescedResult& result, const Function* F) {
+            if (report.CollectFindings) {
+              addUncoalescedFindings(result, fingerprinter, report);
+            }
+            return result.Roots.empty() || addRootResults(result, F);
+          },
+          nullptr, Store);
+      report.UncoalescedTime = secondsSince(start);
+    } else {
+      InterprocUncoalescedResult result = runInterprocUncoalescedAnalysis(M,
+          CG, nullptr, Store, addRootResults);
+      report.UncoalescedTime = secondsSince(start);
+      if (report.CollectFindings) {
+        addUncoalescedFindings(result, fingerprinter, report);
+      }
+    }
+    if (!completed) return false;
+  }
+  if (Analyses & DranoAnalysisBSI) {
+    // The block-size invariance analysis checks shared memory accesses
+    // within a kernel body, so callees are inlined first (as with
+    // opt -always-inline). This runs after the uncoalesced access analysis,
+    // which reports accesses at their original locations.
+    auto start = std::chrono::steady_clock::now();
+    legacy::PassManager PM;
+    PM.add(createAlwaysInlinerLegacyPass());
+    PM.run(M);
+    CallGraph CG(M);
+    InterprocBSIResult result = runInterprocBSIAnalysis(M, CG, nullptr, Store,
+        [&](const InterprocBSIResult& result, const Function* F) {
+          if (!result.EntryPoints.count(F)) return true;
+          report.getKernelTiming(F->getName()).BSITime =
+              result.AnalysisTimeMap.at(F);
+          std::string results;
+          raw_string_ostream os(results);
+          result.printFunction(F, os);
+          return addKernelResults(DranoAnalysisBSI, F->getName(), os.str());
+        });
+    report.BSITime = secondsSince(start);
+    if (report.CollectFindings) addBSIFindings(result, fingerprinter, report);
+  }
+  return completed;
+}
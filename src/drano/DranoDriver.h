@@ -0,0 +1,196 @@
+//===- DranoDriver.h - Loading and analysis of modules in drano -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// Functions shared by the batch and server modes of drano: loading a device
+// module (lazily for bitcode) and running the analyses on it.
+//===----------------------------------------------------------------------===//
+
+#ifndef DRANO_DRIVER_H
+#define DRANO_DRIVER_H
+
+#include "DranoProtocol.h"
+#include "SummaryCache.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace llvm {
+
+// Time spent on a kernel by each analysis (in seconds).
+struct KernelTiming {
+  std::string Name;
+  double UncoalescedTime = 0;
+  double BSITime = 0;
+};
+
+// Source location of an instruction (empty file if unknown).
+struct DranoSourceLocation {
+  std::string File;
+  unsigned Line = 0;
+  unsigned Column = 0;
+
+  // Compilation directory, for relative file names.
+  std::string Directory;
+};
+
+// A finding of an analysis (see DranoReport.h).
+struct DranoFinding {
+  DranoAnalysisFlags Analysis;
+  std::string Kernel;
+
+  // Location of the definition of the kernel.
+  DranoSourceLocation KernelLocation;
+
+  // Identifies the finding independently of debug locations (see
+  // DranoBaseline.h).
+  std::string Fingerprint;
+
+  // Location of the finding as printed in the results.
+  std::string Text;
+
+  DranoSourceLocation Location;
+
+  // Locations of the call sites through which the access is reached from
+  // the kernel (innermost call first).
+  std::vector<DranoSourceLocation> CallSites;
+
+  // Demangled name of the function containing the access.
+  std::string Function;
+
+  // "load", "store" or "call".
+  std::string AccessType;
+
+  // Address space of the accessed pointer (loads and stores).
+  unsigned AddressSpace = 0;
+
+  // Multiplier of thread ID in the address (uncoalesced accesses), or
+  // reasons of the dependence (block-size dependent accesses).
+  std::string AbstractValue;
+
+  // Size of the accessed elements in bytes (0 if unknown).
+  uint64_t ElementSize = 0;
+
+  // Thread dimensions ("x", "y", "z") in which the finding holds.
+  std::vector<std::string> Dimensions;
+
+  // Estimated cost per warp request of uncoalesced accesses (see
+  // TransactionCost in UncoalescedAnalysis.h).
+  bool HasCost = false;
+  bool Gather = false;
+  unsigned Sectors = 0;
+  unsigned Transactions = 0;
+  unsigned IdealSectors = 0;
+
+  // Loops enclosing the access and its call sites, and the estimated number
+  // of executions of the access per execution of the kernel (see Hotness.h).
+  unsigned LoopDepth = 0;
+  double ExecutionWeight = 1.0;
+
+  // Estimated memory traffic of the finding: the execution weight, times
+  // the sectors per warp request for uncoalesced accesses.
+  double getHotness() const {
+    return HasCost ? ExecutionWeight * Sectors : ExecutionWeight;
+  }
+
+  // Profile of the line of the access, if one was given (see
+  // DranoProfile.h).
+  bool Profiled = false;
+  bool ProfileHot = false;
+  double ProfileTraffic = 0;
+  double ProfileShare = 0;
+  double ProfileEfficiency = -1;
+};
+
+// Results of the analysis of a single module. Everything is kept as text,
+// since the module and its context are freed once it has been analyzed.
+struct ModuleReport {
+  std::string Filename;
+
+  // Load error (empty if the module was analyzed).
+  std::string Error;
+
+  // Results printed by the analyses.
+  std::string Results;
+
+  // Findings of the analyses, recorded if CollectFindings is set.
+  bool CollectFindings = false;
+  std::vector<DranoFinding> Findings;
+
+  // Time spent on loading and on each analysis (in seconds).
+  double ParseTime = 0;
+  double UncoalescedTime = 0;
+  double BSITime = 0;
+
+  // Timings of kernels, in the order they were analyzed.
+  std::vector<KernelTiming> Kernels;
+
+  KernelTiming& getKernelTiming(StringRef Name);
+
+  // Prints the timings of the module and its kernels for the analyses in
+  // the mask Analyses.
+  void printTimings(unsigned Analyses, raw_ostream& os) const;
+
+ private:
+  std::map<std::string, size_t> KernelIndex;
+};
+
+// Called with the printed results of each kernel (for the analysis in
+// Analysis) as soon as they are available. Returning false stops the
+// analysis.
+typedef std::function<bool(DranoAnalysisFlags Analysis, StringRef Kernel,
+                           StringRef Results)> KernelResultCallback;
+
+// Returns the functions of a module whose bodies must be loaded.
+typedef std::function<std::set<const Function*>(const Module&)> RootSelector;
+
+// Loads the module in Filename ("-" for standard input). Only the functions
+// reachable from the entry points are kept: bitcode is read from a
+// memory-mapped buffer and other functions are never materialized, while
+// textual IR is parsed entirely and other functions are dropped. If GetRoots
+// is provided, the entry points are the functions it returns instead of
+// those returned by getDranoEntryPoints.
+std::unique_ptr<Module> loadModule(StringRef Filename, LLVMContext& Context,
+                                   SMDiagnostic& Err,
+                                   RootSelector GetRoots = nullptr);
+
+// Loads the module in Buffer, which must be null-terminated if it holds
+// textual IR.
+std::unique_ptr<Module> loadModule(std::unique_ptr<MemoryBuffer> Buffer,
+                                   LLVMContext& Context, SMDiagnostic& Err,
+                                   RootSelector GetRoots = nullptr);
+
+// Returns the entry points of M used by the analyses: the kernels and the
+// functions named with -uncoalesced-entry-points and -bsi-entry-points.
+std::set<const Function*> getDranoEntryPoints(const Module& M);
+
+// Returns the functions defined in M that are named in Names.
+std::set<const Function*> getNamedFunctions(const Module& M,
+                                            ArrayRef<std::string> Names);
+
+// Runs the analyses in the mask Analyses on M and records their results and
+// timings in report. Summaries are cached in Store if provided. Returns false
+// if OnKernel stopped the analysis.
+bool analyzeModule(Module& M, unsigned Analyses, ModuleReport& report,
+                   SummaryStore* Store = nullptr,
+                   KernelResultCallback OnKernel = nullptr);
+
+}
+
+#endif /* DranoDriver.h */
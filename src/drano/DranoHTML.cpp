@@ -0,0 +1,275 @@
+#include "DranoHTML.h"
+
+#include "SourceOrder.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <cctype>
+#include <map>
+#include <set>
+
+using namespace llvm;
+
+// Number of colors of the heatmap.
+static const unsigned HeatLevels = 5;
+
+static const char* const StyleSheet =
+    "body{font-family:sans-serif;margin:1em}"
+    "table{border-collapse:collapse}"
+    "td{padding:0 .5em;vertical-align:top}"
+    "td.n{text-align:right;color:#888}"
+    "td.n a{color:inherit;text-decoration:none}"
+    "pre{margin:0}"
+    "td.a{font-size:85%}"
+    ".h1{background:#fff3e0}.h2{background:#ffe0b2}"
+    ".h3{background:#ffb74d}.h4{background:#ff8a65}";
+
+namespace {
+
+// Findings at a source line.
+struct LineAnnotation {
+  unsigned Uncoalesced = 0;
+  bool Gather = false;
+  unsigned Sectors = 0;
+  unsigned IdealSectors = 0;
+
+  unsigned BSI = 0;
+  std::set<std::string> BSIReasons;
+  bool Divergent = false;
+
+  // Findings reached through calls at this line.
+  unsigned CallSites = 0;
+
+  double Hotness = 0;
+
+  // Kernels reaching the findings, by demangled name.
+  std::map<std::string, DranoSourceLocation> Kernels;
+};
+
+// Findings of a source file.
+struct FileAnnotations {
+  std::map<unsigned, LineAnnotation> Lines;
+  double Hotness = 0;
+};
+
+}
+
+// Returns the path of the source file of location.
+static std::string getSourcePath(const DranoSourceLocation& location) {
+  if (location.Directory.empty() || sys::path::is_absolute(location.File)) {
+    return location.File;
+  }
+  SmallString<256> path(location.Directory);
+  sys::path::append(path, location.File);
+  return path.str().str();
+}
+
+// Returns the name of the page of the source file in path.
+static std::string getPageName(StringRef path) {
+  std::string name;
+  for (char c : path) name += isalnum(c) || c == '.' ? c : '_';
+  return name + ".html";
+}
+
+static std::string escapeHTML(StringRef text) {
+  std::string escaped;
+  for (char c : text) {
+    switch (c) {
+      case '<': escaped += "&lt;"; break;
+      case '>': escaped += "&gt;"; break;
+      case '&': escaped += "&amp;"; break;
+      case '"': escaped += "&quot;"; break;
+      default: escaped += c; break;
+    }
+  }
+  return escaped;
+}
+
+static unsigned getHeatLevel(double hotness, double maxHotness) {
+  if (hotness <= 0 || maxHotness <= 0) return 0;
+  return std::min(HeatLevels - 1,
+                  1 + unsigned((HeatLevels - 1) * hotness / maxHotness));
+}
+
+static void addFinding(std::map<std::string, FileAnnotations>& files,
+                       const DranoFinding& finding) {
+  std::string kernel = demangle(finding.Kernel.c_str());
+  if (!finding.Location.File.empty()) {
+    FileAnnotations& file = files[getSourcePath(finding.Location)];
+    LineAnnotation& line = file.Lines[finding.Location.Line];
+    if (finding.Analysis == DranoAnalysisBSI) {
+      line.BSI++;
+      StringRef reasons = finding.AbstractValue;
+      while (!reasons.empty()) {
+        StringRef reason;
+        std::tie(reason, reasons) = reasons.split('|');
+        line.BSIReasons.insert(reason.str());
+        if (reason == "path") line.Divergent = true;
+      }
+    } else {
+      line.Uncoalesced++;
+      if (finding.HasCost && (line.IdealSectors == 0 ||
+          double(finding.Sectors) / finding.IdealSectors >
+          double(line.Sectors) / line.IdealSectors)) {
+        line.Gather = finding.Gather;
+        line.Sectors = finding.Sectors;
+        line.IdealSectors = finding.IdealSectors;
+      }
+    }
+    line.Hotness += finding.getHotness();
+    file.Hotness += finding.getHotness();
+    line.Kernels.emplace(kernel, finding.KernelLocation);
+  }
+  for (const DranoSourceLocation& callSite : finding.CallSites) {
+    if (callSite.File.empty()) continue;
+    LineAnnotation& line =
+        files[getSourcePath(callSite)].Lines[callSite.Line];
+    line.CallSites++;
+    line.Kernels.emplace(kernel, finding.KernelLocation);
+  }
+}
+
+static void printAnnotation(const LineAnnotation& line, raw_ostream& os) {
+  std::vector<std::string> notes;
+  if (line.Uncoalesced > 0) {
+    std::string note = "uncoalesced";
+    if (line.Uncoalesced > 1) note += " x" + std::to_string(line.Uncoalesced);
+    if (line.IdealSectors > 0) {
+      note += (line.Gather ? ": up to " : ": ") +
+              std::to_string(line.Sectors) + " sectors/request (" +
+              std::to_string(line.Sectors / line.IdealSectors) + "x)";
+    }
+    notes.push_back(note);
+  }
+  if (line.BSI > 0) {
+    std::string note = "block-size dependent";
+    if (line.BSI > 1) note += " x" + std::to_string(line.BSI);
+    std::string reasons;
+    for (const std::string& reason : line.BSIReasons) {
+      reasons += (reasons.empty() ? "" : ", ") + reason;
+    }
+    notes.push_back(note + " (" + reasons + ")");
+  }
+  if (line.Divergent) notes.push_back("divergent");
+  if (line.CallSites > 0) {
+    notes.push_back(std::to_string(line.CallSites) +
+                    " finding(s) reached through calls");
+  }
+  for (const std::string& note : notes) os << escapeHTML(note) << "<br>";
+  os << "kernels:";
+  for (const auto& pair : line.Kernels) {
+    const DranoSourceLocation& location = pair.second;
+    os << " ";
+    if (location.File.empty()) {
+      os << escapeHTML(pair.first);
+    } else {
+      os << "<a href=\"" << getPageName(getSourcePath(location)) << "#L"
+         << location.Line << "\">" << escapeHTML(pair.first) << "</a>";
+    }
+  }
+}
+
+static void printHeader(StringRef title, raw_ostream& os) {
+  os << "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>"
+     << escapeHTML(title) << "</title><style>" << StyleSheet
+     << "</style></head><body>\n<h1>" << escapeHTML(title) << "</h1>\n";
+}
+
+static bool writePage(StringRef Dir, StringRef path,
+                      const FileAnnotations& file, double maxHotness) {
+  SmallString<256> pagePath(Dir);
+  sys::path::append(pagePath, getPageName(path));
+  std::error_code EC;
+  raw_fd_ostream os(pagePath, EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << "drano: " << pagePath << ": " << EC.message() << "\n";
+    return false;
+  }
+  printHeader(path, os);
+  os << "<p><a href=\"index.html\">All files</a></p>\n<table>\n";
+  auto printLine = [&](unsigned number, StringRef text) {
+    auto it = file.Lines.find(number);
+    const LineAnnotation* line = it != file.Lines.end() ? &it->second
+                                                        : nullptr;
+    os << "<tr id=\"L" << number << "\"";
+    unsigned level = line ? getHeatLevel(line->Hotness, maxHotness) : 0;
+    if (level > 0) os << " class=\"h" << level << "\"";
+    os << "><td class=\"n\"><a href=\"#L" << number << "\">" << number
+       << "</a></td><td><pre>" << escapeHTML(text) << "</pre></td>"
+       << "<td class=\"a\">";
+    if (line) printAnnotation(*line, os);
+    os << "</td></tr>\n";
+  };
+
+  auto bufferOrErr = MemoryBuffer::getFile(path, /*IsText=*/true);
+  if (bufferOrErr) {
+    SmallVector<StringRef, 0> lines;
+    (*bufferOrErr)->getBuffer().split(lines, '\n');
+    for (unsigned i = 0; i < lines.size(); i++) {
+      printLine(i + 1, lines[i].rtrim("\r"));
+    }
+  } else {
+    os << "<p>Source not found; annotated lines only.</p>\n";
+    for (const auto& pair : file.Lines) printLine(pair.first, "");
+  }
+  os << "</table>\n</body></html>\n";
+  return true;
+}
+
+bool llvm::writeHTMLReport(StringRef Dir, ArrayRef<ModuleReport> Reports) {
+  if (std::error_code EC = sys::fs::create_directories(Dir)) {
+    errs() << "drano: " << Dir << ": " << EC.message() << "\n";
+    return false;
+  }
+  std::map<std::string, FileAnnotations> files;
+  for (const ModuleReport& report : Reports) {
+    if (!report.Error.empty()) continue;
+    for (const DranoFinding& finding : report.Findings) {
+      addFinding(files, finding);
+    }
+  }
+  double maxHotness = 0;
+  for (const auto& file : files) {
+    for (const auto& line : file.second.Lines) {
+      maxHotness = std::max(maxHotness, line.second.Hotness);
+    }
+  }
+
+  bool succeeded = true;
+  for (const auto& file : files) {
+    succeeded &= writePage(Dir, file.first, file.second, maxHotness);
+  }
+
+  // Files by hotness, hottest first, then by path.
+  std::vector<const std::pair<const std::string, FileAnnotations>*> sorted;
+  for (const auto& file : files) sorted.push_back(&file);
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const std::pair<const std::string, FileAnnotations>* a,
+                      const std::pair<const std::string, FileAnnotations>* b) {
+    return a->second.Hotness > b->second.Hotness;
+  });
+  SmallString<256> indexPath(Dir);
+  sys::path::append(indexPath, "index.html");
+  std::error_code EC;
+  raw_fd_ostream os(indexPath, EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << "drano: " << indexPath << ": " << EC.message() << "\n";
+    return false;
+  }
+  printHeader("GPU Drano findings", os);
+  os << "<table>\n<tr><th>File</th><th>Annotated lines</th>"
+     << "<th>Hotness</th></tr>\n";
+  for (const auto* file : sorted) {
+    os << "<tr><td><a href=\"" << getPageName(file->first) << "\">"
+       << escapeHTML(file->first) << "</a></td><td>"
+       << file->second.Lines.size() << "</td><td>"
+       << format("%.1f", file->second.Hotness) << "</td></tr>\n";
+  }
+  os << "</table>\n</body></html>\n";
+  return succeeded;
+}
@@ -0,0 +1,42 @@
+//===- DranoHTML.h - Annotated-source heatmaps of drano findings -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// With -html-report=<dir>, drano writes a static site with one page per
+// source file named in the debug locations of the findings, for all the
+// input modules at once:
+//   drano -analysis=all -html-report=drano-html rodinia/*.ll
+// Each line of a page shows the findings at that line, aggregated across
+// modules, kernels and inlined copies by debug location: the uncoalesced
+// accesses with their worst estimated cost per warp request, the block-size
+// dependent instructions with their reasons, a divergence marker for
+// instructions whose execution depends on the block size, the findings
+// reached through calls at that line, and links to the kernels reaching
+// them. Lines are colored by the sum of the hotness of their findings,
+// relative to the hottest line of the site. Sources are read from the
+// paths in the debug info (relative to the compilation directory); a page
+// lists the annotated lines only if its source cannot be read. index.html
+// lists the files, hottest first.
+//===----------------------------------------------------------------------===//
+
+#ifndef DRANO_HTML_H
+#define DRANO_HTML_H
+
+#include "DranoDriver.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+namespace llvm {
+
+// Writes the heatmap of the findings of Reports to the directory Dir.
+// Returns false on error.
+bool writeHTMLReport(StringRef Dir, ArrayRef<ModuleReport> Reports);
+
+}
+
+#endif /* DranoHTML.h */
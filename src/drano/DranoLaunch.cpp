@@ -0,0 +1,502 @@
+#include "DranoLaunch.h"
+
+#include "DranoDriver.h"
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Operator.h"
+
+#include <cctype>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+
+// Values of a dimension tracked across the paths to a launch site, beyond
+// which it is unknown.
+static const size_t MaxValues = 64;
+
+// Copies of a dim3 object followed back to its constructor.
+static const unsigned MaxDepth = 16;
+
+// Returns the name in the device module of the kernel whose stub is named
+// Name, for stubs that are not registered: clang names the stub of kernel
+// after it with a __device_stub__ prefix (e.g. _Z21__device_stub__kernelPf
+// for _Z6kernelPf), or with the name of the kernel before clang 9.
+static std::string getKernelNameOfStub(StringRef Name) {
+  static const StringRef Prefix = "__device_stub__";
+  size_t pos = Name.find(Prefix);
+  if (pos == StringRef::npos) return Name.str();
+  size_t digits = pos;
+  while (digits > 0 && isdigit(Name[digits - 1])) digits--;
+  if (digits == pos) {
+    return (Name.substr(0, pos) + Name.substr(pos + Prefix.size())).str();
+  }
+  unsigned length;
+  if (Name.substr(digits, pos - digits).getAsInteger(10, length) ||
+      length <= Prefix.size()) {
+    return Name.str();
+  }
+  return (Name.substr(0, digits) + Twine(length - Prefix.size()) +
+          Name.substr(pos + Prefix.size())).str();
+}
+
+namespace {
+
+// Evaluates the dimensions passed at the launch sites of a host module to
+// the sets of constants they may take.
+class LaunchEvaluator {
+ public:
+  explicit LaunchEvaluator(const Module& M) : DL_(M.getDataLayout()) {}
+
+  // Computes the values V may take into values. Returns false if they are
+  // unknown.
+  bool getValues(const Value* V, std::set<uint64_t>& values);
+
+  // Returns the dimensions packed in XY (x in the low 32 bits, y in the
+  // high ones) and Z.
+  void getDimensions(const Value* XY, const Value* Z, LaunchDimension* dims);
+
+ private:
+  // Computes the values of the 32-bit word at Offset in the object Base
+  // (an alloca or a global variable).
+  bool getWordValues(const Value* Base, int64_t Offset,
+                     std::set<uint64_t>& values, unsigned depth);
+
+  // Collects the instructions writing into the alloca Base, with the offset
+  // they write at. Returns false if Base escapes.
+  bool getWriters(const AllocaInst* Base,
+                  std::vector<std::pair<const Instruction*, int64_t>>&
+                      writers);
+
+  const DataLayout& DL_;
+
+  // Values being evaluated (a cycle is unknown).
+  std::set<const Value*> Active_;
+};
+
+}
+
+// Adds f(v) for each v in values to out. Returns false if there are too many
+// values.
+template <typename Mapper>
+static bool mapValues(const std::set<uint64_t>& values,
+                      std::set<uint64_t>& out, Mapper f) {
+  for (uint64_t v : values) {
+    out.insert(f(v));
+    if (out.size() > MaxValues) return false;
+  }
+  return true;
+}
+
+// Reads the 32-bit word at Offset of the constant C into v. Returns false if
+// it is not an integer constant.
+static bool getConstantWord(const Constant* C, uint64_t Offset,
+                            const DataLayout& DL, uint64_t& v) {
+  if (isa<ConstantAggregateZero>(C)) {
+    v = 0;
+    return true;
+  }
+  if (const ConstantInt* CI = dyn_cast<ConstantInt>(C)) {
+    unsigned bits = CI->getBitWidth();
+    if (bits % 32 != 0 || Offset % 4 != 0 || Offset * 8 + 32 > bits) {
+      return false;
+    }
+    v = CI->getValue().extractBitsAsZExtValue(32, Offset * 8);
+    return true;
+  }
+  if (const ConstantStruct* CS = dyn_cast<ConstantStruct>(C)) {
+    const StructLayout* layout = DL.getStructLayout(CS->getType());
+    if (Offset >= layout->getSizeInBytes()) return false;
+    unsigned i = layout->getElementContainingOffset(Offset);
+    return getConstantWord(CS->getOperand(i),
+                           Offset - layout->getElementOffset(i), DL, v);
+  }
+  if (isa<ConstantArray>(C) || isa<ConstantDataSequential>(C)) {
+    Type* elementType = C->getType()->getArrayElementType();
+    uint64_t size = DL.getTypeAllocSize(elementType);
+    if (size == 0 || Offset / size >= C->getType()->getArrayNumElements()) {
+      return false;
+    }
+    const Constant* element = C->getAggregateElement(Offset / size);
+    return element && getConstantWord(element, Offset % size, DL, v);
+  }
+  return false;
+}
+
+// Is F a constructor dim3(unsigned, unsigned, unsigned)?
+static bool isDim3Constructor(const Function* F) {
+  return F && (F->getName() == "_ZN4dim3C1Ejjj" ||
+               F->getName() == "_ZN4dim3C2Ejjj");
+}
+
+bool LaunchEvaluator::getWriters(const AllocaInst* Base,
+    std::vector<std::pair<const Instruction*, int64_t>>& writers) {
+  std::vector<std::pair<const Value*, int64_t>> worklist = {{Base, 0}};
+  std::set<const Value*> visited;
+  while (!worklist.empty()) {
+    const Value* P = worklist.back().first;
+    int64_t offset = worklist.back().second;
+    worklist.pop_back();
+    if (!visited.insert(P).second) continue;
+    for (const User* U : P->users()) {
+      if (isa<BitCastOperator>(U)) {
+        worklist.emplace_back(U, offset);
+      } else if (const GEPOperator* GEP = dyn_cast<GEPOperator>(U)) {
+        APInt delta(DL_.getIndexTypeSizeInBits(GEP->getType()), 0);
+        if (GEP->getPointerOperand() != P ||
+            !GEP->accumulateConstantOffset(DL_, delta)) {
+          return false;
+        }
+        worklist.emplace_back(U, offset + delta.getSExtValue());
+      } else if (isa<LoadInst>(U)) {
+        continue;
+      } else if (const StoreInst* SI = dyn_cast<StoreInst>(U)) {
+        if (SI->getValueOperand() == P) return false;
+        writers.emplace_back(SI, offset);
+      } else if (const MemIntrinsic* MI = dyn_cast<MemIntrinsic>(U)) {
+        if (MI->getRawDest() == P) {
+          writers.emplace_back(MI, offset);
+        } else if (!isa<MemTransferInst>(MI)) {
+          return false;
+        }
+      } else if (const IntrinsicInst* II = dyn_cast<IntrinsicInst>(U)) {
+        if (!II->isLifetimeStartOrEnd()) return false;
+      } else if (const CallBase* CB = dyn_cast<CallBase>(U)) {
+        if (!isDim3Constructor(CB->getCalledFunction()) ||
+            CB->getArgOperand(0) != P) {
+          return false;
+        }
+        writers.emplace_back(CB, offset);
+      } else {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool LaunchEvaluator::getWordValues(const Value* Base, int64_t Offset,
+                                    std::set<uint64_t>& values,
+                                    unsigned depth) {
+  if (depth > MaxDepth || Offset < 0) return false;
+  if (const GlobalVariable* GV = dyn_cast<GlobalVariable>(Base)) {
+    uint64_t v;
+    if (!GV->isConstant() || !GV->hasDefinitiveInitializer() ||
+        !getConstantWord(GV->getInitializer(), Offset, DL_, v)) {
+      return false;
+    }
+    values.insert(v);
+    return true;
+  }
+  const AllocaInst* AI = dyn_cast<AllocaInst>(Base);
+  std::vector<std::pair<const Instruction*, int64_t>> writers;
+  if (!AI || !getWriters(AI, writers)) return false;
+
+  // The word may hold the value of any writer covering it (stores in
+  // different paths, or reassignments): their values are joined.
+  bool covered = false;
+  for (const auto& writer : writers) {
+    const Instruction* I = writer.first;
+    int64_t start = writer.second;
+    uint64_t size;
+    if (const StoreInst* SI = dyn_cast<StoreInst>(I)) {
+      size = DL_.getTypeStoreSize(SI->getValueOperand()->getType());
+    } else if (const MemIntrinsic* MI = dyn_cast<MemIntrinsic>(I)) {
+      const ConstantInt* length = dyn_cast<ConstantInt>(MI->getLength());
+      if (!length) return false;
+      size = length->getZExtValue();
+    } else {
+      size = 12;
+    }
+    if (Offset + 4 <= start || int64_t(start + size) <= Offset) continue;
+    if (Offset < start || int64_t(start + size) < Offset + 4) return false;
+    covered = true;
+    uint64_t shift = Offset - start;
+    if (const StoreInst* SI = dyn_cast<StoreInst>(I)) {
+      const Value* stored = SI->getValueOperand();
+      if (const Constant* C = dyn_cast<Constant>(stored)) {
+        uint64_t v;
+        if (getConstantWord(C, shift, DL_, v)) {
+          values.insert(v);
+          continue;
+        }
+      }
+      std::set<uint64_t> storedValues;
+      if (!stored->getType()->isIntegerTy() || shift % 4 != 0 ||
+          !getValues(stored, storedValues) ||
+          !mapValues(storedValues, values, [shift](uint64_t v) {
+            return (v >> (8 * shift)) & 0xffffffff;
+          })) {
+        return false;
+      }
+    } else if (const MemSetInst* MS = dyn_cast<MemSetInst>(I)) {
+      const ConstantInt* byte = dyn_cast<ConstantInt>(MS->getValue());
+      if (!byte) return false;
+      values.insert(byte->getZExtValue() * 0x01010101);
+    } else if (const MemTransferInst* MT = dyn_cast<MemTransferInst>(I)) {
+      const Value* source = MT->getRawSource();
+      APInt sourceOffset(DL_.getIndexTypeSizeInBits(source->getType()), 0);
+      source = source->stripAndAccumulateConstantOffsets(DL_, sourceOffset,
+          /*AllowNonInbounds=*/true);
+      if (!getWordValues(source, sourceOffset.getSExtValue() + shift, values,
+                         depth + 1)) {
+        return false;
+      }
+    } else {
+      // dim3(x, y, z) stores its arguments in order.
+      if (shift % 4 != 0) return false;
+      if (!getValues(cast<CallBase>(I)->getArgOperand(1 + shift / 4),
+                     values)) {
+        return false;
+      }
+    }
+    if (values.size() > MaxValues) return false;
+  }
+  return covered;
+}
+
+bool LaunchEvaluator::getValues(const Value* V, std::set<uint64_t>& values) {
+  if (!V->getType()->isIntegerTy() ||
+      V->getType()->getIntegerBitWidth() > 64) {
+    return false;
+  }
+  uint64_t mask = V->getType()->getIntegerBitWidth() == 64 ? ~uint64_t(0) :
+      (uint64_t(1) << V->getType()->getIntegerBitWidth()) - 1;
+  if (const ConstantInt* CI = dyn_cast<ConstantInt>(V)) {
+    values.insert(CI->getZExtValue());
+    return true;
+  }
+  if (!isa<Instruction>(V) || !Active_.insert(V).second) return false;
+  bool known = false;
+  std::set<uint64_t> a, b;
+  if (const CastInst* CI = dyn_cast<CastInst>(V)) {
+    const Value* op = CI->getOperand(0);
+    if ((isa<ZExtInst>(CI) || isa<TruncInst>(CI)) && getValues(op, a)) {
+      known = mapValues(a, values, [mask](uint64_t v) { return v & mask; });
+    }
+  } else if (const BinaryOperator* BO = dyn_cast<BinaryOperator>(V)) {
+    if (getValues(BO->getOperand(0), a) && getValues(BO->getOperand(1), b)) {
+      known = true;
+      for (uint64_t x : a) {
+        for (uint64_t y : b) {
+          uint64_t v;
+          switch (BO->getOpcode()) {
+            case Instruction::Add: v = x + y; break;
+            case Instruction::Sub: v = x - y; break;
+            case Instruction::Mul: v = x * y; break;
+            case Instruction::And: v = x & y; break;
+            case Instruction::Or: v = x | y; break;
+            case Instruction::Shl: v = y < 64 ? x << y : 0; break;
+            case Instruction::LShr: v = y < 64 ? x >> y : 0; break;
+            case Instruction::UDiv: known &= y != 0; v = y ? x / y : 0; break;
+            default: known = false; v = 0; break;
+          }
+          values.insert(v & mask);
+        }
+      }
+      known &= values.size() <= MaxValues;
+    }
+  } else if (const SelectInst* SI = dyn_cast<SelectInst>(V)) {
+    known = getValues(SI->getTrueValue(), values) &&
+            getValues(SI->getFalseValue(), values);
+  } else if (const PHINode* PN = dyn_cast<PHINode>(V)) {
+    known = true;
+    for (const Value* incoming : PN->incoming_values()) {
+      known = known && getValues(incoming, values);
+    }
+  } else if (const LoadInst* LI = dyn_cast<LoadInst>(V)) {
+    unsigned bits = LI->getType()->getIntegerBitWidth();
+    APInt offset(DL_.getIndexTypeSizeInBits(LI->getPointerOperandType()), 0);
+    const Value* base =
+        LI->getPointerOperand()->stripAndAccumulateConstantOffsets(
+            DL_, offset, /*AllowNonInbounds=*/true);
+    int64_t start = offset.getSExtValue();
+    if (bits == 32) {
+      known = getWordValues(base, start, values, 0);
+    } else if (bits == 64 && getWordValues(base, start, a, 0) &&
+               getWordValues(base, start + 4, b, 0)) {
+      known = true;
+      for (uint64_t low : a) {
+        for (uint64_t high : b) values.insert(low | high << 32);
+      }
+      known &= values.size() <= MaxValues;
+    }
+  }
+  Active_.erase(V);
+  return known && values.size() <= MaxValues;
+}
+
+// Returns the range of values, or an unknown dimension if values is empty.
+static LaunchDimension getDimension(const std::set<uint64_t>& values) {
+  if (values.empty()) return LaunchDimension();
+  return LaunchDimension(*values.begin(), *values.rbegin());
+}
+
+void LaunchEvaluator::getDimensions(const Value* XY, const Value* Z,
+                                    LaunchDimension* dims) {
+  std::set<uint64_t> xy, x, y, z;
+  if (getValues(XY, xy)) {
+    for (uint64_t v : xy) {
+      x.insert(v & 0xffffffff);
+      y.insert(v >> 32);
+    }
+  }
+  if (!getValues(Z, z)) z.clear();
+  dims[0] = getDimension(x);
+  dims[1] = getDimension(y);
+  dims[2] = getDimension(z);
+}
+
+// Returns the launch configuration passed as (gridXY, gridZ, blockXY,
+// blockZ) in the first arguments of the call CB.
+static LaunchConfig getLaunchConfig(const CallBase* CB, unsigned FirstArg,
+                                    LaunchEvaluator& evaluator) {
+  LaunchConfig config;
+  config.Launches = 1;
+  if (CB->arg_size() < FirstArg + 4) return config;
+  evaluator.getDimensions(CB->getArgOperand(FirstArg),
+                          CB->getArgOperand(FirstArg + 1), config.Grid);
+  evaluator.getDimensions(CB->getArgOperand(FirstArg + 2),
+                          CB->getArgOperand(FirstArg + 3), config.Block);
+  return config;
+}
+
+// Is F the runtime function configuring the next launch?
+static bool isCallConfiguration(const Function* F) {
+  return F && (F->getName() == "__cudaPushCallConfiguration" ||
+               F->getName() == "cudaConfigureCall");
+}
+
+// Returns the first call to one of Stubs after the call configuration I, or
+// null. The stub is called in the block of I or in a block reached from it
+// (e.g. once the configuration succeeded) without another configuration.
+static const CallBase* getLaunchedStub(const CallBase* I,
+    const std::map<const Function*, std::string>& Stubs) {
+  // Blocks searched after the block of I.
+  static const size_t MaxBlocks = 8;
+  std::vector<const BasicBlock*> worklist;
+  std::set<const BasicBlock*> visited;
+  const Instruction* start = I->getNextNode();
+  for (size_t i = 0; start; i++) {
+    bool configured = false;
+    for (const Instruction* J = start; J && !configured;
+         J = J->getNextNode()) {
+      const CallBase* CB = dyn_cast<CallBase>(J);
+      if (!CB) continue;
+      if (Stubs.count(CB->getCalledFunction())) return CB;
+      configured = isCallConfiguration(CB->getCalledFunction());
+    }
+    if (!configured) {
+      for (const BasicBlock* succ : successors(start->getParent())) {
+        if (visited.insert(succ).second) worklist.push_back(succ);
+      }
+    }
+    start = nullptr;
+    if (i < worklist.size() && i < MaxBlocks) start = &worklist[i]->front();
+  }
+  return nullptr;
+}
+
+LaunchConfigMap llvm::extractLaunchConfigs(const Module& Host) {
+  // Map from the stubs of the kernels to the names of the kernels.
+  std::map<const Function*, std::string> stubs;
+  for (const char* name : {"__cudaRegisterFunction", "__hipRegisterFunction"}) {
+    const Function* RF = Host.getFunction(name);
+    if (!RF) continue;
+    for (const User* U : RF->users()) {
+      const CallBase* CB = dyn_cast<CallBase>(U);
+      if (!CB || CB->arg_size() < 3) continue;
+      const Function* stub = dyn_cast<Function>(
+          CB->getArgOperand(1)->stripPointerCasts());
+      StringRef kernel;
+      if (!stub) continue;
+      if (!getConstantStringInfo(CB->getArgOperand(2), kernel)) {
+        kernel = stub->getName();
+      }
+      stubs[stub] = kernel.str();
+    }
+  }
+  // Without registrations, the stubs are the functions that launch a kernel
+  // through the runtime.
+  if (stubs.empty()) {
+    for (const char* name : {"cudaLaunch", "cudaLaunchKernel"}) {
+      const Function* LF = Host.getFunction(name);
+      if (!LF) continue;
+      for (const User* U : LF->users()) {
+        if (const CallBase* CB = dyn_cast<CallBase>(U)) {
+          const Function* stub = CB->getFunction();
+          stubs[stub] = getKernelNameOfStub(stub->getName());
+        }
+      }
+    }
+  }
+
+  LaunchConfigMap configs;
+  LaunchEvaluator evaluator(Host);
+  for (const char* name : {"__cudaPushCallConfiguration",
+                           "cudaConfigureCall"}) {
+    const Function* CF = Host.getFunction(name);
+    if (!isCallConfiguration(CF)) continue;
+    for (const User* U : CF->users()) {
+      const CallBase* CB = dyn_cast<CallBase>(U);
+      if (!CB || CB->getCalledFunction() != CF) continue;
+      const CallBase* launch = getLaunchedStub(CB, stubs);
+      if (!launch) continue;
+      configs[stubs.at(launch->getCalledFunction())].join(
+          getLaunchConfig(CB, 0, evaluator));
+    }
+  }
+  // Direct calls to cudaLaunchKernel(stub, grid, block, ...) outside the
+  // stubs.
+  if (const Function* LF = Host.getFunction("cudaLaunchKernel")) {
+    for (const User* U : LF->users()) {
+      const CallBase* CB = dyn_cast<CallBase>(U);
+      if (!CB || CB->arg_size() < 5 || stubs.count(CB->getFunction())) {
+        continue;
+      }
+      const Function* stub = dyn_cast<Function>(
+          CB->getArgOperand(0)->stripPointerCasts());
+      auto it = stubs.find(stub);
+      if (it == stubs.end()) continue;
+      configs[it->second].join(getLaunchConfig(CB, 1, evaluator));
+    }
+  }
+  return configs;
+}
+
+bool llvm::readHostModules(ArrayRef<std::string> Paths,
+                           LaunchConfigMap& Configs) {
+  for (const std::string& Path : Paths) {
+    // The module must be destroyed before its context.
+    LLVMContext Context;
+    SMDiagnostic Err;
+    std::unique_ptr<Module> M = loadModule(Path, Context, Err);
+    if (!M) {
+      Err.print("drano", errs());
+      return false;
+    }
+    for (const auto& pair : extractLaunchConfigs(*M)) {
+      Configs[pair.first].join(pair.second);
+    }
+  }
+  return true;
+}
+
+void llvm::printLaunchConfigs(const LaunchConfigMap& Configs,
+                              raw_ostream& os) {
+  os << "Launch configurations:\n";
+  for (const auto& pair : Configs) {
+    os << "  " << pair.first << " " << pair.second.getString();
+    BlockShape shape = pair.second.getBlockShape();
+    if (shape.isKnown()) os << " (analyzed for " << shape.getString() << ")";
+    os << "\n";
+  }
+}
@@ -0,0 +1,60 @@
+//===- DranoLaunch.h - Launch configurations from CUDA host modules -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// clang compiles a CUDA file into a device module per GPU architecture and a
+// host module, which holds the launch sites of the kernels. With
+// -host-module=<file>, drano recovers the grid and block dimensions of each
+// kernel from its launch sites in the host module:
+//   drano -host-module=app.ll app-cuda-nvptx64-nvidia-cuda-sm_30.ll
+//
+// A launch site is a call to __cudaPushCallConfiguration (or
+// cudaConfigureCall before CUDA 9.2) followed by a call to the stub of a
+// kernel, or a direct call to cudaLaunchKernel with a stub. Stubs are mapped
+// to the names of their kernels in the device module by the calls to
+// __cudaRegisterFunction of the host module. The dimensions are passed as
+// an i64 packing x and y and an i32 for z; they are evaluated through
+// constants, selects and phis, and at -O0 through the dim3 objects they are
+// copied from (their constructors, field stores and copies). Each dimension
+// is then a constant, a range of constants (e.g. blocks of 128 or 256
+// threads depending on a flag), or unknown, joined across the launch sites
+// of the kernel.
+//
+// Kernels whose launches all use the same block shape are analyzed for it
+// by the uncoalesced access analysis, instead of the shape given with
+// -uncoalesced-block-dim (see getUncoalescedBlockShape(const Function*)).
+// -emit-launch-configs=<file> writes the configurations to a sidecar file
+// (see LaunchConfig.h), which opt reads with -uncoalesced-launch-configs.
+//===----------------------------------------------------------------------===//
+
+#ifndef DRANO_LAUNCH_H
+#define DRANO_LAUNCH_H
+
+#include "LaunchConfig.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+
+namespace llvm {
+
+// Returns the launch configurations of the kernels launched in the host
+// module Host, keyed by the names of the kernels in the device module.
+LaunchConfigMap extractLaunchConfigs(const Module& Host);
+
+// Loads the host modules in Paths and joins the launch configurations of
+// their kernels into Configs. Returns false on error.
+bool readHostModules(ArrayRef<std::string> Paths, LaunchConfigMap& Configs);
+
+// Prints Configs, one kernel per line.
+void printLaunchConfigs(const LaunchConfigMap& Configs, raw_ostream& os);
+
+}
+
+#endif /* DranoLaunch.h */
@@ -0,0 +1,289 @@
+#include "DranoLink.h"
+
+#include "EntryPoints.h"
+#include "InterprocBSIAnalysisPass.h"
+#include "InterprocUncoalescedAnalysisPass.h"
+#include "SummaryCache.h"
+#include "UncoalescedSummaries.h"
+
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+
+#include <chrono>
+#include <map>
+
+using namespace llvm;
+
+// Summary file layout:
+//   string "drano-tu-summary", u32 version
+//   string absolute path of the module
+//   u32 #entries
+//   for each entry: string cache key, string cache entry
+
+static const char* const TUSummaryMagic = "drano-tu-summary";
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Returns the functions defined in M that other modules may call.
+static std::set<const Function*> getExportedFunctions(const Module& M) {
+  std::set<const Function*> exported;
+  for (const Function& F : M) {
+    if (!F.isDeclaration() && !F.hasLocalLinkage()) exported.insert(&F);
+  }
+  return exported;
+}
+
+// Returns the functions of a translation unit whose bodies are loaded: the
+// entry points and the functions other units may call.
+static std::set<const Function*> getUnitRoots(const Module& M) {
+  std::set<const Function*> roots = getDranoEntryPoints(M);
+  std::set<const Function*> exported = getExportedFunctions(M);
+  roots.insert(exported.begin(), exported.end());
+  return roots;
+}
+
+bool llvm::emitTUSummary(StringRef Filename, unsigned Analyses,
+                         StringRef SummaryPath, raw_ostream& os) {
+  SmallString<256> path(Filename);
+  if (Filename == "-") {
+    errs() << "drano: -emit-tu-summary requires an input file\n";
+    return false;
+  }
+  if (std::error_code EC = sys::fs::make_absolute(path)) {
+    errs() << "drano: " << Filename << ": " << EC.message() << "\n";
+    return false;
+  }
+
+  // The module must be destroyed before its context.
+  LLVMContext Context;
+  SMDiagnostic Err;
+  ModuleReport report;
+  report.Filename = Filename.str();
+  auto start = std::chrono::steady_clock::now();
+  std::unique_ptr<Module> M = loadModule(path, Context, Err, getUnitRoots);
+  report.ParseTime = secondsSince(start);
+  if (!M) {
+    Err.print("drano", errs());
+    return false;
+  }
+  // Summaries of functions calling into other units are never stored, so
+  // the store ends up with the summaries that hold in any program.
+  MemorySummaryStore Store;
+  analyzeModule(*M, Analyses, report, &Store);
+
+  CacheWriter W;
+  W.writeString(TUSummaryMagic);
+  W.writeU32(DRANO_TU_SUMMARY_VERSION);
+  W.writeString(path);
+  std::map<std::string, std::string> entries = Store.getEntries();
+  W.writeU32(entries.size());
+  for (const auto& entry : entries) {
+    W.writeString(entry.first);
+    W.writeString(entry.second);
+  }
+  std::error_code EC;
+  raw_fd_ostream out(SummaryPath, EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << "drano: " << SummaryPath << ": " << EC.message() << "\n";
+    return false;
+  }
+  out << W.getBuffer();
+
+  os << "Module: " << report.Filename << "\n" << report.Results;
+  os << "Timings (seconds):\n";
+  report.printTimings(Analyses, os);
+  return true;
+}
+
+// Reads the summary file in SummaryPath: returns the path of its module and
+// adds its entries to Store.
+static bool readTUSummary(StringRef SummaryPath, std::string& modulePath,
+                          SummaryStore& Store) {
+  std::string contents;
+  if (!readCacheEntry(SummaryPath, contents)) {
+    errs() << "drano: cannot read " << SummaryPath << "\n";
+    return false;
+  }
+  CacheReader R(contents);
+  if (R.readString() != TUSummaryMagic ||
+      R.readU32() != DRANO_TU_SUMMARY_VERSION) {
+    errs() << "drano: " << SummaryPath << ": not a summary file of this "
+           << "version of drano\n";
+    return false;
+  }
+  modulePath = R.readString();
+  uint32_t numEntries = R.readU32();
+  for (uint32_t i = 0; i < numEntries && !R.hasError(); i++) {
+    std::string key = R.readString();
+    std::string entry = R.readString();
+    if (!R.hasError()) Store.store(key, entry);
+  }
+  if (R.hasError()) {
+    errs() << "drano: malformed summary file " << SummaryPath << "\n";
+    return false;
+  }
+  return true;
+}
+
+namespace {
+
+// Translation unit of the linked program. Members are destroyed in reverse
+// order: the summaries before the module, and the module before its
+// context.
+struct LinkedUnit {
+  std::unique_ptr<LLVMContext> Context;
+  std::unique_ptr<Module> M;
+  std::unique_ptr<UncoalescedSummaries> Summaries;
+  ModuleReport Report;
+
+  // Units defining functions called from this unit.
+  std::set<size_t> Dependencies;
+};
+
+}
+
+// Orders units so that units are analyzed after the units they call, except
+// for units calling each other, which are taken in the order of the inputs.
+static std::vector<size_t> getLinkOrder(const std::vector<LinkedUnit>& units) {
+  std::vector<size_t> order;
+  std::vector<bool> done(units.size(), false);
+  while (order.size() < units.size()) {
+    size_t next = units.size();
+    for (size_t i = 0; i < units.size() && next == units.size(); i++) {
+      if (done[i]) continue;
+      bool ready = true;
+      for (size_t j : units[i].Dependencies) ready = ready && done[j];
+      if (ready) next = i;
+    }
+    for (size_t i = 0; i < units.size() && next == units.size(); i++) {
+      if (!done[i]) next = i;
+    }
+    done[next] = true;
+    order.push_back(next);
+  }
+  return order;
+}
+
+bool llvm::linkTUSummaries(ArrayRef<std::string> SummaryPaths,
+                           unsigned Analyses, raw_ostream& os) {
+  // Summaries of all units, shared by the analyses of all units.
+  MemorySummaryStore Store;
+  std::vector<LinkedUnit> units(SummaryPaths.size());
+  for (size_t i = 0; i < units.size(); i++) {
+    LinkedUnit& unit = units[i];
+    if (!readTUSummary(SummaryPaths[i], unit.Report.Filename, Store)) {
+      return false;
+    }
+    unit.Context.reset(new LLVMContext());
+    SMDiagnostic Err;
+    auto start = std::chrono::steady_clock::now();
+    unit.M = loadModule(unit.Report.Filename, *unit.Context, Err,
+                        getUnitRoots);
+    unit.Report.ParseTime = secondsSince(start);
+    if (!unit.M) {
+      Err.print("drano", errs());
+      return false;
+    }
+  }
+
+  // Map from the names of exported functions to the units defining them.
+  // The first definition is used if several units define a function (e.g.
+  // linkonce_odr functions from a common header).
+  std::map<std::string, std::pair<size_t, const Function*>> definitions;
+  for (size_t i = 0; i < units.size(); i++) {
+    for (const Function* F : getExportedFunctions(*units[i].M)) {
+      definitions.emplace(F->getName().str(), std::make_pair(i, F));
+    }
+  }
+  for (size_t i = 0; i < units.size(); i++) {
+    for (const Function& F : *units[i].M) {
+      if (!F.isDeclaration()) continue;
+      auto it = definitions.find(F.getName().str());
+      if (it != definitions.end() && it->second.first != i) {
+        units[i].Dependencies.insert(it->second.first);
+      }
+    }
+  }
+  std::vector<size_t> order = getLinkOrder(units);
+
+  if (Analyses & DranoAnalysisUncoalesced) {
+    // Calls to functions of other units are resolved with the summaries of
+    // the defining unit, in the context of the call.
+    for (LinkedUnit& unit : units) {
+      unit.Summaries.reset(new UncoalescedSummaries(&Store));
+      unit.Summaries->setExternalResolver(
+          [&units, &definitions](const Function* F, const CallContext& ctx)
+              -> const FunctionSummary* {
+            auto it = definitions.find(F->getName().str());
+            if (it == definitions.end()) return nullptr;
+            const Function* G = it->second.second;
+            if (G->arg_size() != ctx.size()) return nullptr;
+            return &units[it->second.first].Summaries->getSummary(G, ctx);
+          });
+    }
+    // Callers first, so that functions called from other units are reported
+    // as part of their callers, as in a single module.
+    for (auto it = order.rbegin(), ite = order.rend(); it != ite; ++it) {
+      LinkedUnit& unit = units[*it];
+      auto start = std::chrono::steady_clock::now();
+      CallGraph CG(*unit.M);
+      runInterprocUncoalescedAnalysis(*unit.M, CG, *unit.Summaries,
+          [&unit](const InterprocUncoalescedResult& result, const Function* F) {
+            unit.Report.getKernelTiming(F->getName()).UncoalescedTime =
+                result.AnalysisTimeMap.at(F);
+            raw_string_ostream os(unit.Report.Results);
+            result.printRoot(F, os);
+            return true;
+          });
+      unit.Report.UncoalescedTime = secondsSince(start);
+    }
+    for (LinkedUnit& unit : units) unit.Summaries.reset();
+  }
+
+  if (Analyses & DranoAnalysisBSI) {
+    // Callees first, so that the results of functions called from other
+    // units are known when their callers are analyzed. As in analyzeModule,
+    // callees within a unit are inlined first.
+    BSILinkContext link;
+    for (size_t i : order) {
+      LinkedUnit& unit = units[i];
+      auto start = std::chrono::steady_clock::now();
+      legacy::PassManager PM;
+      PM.add(createAlwaysInlinerLegacyPass());
+      PM.run(*unit.M);
+      link.ExportedFunctions = getExportedFunctions(*unit.M);
+      CallGraph CG(*unit.M);
+      InterprocBSIResult result = runInterprocBSIAnalysis(*unit.M, CG,
+          nullptr, &Store,
+          [&unit](const InterprocBSIResult& result, const Function* F) {
+            if (!result.EntryPoints.count(F)) return true;
+            unit.Report.getKernelTiming(F->getName()).BSITime =
+                result.AnalysisTimeMap.at(F);
+            raw_string_ostream os(unit.Report.Results);
+            result.printFunction(F, os);
+            return true;
+          }, &link);
+      for (const Function* F : result.Functions) {
+        if (F->hasLocalLinkage()) continue;
+        link.ExternalResults.emplace(F->getName().str(),
+                                     result.FunctionResults.at(F));
+      }
+      unit.Report.BSITime = secondsSince(start);
+    }
+  }
+
+  for (const LinkedUnit& unit : units) {
+    os << "Module: " << unit.Report.Filename << "\n" << unit.Report.Results;
+  }
+  os << "Timings (seconds):\n";
+  for (const LinkedUnit& unit : units) {
+    unit.Report.printTimings(Analyses, os);
+  }
+  return true;
+}
@@ -0,0 +1,61 @@
+//===- DranoLink.h - Analysis of separately compiled device code in drano -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// Device code compiled with separate compilation (nvcc -rdc / clang
+// -fgpu-rdc) is split into translation units that call each other's device
+// functions. Analyzed on its own, a translation unit only sees declarations
+// of these functions: the uncoalesced access analysis assumes they return
+// TOP and the block-size invariance analysis assumes they are block-size
+// dependent.
+//
+// With -emit-tu-summary=<file>, drano analyzes a single translation unit and
+// writes a summary file next to its report. The summary records the path of
+// the module and the cached summaries of its functions that do not call
+// into other translation units; they do not change when the program is
+// linked.
+//
+// With -link, the inputs are the summary files of the translation units of
+// a program. drano loads each module (lazily, in its own context) and
+// resolves calls to functions declared in one unit and defined in another:
+// the callee is analyzed in the unit that defines it, in the call context of
+// the caller. Functions recorded in the summaries are not analyzed again, so
+// only functions that (transitively) call into other units are re-analyzed.
+// No merged module is built.
+//===----------------------------------------------------------------------===//
+
+#ifndef DRANO_LINK_H
+#define DRANO_LINK_H
+
+#include "DranoDriver.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+
+// Version of the summary file format.
+#define DRANO_TU_SUMMARY_VERSION 1
+
+namespace llvm {
+
+// Analyzes the translation unit in Filename with the analyses in the mask
+// Analyses, prints its results to os and writes its summary to SummaryPath.
+// Returns false on error.
+bool emitTUSummary(StringRef Filename, unsigned Analyses,
+                   StringRef SummaryPath, raw_ostream& os);
+
+// Analyzes the program made of the translation units whose summaries are in
+// SummaryPaths and prints the results of each unit to os. Returns false on
+// error.
+bool linkTUSummaries(ArrayRef<std::string> SummaryPaths, unsigned Analyses,
+                     raw_ostream& os);
+
+}
+
+#endif /* DranoLink.h */
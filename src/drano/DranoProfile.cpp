@@ -0,0 +1,255 @@
+#include "DranoProfile.h"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+#include <algorithm>
+#include <set>
+
+using namespace llvm;
+
+static cl::opt<double> HotPercent("profile-hot-percent",
+    cl::desc("Share of the profiled traffic, in percent, above which a line "
+             "is hot"),
+    cl::init(1.0));
+
+static cl::opt<double> EfficiencyPercent("profile-efficiency-percent",
+    cl::desc("Efficiency, in percent, below which a profiled line is "
+             "inefficient"),
+    cl::init(50.0));
+
+bool ProfiledLine::isHot() const { return Share >= HotPercent; }
+
+bool ProfiledLine::isInefficient() const {
+  return Efficiency >= 0 && Efficiency < EfficiencyPercent;
+}
+
+// Splits a CSV row into fields, removing quotes.
+static std::vector<std::string> splitCSVRow(StringRef row) {
+  std::vector<std::string> fields(1);
+  bool quoted = false;
+  for (size_t i = 0; i < row.size(); i++) {
+    char c = row[i];
+    if (quoted) {
+      if (c == '"' && i + 1 < row.size() && row[i + 1] == '"') {
+        fields.back() += '"';
+        i++;
+      } else if (c == '"') {
+        quoted = false;
+      } else {
+        fields.back() += c;
+      }
+    } else if (c == '"') {
+      quoted = true;
+    } else if (c == ',') {
+      fields.emplace_back();
+    } else {
+      fields.back() += c;
+    }
+  }
+  for (std::string& field : fields) field = StringRef(field).trim().str();
+  return fields;
+}
+
+// Parses a number such as "1,234" or "12.5%". Returns false if the field is
+// not a number.
+static bool parseNumber(StringRef field, double& v) {
+  std::string digits;
+  for (char c : field) {
+    if (c != ',' && c != '%') digits += c;
+  }
+  return !digits.empty() && !StringRef(digits).getAsDouble(v);
+}
+
+// Returns the key of a location: the file name without directories, and the
+// line.
+static std::pair<std::string, unsigned> getLineKey(StringRef File,
+                                                   unsigned Line) {
+  return std::make_pair(sys::path::filename(File).str(), Line);
+}
+
+namespace {
+
+// Columns of the profile.
+struct ProfileColumns {
+  int File = -1;
+  int Line = -1;
+  int Source = -1;
+  int Efficiency = -1;
+  std::vector<int> Traffic;
+
+  // Reads the columns from a header row. Returns false if the row does not
+  // name a location.
+  bool read(const std::vector<std::string>& header) {
+    for (unsigned i = 0; i < header.size(); i++) {
+      std::string name = StringRef(header[i]).lower();
+      if (name == "file" || name == "source file") {
+        File = i;
+      } else if (name == "line" || name == "line number") {
+        Line = i;
+      } else if (name == "source" || name == "source location") {
+        Source = i;
+      } else if (StringRef(name).contains("efficiency")) {
+        Efficiency = i;
+      } else if (StringRef(name).contains("transactions") ||
+                 StringRef(name).contains("sectors")) {
+        Traffic.push_back(i);
+      }
+    }
+    return (File >= 0 && Line >= 0) || Source >= 0;
+  }
+};
+
+}
+
+bool DranoProfile::read(StringRef Path) {
+  Path_ = Path.str();
+  auto bufferOrErr = MemoryBuffer::getFile(Path, /*IsText=*/true);
+  if (std::error_code EC = bufferOrErr.getError()) {
+    errs() << "drano: " << Path << ": " << EC.message() << "\n";
+    return false;
+  }
+  SmallVector<StringRef, 0> rows;
+  (*bufferOrErr)->getBuffer().split(rows, '\n');
+
+  ProfileColumns columns;
+  bool hasHeader = false;
+  // Sums of efficiency weighted by traffic, and of the weights, by line.
+  std::map<std::pair<std::string, unsigned>, std::pair<double, double>>
+      efficiencies;
+  double totalTraffic = 0;
+  for (StringRef row : rows) {
+    row = row.trim();
+    if (row.empty()) continue;
+    std::vector<std::string> fields = splitCSVRow(row);
+    if (!hasHeader) {
+      hasHeader = columns.read(fields);
+      continue;
+    }
+    auto getField = [&fields](int i) {
+      return i >= 0 && unsigned(i) < fields.size() ? StringRef(fields[i])
+                                                   : StringRef();
+    };
+    StringRef file = getField(columns.File);
+    StringRef line = getField(columns.Line);
+    if (columns.Source >= 0) {
+      std::tie(file, line) = getField(columns.Source).rsplit(':');
+    }
+    unsigned lineNumber;
+    if (file.empty() || line.trim().getAsInteger(10, lineNumber)) continue;
+
+    auto key = getLineKey(file, lineNumber);
+    ProfiledLine& profiled = Lines_[key];
+    profiled.File = file.str();
+    profiled.Line = lineNumber;
+    double traffic = 0, v;
+    for (int i : columns.Traffic) {
+      if (parseNumber(getField(i), v)) traffic += v;
+    }
+    profiled.Traffic += traffic;
+    totalTraffic += traffic;
+    if (parseNumber(getField(columns.Efficiency), v)) {
+      // Rows without traffic still count, e.g. exports with efficiency only.
+      double weight = traffic > 0 ? traffic : 1;
+      efficiencies[key].first += v * weight;
+      efficiencies[key].second += weight;
+    }
+  }
+  if (!hasHeader) {
+    errs() << "drano: " << Path << ": no column with source locations\n";
+    return false;
+  }
+  for (auto& pair : Lines_) {
+    ProfiledLine& profiled = pair.second;
+    if (totalTraffic > 0) {
+      profiled.Share = 100 * profiled.Traffic / totalTraffic;
+    }
+    auto it = efficiencies.find(pair.first);
+    if (it != efficiencies.end()) {
+      profiled.Efficiency = it->second.first / it->second.second;
+    }
+  }
+  return true;
+}
+
+const ProfiledLine* DranoProfile::lookup(
+    const DranoSourceLocation& location) const {
+  if (location.File.empty()) return nullptr;
+  auto it = Lines_.find(getLineKey(location.File, location.Line));
+  return it != Lines_.end() ? &it->second : nullptr;
+}
+
+void DranoProfile::annotate(MutableArrayRef<ModuleReport> Reports) const {
+  for (ModuleReport& report : Reports) {
+    for (DranoFinding& finding : report.Findings) {
+      const ProfiledLine* profiled = lookup(finding.Location);
+      if (!profiled) continue;
+      finding.Profiled = true;
+      finding.ProfileHot = profiled->isHot();
+      finding.ProfileTraffic = profiled->Traffic;
+      finding.ProfileShare = profiled->Share;
+      finding.ProfileEfficiency = profiled->Efficiency;
+    }
+  }
+}
+
+std::vector<const ProfiledLine*> DranoProfile::getMissedLines(
+    ArrayRef<ModuleReport> Reports) const {
+  std::set<std::pair<std::string, unsigned>> found;
+  for (const ModuleReport& report : Reports) {
+    for (const DranoFinding& finding : report.Findings) {
+      found.insert(getLineKey(finding.Location.File, finding.Location.Line));
+    }
+  }
+  std::vector<const ProfiledLine*> missed;
+  for (const auto& pair : Lines_) {
+    const ProfiledLine& profiled = pair.second;
+    if (profiled.isHot() && profiled.isInefficient() &&
+        !found.count(pair.first)) {
+      missed.push_back(&profiled);
+    }
+  }
+  std::stable_sort(missed.begin(), missed.end(),
+                   [](const ProfiledLine* a, const ProfiledLine* b) {
+    return a->Traffic > b->Traffic;
+  });
+  return missed;
+}
+
+static void printProfile(double share, double efficiency, raw_ostream& os) {
+  os << format(" (%.1f%% of traffic", share);
+  if (efficiency >= 0) os << format(", efficiency %.1f%%", efficiency);
+  os << ")";
+}
+
+void DranoProfile::print(ArrayRef<ModuleReport> Reports,
+                         raw_ostream& os) const {
+  os << "Profile: " << Path_ << "\n";
+  for (bool hot : {true, false}) {
+    os << (hot ? "Confirmed hot findings:\n" : "Cold or unprofiled findings:\n");
+    for (const ModuleReport& report : Reports) {
+      if (!report.Error.empty()) continue;
+      for (const DranoFinding& finding : report.Findings) {
+        if (finding.ProfileHot != hot) continue;
+        os << "  " << (finding.Analysis == DranoAnalysisBSI ? "bsi"
+                                                          : "uncoalesced")
+           << " " << finding.Kernel << ": " << finding.Text;
+        if (finding.Profiled) {
+          printProfile(finding.ProfileShare, finding.ProfileEfficiency, os);
+        } else {
+          os << " (not profiled)";
+        }
+        os << "\n";
+      }
+    }
+  }
+  os << "Missed inefficient lines:\n";
+  for (const ProfiledLine* profiled : getMissedLines(Reports)) {
+    os << "  " << profiled->File << ":" << profiled->Line;
+    printProfile(profiled->Share, profiled->Efficiency, os);
+    os << "\n";
+  }
+}
@@ -0,0 +1,96 @@
+//===- DranoProfile.h - Profiler exports joined with drano findings -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// With -profile=<file>, drano reads a CSV export of a GPU profiler (Nsight
+// Compute source view, nvprof) with per-source-line memory statistics, and
+// joins its rows with the findings by debug location:
+//   drano -analysis=all -profile=fleet.csv -report-json=drano.json *.ll
+// No GPU is needed: the profile was collected elsewhere.
+//
+// The first row naming a location is the header. The location is given by
+// a "File" and a "Line" column (or "Source File" and "Line Number"), or by a
+// "Source" column holding "file:line". Columns whose name contains
+// "Transactions" or "Sectors" are summed into the traffic of the line, and
+// a column whose name contains "Efficiency" gives the efficiency of its
+// accesses, in percent. Other columns and rows before the header (e.g.
+// "==PROF==" lines) are ignored. Rows of the same line are merged. Files
+// are matched by name, without their directories, since profiles usually
+// hold absolute paths.
+//
+// A profiled line is hot if it accounts for at least -profile-hot-percent
+// percent of the traffic of the profile, and inefficient if its efficiency
+// is below -profile-efficiency-percent. drano then reports the findings
+// whose line is hot (confirmed), the other findings (cold, or not profiled),
+// and the inefficient hot lines without findings (missed by the analyses).
+//===----------------------------------------------------------------------===//
+
+#ifndef DRANO_PROFILE_H
+#define DRANO_PROFILE_H
+
+#include "DranoDriver.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+
+// Statistics of a source line in the profile.
+struct ProfiledLine {
+  std::string File;
+  unsigned Line = 0;
+
+  // Transactions (or sectors) of the accesses of the line.
+  double Traffic = 0;
+
+  // Share of the traffic of the profile, in percent.
+  double Share = 0;
+
+  // Efficiency of the accesses of the line in percent (-1 if unknown).
+  double Efficiency = -1;
+
+  bool isHot() const;
+  bool isInefficient() const;
+};
+
+class DranoProfile {
+ public:
+  // Reads the CSV file in Path. Returns false on error.
+  bool read(StringRef Path);
+
+  // Returns the profile of the line of location, or null if it was not
+  // profiled.
+  const ProfiledLine* lookup(const DranoSourceLocation& location) const;
+
+  // Records the profile of the line of each finding of Reports.
+  void annotate(MutableArrayRef<ModuleReport> Reports) const;
+
+  // Returns the inefficient hot lines without findings in Reports, hottest
+  // first.
+  std::vector<const ProfiledLine*> getMissedLines(
+      ArrayRef<ModuleReport> Reports) const;
+
+  // Prints the confirmed and cold findings of Reports (annotated first) and
+  // the missed lines.
+  void print(ArrayRef<ModuleReport> Reports, raw_ostream& os) const;
+
+ private:
+  std::string Path_;
+
+  // Map from file names (without directories) and lines to their profile.
+  std::map<std::pair<std::string, unsigned>, ProfiledLine> Lines_;
+};
+
+}
+
+#endif /* DranoProfile.h */
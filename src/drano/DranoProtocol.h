@@ -0,0 +1,134 @@
+//===- DranoProtocol.h - Messages between drano -serve and drano-client -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// A client connects to the Unix domain socket of the server and sends one
+// request per connection. Every message is a u32 length (at most
+// MaxDranoMessageSize) followed by its payload, encoded with CacheWriter (see
+// SummaryCache.h). The socket is only accessible to the user running the
+// server.
+//
+// Request (client to server):
+//   u8 analyses (DranoAnalysisFlags), u8 input kind (DranoInputKind),
+//   string name, string contents (IR buffer or absolute path)
+// Responses (server to client), until a DranoDone or DranoError response:
+//   u8 response kind (DranoResponseKind), string text
+// DranoResult responses hold the results of one kernel each and are sent as
+// soon as the kernel is analyzed. The client cancels a request by sending
+// any data or closing its end of the connection.
+//===----------------------------------------------------------------------===//
+
+#ifndef DRANO_PROTOCOL_H
+#define DRANO_PROTOCOL_H
+
+#include "SummaryCache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Path.h"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace llvm;
+
+// Analyses run by drano (a bit mask).
+enum DranoAnalysisFlags {
+  DranoAnalysisUncoalesced = 1,
+  DranoAnalysisBSI = 2,
+  DranoAnalysisAll = DranoAnalysisUncoalesced | DranoAnalysisBSI
+};
+
+enum DranoInputKind {
+  DranoInputBuffer = 0,
+  DranoInputPath = 1
+};
+
+enum DranoResponseKind {
+  DranoResult = 0,
+  DranoDone = 1,
+  DranoError = 2
+};
+
+// Largest message accepted, so that a peer cannot make the other end
+// allocate up to 4 GiB. Larger modules are sent by path.
+static const uint32_t MaxDranoMessageSize = 256 << 20;
+
+// Returns the socket used when none is given: drano-<uid>.sock in the
+// temporary directory.
+inline std::string getDefaultDranoSocketPath() {
+  SmallString<128> path;
+  sys::path::system_temp_directory(/*ErasedOnReboot=*/true, path);
+  sys::path::append(path, "drano-" + std::to_string(getuid()) + ".sock");
+  return path.str().str();
+}
+
+// Fills addr with the address of the socket at path. Returns false if the
+// path is too long.
+inline bool getDranoSocketAddress(StringRef path, sockaddr_un& addr) {
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) return false;
+  memcpy(addr.sun_path, path.data(), path.size());
+  return true;
+}
+
+inline bool writeAll(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+inline bool readAll(int fd, char* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = read(fd, data, size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+// Sends a message. Returns false if the connection is closed.
+inline bool sendDranoMessage(int fd, const std::string& payload) {
+  CacheWriter W;
+  W.writeU32(payload.size());
+  return writeAll(fd, W.getBuffer().data(), W.getBuffer().size()) &&
+         writeAll(fd, payload.data(), payload.size());
+}
+
+// Receives a message. Returns false if the connection is closed or if the
+// message is larger than MaxDranoMessageSize.
+inline bool receiveDranoMessage(int fd, std::string& payload) {
+  char header[4];
+  if (!readAll(fd, header, sizeof(header))) return false;
+  uint32_t size = CacheReader(StringRef(header, sizeof(header))).readU32();
+  if (size > MaxDranoMessageSize) return false;
+  payload.resize(size);
+  return size == 0 || readAll(fd, &payload[0], size);
+}
+
+// Sends a response of the given kind.
+inline bool sendDranoResponse(int fd, DranoResponseKind kind,
+                              StringRef text) {
+  CacheWriter W;
+  W.writeU8(kind);
+  W.writeString(text);
+  return sendDranoMessage(fd, W.getBuffer());
+}
+
+#endif /* DranoProtocol.h */
@@ -0,0 +1,455 @@
+#include "DranoReport.h"
+
+#include "Hotness.h"
+#include "InterprocBSIAnalysisPass.h"
+#include "InterprocUncoalescedAnalysisPass.h"
+#include "MultiplierValue.h"
+#include "SourceOrder.h"
+
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+
+#include <algorithm>
+#include <map>
+
+using namespace llvm;
+
+static const char* const DimensionNames[] = {"x", "y", "z"};
+
+static DranoSourceLocation getSourceLocation(const Instruction* I) {
+  DranoSourceLocation location;
+  if (const DILocation* L = I->getDebugLoc().get()) {
+    location.File = L->getFilename().str();
+    location.Line = L->getLine();
+    location.Column = L->getColumn();
+    location.Directory = L->getDirectory().str();
+  }
+  return location;
+}
+
+static DranoSourceLocation getSourceLocation(const Function* F) {
+  DranoSourceLocation location;
+  if (const DISubprogram* SP = F->getSubprogram()) {
+    location.File = SP->getFilename().str();
+    location.Line = SP->getLine();
+    location.Directory = SP->getDirectory().str();
+  }
+  return location;
+}
+
+// Returns the accessed pointer of I, if it is a load or a store.
+static const Value* getAccessedPointer(const Instruction* I) {
+  if (const LoadInst* LI = dyn_cast<LoadInst>(I)) {
+    return LI->getPointerOperand();
+  }
+  if (const StoreInst* SI = dyn_cast<StoreInst>(I)) {
+    return SI->getPointerOperand();
+  }
+  return nullptr;
+}
+
+// Returns the size in bytes of the value loaded or stored by I (0 for other
+// instructions).
+static uint64_t getAccessSize(const Instruction* I) {
+  const Type* type = nullptr;
+  if (const LoadInst* LI = dyn_cast<LoadInst>(I)) {
+    type = LI->getType();
+  } else if (const StoreInst* SI = dyn_cast<StoreInst>(I)) {
+    type = SI->getValueOperand()->getType();
+  }
+  if (!type || !type->isSized()) return 0;
+  const DataLayout& DL = I->getModule()->getDataLayout();
+  return DL.getTypeStoreSize(const_cast<Type*>(type)).getFixedSize();
+}
+
+// Returns a finding for the access I reached through trace (I first).
+static DranoFinding getFinding(DranoAnalysisFlags Analysis,
+                               const Function* Kernel,
+                               const AccessTrace& trace,
+                               HotnessEstimator& hotness) {
+  const Instruction* I = trace[0];
+  DranoFinding finding;
+  finding.LoopDepth = hotness.getLoopDepth(trace);
+  finding.ExecutionWeight = hotness.getWeight(trace);
+  finding.Analysis = Analysis;
+  finding.Kernel = Kernel->getName().str();
+  finding.KernelLocation = getSourceLocation(Kernel);
+  finding.Location = getSourceLocation(I);
+  for (unsigned i = 1; i < trace.size(); i++) {
+    finding.CallSites.push_back(getSourceLocation(trace[i]));
+  }
+  finding.Function = demangle(I->getFunction()->getName().str().c_str());
+  finding.AccessType = I->getOpcodeName();
+  if (const Value* p = getAccessedPointer(I)) {
+    finding.AddressSpace = p->getType()->getPointerAddressSpace();
+  }
+  return finding;
+}
+
+void llvm::addUncoalescedFindings(const InterprocUncoalescedResult& result,
+                                  AccessFingerprinter& fingerprinter,
+                                  ModuleReport& report) {
+  HotnessEstimator hotness;
+  for (const Function* F : result.Roots) {
+    auto it = result.RootAccessMap.find(F);
+    if (it == result.RootAccessMap.end()) continue;
+    for (const AccessTrace& trace :
+             getInSourceOrder<AccessTrace>(it->second)) {
+      DranoFinding finding = getFinding(DranoAnalysisUncoalesced, F, trace,
+                                        hotness);
+      finding.Fingerprint = fingerprinter.getFingerprint(trace);
+      raw_string_ostream os(finding.Text);
+      printAccessTrace(trace, os);
+      os.flush();
+      auto iit = result.AccessInfoMap.find(trace[0]);
+      if (iit != result.AccessInfoMap.end()) {
+        finding.AbstractValue =
+            iit->second.getMultiplierValue().getString();
+        finding.ElementSize = iit->second.ElementSize;
+        TransactionCost cost = getTransactionCost(trace[0], iit->second,
+            getUncoalescedWarpSize(), result.getRootShape(F));
+        finding.HasCost = true;
+        finding.Gather = cost.Gather;
+        finding.Sectors = cost.Sectors;
+        finding.Transactions = cost.Transactions;
+        finding.IdealSectors = cost.IdealSectors;
+        // The dimensions of the thread index the address depends on.
+        MultiplierValue v = iit->second.getMultiplierValue();
+        for (unsigned dim = 0; dim < 3; dim++) {
+          MultiplierValueType type = v.getDimension(dim).getType();
+          if (type != MultiplierValueType::ZERO &&
+              type != MultiplierValueType::BOT) {
+            finding.Dimensions.push_back(DimensionNames[dim]);
+          }
+        }
+      } else {
+        // Unknown reason: reported along x, where the threads of a warp
+        // differ when the block shape is unknown.
+        finding.Dimensions.push_back(DimensionNames[0]);
+      }
+      report.Findings.push_back(finding);
+    }
+  }
+}
+
+// Returns the names of the reasons in the mask of DranoBSIReason.
+static std::string getReasonNames(unsigned Reasons) {
+  static const std::pair<DranoBSIReason, const char*> Names[] = {
+    {DranoBSIAddress, "address"}, {DranoBSIValue, "value"},
+    {DranoBSIPath, "path"}, {DranoBSICallee, "callee"},
+    {DranoBSIUnknownCallee, "unknown-callee"},
+    {DranoBSISyncThreads, "syncthreads"}};
+  std::string names;
+  for (const auto& name : Names) {
+    if (!(Reasons & name.first)) continue;
+    if (!names.empty()) names += "|";
+    names += name.second;
+  }
+  return names;
+}
+
+void llvm::addBSIFindings(const InterprocBSIResult& result,
+                          AccessFingerprinter& fingerprinter,
+                          ModuleReport& report) {
+  // Callees are inlined before this analysis, so the loops are those of the
+  // inlined module.
+  HotnessEstimator hotness;
+  for (const Function* F : result.Functions) {
+    if (!result.EntryPoints.count(F)) continue;
+    const BSIFunctionResult& functionResult = result.FunctionResults.at(F);
+    for (const Instruction* I : getInSourceOrder<const Instruction*>(
+             functionResult.DependentAccesses)) {
+      DranoFinding finding = getFinding(DranoAnalysisBSI, F, AccessTrace{I},
+                                        hotness);
+      finding.Fingerprint = fingerprinter.getFingerprint(I);
+      raw_string_ostream os(finding.Text);
+      I->getDebugLoc().print(os);
+      os.flush();
+      finding.ElementSize = getAccessSize(I);
+      auto it = functionResult.Dependences.find(I);
+      if (it != functionResult.Dependences.end()) {
+        finding.AbstractValue = getReasonNames(it->second.Reasons);
+        for (unsigned dim = 0; dim < 3; dim++) {
+          if (it->second.Dimensions & (1 << dim)) {
+            finding.Dimensions.push_back(DimensionNames[dim]);
+          }
+        }
+      }
+      report.Findings.push_back(finding);
+    }
+  }
+}
+
+static const char* getAnalysisName(DranoAnalysisFlags Analysis) {
+  return Analysis == DranoAnalysisBSI ? "bsi" : "uncoalesced";
+}
+
+static const char* getRuleId(DranoAnalysisFlags Analysis) {
+  return Analysis == DranoAnalysisBSI ? "block-size-dependence"
+                                      : "uncoalesced-access";
+}
+
+// Returns the findings of report sorted by source location, then by
+// analysis, kernel and fingerprint.
+static std::vector<const DranoFinding*> getSortedFindings(
+    const ModuleReport& report) {
+  std::vector<const DranoFinding*> findings;
+  for (const DranoFinding& finding : report.Findings) {
+    findings.push_back(&finding);
+  }
+  std::sort(findings.begin(), findings.end(),
+            [](const DranoFinding* a, const DranoFinding* b) {
+    return std::tie(a->Location.File, a->Location.Line, a->Location.Column,
+                    a->Analysis, a->Kernel, a->Fingerprint) <
+           std::tie(b->Location.File, b->Location.Line, b->Location.Column,
+                    b->Analysis, b->Kernel, b->Fingerprint);
+  });
+  return findings;
+}
+
+static void writeLocation(json::OStream& J,
+                          const DranoSourceLocation& location) {
+  J.attribute("file", location.File);
+  J.attribute("line", location.Line);
+  J.attribute("column", location.Column);
+}
+
+static void writeCost(json::OStream& J, const DranoFinding& finding) {
+  if (!finding.HasCost) return;
+  J.attributeObject("cost", [&] {
+    J.attribute("gather", finding.Gather);
+    J.attribute("sectors", finding.Sectors);
+    J.attribute("transactions", finding.Transactions);
+    J.attribute("idealSectors", finding.IdealSectors);
+  });
+}
+
+static void writeProfile(json::OStream& J, const DranoFinding& finding) {
+  if (!finding.Profiled) return;
+  J.attributeObject("profile", [&] {
+    J.attribute("hot", finding.ProfileHot);
+    J.attribute("traffic", finding.ProfileTraffic);
+    J.attribute("share", finding.ProfileShare);
+    if (finding.ProfileEfficiency >= 0) {
+      J.attribute("efficiency", finding.ProfileEfficiency);
+    }
+  });
+}
+
+static void writeFinding(json::OStream& J, const DranoFinding& finding) {
+  J.object([&] {
+    J.attribute("analysis", getAnalysisName(finding.Analysis));
+    J.attribute("kernel", demangle(finding.Kernel.c_str()));
+    J.attribute("function", finding.Function);
+    writeLocation(J, finding.Location);
+    J.attribute("accessType", finding.AccessType);
+    J.attribute("addressSpace", finding.AddressSpace);
+    J.attribute("abstractValue", finding.AbstractValue);
+    J.attribute("elementSize", finding.ElementSize);
+    J.attributeArray("dimensions", [&] {
+      for (const std::string& dim : finding.Dimensions) J.value(dim);
+    });
+    writeCost(J, finding);
+    J.attribute("loopDepth", finding.LoopDepth);
+    J.attribute("executionWeight", finding.ExecutionWeight);
+    J.attribute("hotness", finding.getHotness());
+    writeProfile(J, finding);
+    J.attributeArray("callSites", [&] {
+      for (const DranoSourceLocation& callSite : finding.CallSites) {
+        J.object([&] { writeLocation(J, callSite); });
+      }
+    });
+    J.attribute("fingerprint", finding.Fingerprint);
+  });
+}
+
+// Opens Path for writing a report.
+static std::unique_ptr<raw_fd_ostream> openReport(StringRef Path) {
+  std::error_code EC;
+  auto out = std::make_unique<raw_fd_ostream>(Path, EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << "drano: " << Path << ": " << EC.message() << "\n";
+    return nullptr;
+  }
+  return out;
+}
+
+bool llvm::writeJSONReport(StringRef Path, ArrayRef<ModuleReport> Reports,
+                           const DranoProfile* Profile) {
+  std::unique_ptr<raw_fd_ostream> out = openReport(Path);
+  if (!out) return false;
+  json::OStream J(*out, 2);
+  J.object([&] {
+    J.attribute("version", DRANO_JSON_REPORT_VERSION);
+    J.attributeArray("modules", [&] {
+      for (const ModuleReport& report : Reports) {
+        J.object([&] {
+          J.attribute("module", report.Filename);
+          if (!report.Error.empty()) {
+            J.attribute("error", report.Error);
+            return;
+          }
+          J.attributeArray("findings", [&] {
+            for (const DranoFinding* finding : getSortedFindings(report)) {
+              writeFinding(J, *finding);
+            }
+          });
+        });
+      }
+    });
+    if (!Profile) return;
+    J.attributeArray("missedProfiledLines", [&] {
+      for (const ProfiledLine* profiled : Profile->getMissedLines(Reports)) {
+        J.object([&] {
+          J.attribute("file", profiled->File);
+          J.attribute("line", profiled->Line);
+          J.attribute("traffic", profiled->Traffic);
+          J.attribute("share", profiled->Share);
+          J.attribute("efficiency", profiled->Efficiency);
+        });
+      }
+    });
+  });
+  *out << "\n";
+  return true;
+}
+
+static void writeSARIFRule(json::OStream& J, DranoAnalysisFlags Analysis,
+                           StringRef Description) {
+  J.object([&] {
+    J.attribute("id", getRuleId(Analysis));
+    J.attributeObject("shortDescription", [&] {
+      J.attribute("text", Description);
+    });
+    J.attributeObject("defaultConfiguration", [&] {
+      J.attribute("level", "warning");
+    });
+  });
+}
+
+static void writeSARIFResult(json::OStream& J, const ModuleReport& report,
+                             const DranoFinding& finding) {
+  std::string kernel = demangle(finding.Kernel.c_str());
+  std::string message;
+  if (finding.Analysis == DranoAnalysisBSI) {
+    message = "Block-size dependent " + finding.AccessType + " in kernel " +
+              kernel + " (" + finding.AbstractValue + ")";
+  } else {
+    message = "Uncoalesced " + finding.AccessType + " in kernel " + kernel +
+              " (thread ID multiplier " + finding.AbstractValue + ")";
+  }
+  J.object([&] {
+    J.attribute("ruleId", getRuleId(finding.Analysis));
+    J.attribute("level", "warning");
+    J.attributeObject("message", [&] { J.attribute("text", message); });
+    J.attributeArray("locations", [&] {
+      J.object([&] {
+        J.attributeObject("physicalLocation", [&] {
+          J.attributeObject("artifactLocation", [&] {
+            J.attribute("uri", finding.Location.File.empty() ?
+                report.Filename : finding.Location.File);
+          });
+          // Lines and columns start at 1 in SARIF; 0 means unknown here.
+          if (finding.Location.Line > 0) {
+            J.attributeObject("region", [&] {
+              J.attribute("startLine", finding.Location.Line);
+              if (finding.Location.Column > 0) {
+                J.attribute("startColumn", finding.Location.Column);
+              }
+            });
+          }
+        });
+        J.attributeArray("logicalLocations", [&] {
+          J.object([&] {
+            J.attribute("fullyQualifiedName", finding.Function);
+            J.attribute("kind", "function");
+          });
+        });
+      });
+    });
+    J.attributeObject("partialFingerprints", [&] {
+      J.attribute("dranoFingerprint/v1", finding.Fingerprint);
+    });
+    J.attributeObject("properties", [&] {
+      J.attribute("module", report.Filename);
+      J.attribute("kernel", kernel);
+      J.attribute("accessType", finding.AccessType);
+      J.attribute("addressSpace", finding.AddressSpace);
+      J.attribute("abstractValue", finding.AbstractValue);
+      J.attribute("elementSize", finding.ElementSize);
+      J.attributeArray("dimensions", [&] {
+        for (const std::string& dim : finding.Dimensions) J.value(dim);
+      });
+      writeCost(J, finding);
+      J.attribute("loopDepth", finding.LoopDepth);
+      J.attribute("executionWeight", finding.ExecutionWeight);
+      J.attribute("hotness", finding.getHotness());
+      writeProfile(J, finding);
+    });
+  });
+}
+
+bool llvm::writeSARIFReport(StringRef Path, ArrayRef<ModuleReport> Reports) {
+  std::unique_ptr<raw_fd_ostream> out = openReport(Path);
+  if (!out) return false;
+  json::OStream J(*out, 2);
+  J.object([&] {
+    J.attribute("$schema", "https://json.schemastore.org/sarif-2.1.0.json");
+    J.attribute("version", "2.1.0");
+    J.attributeArray("runs", [&] {
+      J.object([&] {
+        J.attributeObject("tool", [&] {
+          J.attributeObject("driver", [&] {
+            J.attribute("name", "drano");
+            J.attributeArray("rules", [&] {
+              writeSARIFRule(J, DranoAnalysisUncoalesced,
+                  "Uncoalesced global memory access");
+              writeSARIFRule(J, DranoAnalysisBSI,
+                  "Block-size dependent instruction");
+            });
+          });
+        });
+        J.attributeArray("results", [&] {
+          for (const ModuleReport& report : Reports) {
+            if (!report.Error.empty()) continue;
+            for (const DranoFinding* finding : getSortedFindings(report)) {
+              writeSARIFResult(J, report, *finding);
+            }
+          }
+        });
+      });
+    });
+  });
+  *out << "\n";
+  return true;
+}
+
+void llvm::printHotFindings(const ModuleReport& report, unsigned N,
+                            raw_ostream& os) {
+  // Findings of each kernel, hottest first, then in source order.
+  std::map<std::string, std::vector<const DranoFinding*>> kernelFindings;
+  for (const DranoFinding* finding : getSortedFindings(report)) {
+    kernelFindings[finding->Kernel].push_back(finding);
+  }
+  os << "Hot findings:\n";
+  for (auto& pair : kernelFindings) {
+    std::vector<const DranoFinding*>& findings = pair.second;
+    std::stable_sort(findings.begin(), findings.end(),
+                     [](const DranoFinding* a, const DranoFinding* b) {
+      return a->getHotness() > b->getHotness();
+    });
+    os << "  Kernel: " << pair.first << "\n";
+    for (unsigned i = 0; i < findings.size() && i < N; i++) {
+      const DranoFinding& finding = *findings[i];
+      os << "    " << i + 1 << ". " << getAnalysisName(finding.Analysis)
+         << " " << finding.Text
+         << format(" (hotness %.1f, loop depth %u)", finding.getHotness(),
+                   finding.LoopDepth) << "\n";
+    }
+  }
+}
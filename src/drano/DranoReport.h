@@ -0,0 +1,81 @@
+//===- DranoReport.h - Structured reports of drano findings -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// With -report-json=<file> and -report-sarif=<file>, drano writes its
+// findings in a form that other tools read without parsing the text report:
+//   drano -analysis=all -report-json=drano.json -report-sarif=drano.sarif *.ll
+// Each finding carries the source location of the access (file, line and
+// column, from its debug location), the demangled names of the enclosing
+// function and of the kernel, the type of access, the address space, the
+// abstract value found by the analysis, the size of the accessed elements
+// and the thread dimensions in which it holds, plus the call sites through
+// which the access is reached and its fingerprint (see DranoBaseline.h).
+// Uncoalesced accesses also carry their estimated cost per warp request
+// (sectors, transactions and the sectors of a coalesced access). Findings
+// are weighted by the loops enclosing the access and its call sites (loop
+// depth, and estimated executions per kernel execution from the trip counts
+// ScalarEvolution computes); the hotness of a finding is that weight, times
+// the sectors per warp request for uncoalesced accesses. With -profile,
+// findings carry the profile of their line (see DranoProfile.h).
+//
+// Modules are listed in the order they were given and findings are sorted
+// by source location, with ties broken by analysis, kernel and fingerprint.
+// Reports do not contain timings, so they are byte-identical across runs on
+// the same inputs, whatever the number of threads.
+//
+// The SARIF report follows SARIF 2.1.0, with one rule per analysis
+// ("uncoalesced-access" and "block-size-dependence") and the fingerprint as
+// the "dranoFingerprint/v1" partial fingerprint, so that code scanning tools
+// track findings across commits.
+//===----------------------------------------------------------------------===//
+
+#ifndef DRANO_REPORT_H
+#define DRANO_REPORT_H
+
+#include "DranoBaseline.h"
+#include "DranoDriver.h"
+#include "DranoProfile.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Version of the JSON report format.
+#define DRANO_JSON_REPORT_VERSION 1
+
+namespace llvm {
+
+struct InterprocUncoalescedResult;
+struct InterprocBSIResult;
+
+// Adds the uncoalesced accesses of each top-most function to the findings
+// of report.
+void addUncoalescedFindings(const InterprocUncoalescedResult& result,
+                            AccessFingerprinter& fingerprinter,
+                            ModuleReport& report);
+
+// Adds the block-size dependent accesses of each entry point to the
+// findings of report.
+void addBSIFindings(const InterprocBSIResult& result,
+                    AccessFingerprinter& fingerprinter, ModuleReport& report);
+
+// Prints the N hottest findings of each kernel of report (see
+// DranoFinding::getHotness).
+void printHotFindings(const ModuleReport& report, unsigned N,
+                      raw_ostream& os);
+
+// Writes the findings of Reports as JSON (or SARIF) to Path. The JSON
+// report also lists the lines of Profile missed by the analyses, if
+// provided. Returns false on error.
+bool writeJSONReport(StringRef Path, ArrayRef<ModuleReport> Reports,
+                     const DranoProfile* Profile = nullptr);
+bool writeSARIFReport(StringRef Path, ArrayRef<ModuleReport> Reports);
+
+}
+
+#endif /* DranoReport.h */
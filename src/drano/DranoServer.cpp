@@ -0,0 +1,140 @@
+#include "DranoServer.h"
+
+#include "DranoDriver.h"
+#include "DranoProtocol.h"
+#include "SummaryCache.h"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+
+#include <chrono>
+#include <poll.h>
+#include <sys/stat.h>
+
+using namespace llvm;
+
+// Has the client sent data or closed the connection since its request?
+// Either cancels the request.
+static bool isCancelled(int fd) {
+  pollfd pfd;
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  return poll(&pfd, 1, 0) > 0 && pfd.revents != 0;
+}
+
+// Does a server answer on the socket at addr?
+static bool isServerListening(const sockaddr_un& addr) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return false;
+  bool listening = connect(fd, reinterpret_cast<const sockaddr*>(&addr),
+                           sizeof(addr)) == 0;
+  close(fd);
+  return listening;
+}
+
+// Handles a single request on the connection fd.
+static void handleConnection(int fd, SummaryStore& Store) {
+  std::string request;
+  if (!receiveDranoMessage(fd, request)) return;
+  CacheReader R(request);
+  unsigned analyses = R.readU8();
+  unsigned kind = R.readU8();
+  std::string name = R.readString();
+  std::string contents = R.readString();
+  if (R.hasError()) {
+    sendDranoResponse(fd, DranoError, "drano: malformed request\n");
+    return;
+  }
+
+  // The module must be destroyed before its context.
+  LLVMContext Context;
+  SMDiagnostic Err;
+  ModuleReport report;
+  report.Filename = name;
+  auto start = std::chrono::steady_clock::now();
+  std::unique_ptr<Module> M = kind == DranoInputPath ?
+      loadModule(contents, Context, Err) :
+      loadModule(MemoryBuffer::getMemBufferCopy(contents, name), Context, Err);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  report.ParseTime = elapsed.count();
+  if (!M) {
+    raw_string_ostream os(report.Error);
+    Err.print("drano", os);
+    sendDranoResponse(fd, DranoError, os.str());
+    return;
+  }
+
+  bool completed = analyzeModule(*M, analyses, report, &Store,
+      [fd](DranoAnalysisFlags Analysis, StringRef Kernel, StringRef Results) {
+        return !isCancelled(fd) &&
+               sendDranoResponse(fd, DranoResult, Results);
+      });
+  if (!completed) return;
+  std::string timings;
+  raw_string_ostream os(timings);
+  report.printTimings(analyses, os);
+  sendDranoResponse(fd, DranoDone, os.str());
+}
+
+int llvm::runDranoServer(StringRef SocketPath, unsigned Jobs) {
+  sockaddr_un addr;
+  if (!getDranoSocketAddress(SocketPath, addr)) {
+    errs() << "drano: socket path too long: " << SocketPath << "\n";
+    return 1;
+  }
+  int listenFD = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenFD < 0) {
+    errs() << "drano: socket: " << strerror(errno) << "\n";
+    return 1;
+  }
+  // Replace the socket left by a previous server, but never that of a
+  // running one.
+  if (isServerListening(addr)) {
+    errs() << "drano: a server is already listening on " << SocketPath
+           << "\n";
+    close(listenFD);
+    return 1;
+  }
+  sys::fs::file_status status;
+  if (!sys::fs::status(SocketPath, status) &&
+      status.type() == sys::fs::file_type::socket_file) {
+    unlink(addr.sun_path);
+  }
+  // Requests make the server read arbitrary files with its privileges, so
+  // the socket is created accessible to its user only.
+  mode_t mask = umask(0177);
+  int bound = bind(listenFD, reinterpret_cast<sockaddr*>(&addr),
+                   sizeof(addr));
+  umask(mask);
+  if (bound < 0 || chmod(addr.sun_path, 0600) < 0 ||
+      listen(listenFD, SOMAXCONN) < 0) {
+    errs() << "drano: " << SocketPath << ": " << strerror(errno) << "\n";
+    close(listenFD);
+    return 1;
+  }
+
+  // Summaries shared by all requests.
+  MemorySummaryStore Store;
+  ThreadPool Pool(heavyweight_hardware_concurrency(Jobs));
+  errs() << "drano: listening on " << SocketPath << " ("
+         << Pool.getThreadCount() << " threads)\n";
+  while (true) {
+    int fd = accept(listenFD, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      errs() << "drano: accept: " << strerror(errno) << "\n";
+      break;
+    }
+    Pool.async([fd, &Store] {
+      handleConnection(fd, Store);
+      close(fd);
+    });
+  }
+  Pool.wait();
+  close(listenFD);
+  unlink(addr.sun_path);
+  return 1;
+}
@@ -0,0 +1,29 @@
+//===- DranoServer.h - Analysis server of drano -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// In server mode (drano -serve), drano listens on a Unix domain socket and
+// analyzes the modules sent by drano-client (see DranoProtocol.h). Requests
+// are queued on a thread pool, and summaries of analyzed functions are kept
+// in memory across requests, keyed by their structural hash, so unchanged
+// callees are not analyzed again.
+//===----------------------------------------------------------------------===//
+
+#ifndef DRANO_SERVER_H
+#define DRANO_SERVER_H
+
+#include "llvm/ADT/StringRef.h"
+
+namespace llvm {
+
+// Serves requests on the socket at SocketPath with Jobs worker threads (0
+// for one per core). Returns only on error, with the process exit code.
+int runDranoServer(StringRef SocketPath, unsigned Jobs);
+
+}
+
+#endif /* DranoServer.h */
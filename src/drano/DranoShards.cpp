@@ -0,0 +1,264 @@
+#include "DranoShards.h"
+
+#include "EntryPoints.h"
+#include "InterprocBSIAnalysisPass.h"
+#include "InterprocUncoalescedAnalysisPass.h"
+#include "SummaryCache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <tuple>
+
+using namespace llvm;
+
+// Report file of a worker:
+//   u32 #results
+//   for each result: u8 analysis, string kernel, string printed results
+//   string printed timings
+
+// Returns the value of -analysis for the mask Analyses.
+static const char* getAnalysisOption(unsigned Analyses) {
+  if (Analyses == DranoAnalysisUncoalesced) return "-analysis=uncoalesced";
+  if (Analyses == DranoAnalysisBSI) return "-analysis=bsi";
+  return "-analysis=all";
+}
+
+// Returns the number of instructions in the functions reachable from F.
+static size_t getReachableSize(const Function* F) {
+  size_t size = 0;
+  for (const Function* G : getReachableFunctions({F})) {
+    for (const BasicBlock& BB : *G) size += BB.size();
+  }
+  return size;
+}
+
+// Splits the top-level entry points of the module in Filename into at most
+// NumShards shards of similar size (in instructions reachable from each
+// entry point). The split only depends on the module.
+static bool computeShards(StringRef Filename, unsigned NumShards,
+                          std::vector<std::vector<std::string>>& shards) {
+  LLVMContext Context;
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = loadModule(Filename, Context, Err);
+  if (!M) {
+    Err.print("drano", errs());
+    return false;
+  }
+  std::set<const Function*> entries = getDranoEntryPoints(*M);
+  if (entries.empty()) {
+    entries = getEntryPoints(*M, std::vector<std::string>());
+  }
+
+  // Entry points called from other analyzed functions are analyzed (and
+  // reported) as part of their callers, as in a single-process run.
+  std::set<const Function*> referenced;
+  for (const Function* F : getReachableFunctions(entries)) {
+    for (const Function* G : getReferencedFunctions(F)) {
+      if (G != F) referenced.insert(G);
+    }
+  }
+  std::vector<std::pair<size_t, std::string>> units;
+  for (const Function* F : entries) {
+    if (referenced.count(F)) continue;
+    units.emplace_back(getReachableSize(F), F->getName().str());
+  }
+  if (units.empty()) {
+    for (const Function* F : entries) {
+      units.emplace_back(getReachableSize(F), F->getName().str());
+    }
+  }
+
+  // Assign the largest entry points first, each to the smallest shard.
+  std::sort(units.begin(), units.end(),
+      [](const std::pair<size_t, std::string>& a,
+         const std::pair<size_t, std::string>& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+      });
+  shards.assign(std::min<size_t>(NumShards, units.size()),
+                std::vector<std::string>());
+  std::vector<size_t> sizes(shards.size(), 0);
+  for (const auto& unit : units) {
+    size_t i = std::min_element(sizes.begin(), sizes.end()) - sizes.begin();
+    shards[i].push_back(unit.second);
+    sizes[i] += unit.first;
+  }
+  return true;
+}
+
+bool llvm::runShardedAnalysis(StringRef Argv0, StringRef Filename,
+                              unsigned NumShards, unsigned Analyses,
+                              StringRef ShardDir, raw_ostream& os) {
+  std::vector<std::vector<std::string>> shards;
+  if (!computeShards(Filename, NumShards, shards)) return false;
+
+  SmallString<128> dir(ShardDir);
+  std::error_code EC = dir.empty() ?
+      sys::fs::createUniqueDirectory("drano-shards", dir) :
+      sys::fs::create_directories(dir);
+  if (EC) {
+    errs() << "drano: " << dir << ": " << EC.message() << "\n";
+    return false;
+  }
+
+  // The launch configurations of the kernels are handed to the workers
+  // through a sidecar file.
+  std::string launchConfigsPath;
+  LaunchConfigMap launchConfigs = getUncoalescedLaunchConfigs();
+  if (!launchConfigs.empty()) {
+    SmallString<128> path(dir);
+    sys::path::append(path, "launch-configs.txt");
+    launchConfigsPath = path.str().str();
+    std::string error;
+    if (!writeLaunchConfigs(launchConfigsPath, launchConfigs, error)) {
+      errs() << "drano: " << error << "\n";
+      return false;
+    }
+  }
+
+  // Start the workers.
+  std::string exe = sys::fs::getMainExecutable(Argv0.str().c_str(),
+      reinterpret_cast<void*>(&runShardedAnalysis));
+  std::vector<std::string> reportPaths;
+  std::vector<sys::ProcessInfo> workers;
+  bool failed = false;
+  for (unsigned i = 0; i < shards.size(); i++) {
+    SmallString<128> reportPath(dir);
+    sys::path::append(reportPath, "shard-" + std::to_string(i) + ".report");
+    sys::fs::remove(reportPath);
+    reportPaths.push_back(reportPath.str().str());
+    std::vector<std::string> args = {
+      exe, "-shard-worker", getAnalysisOption(Analyses),
+      "-shard-roots=" + join(shards[i], ","),
+      "-shard-dir=" + dir.str().str(),
+      "-shard-report=" + reportPaths.back(),
+      Filename.str()
+    };
+    std::vector<std::string> entryNames = getUncoalescedEntryPointNames();
+    if (!entryNames.empty()) {
+      args.push_back("-uncoalesced-entry-points=" + join(entryNames, ","));
+    }
+    entryNames = getBSIEntryPointNames();
+    if (!entryNames.empty()) {
+      args.push_back("-bsi-entry-points=" + join(entryNames, ","));
+    }
+    if (!launchConfigsPath.empty()) {
+      args.push_back("-uncoalesced-launch-configs=" + launchConfigsPath);
+    }
+    // The other options that affect the analyses, so that the results are
+    // those of a single-process run.
+    args.push_back("-uncoalesced-warp-size=" +
+                   std::to_string(getUncoalescedWarpSize()));
+    BlockShape shape = getUncoalescedBlockShape();
+    if (shape.isKnown()) {
+      args.push_back("-uncoalesced-block-dim=" + std::to_string(shape.X) +
+                     "," + std::to_string(shape.Y) + "," +
+                     std::to_string(shape.Z));
+    }
+    if (isUncoalescedStreamingEnabled()) args.push_back("-uncoalesced-stream");
+    if (getUncoalescedMemoryStats()) {
+      args.push_back("-uncoalesced-memory-stats");
+    }
+    if (getBSIMemoryStats()) args.push_back("-bsi-memory-stats");
+    std::vector<StringRef> argRefs(args.begin(), args.end());
+    std::string errMsg;
+    bool execFailed = false;
+    workers.push_back(sys::ExecuteNoWait(exe, argRefs, None, {}, 0, &errMsg,
+                                         &execFailed));
+    if (execFailed) {
+      errs() << "drano: cannot start worker: " << errMsg << "\n";
+      failed = true;
+    }
+  }
+
+  // Wait for the workers and merge their reports.
+  std::map<std::pair<unsigned, std::string>, std::string> results;
+  std::vector<std::string> timings(shards.size());
+  for (unsigned i = 0; i < workers.size(); i++) {
+    if (workers[i].Pid == sys::ProcessInfo::InvalidPid) continue;
+    std::string errMsg;
+    sys::ProcessInfo PI = sys::Wait(workers[i], 0, /*WaitUntilTerminates=*/true,
+                                    &errMsg);
+    std::string contents;
+    if (PI.ReturnCode != 0 || !readCacheEntry(reportPaths[i], contents)) {
+      errs() << "drano: shard " << i << " of " << Filename << " failed"
+             << (errMsg.empty() ? "" : ": ") << errMsg << "\n";
+      failed = true;
+      continue;
+    }
+    CacheReader R(contents);
+    uint32_t numResults = R.readU32();
+    for (uint32_t r = 0; r < numResults && !R.hasError(); r++) {
+      unsigned analysis = R.readU8();
+      std::string kernel = R.readString();
+      std::string text = R.readString();
+      // Kernels reached from several shards have the same results in each.
+      results.emplace(std::make_pair(analysis, kernel), text);
+    }
+    timings[i] = R.readString();
+    if (R.hasError()) {
+      errs() << "drano: malformed report of shard " << i << "\n";
+      failed = true;
+    }
+  }
+  if (ShardDir.empty()) sys::fs::remove_directories(dir);
+  if (failed) return false;
+
+  os << "Module: " << Filename << "\n";
+  for (const auto& pair : results) os << pair.second;
+  os << "Timings (seconds):\n";
+  for (unsigned i = 0; i < shards.size(); i++) {
+    os << "Shard " << i << " (" << shards[i].size() << " entry points)\n"
+       << timings[i];
+  }
+  return true;
+}
+
+int llvm::runShardWorker(StringRef Filename, ArrayRef<std::string> Roots,
+                         unsigned Analyses, StringRef ShardDir,
+                         StringRef ReportPath) {
+  // The module must be destroyed before its context.
+  LLVMContext Context;
+  SMDiagnostic Err;
+  ModuleReport report;
+  report.Filename = Filename.str();
+  auto start = std::chrono::steady_clock::now();
+  std::unique_ptr<Module> M = loadModule(Filename, Context, Err,
+      [Roots](const Module& M) { return getNamedFunctions(M, Roots); });
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  report.ParseTime = elapsed.count();
+  if (!M) {
+    Err.print("drano", errs());
+    return 1;
+  }
+
+  DirectorySummaryStore Store(ShardDir);
+  std::vector<std::tuple<unsigned, std::string, std::string>> results;
+  analyzeModule(*M, Analyses, report, &Store,
+      [&results](DranoAnalysisFlags Analysis, StringRef Kernel,
+                 StringRef Results) {
+        results.emplace_back(Analysis, Kernel.str(), Results.str());
+        return true;
+      });
+
+  CacheWriter W;
+  W.writeU32(results.size());
+  for (const auto& result : results) {
+    W.writeU8(std::get<0>(result));
+    W.writeString(std::get<1>(result));
+    W.writeString(std::get<2>(result));
+  }
+  std::string timings;
+  raw_string_ostream os(timings);
+  report.printTimings(Analyses, os);
+  W.writeString(os.str());
+  writeCacheEntry(ShardDir, ReportPath, W.getBuffer());
+  return 0;
+}
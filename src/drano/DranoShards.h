@@ -0,0 +1,51 @@
+//===- DranoShards.h - Multi-process sharded analysis in drano -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// With -shards=<n>, drano analyzes each module in n worker processes. The
+// coordinator splits the top-level entry points of the module (kernels that
+// are not called from other analyzed functions) into n shards of similar
+// size, and runs drano on each shard with -shard-worker. A worker keeps only
+// the functions reachable from its shard, shares function summaries with
+// the other workers through the summary cache in the shard directory, and
+// writes the results of each kernel to a report file. The coordinator
+// merges the reports ordered by analysis and kernel name, so the merged
+// report does not depend on scheduling and holds the same findings as a
+// single-process run.
+//===----------------------------------------------------------------------===//
+
+#ifndef DRANO_SHARDS_H
+#define DRANO_SHARDS_H
+
+#include "DranoDriver.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+
+namespace llvm {
+
+// Analyzes the module in Filename with NumShards worker processes running
+// the executable Argv0. Summaries are exchanged through ShardDir (a new
+// temporary directory if empty). Prints the merged results and the timings
+// of each shard to os. Returns false on error.
+bool runShardedAnalysis(StringRef Argv0, StringRef Filename,
+                        unsigned NumShards, unsigned Analyses,
+                        StringRef ShardDir, raw_ostream& os);
+
+// Runs a worker: analyzes the functions reachable from Roots in the module
+// in Filename and writes the results to ReportPath. Returns the process
+// exit code.
+int runShardWorker(StringRef Filename, ArrayRef<std::string> Roots,
+                   unsigned Analyses, StringRef ShardDir,
+                   StringRef ReportPath);
+
+}
+
+#endif /* DranoShards.h */
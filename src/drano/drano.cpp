@@ -0,0 +1,347 @@
+//===- drano.cpp - Batch driver for the GPU Drano analyses -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// drano runs the interprocedural analyses on many device modules in a single
+// process, e.g.
+//   drano -analysis=all -j 8 -o results.txt *.ll
+//   drano @modules.txt
+//   drano -serve (see DranoServer.h)
+//   drano -shards=8 huge-module.bc (see DranoShards.h)
+//   drano -emit-tu-summary=a.drsum a.bc; drano -link a.drsum b.drsum
+//     (see DranoLink.h)
+//   drano -drano-baseline=base.drb *.ll (see DranoBaseline.h)
+//   drano -report-json=drano.json -report-sarif=drano.sarif *.ll
+//     (see DranoReport.h)
+//   drano -profile=fleet.csv *.ll (see DranoProfile.h)
+//   drano -html-report=drano-html *.ll (see DranoHTML.h)
+//   drano -host-module=app.ll app-cuda-nvptx64-nvidia-cuda-sm_30.ll
+//     (see DranoLaunch.h)
+// Each module is parsed and analyzed as one task of a thread pool, with its
+// own LLVMContext. Bitcode files are memory-mapped and loaded lazily: only
+// the bodies of functions reachable from the entry points are read. The
+// report lists the results of each module in the order the modules were
+// given, followed by the time spent on each module and on each kernel.
+//===----------------------------------------------------------------------===//
+
+#include "BlockSizeInvarianceAnalysis.h"
+#include "DranoBaseline.h"
+#include "DranoDriver.h"
+#include "DranoHTML.h"
+#include "DranoLaunch.h"
+#include "DranoLink.h"
+#include "DranoProfile.h"
+#include "DranoReport.h"
+#include "DranoServer.h"
+#include "DranoShards.h"
+#include "UncoalescedAnalysis.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/ToolOutputFile.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::list<std::string> InputFilenames(cl::Positional, cl::ZeroOrMore,
+    cl::desc("<input .ll/.bc files, or @file with one input per line>"));
+
+static cl::opt<std::string> OutputFilename("o",
+    cl::desc("Output report file (default: standard output)"),
+    cl::value_desc("filename"), cl::init("-"));
+
+static cl::opt<unsigned> Jobs("j",
+    cl::desc("Number of modules analyzed in parallel (default: one per core)"),
+    cl::init(0));
+
+static cl::opt<DranoAnalysisFlags> Analyses("analysis",
+    cl::desc("Analyses to run"),
+    cl::values(clEnumValN(DranoAnalysisUncoalesced, "uncoalesced",
+                          "Uncoalesced access analysis"),
+               clEnumValN(DranoAnalysisBSI, "bsi",
+                          "Block-size invariance analysis"),
+               clEnumValN(DranoAnalysisAll, "all", "Both analyses")),
+    cl::init(DranoAnalysisUncoalesced));
+
+static cl::opt<bool> Serve("serve",
+    cl::desc("Serve requests of drano-client instead of analyzing inputs"));
+
+static cl::opt<std::string> SocketPath("socket",
+    cl::desc("Socket of the server (default: drano-<uid>.sock in the "
+             "temporary directory)"),
+    cl::value_desc("path"), cl::init(""));
+
+static cl::opt<unsigned> Shards("shards",
+    cl::desc("Analyze each module in this many worker processes"),
+    cl::init(0));
+
+static cl::opt<std::string> ShardDir("shard-dir",
+    cl::desc("Directory where workers exchange summaries (default: a new "
+             "temporary directory)"),
+    cl::value_desc("directory"), cl::init(""));
+
+static cl::opt<std::string> EmitTUSummary("emit-tu-summary",
+    cl::desc("Write the summary of the input translation unit, for -link"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<bool> Link("link",
+    cl::desc("Analyze the program made of the translation units whose "
+             "summaries are given as inputs"));
+
+static cl::opt<std::string> Baseline("drano-baseline",
+    cl::desc("Print only the findings added or removed since the baseline, "
+             "and exit with code 2 if findings were added"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<std::string> BaselineOut("drano-baseline-out",
+    cl::desc("Write the findings of this run as a baseline"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<std::string> ReportJSON("report-json",
+    cl::desc("Write the findings as JSON"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<std::string> ReportSARIF("report-sarif",
+    cl::desc("Write the findings as SARIF"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<unsigned> HotFindings("hot-findings",
+    cl::desc("Print the N hottest findings of each kernel"),
+    cl::value_desc("N"), cl::init(0));
+
+static cl::opt<std::string> HTMLReport("html-report",
+    cl::desc("Write a heatmap of the findings over the sources as HTML"),
+    cl::value_desc("directory"), cl::init(""));
+
+static cl::opt<std::string> ProfilePath("profile",
+    cl::desc("CSV export of a GPU profiler to join with the findings"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::list<std::string> HostModules("host-module",
+    cl::desc("Host module of the inputs, whose launch sites give the block "
+             "shapes the kernels are analyzed for"),
+    cl::value_desc("filename"), cl::CommaSeparated);
+
+static cl::opt<std::string> EmitLaunchConfigs("emit-launch-configs",
+    cl::desc("Write the launch configurations recovered from the host "
+             "modules, for opt -uncoalesced-launch-configs"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<bool> ShardWorker("shard-worker", cl::Hidden,
+    cl::desc("Run as a worker of a sharded analysis"));
+
+static cl::list<std::string> ShardRoots("shard-roots", cl::Hidden,
+    cl::desc("Entry points analyzed by the worker"), cl::CommaSeparated);
+
+static cl::opt<std::string> ShardReport("shard-report", cl::Hidden,
+    cl::desc("Report file written by the worker"), cl::init(""));
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Loads and analyzes the module named in report. Summaries are cached in
+// Store if provided.
+static void analyzeModule(ModuleReport& report, SummaryStore* Store) {
+  // The module must be destroyed before its context.
+  LLVMContext Context;
+  SMDiagnostic Err;
+  auto start = std::chrono::steady_clock::now();
+  std::unique_ptr<Module> M = loadModule(report.Filename, Context, Err);
+  report.ParseTime = secondsSince(start);
+  if (!M) {
+    raw_string_ostream os(report.Error);
+    Err.print("drano", os);
+    return;
+  }
+  analyzeModule(*M, Analyses, report, Store);
+}
+
+int main(int argc, char** argv) {
+  InitLLVM X(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv,
+      "GPU Drano: batch analysis of GPU device modules\n");
+
+  if (Serve) {
+    return runDranoServer(SocketPath.empty() ? getDefaultDranoSocketPath()
+                                             : SocketPath, Jobs);
+  }
+  // Launch configurations of the kernels, handed to the analyses of all
+  // inputs.
+  if (!HostModules.empty()) {
+    LaunchConfigMap configs;
+    if (!readHostModules(std::vector<std::string>(HostModules.begin(),
+                                                  HostModules.end()),
+                         configs)) {
+      return 1;
+    }
+    setUncoalescedLaunchConfigs(configs);
+    std::string error;
+    if (!EmitLaunchConfigs.empty() &&
+        !writeLaunchConfigs(EmitLaunchConfigs, configs, error)) {
+      errs() << "drano: " << error << "\n";
+      return 1;
+    }
+  } else if (!EmitLaunchConfigs.empty()) {
+    errs() << "drano: -emit-launch-configs requires -host-module\n";
+    return 1;
+  }
+  if (InputFilenames.empty()) {
+    // Only the launch configurations were requested.
+    if (!EmitLaunchConfigs.empty()) return 0;
+    errs() << "drano: no input files\n";
+    return 1;
+  }
+  if (ShardWorker) {
+    return runShardWorker(InputFilenames[0],
+        std::vector<std::string>(ShardRoots.begin(), ShardRoots.end()),
+        Analyses, ShardDir, ShardReport);
+  }
+
+  bool reportFindings = !ReportJSON.empty() || !ReportSARIF.empty() ||
+                        !HTMLReport.empty() || HotFindings > 0 ||
+                        !ProfilePath.empty();
+  if (reportFindings && (!EmitTUSummary.empty() || Link || Shards > 0)) {
+    errs() << "drano: -report-json, -report-sarif, -html-report, "
+           << "-hot-findings and -profile cannot be used with "
+           << "-emit-tu-summary, -link or -shards\n";
+    return 1;
+  }
+  DranoProfile profile;
+  if (!ProfilePath.empty() && !profile.read(ProfilePath)) return 1;
+
+  std::error_code EC;
+  ToolOutputFile Out(OutputFilename, EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << "drano: " << OutputFilename << ": " << EC.message() << "\n";
+    return 1;
+  }
+
+  if (!EmitTUSummary.empty() || Link) {
+    auto start = std::chrono::steady_clock::now();
+    bool succeeded;
+    if (Link) {
+      succeeded = linkTUSummaries(InputFilenames, Analyses, Out.os());
+    } else if (InputFilenames.size() != 1) {
+      errs() << "drano: -emit-tu-summary takes a single input file\n";
+      return 1;
+    } else {
+      succeeded = emitTUSummary(InputFilenames[0], Analyses, EmitTUSummary,
+                                Out.os());
+    }
+    if (!succeeded) return 1;
+    Out.os() << "Total: " << InputFilenames.size() << " modules"
+             << format(" in %.3f", secondsSince(start)) << "\n";
+    Out.keep();
+    return 0;
+  }
+
+  // Analyze modules one after the other, each with Shards processes.
+  if (Shards > 0) {
+    auto start = std::chrono::steady_clock::now();
+    bool failed = false;
+    for (const std::string& Filename : InputFilenames) {
+      if (!runShardedAnalysis(argv[0], Filename, Shards, Analyses, ShardDir,
+                              Out.os())) {
+        failed = true;
+      }
+    }
+    Out.os() << "Total: " << InputFilenames.size() << " modules"
+             << format(" in %.3f", secondsSince(start)) << " (" << Shards
+             << " processes)\n";
+    Out.keep();
+    return failed ? 1 : 0;
+  }
+
+  if (!HostModules.empty()) {
+    printLaunchConfigs(getUncoalescedLaunchConfigs(), Out.os());
+  }
+
+  // Summaries of the baseline, and of this run for the next baseline.
+  MemorySummaryStore BaselineStore;
+  RecordingSummaryStore Store(BaselineStore);
+  DranoBaseline baseline;
+  bool useBaseline = !Baseline.empty() || !BaselineOut.empty();
+  if (!Baseline.empty() && !baseline.read(Baseline, BaselineStore)) {
+    return 1;
+  }
+
+  std::vector<ModuleReport> reports(InputFilenames.size());
+  for (unsigned i = 0; i < InputFilenames.size(); i++) {
+    reports[i].Filename = InputFilenames[i];
+    reports[i].CollectFindings = useBaseline || reportFindings;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  unsigned numThreads;
+  {
+    ThreadPool Pool(heavyweight_hardware_concurrency(Jobs));
+    numThreads = Pool.getThreadCount();
+    for (ModuleReport& report : reports) {
+      Pool.async([&report, &Store, useBaseline] {
+        analyzeModule(report, useBaseline ? &Store : nullptr);
+      });
+    }
+    Pool.wait();
+  }
+  double totalTime = secondsSince(start);
+
+  if (!ProfilePath.empty()) profile.annotate(reports);
+  bool failed = false;
+  for (const ModuleReport& report : reports) {
+    if (!report.Error.empty()) {
+      errs() << report.Error;
+      failed = true;
+      continue;
+    }
+    if (Baseline.empty()) {
+      Out.os() << "Module: " << report.Filename << "\n" << report.Results;
+      if (HotFindings > 0) printHotFindings(report, HotFindings, Out.os());
+    }
+  }
+  unsigned added = 0;
+  if (!Baseline.empty()) added = baseline.printDiff(reports, Out.os());
+  if (!BaselineOut.empty() &&
+      !writeDranoBaseline(BaselineOut, reports, Store)) {
+    failed = true;
+  }
+  if (!ProfilePath.empty()) profile.print(reports, Out.os());
+  if (!ReportJSON.empty() &&
+      !writeJSONReport(ReportJSON, reports,
+                       ProfilePath.empty() ? nullptr : &profile)) {
+    failed = true;
+  }
+  if (!ReportSARIF.empty() && !writeSARIFReport(ReportSARIF, reports)) {
+    failed = true;
+  }
+  if (!HTMLReport.empty() && !writeHTMLReport(HTMLReport, reports)) {
+    failed = true;
+  }
+  Out.os() << "Timings (seconds):\n";
+  for (const ModuleReport& report : reports) {
+    if (report.Error.empty()) report.printTimings(Analyses, Out.os());
+  }
+  Out.os() << "Total: " << reports.size() << " modules"
+           << format(" in %.3f", totalTime) << " (" << numThreads
+           << " threads)\n";
+  // Memory statistics, if accounted (-uncoalesced-memory-stats,
+  // -bsi-memory-stats).
+  if (MemoryStats* stats = getUncoalescedMemoryStats()) stats->print(Out.os());
+  if (MemoryStats* stats = getBSIMemoryStats()) stats->print(Out.os());
+  Out.keep();
+  if (failed) return 1;
+  return added > 0 ? 2 : 0;
+}
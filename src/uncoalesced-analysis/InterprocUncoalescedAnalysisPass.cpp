@@ -1,48 +1,491 @@
 #define DEBUG_TYPE "uncoalesced-analysis"
 
 #include "InterprocUncoalescedAnalysisPass.h"
+#include "SourceOrder.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <chrono>
 
 using namespace llvm;
 
-bool InterproceduralUncoalescedAnalysisPass::runOnModule(Module &M) {
-  auto &CG = getAnalysis<CallGraphWrapperPass>().getCallGraph();
+static cl::opt<std::string> CacheDir("uncoalesced-cache-dir",
+    cl::desc("Directory to cache function summaries of the uncoalesced "
+             "access analysis across runs"),
+    cl::value_desc("directory"), cl::init(""));
 
-  // Generate topological order of visiting function nodes.
-  std::vector<Function *> functionList;
+static cl::opt<bool> Annotate("uncoalesced-annotate",
+    cl::desc("Attach the results of the uncoalesced access analysis to the "
+             "module as metadata"));
+
+static cl::list<std::string> EntryPoints("uncoalesced-entry-points",
+    cl::desc("Functions to analyze in addition to the kernels of the module"),
+    cl::value_desc("function"), cl::CommaSeparated);
+
+static cl::opt<bool> Stream("uncoalesced-stream",
+    cl::desc("Print the results of each function as soon as they are final "
+             "and release its summaries, to bound the memory of the "
+             "uncoalesced access analysis"));
+
+std::vector<std::string> llvm::getUncoalescedEntryPointNames() {
+  return std::vector<std::string>(EntryPoints.begin(), EntryPoints.end());
+}
+
+bool llvm::isUncoalescedStreamingEnabled() { return Stream; }
+
+// Returns the SCCs of the call graph of M in topological order (callers
+// first), keeping only the functions defined in M that are reachable from
+// the entry points. Functions within an SCC are in reverse call graph order.
+static std::vector<std::vector<Function*>> getReachableSCCs(Module& M,
+                                                            CallGraph& CG) {
+  // Functions reachable from the entry points; other functions are not
+  // analyzed.
+  std::set<const Function*> reachable = getReachableFunctions(
+      getEntryPoints(M, getUncoalescedEntryPointNames()));
+
+  std::vector<std::vector<Function*>> sccs;
   for (scc_iterator<CallGraph *> I = scc_begin(&CG), IE = scc_end(&CG);
                                        I != IE; ++I) {
-    const std::vector<CallGraphNode *> &SCCCGNs = *I;
-    for (std::vector<CallGraphNode *>::const_iterator CGNI = SCCCGNs.begin(),
-						    CGNIE = SCCCGNs.end();
-                                                CGNI != CGNIE; ++CGNI) {
-      if ((*CGNI)->getFunction()) {
-        Function *F = (*CGNI)->getFunction();
-        if (!F->isDeclaration()) {
-          functionList.insert(functionList.begin(), F);
-        }
+    std::vector<Function*> scc;
+    for (CallGraphNode* CGN : *I) {
+      Function *F = CGN->getFunction();
+      if (F && !F->isDeclaration() && reachable.count(F)) {
+        scc.insert(scc.begin(), F);
+      }
+    }
+    if (!scc.empty()) sccs.insert(sccs.begin(), scc);
+  }
+  return sccs;
+}
+
+namespace {
+
+// Summaries of the functions analyzed for each block shape. Top-most
+// functions are analyzed for the shape of their launches (see
+// getUncoalescedBlockShape(const Function*)), and their callees on demand in
+// the summaries of the same shape, so that a callee reached from kernels
+// launched with different shapes is analyzed for each of them.
+class ShapedSummaries {
+ public:
+  // Summaries are created for each shape on first use.
+  ShapedSummaries(SummaryStore* Store, DomTreeGetter GetDomTree)
+    : Store_(Store), GetDomTree_(GetDomTree), Shared_(nullptr) {}
+
+  // All functions are analyzed with Summaries, for its shape.
+  explicit ShapedSummaries(UncoalescedSummaries& Summaries)
+    : Store_(nullptr), Shared_(&Summaries) {}
+
+  // Returns the summaries the top-most function Root is analyzed with.
+  UncoalescedSummaries& getSummaries(const Function* Root) {
+    if (Shared_) return *Shared_;
+    BlockShape shape = getUncoalescedBlockShape(Root);
+    std::unique_ptr<UncoalescedSummaries>& summaries = SummariesMap_[shape];
+    if (!summaries) {
+      summaries.reset(new UncoalescedSummaries(Store_, GetDomTree_, shape));
+    }
+    return *summaries;
+  }
+
+  // Has F been analyzed for any shape?
+  bool isAnalyzed(const Function* F) const {
+    if (Shared_) return Shared_->isAnalyzed(F);
+    for (const auto& pair : SummariesMap_) {
+      if (pair.second->isAnalyzed(F)) return true;
+    }
+    return false;
+  }
+
+  // Returns the uncoalesced accesses within F for any shape.
+  std::set<const Instruction*> getUncoalescedAccesses(const Function* F)
+      const {
+    if (Shared_) return Shared_->getUncoalescedAccesses(F);
+    std::set<const Instruction*> accesses;
+    for (const auto& pair : SummariesMap_) {
+      std::set<const Instruction*> shapeAccesses =
+          pair.second->getUncoalescedAccesses(F);
+      accesses.insert(shapeAccesses.begin(), shapeAccesses.end());
+    }
+    return accesses;
+  }
+
+  // Returns why the accesses within F are uncoalesced (joined across
+  // shapes).
+  std::map<const Instruction*, UncoalescedAccessInfo>
+      getUncoalescedAccessInfo(const Function* F) const {
+    if (Shared_) return Shared_->getUncoalescedAccessInfo(F);
+    std::map<const Instruction*, UncoalescedAccessInfo> info;
+    for (const auto& pair : SummariesMap_) {
+      for (const auto& access : pair.second->getUncoalescedAccessInfo(F)) {
+        info[access.first] = info[access.first].join(access.second);
       }
     }
+    return info;
+  }
+
+  // Releases the summaries of F for all shapes.
+  void releaseFunction(const Function* F) {
+    if (Shared_) return Shared_->releaseFunction(F);
+    for (const auto& pair : SummariesMap_) {
+      if (pair.second->isAnalyzed(F)) pair.second->releaseFunction(F);
+    }
   }
 
-  // Map from function to initial argument values.
-  // It is built by joining all contexts in which the function is called.
-  std::map<const Function *, std::map<const Value *, MultiplierValue>> 
-      FunctionArgumentValues;
+  // Writes the summaries created here to the cache.
+  void saveCache() {
+    for (const auto& pair : SummariesMap_) pair.second->saveCache();
+  }
+
+ private:
+  SummaryStore* Store_;
+  DomTreeGetter GetDomTree_;
+
+  // Summaries of all functions (null unless given).
+  UncoalescedSummaries* Shared_;
+
+  // Map from block shapes to the summaries of the functions analyzed for
+  // them.
+  std::map<BlockShape, std::unique_ptr<UncoalescedSummaries>> SummariesMap_;
+};
+
+}
+
+// Runs the interprocedural analysis on M with the summaries of each shape
+// in Summaries.
+static InterprocUncoalescedResult analyzeRoots(Module& M, CallGraph& CG,
+    ShapedSummaries& Summaries, UncoalescedRootCallback OnRoot) {
+  InterprocUncoalescedResult result;
 
-  // Run analysis on functions.
+  // Generate topological order of visiting function nodes.
+  std::vector<Function *> functionList;
+  for (const std::vector<Function*>& scc : getReachableSCCs(M, CG)) {
+    functionList.insert(functionList.end(), scc.begin(), scc.end());
+  }
+
+  // Run analysis on functions that are not reached from functions analyzed
+  // earlier (i.e. the top-most functions), assuming all their arguments are
+  // independent of thread ID. Their callees are analyzed on demand, once for
+  // each distinct call context. Summaries found in the cache are not
+  // analyzed again.
   for (Function *F : functionList) {
-    LLVM_DEBUG(errs() << "Analyzing function: " << F->getName());
-    DominatorTree DT(*F);
-    UncoalescedAnalysis UA(F, &DT, &FunctionArgumentValues);
-    errs() << "Analysis Results: \n";
-    GPUState st = UA.BuildInitialState();
-    UA.BuildAnalysisInfo(st);
-    std::set<const Instruction*> uncoalesced = UA.getUncoalescedAccesses();
-    UncoalescedAccessMap_.emplace(F, uncoalesced);
+    if (Summaries.isAnalyzed(F)) { continue; }
+    LLVM_DEBUG(errs() << "Analyzing function: " << F->getName() << "\n");
+    auto start = std::chrono::steady_clock::now();
+    UncoalescedSummaries& summaries = Summaries.getSummaries(F);
+    const FunctionSummary& summary = summaries.getSummary(F,
+        CallContext(F->arg_size(), MultiplierValue(ZERO)));
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::set<const Instruction*> uncoalesced;
+    for (const AccessTrace& trace : summary.UncoalescedAccesses) {
+      if (trace.size() == 1) uncoalesced.insert(trace[0]);
+      // Why the access is uncoalesced so far, for the costs printed by
+      // OnRoot (updated below once all functions are analyzed).
+      const UncoalescedAccessInfo* info = summaries.lookupAccessInfo(trace[0]);
+      if (info) result.AccessInfoMap[trace[0]] = *info;
+    }
+    result.Roots.push_back(F);
+    result.RootShapeMap.emplace(F, summaries.getBlockShape());
+    result.RootAccessMap.emplace(F, summary.UncoalescedAccesses);
+    result.UncoalescedAccessMap.emplace(F, uncoalesced);
+    result.AnalysisTimeMap.emplace(F, elapsed.count());
+    if (OnRoot && !OnRoot(result, F)) { break; }
+  }
+
+  // Record uncoalesced accesses within callees (joined across contexts).
+  for (Function *F : functionList) {
+    if (result.UncoalescedAccessMap.find(F) !=
+            result.UncoalescedAccessMap.end()) {
+      continue;
+    }
+    result.UncoalescedAccessMap.emplace(F, Summaries.getUncoalescedAccesses(F));
+  }
+  for (Function *F : functionList) {
+    for (const auto& pair : Summaries.getUncoalescedAccessInfo(F)) {
+      result.AccessInfoMap[pair.first] = pair.second;
+    }
+  }
+  return result;
+}
+
+InterprocUncoalescedResult llvm::runInterprocUncoalescedAnalysis(Module& M,
+    CallGraph& CG, DomTreeGetter GetDomTree, SummaryStore* Store,
+    UncoalescedRootCallback OnRoot) {
+  // Memoized summaries of functions for each call context in which they are
+  // called.
+  std::unique_ptr<SummaryStore> DirectoryStore;
+  if (!Store && !CacheDir.empty()) {
+    DirectoryStore.reset(new DirectorySummaryStore(CacheDir));
+    Store = DirectoryStore.get();
+  }
+  ShapedSummaries Summaries(Store, GetDomTree);
+  InterprocUncoalescedResult result =
+      analyzeRoots(M, CG, Summaries, OnRoot);
+  Summaries.saveCache();
+  return result;
+}
+
+InterprocUncoalescedResult llvm::runInterprocUncoalescedAnalysis(Module& M,
+    CallGraph& CG, UncoalescedSummaries& Summaries,
+    UncoalescedRootCallback OnRoot) {
+  ShapedSummaries shaped(Summaries);
+  return analyzeRoots(M, CG, shaped, OnRoot);
+}
+
+bool llvm::streamInterprocUncoalescedAnalysis(Module& M, CallGraph& CG,
+    UncoalescedFunctionCallback OnFunction, DomTreeGetter GetDomTree,
+    SummaryStore* Store) {
+  std::unique_ptr<SummaryStore> DirectoryStore;
+  if (!Store && !CacheDir.empty()) {
+    DirectoryStore.reset(new DirectorySummaryStore(CacheDir));
+    Store = DirectoryStore.get();
+  }
+  ShapedSummaries Summaries(Store, GetDomTree);
+  std::vector<std::vector<Function*>> sccs = getReachableSCCs(M, CG);
+
+  // The summaries of the functions of an SCC are released together, once
+  // all functions of the SCC are analyzed and all SCCs calling it are
+  // released. Map from functions to their SCCs, and from SCCs to the SCCs
+  // they call and the number of calling SCCs not released yet.
+  std::map<const Function*, unsigned> sccIndex;
+  for (unsigned i = 0; i < sccs.size(); i++) {
+    for (Function* F : sccs[i]) sccIndex[F] = i;
+  }
+  std::vector<std::set<unsigned>> calleeSCCs(sccs.size());
+  std::vector<unsigned> pendingCallers(sccs.size(), 0);
+  for (unsigned i = 0; i < sccs.size(); i++) {
+    for (Function* F : sccs[i]) {
+      for (const CallGraphNode::CallRecord& CR : *CG[F]) {
+        auto it = sccIndex.find(CR.second->getFunction());
+        if (it == sccIndex.end() || it->second == i) continue;
+        if (calleeSCCs[i].insert(it->second).second) {
+          pendingCallers[it->second]++;
+        }
+      }
+    }
+  }
+
+  // Access traces of the top-most functions not released yet, and the time
+  // spent analyzing them.
+  std::map<const Function*, std::pair<std::set<AccessTrace>, double>> roots;
+
+  // Summaries the top-most functions not released yet were analyzed with.
+  std::map<const Function*, UncoalescedSummaries*> rootSummaries;
+
+  // Passes the results of F to OnFunction.
+  auto emitFunction = [&](const Function* F) {
+    InterprocUncoalescedResult result;
+    result.AccessInfoMap = Summaries.getUncoalescedAccessInfo(F);
+    auto it = roots.find(F);
+    if (it == roots.end()) {
+      result.UncoalescedAccessMap.emplace(F,
+          Summaries.getUncoalescedAccesses(F));
+      return OnFunction(result, F);
+    }
+    const UncoalescedSummaries& summaries = *rootSummaries.at(F);
+    std::set<const Instruction*> uncoalesced;
+    for (const AccessTrace& trace : it->second.first) {
+      if (trace.size() == 1) uncoalesced.insert(trace[0]);
+      const UncoalescedAccessInfo* info = summaries.lookupAccessInfo(trace[0]);
+      if (info) result.AccessInfoMap.emplace(trace[0], *info);
+    }
+    result.Roots.push_back(F);
+    result.RootShapeMap.emplace(F, summaries.getBlockShape());
+    result.RootAccessMap.emplace(F, std::move(it->second.first));
+    result.UncoalescedAccessMap.emplace(F, uncoalesced);
+    result.AnalysisTimeMap.emplace(F, it->second.second);
+    roots.erase(it);
+    rootSummaries.erase(F);
+    return OnFunction(result, F);
+  };
+
+  // Emits and releases the SCCs that are ready, callers first, so that the
+  // callees of a released SCC are considered in the same pass.
+  std::vector<bool> released(sccs.size(), false);
+  auto releaseSCCs = [&]() {
+    for (unsigned i = 0; i < sccs.size(); i++) {
+      if (released[i] || pendingCallers[i] > 0) continue;
+      bool analyzed = true;
+      for (Function* F : sccs[i]) analyzed &= Summaries.isAnalyzed(F);
+      if (!analyzed) continue;
+      // The functions of the SCC are emitted before any of them is
+      // released, since their traces may go through each other.
+      for (Function* F : sccs[i]) {
+        if (!emitFunction(F)) return false;
+      }
+      for (Function* F : sccs[i]) Summaries.releaseFunction(F);
+      released[i] = true;
+      for (unsigned callee : calleeSCCs[i]) pendingCallers[callee]--;
+    }
+    return true;
+  };
+
+  // Top-most functions are analyzed in the same order as in
+  // runInterprocUncoalescedAnalysis.
+  bool completed = true;
+  for (unsigned i = 0; i < sccs.size() && completed; i++) {
+    for (Function *F : sccs[i]) {
+      if (Summaries.isAnalyzed(F)) { continue; }
+      LLVM_DEBUG(errs() << "Analyzing function: " << F->getName() << "\n");
+      auto start = std::chrono::steady_clock::now();
+      UncoalescedSummaries& summaries = Summaries.getSummaries(F);
+      const FunctionSummary& summary = summaries.getSummary(F,
+          CallContext(F->arg_size(), MultiplierValue(ZERO)));
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      roots[F] = std::make_pair(summary.UncoalescedAccesses, elapsed.count());
+      rootSummaries[F] = &summaries;
+      if (!releaseSCCs()) {
+        completed = false;
+        break;
+      }
+    }
+  }
+  Summaries.saveCache();
+  return completed;
+}
+
+BlockShape InterprocUncoalescedResult::getRootShape(const Function* F) const {
+  auto it = RootShapeMap.find(F);
+  return it != RootShapeMap.end() ? it->second : getUncoalescedBlockShape();
+}
+
+void InterprocUncoalescedResult::printRoot(const Function* F,
+                                           raw_ostream& os) const {
+  const std::set<AccessTrace>& accesses = RootAccessMap.at(F);
+  os << "Analysis Results: \n";
+  os << "Function: " << F->getName() << "\n";
+  // Print uncoalesced accesses found by the analysis.
+  os << "  Uncoalesced accesses: #" << accesses.size() << "\n";
+  // Most wasteful accesses first, then in source order. The cost is printed
+  // on a line of its own, so that each "--" line only holds the location.
+  std::vector<AccessTrace> traces = getInSourceOrder<AccessTrace>(accesses);
+  BlockShape shape = getRootShape(F);
+  std::map<const Instruction*, TransactionCost> costs;
+  for (const AccessTrace& trace : traces) {
+    auto it = AccessInfoMap.find(trace[0]);
+    costs[trace[0]] = getTransactionCost(trace[0], it != AccessInfoMap.end() ?
+        it->second : UncoalescedAccessInfo(MultiplierValueType::TOP, 0),
+        getUncoalescedWarpSize(), shape);
+  }
+  std::stable_sort(traces.begin(), traces.end(),
+                   [&costs](const AccessTrace& a, const AccessTrace& b) {
+    return costs.at(a[0]).isWorseThan(costs.at(b[0]));
+  });
+  for (const AccessTrace& trace : traces) {
+    os << "  -- ";
+    printAccessTrace(trace, os);
+    os << "\n     cost ";
+    costs.at(trace[0]).print(os);
+    os << "\n";
+  }
+  os << "\n";
+}
+
+void InterprocUncoalescedResult::print(raw_ostream& os) const {
+  for (const Function* F : Roots) {
+    printRoot(F, os);
   }
-  return false;
+}
+
+// Returns why the access with info is uncoalesced. The kind does not depend
+// on the block shape, since an access may be reached from kernels launched
+// with different shapes.
+static DranoAccessKind getDranoAccessKind(const UncoalescedAccessInfo& info) {
+  MultiplierValue v = info.getMultiplierValue();
+  MultiplierValue x = v.getDimension(0);
+  if (!x.hasExactCoefficient()) return DranoAccessUnknownStride;
+  int64_t coefficient = x.getCoefficient();
+  if (uint64_t(std::abs(coefficient)) * info.ElementSize > 4) {
+    if (coefficient == 1) return DranoAccessWideElements;
+    if (coefficient == -1) return DranoAccessReversedWideElements;
+    return DranoAccessStrided;
+  }
+  // Coalesced along x, so reported because warps span several rows or
+  // planes of the block.
+  for (unsigned dim = 1; dim < 3; dim++) {
+    if (!v.getDimension(dim).hasExactCoefficient()) {
+      return DranoAccessUnknownStride;
+    }
+  }
+  return DranoAccessSplitWarp;
+}
+
+void InterprocUncoalescedResult::annotate() const {
+  for (const auto& pair : UncoalescedAccessMap) {
+    setDranoUncoalescedAccessCount(pair.first, pair.second.size());
+  }
+  for (const auto& pair : AccessInfoMap) {
+    DranoUncoalescedAccess access;
+    access.Kind = getDranoAccessKind(pair.second);
+    access.Stride = pair.second.getStride(0);
+    access.StrideY = pair.second.getStride(1);
+    access.StrideZ = pair.second.getStride(2);
+    setDranoUncoalescedAccess(pair.first, access);
+  }
+}
+
+bool InterproceduralUncoalescedAnalysisPass::runOnModule(Module &M) {
+  auto &CG = getAnalysis<CallGraphWrapperPass>().getCallGraph();
+  if (Stream) {
+    streamInterprocUncoalescedAnalysis(M, CG,
+        [](const InterprocUncoalescedResult& result, const Function*) {
+          result.print(errs());
+          if (Annotate) { result.annotate(); }
+          return true;
+        });
+    if (MemoryStats* stats = getUncoalescedMemoryStats()) stats->print(errs());
+    return Annotate;
+  }
+  InterprocUncoalescedResult result = runInterprocUncoalescedAnalysis(M, CG);
+  result.print(errs());
+  if (MemoryStats* stats = getUncoalescedMemoryStats()) stats->print(errs());
+  UncoalescedAccessMap_ = result.UncoalescedAccessMap;
+  if (Annotate) { result.annotate(); }
+  return Annotate;
 }
 
 char InterproceduralUncoalescedAnalysisPass::ID = 0;
 static RegisterPass<InterproceduralUncoalescedAnalysisPass>
 Y("interproc-uncoalesced-analysis", "Interprocedural analysis to detect uncoalesced accesses in gpu programs.");
+
+AnalysisKey InterprocUncoalescedAccessAnalysis::Key;
+
+InterprocUncoalescedResult InterprocUncoalescedAccessAnalysis::run(
+    Module &M, ModuleAnalysisManager &MAM) {
+  auto &CG = MAM.getResult<CallGraphAnalysis>(M);
+  auto &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  return runInterprocUncoalescedAnalysis(M, CG,
+      [&FAM](const Function* F) -> const DominatorTree* {
+        return &FAM.getResult<DominatorTreeAnalysis>(const_cast<Function&>(*F));
+      });
+}
+
+PreservedAnalyses InterprocUncoalescedAccessPrinterPass::run(
+    Module &M, ModuleAnalysisManager &MAM) {
+  if (Stream) {
+    // The results are printed as they are computed rather than cached in
+    // the analysis manager.
+    auto &CG = MAM.getResult<CallGraphAnalysis>(M);
+    auto &FAM =
+        MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+    streamInterprocUncoalescedAnalysis(M, CG,
+        [this](const InterprocUncoalescedResult& result, const Function*) {
+          result.print(OS);
+          if (Annotate) { result.annotate(); }
+          return true;
+        },
+        [&FAM](const Function* F) -> const DominatorTree* {
+          return &FAM.getResult<DominatorTreeAnalysis>(
+              const_cast<Function&>(*F));
+        });
+    if (MemoryStats* stats = getUncoalescedMemoryStats()) stats->print(OS);
+    return PreservedAnalyses::all();
+  }
+  const InterprocUncoalescedResult& result =
+      MAM.getResult<InterprocUncoalescedAccessAnalysis>(M);
+  result.print(OS);
+  if (MemoryStats* stats = getUncoalescedMemoryStats()) stats->print(OS);
+  // Metadata does not change the results of any analysis.
+  if (Annotate) { result.annotate(); }
+  return PreservedAnalyses::all();
+}
@@ -12,17 +12,23 @@
 // on threadID (a unique identifier for threads). If the dependence is
 // non-linear or a large linear function, the access is labelled as uncoalesced.
 // 
-// It starts with the analysis of the top-most functions in the call-graph and
-// then proceeds with the analysis of their callees in a topological order.
-// While analyzing a specific callee, it considers the join of the call contexts
-// of all its callers.
+// Only functions reachable from the kernels of the module (and from functions
+// named with -uncoalesced-entry-points) are analyzed.
+// It starts with the analysis of the top-most functions in the call-graph.
+// Callees are analyzed on demand, once for each distinct call context (the
+// abstract values of the arguments at the call), and the memoized summary is
+// reused at every call site with the same context. Uncoalesced accesses within
+// callees are reported at the call sites through which they are reached.
 //===----------------------------------------------------------------------===//
 
 #ifndef LLVM_INTERPROC_UNCOALESCED_ANALYSIS_PASS_H
 #define LLVM_INTERPROC_UNCOALESCED_ANALYSIS_PASS_H
 
+#include "DranoAnnotations.h"
+#include "EntryPoints.h"
 #include "MultiplierValue.h"
 #include "UncoalescedAnalysis.h"
+#include "UncoalescedSummaries.h"
 
 #include "llvm/ADT/SCCIterator.h"
 #include "llvm/ADT/Statistic.h"
@@ -32,16 +38,108 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
 #include "llvm/IR/Type.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <functional>
 #include <list>
 
 namespace llvm {
 
+// Results of the interprocedural analysis of a module.
+struct InterprocUncoalescedResult {
+  // Top-most functions in the order they were analyzed.
+  std::vector<const Function*> Roots;
+
+  // Map from top-most functions to the uncoalesced accesses within them and
+  // their callees.
+  std::map<const Function*, std::set<AccessTrace>> RootAccessMap;
+
+  // Map from analyzed functions to the uncoalesced accesses within them
+  // (joined across call contexts).
+  std::map<const Function*, std::set<const Instruction*>> UncoalescedAccessMap;
+
+  // Map from uncoalesced accesses to why they are uncoalesced (joined across
+  // call contexts).
+  std::map<const Instruction*, UncoalescedAccessInfo> AccessInfoMap;
+
+  // Map from top-most functions to the time spent analyzing them and the
+  // callees first reached from them (in seconds).
+  std::map<const Function*, double> AnalysisTimeMap;
+
+  // Map from top-most functions to the shape of the thread blocks they and
+  // their callees were analyzed for.
+  std::map<const Function*, BlockShape> RootShapeMap;
+
+  // Returns the shape of the thread blocks the top-most function F was
+  // analyzed for.
+  BlockShape getRootShape(const Function* F) const;
+
+  // Prints uncoalesced accesses for the top-most function F.
+  void printRoot(const Function* F, raw_ostream& os) const;
+
+  // Prints uncoalesced accesses for each top-most function.
+  void print(raw_ostream& os) const;
+
+  // Attaches the results to the analyzed functions and the uncoalesced
+  // accesses as metadata (see DranoAnnotations.h).
+  void annotate() const;
+};
+
+// Called after each top-most function is analyzed, with the results so far.
+// Returning false stops the analysis.
+typedef std::function<bool(const InterprocUncoalescedResult&, const Function*)>
+    UncoalescedRootCallback;
+
+// Runs the interprocedural analysis on M. Dominator trees are obtained from
+// GetDomTree if provided, and are built by the analysis otherwise. Summaries
+// are cached in Store if provided, and in the directory given with
+// -uncoalesced-cache-dir otherwise. Each top-most function is analyzed with
+// its callees for the shape of its launches, if known (see
+// getUncoalescedBlockShape(const Function*)).
+InterprocUncoalescedResult runInterprocUncoalescedAnalysis(Module& M,
+    CallGraph& CG, DomTreeGetter GetDomTree = nullptr,
+    SummaryStore* Store = nullptr, UncoalescedRootCallback OnRoot = nullptr);
+
+// Runs the interprocedural analysis on M with the summaries in Summaries,
+// which may be shared with the analyses of other modules (e.g. to resolve
+// calls across translation units). All functions are analyzed for the block
+// shape of Summaries. Summaries are not saved to the cache.
+InterprocUncoalescedResult runInterprocUncoalescedAnalysis(Module& M,
+    CallGraph& CG, UncoalescedSummaries& Summaries,
+    UncoalescedRootCallback OnRoot = nullptr);
+
+// Called in streaming mode with the results of each analyzed function once
+// they are final, i.e. once all its callers have been analyzed. Result holds
+// only the results of F: its uncoalesced accesses and why they are
+// uncoalesced, and if F is a top-most function, F in Roots with its access
+// traces and analysis time (AccessInfoMap then also covers the accesses at
+// the head of the traces). Returning false stops the analysis.
+typedef std::function<bool(const InterprocUncoalescedResult&, const Function*)>
+    UncoalescedFunctionCallback;
+
+// Runs the interprocedural analysis on M in streaming mode: the results of
+// each function are passed to OnFunction as soon as they are final, and the
+// summaries of the function are then released. Only the summaries of
+// functions with callers left to analyze are kept, so memory is bounded by
+// the analysis of the largest chain of calls rather than by the module.
+// Returns false if OnFunction stopped the analysis.
+bool streamInterprocUncoalescedAnalysis(Module& M, CallGraph& CG,
+    UncoalescedFunctionCallback OnFunction, DomTreeGetter GetDomTree = nullptr,
+    SummaryStore* Store = nullptr);
+
+// Is streaming mode enabled (with -uncoalesced-stream)?
+bool isUncoalescedStreamingEnabled();
+
+// Returns the functions named with -uncoalesced-entry-points.
+std::vector<std::string> getUncoalescedEntryPointNames();
+
 struct InterproceduralUncoalescedAnalysisPass : public ModulePass {
+  // Uncoalesced accesses of each analyzed function (empty in streaming
+  // mode, where results are not kept).
   std::map<const Function*, std::set<const Instruction*>> UncoalescedAccessMap_;
 
  public:
@@ -56,13 +154,39 @@ struct InterproceduralUncoalescedAnalysisPass : public ModulePass {
     return UncoalescedAccessMap_.at(F);
   }
 
-  // We don't modify the program, so we preserve all analyses.
+  // We only add metadata to the program, so we preserve all analyses.
   void getAnalysisUsage(AnalysisUsage &AU) const override {
     AU.addRequired<CallGraphWrapperPass>();
     AU.setPreservesAll();
   }
 };
 
+// Interprocedural analysis for the new pass manager. Dominator trees are
+// taken from the function analysis manager, and the result is cached until
+// a pass invalidates it.
+class InterprocUncoalescedAccessAnalysis
+  : public AnalysisInfoMixin<InterprocUncoalescedAccessAnalysis> {
+  friend AnalysisInfoMixin<InterprocUncoalescedAccessAnalysis>;
+  static AnalysisKey Key;
+
+ public:
+  typedef InterprocUncoalescedResult Result;
+
+  Result run(Module &M, ModuleAnalysisManager &MAM);
+};
+
+// Prints the results of InterprocUncoalescedAccessAnalysis, and attaches them
+// to the module with -uncoalesced-annotate.
+class InterprocUncoalescedAccessPrinterPass
+  : public PassInfoMixin<InterprocUncoalescedAccessPrinterPass> {
+  raw_ostream &OS;
+
+ public:
+  explicit InterprocUncoalescedAccessPrinterPass(raw_ostream &OS) : OS(OS) {}
+
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+};
+
 }
 
 #endif /* InterproceduralUncoalescedAnalysisPass.h */
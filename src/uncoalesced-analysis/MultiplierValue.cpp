@@ -1,79 +1,279 @@
 #include "MultiplierValue.h"
 
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Value.h"
 #include "llvm/Support/raw_ostream.h"
+#include <cstring>
+#include <functional>
 #include <string>
 
 using namespace llvm;
 
-// Helper functions: Int to MultiplierValue; MultiplierValue to Int
-MultiplierValue MultiplierValue::getMultiplierValue(int x, bool b) {
-  if (x == 0) return MultiplierValue(ZERO, b);
-  if (x == 1) return MultiplierValue(ONE, b);
-  if (x == -1) return MultiplierValue(NEGONE, b);
-  return MultiplierValue(TOP);
+MultiplierValue MultiplierValue::getLinear(int64_t c) {
+  if (c == 0) return MultiplierValue(ZERO);
+  if (c == 1) return MultiplierValue(ONE);
+  if (c == -1) return MultiplierValue(NEGONE);
+  if (c < INT32_MIN || c > INT32_MAX) return MultiplierValue(TOP);
+  MultiplierValue v(STRIDE);
+  v.coefficient_ = c;
+  return v;
+}
+
+MultiplierValue MultiplierValue::getSymbolic(int64_t c, const Value* symbol) {
+  if (!symbol || c == 0) return getLinear(c);
+  if (c < INT32_MIN || c > INT32_MAX) return MultiplierValue(TOP);
+  MultiplierValue v(STRIDE);
+  v.coefficient_ = c;
+  v.symbol_ = symbol;
+  return v;
+}
+
+bool MultiplierValue::isLinear() const {
+  return t_ == ZERO || t_ == ONE || t_ == NEGONE ||
+         (t_ == STRIDE && coefficient_ != 0);
+}
+
+int64_t MultiplierValue::getLinearCoefficient() const {
+  if (t_ == ONE) return 1;
+  if (t_ == NEGONE) return -1;
+  if (t_ == STRIDE) return coefficient_;
+  return 0;
+}
+
+bool MultiplierValue::hasExactCoefficient() const {
+  return isLinear() && !symbol_;
+}
+
+int64_t MultiplierValue::getCoefficient() const {
+  return hasExactCoefficient() ? getLinearCoefficient() : 0;
+}
+
+MultiplierValue MultiplierValue::getThreadIndex(unsigned dim) {
+  return MultiplierValue(ZERO).withDimension(dim, MultiplierValue(ONE));
+}
+
+MultiplierValue MultiplierValue::getDimension(unsigned dim) const {
+  MultiplierValue v;
+  if (dim == 0) {
+    v.t_ = t_;
+    v.coefficient_ = coefficient_;
+    v.symbol_ = symbol_;
+  } else {
+    v.t_ = dims_[dim - 1].Type;
+    v.coefficient_ = dims_[dim - 1].Coefficient;
+    v.symbol_ = dims_[dim - 1].Symbol;
+  }
+  return v;
+}
+
+MultiplierValue MultiplierValue::withDimension(
+    unsigned dim, const MultiplierValue& d) const {
+  MultiplierValue v = *this;
+  if (dim == 0) {
+    v.t_ = d.t_;
+    v.coefficient_ = d.coefficient_;
+    v.symbol_ = d.symbol_;
+  } else if (d.t_ == BOT) {
+    v.dims_[dim - 1] = {ZERO, 0, nullptr};
+  } else {
+    v.dims_[dim - 1] = {d.t_, d.coefficient_, d.symbol_};
+  }
+  return v;
+}
+
+bool MultiplierValue::isUniform() const {
+  return t_ == ZERO && dims_[0].Type == ZERO && dims_[1].Type == ZERO;
+}
+
+template <typename Op>
+MultiplierValue& MultiplierValue::setDimensions(const MultiplierValue& v1,
+                                                const MultiplierValue& v2,
+                                                Op op) {
+  for (unsigned dim = 1; dim < 3; dim++) {
+    *this = withDimension(dim, op(v1.getDimension(dim),
+                                  v2.getDimension(dim)));
+  }
+  return *this;
+}
+
+MultiplierValue MultiplierValue::withoutSymbolX(const MultiplierValue& v) {
+  if (!v.symbol_) return v;
+  MultiplierValue out(TOP);
+  if (v.isAddressType()) out.setAddressType();
+  return out;
+}
+
+MultiplierValue MultiplierValue::withoutSymbol() const {
+  MultiplierValue v = withoutSymbolX(*this);
+  if (t_ == BOT) return v;
+  for (unsigned dim = 1; dim < 3; dim++) {
+    v = v.withDimension(dim, withoutSymbolX(getDimension(dim)));
+  }
+  return v;
 }
 
-int MultiplierValue::getIntValue() const {
-  if(t_ == ZERO) return 0;
-  if(t_ == ONE) return 1;
-  if(t_ == NEGONE) return -1;
-  return 2; // TOP
+MultiplierValue MultiplierValue::joinX(const MultiplierValue& v1,
+                                       const MultiplierValue& v2) {
+  if (v1.t_ == BOT) return v2;
+  if (v2.t_ == BOT) return v1;
+  if (v1.t_ == v2.t_ && v1.coefficient_ == v2.coefficient_ &&
+      v1.symbol_ == v2.symbol_) {
+    return v2;
+  }
+  return MultiplierValue(TOP);
 }
 
 MultiplierValue MultiplierValue::join(const MultiplierValue& v) const {
   if (t_ == BOT) return v;
   if (v.t_ == BOT) return *this;
-  if (t_ == v.t_) return v;
-  return MultiplierValue(TOP);
+  if (*this == v) return v;
+  MultiplierValue out = joinX(*this, v);
+  return out.setDimensions(*this, v, joinX);
 }
 
 // Binary Operations
 
 // Integer addition
-MultiplierValue operator+(const MultiplierValue& v1, const MultiplierValue& v2) {
+// The coefficients of linear values are added if they have the same symbol
+// (or none).
+MultiplierValue MultiplierValue::addX(const MultiplierValue& v1,
+                                      const MultiplierValue& v2) {
   if (v1.t_ == BOT || v2.t_ == BOT) return MultiplierValue(BOT);
-  if (v1.t_ == TOP || v2.t_ == TOP) return MultiplierValue(TOP);
-  int out = v1.getIntValue() + v2.getIntValue();
-  return MultiplierValue::getMultiplierValue(out, false);
+  if (!v1.isLinear() || !v2.isLinear()) return MultiplierValue(TOP);
+  if (v1.t_ == ZERO) {
+    return MultiplierValue::getSymbolic(v2.getLinearCoefficient(), v2.symbol_);
+  }
+  if (v2.t_ == ZERO) {
+    return MultiplierValue::getSymbolic(v1.getLinearCoefficient(), v1.symbol_);
+  }
+  if (v1.symbol_ != v2.symbol_) return MultiplierValue(TOP);
+  return MultiplierValue::getSymbolic(
+      v1.getLinearCoefficient() + v2.getLinearCoefficient(), v1.symbol_);
+}
+
+MultiplierValue operator+(const MultiplierValue& v1, const MultiplierValue& v2) {
+  MultiplierValue out = MultiplierValue::addX(v1, v2);
+  if (out.t_ == BOT) return out;
+  return out.setDimensions(v1, v2, MultiplierValue::addX);
 }
 
 // Integer multiplication
-MultiplierValue operator*(const MultiplierValue& v1, const MultiplierValue& v2) {
+// The product of two values is thread-independent if both values are;
+// otherwise the factors are unknown here (see scale()).
+MultiplierValue MultiplierValue::multiplyX(const MultiplierValue& v1,
+                                           const MultiplierValue& v2) {
   if (v1.t_ == BOT || v2.t_ == BOT) return MultiplierValue(BOT);
   if (v1.t_ == ZERO && v2.t_ == ZERO) return MultiplierValue(ZERO);
   return MultiplierValue(TOP);
 }
 
+MultiplierValue operator*(const MultiplierValue& v1, const MultiplierValue& v2) {
+  MultiplierValue out = MultiplierValue::multiplyX(v1, v2);
+  if (out.t_ == BOT) return out;
+  return out.setDimensions(v1, v2, MultiplierValue::multiplyX);
+}
+
+MultiplierValue MultiplierValue::scaleX(const MultiplierValue& v, int64_t k) {
+  if (v.t_ == BOT) return MultiplierValue(BOT);
+  if (k == 0 || v.t_ == ZERO) return MultiplierValue(ZERO);
+  if (!v.isLinear() || k < INT32_MIN || k > INT32_MAX) {
+    return MultiplierValue(TOP);
+  }
+  return getSymbolic(v.getLinearCoefficient() * k, v.symbol_);
+}
+
+MultiplierValue MultiplierValue::scale(int64_t k) const {
+  MultiplierValue out = scaleX(*this, k);
+  if (out.t_ == BOT) return out;
+  return out.setDimensions(*this, *this,
+      [k](const MultiplierValue& d, const MultiplierValue&) {
+        return scaleX(d, k);
+      });
+}
+
+MultiplierValue MultiplierValue::scaleX(const MultiplierValue& v,
+                                        const Value* symbol) {
+  if (v.t_ == BOT) return MultiplierValue(BOT);
+  if (v.t_ == ZERO) return MultiplierValue(ZERO);
+  // The product of two symbols is not tracked.
+  if (!v.isLinear() || v.symbol_) return MultiplierValue(TOP);
+  return getSymbolic(v.getLinearCoefficient(), symbol);
+}
+
+MultiplierValue MultiplierValue::scale(const Value* symbol) const {
+  MultiplierValue out = scaleX(*this, symbol);
+  if (out.t_ == BOT) return out;
+  return out.setDimensions(*this, *this,
+      [symbol](const MultiplierValue& d, const MultiplierValue&) {
+        return scaleX(d, symbol);
+      });
+}
+
+MultiplierValue MultiplierValue::floorDivideX(const MultiplierValue& v,
+                                              int64_t d) {
+  // (c.threadID + e) / d = (c/d).threadID + e/d (rounding down) if c is a
+  // multiple of d. Otherwise the quotient is not linear in thread ID.
+  if (v.t_ == BOT) return MultiplierValue(BOT);
+  if (v.isLinear() && d != 0 && v.getLinearCoefficient() % d == 0) {
+    return getSymbolic(v.getLinearCoefficient() / d, v.symbol_);
+  }
+  return MultiplierValue(TOP);
+}
+
+MultiplierValue MultiplierValue::floorDivide(int64_t d) const {
+  MultiplierValue out = *this;
+  out = out.withDimension(0, floorDivideX(*this, d));
+  if (t_ == BOT) return out;
+  return out.setDimensions(*this, *this,
+      [d](const MultiplierValue& v, const MultiplierValue&) {
+        return floorDivideX(v, d);
+      });
+}
+
+// A predicate depends on a dimension unless both compared values are equal
+// and linear in it, or independent of it.
+MultiplierValue MultiplierValue::compareX(const MultiplierValue& v1,
+                                          const MultiplierValue& v2) {
+  if (v1 == v2 && v1.isLinear()) return MultiplierValue(ZERO);
+  return multiplyX(v1, v2);
+}
+
 // Returns abstract value for predicate (v1 == v2);
 // If the incoming values are equal, then they have the same dependence on
 // thread ID, hence the conditional is thread ID independent. Returns boolean
 // value (zero).
-// If one incoming value is a constant, and other is linear in thread ID, 
-// they can be equal for at most one thread. Returns boolean value (one). 
+// If one incoming value is a constant, and other is linear in thread ID with
+// a non-zero constant coefficient, they can be equal for at most one thread.
+// Returns boolean value (one). A symbolic coefficient may be zero.
 MultiplierValue eq(const MultiplierValue& v1, const MultiplierValue& v2) {
   if (v1.t_ == BOT || v2.t_ == BOT) return MultiplierValue(BOT);
-  if (v1.t_ == v2.t_ && v1.t_ != TOP) return MultiplierValue(ZERO, true);
-  if (((v1.t_ == ONE || v1.t_ == NEGONE) && v2.t_ == ZERO) || 
-      ((v2.t_ == ONE || v2.t_ == NEGONE) && v1.t_ == ZERO)) {
-    return MultiplierValue(ONE, true);
+  MultiplierValue out(TOP);
+  if (v1 == v2 && v1.isLinear()) {
+    out = MultiplierValue(ZERO, true);
+  } else if ((v1.getCoefficient() != 0 && v2.t_ == ZERO) ||
+             (v2.getCoefficient() != 0 && v1.t_ == ZERO)) {
+    out = MultiplierValue(ONE, true);
   }
-  return MultiplierValue(TOP);
+  return out.setDimensions(v1, v2, MultiplierValue::compareX);
 }
 
 // Returns abstract value for predicate (v1 != v2);
 // If the incoming values are equal, then they have the same dependence on
 // thread ID, hence the conditional is thread ID independent. Returns boolean
 // value (zero).
-// If one incoming value is a constant, and other is linear in thread ID, 
-// they will be unequal for all but one thread. Returns boolean value (negone).
+// If one incoming value is a constant, and other is linear in thread ID with
+// a non-zero constant coefficient, they will be unequal for all but one
+// thread. Returns boolean value (negone).
 MultiplierValue neq(const MultiplierValue& v1, const MultiplierValue& v2) {
   if (v1.t_ == BOT || v2.t_ == BOT) return MultiplierValue(BOT);
-  if (v1.t_ == v2.t_ && v1.t_ != TOP) return MultiplierValue(ZERO, true);
-  if (((v1.t_ == ONE || v1.t_ == NEGONE) && v2.t_ == ZERO) ||
-      ((v2.t_ == ONE || v2.t_ == NEGONE) && v1.t_ == ZERO)) {
-    return MultiplierValue(NEGONE, true);
+  MultiplierValue out(TOP);
+  if (v1 == v2 && v1.isLinear()) {
+    out = MultiplierValue(ZERO, true);
+  } else if ((v1.getCoefficient() != 0 && v2.t_ == ZERO) ||
+             (v2.getCoefficient() != 0 && v1.t_ == ZERO)) {
+    out = MultiplierValue(NEGONE, true);
   }
-  return MultiplierValue(TOP);
+  return out.setDimensions(v1, v2, MultiplierValue::compareX);
 }
 
 // Returns conjunction of abstract predicate values.
@@ -82,9 +282,13 @@ MultiplierValue neq(const MultiplierValue& v1, const MultiplierValue& v2) {
 // true for at most one thread.
 MultiplierValue operator&&(const MultiplierValue& v1, const MultiplierValue& v2) {
   if (v1.t_ == BOT || v2.t_ == BOT) return MultiplierValue(BOT);
-  if (v1.t_ == ZERO && v2.t_ == ZERO) return MultiplierValue(ZERO, true);
-  if (v1.t_ == ONE || v2.t_ == ONE) return MultiplierValue(ONE, true);
-  return MultiplierValue(TOP);
+  MultiplierValue out(TOP);
+  if (v1.t_ == ZERO && v2.t_ == ZERO) {
+    out = MultiplierValue(ZERO, true);
+  } else if (v1.t_ == ONE || v2.t_ == ONE) {
+    out = MultiplierValue(ONE, true);
+  }
+  return out.setDimensions(v1, v2, MultiplierValue::multiplyX);
 }
 
 // Returns disjunction of abstract predicate values.
@@ -93,43 +297,123 @@ MultiplierValue operator&&(const MultiplierValue& v1, const MultiplierValue& v2)
 // false for at most one thread.
 MultiplierValue operator||(const MultiplierValue& v1, const MultiplierValue& v2) {
   if (v1.t_ == BOT || v2.t_ == BOT) return MultiplierValue(BOT);
-  if (v1.t_ == ZERO && v2.t_ == ZERO) return MultiplierValue(ZERO, true);
-  if (v1.t_ == NEGONE || v2.t_ == NEGONE) return MultiplierValue(NEGONE, true);
-  return MultiplierValue(TOP);
+  MultiplierValue out(TOP);
+  if (v1.t_ == ZERO && v2.t_ == ZERO) {
+    out = MultiplierValue(ZERO, true);
+  } else if (v1.t_ == NEGONE || v2.t_ == NEGONE) {
+    out = MultiplierValue(NEGONE, true);
+  }
+  return out.setDimensions(v1, v2, MultiplierValue::multiplyX);
 }
 
 // Negates the abstract value (useful for negation as well.)
-MultiplierValue operator-(const MultiplierValue& v) {
+MultiplierValue MultiplierValue::negateX(const MultiplierValue& v) {
   if (v.t_ == BOT) return MultiplierValue(BOT);
-  if (v.t_ == TOP) return MultiplierValue(TOP);
-  int out = -v.getIntValue();
-  return MultiplierValue::getMultiplierValue(out, v.isBool_);
+  if (!v.isLinear()) return MultiplierValue(TOP);
+  return getSymbolic(-v.getLinearCoefficient(), v.symbol_);
+}
+
+MultiplierValue operator-(const MultiplierValue& v) {
+  MultiplierValue out = MultiplierValue::negateX(v);
+  if (v.t_ == BOT) return out;
+  if (v.isLinear()) out.isBool_ = v.isBool_;
+  return out.setDimensions(v, v,
+      [](const MultiplierValue& d, const MultiplierValue&) {
+        return MultiplierValue::negateX(d);
+      });
 }
 
 bool operator==(const MultiplierValue& v1, const MultiplierValue& v2) {
-  return (v1.t_ == v2.t_);
+  for (unsigned i = 0; i < 2; i++) {
+    if (v1.dims_[i].Type != v2.dims_[i].Type ||
+        v1.dims_[i].Coefficient != v2.dims_[i].Coefficient ||
+        v1.dims_[i].Symbol != v2.dims_[i].Symbol) {
+      return false;
+    }
+  }
+  return v1.t_ == v2.t_ && v1.coefficient_ == v2.coefficient_ &&
+         v1.symbol_ == v2.symbol_;
 }
 
 bool operator!=(const MultiplierValue& v1, const MultiplierValue& v2) {
-  return (v1.t_ != v2.t_);
+  return !(v1 == v2);
 }
 
-std::string MultiplierValue::getString() const {
-  std::string s;
-  if (isAddressType()) s.append("*");
+bool operator<(const MultiplierValue& v1, const MultiplierValue& v2) {
+  if (v1.t_ != v2.t_) return v1.t_ < v2.t_;
+  if (v1.coefficient_ != v2.coefficient_) {
+    return v1.coefficient_ < v2.coefficient_;
+  }
+  if (v1.symbol_ != v2.symbol_) {
+    return std::less<const Value*>()(v1.symbol_, v2.symbol_);
+  }
+  for (unsigned i = 0; i < 2; i++) {
+    const auto& d1 = v1.dims_[i];
+    const auto& d2 = v2.dims_[i];
+    if (d1.Type != d2.Type) return d1.Type < d2.Type;
+    if (d1.Coefficient != d2.Coefficient) {
+      return d1.Coefficient < d2.Coefficient;
+    }
+    if (d1.Symbol != d2.Symbol) {
+      return std::less<const Value*>()(d1.Symbol, d2.Symbol);
+    }
+  }
+  return false;
+}
+
+// Returns the name of a symbol, e.g. "width" for a kernel argument, or
+// "ntid.x" for blockDim.x.
+static std::string getSymbolName(const Value* symbol) {
+  if (const CallInst* CI = dyn_cast<CallInst>(symbol)) {
+    const Function* F = CI->getCalledFunction();
+    if (F && F->getName().startswith("llvm.nvvm.read.ptx.sreg.")) {
+      return F->getName().substr(strlen("llvm.nvvm.read.ptx.sreg.")).str();
+    }
+  }
+  return symbol->hasName() ? symbol->getName().str() : "s";
+}
+
+std::string MultiplierValue::getTermString() const {
   switch(t_) {
     case BOT:
-      return s.append("u");
+      return "u";
     case ZERO: 
-      return s.append("0");
+      return "0";
     case ONE: 
-      return s.append("1");
+      return "1";
     case NEGONE: 
-      return s.append("-1");
+      return "-1";
+    case STRIDE: {
+      // e.g. "32", "-2*width", or "n" if the coefficient is unknown.
+      if (!symbol_) {
+        return coefficient_ ? std::to_string(coefficient_) : "n";
+      }
+      std::string s;
+      if (coefficient_ == -1) {
+        s.append("-");
+      } else if (coefficient_ != 1) {
+        s.append(std::to_string(coefficient_)).append("*");
+      }
+      return s.append(getSymbolName(symbol_));
+    }
     case TOP:
     default:
-      return s.append(">1");
+      return ">1";
+  }
+}
+
+std::string MultiplierValue::getString() const {
+  std::string s;
+  if (isAddressType()) s.append("*");
+  s.append(getTermString());
+  if (t_ == BOT) return s;
+  // e.g. "1, y: 16" for tid.x + 16.tid.y.
+  for (unsigned dim = 1; dim < 3; dim++) {
+    if (dims_[dim - 1].Type == ZERO) continue;
+    s.append(dim == 1 ? ", y: " : ", z: ");
+    s.append(getDimension(dim).getTermString());
   }
+  return s;
 }
 
 bool MultiplierValue::testMultiplierValue() {
@@ -150,6 +434,16 @@ bool MultiplierValue::testMultiplierValue() {
   errs() << " c := a * b : " << c.getString() << "\n";
   c = b * c;
   errs() << " c := b * c : " << c.getString() << "\n";
+  c = b.scale(4);
+  errs() << " c := b.scale(4) : " << c.getString() << "\n";
+  c = c + b.scale(-2);
+  errs() << " c := c + b.scale(-2) : " << c.getString() << "\n";
+  c = c.floorDivide(2);
+  errs() << " c := c.floorDivide(2) : " << c.getString() << "\n";
+  c = b + MultiplierValue::getThreadIndex(1).scale(16);
+  errs() << " c := b + tid.y.scale(16) : " << c.getString() << "\n";
+  c = c * a;
+  errs() << " c := c * a : " << c.getString() << "\n";
   errs() << "\n";
 
   // Test relational and boolean operations.
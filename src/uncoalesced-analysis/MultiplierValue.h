@@ -3,6 +3,12 @@
 
 #include "PointerAbstractValue.h"
 
+#include <cstdint>
+
+namespace llvm {
+class Value;
+}
+
 // Multiplier Value
 // An abstract value used to represent values of integer and boolean variables.
 // 
@@ -14,11 +20,23 @@
 //     variable has an expression of the form (thread ID + constant).
 // - (negone) represents values which a negative unit depdendence on thread ID
 //     (-thread ID + constant).
-// - (unknown) or (top): other kinds of unknown dependences on thread ID (e.g. 2.threadID,
-//     10.threadID + 1).
+// - (stride) represents other linear dependences on thread ID
+//     (c.threadID + constant), where the coefficient c is either a
+//     compile-time constant (e.g. 2.threadID, -32.threadID + 1) or a constant
+//     times a thread-independent value s, the symbol (e.g. threadID.width
+//     for a kernel argument width). The coefficient of values read back
+//     without their symbol (e.g. from access information) is unknown.
+// - (unknown) or (top): other kinds of unknown dependences on thread ID (e.g.
+//     threadID.threadID, threadID.width.height).
 // For integers it is also refered to as the "thread ID multiplier" (since it
 // tracks the multiplier for thread ID).
 //
+// Thread ID above is the index along x (tid.x). The dependences of integers
+// on tid.y and tid.z are tracked alongside in the same form, e.g. tid.x +
+// 16.tid.y is (one) with a (stride) dependence of 16 on tid.y, and a value
+// loaded from a[tid.y] is (zero) with an unknown dependence on tid.y. The
+// dependences on tid.y and tid.z never are (bot), and are (zero) unless set.
+//
 // For booleans variables, (bot) and (top) representations are the same.
 // Other values are as follows:
 // - (zero) : The variable has same truth value across threads (similar to integers).
@@ -32,7 +50,8 @@ enum MultiplierValueType {
   ZERO,
   ONE,
   NEGONE,
-  TOP
+  TOP,
+  STRIDE
 }; 
 
 }
@@ -41,10 +60,21 @@ using namespace uncoalesced_analysis;
 
 class MultiplierValue : public PointerAbstractValue<MultiplierValue> { 
  public:
-  MultiplierValue() : t_(MultiplierValueType::BOT), isBool_(false) {}
+  MultiplierValue()
+      : t_(MultiplierValueType::BOT), isBool_(false), coefficient_(0),
+        symbol_(nullptr), dims_{{ZERO, 0, nullptr}, {ZERO, 0, nullptr}} {}
 
   MultiplierValue(MultiplierValueType t, bool isBool = false)
-      : t_(t), isBool_(isBool) {}
+      : t_(t), isBool_(isBool), coefficient_(0), symbol_(nullptr),
+        dims_{{ZERO, 0, nullptr}, {ZERO, 0, nullptr}} {}
+
+  // Returns the integer value c.threadID (+ constant): (zero), (one),
+  // (negone) or (stride), or (top) if c does not fit in 32 bits.
+  static MultiplierValue getLinear(int64_t c);
+
+  // Returns the thread index along dim (0 for tid.x, 1 for tid.y, 2 for
+  // tid.z).
+  static MultiplierValue getThreadIndex(unsigned dim);
 
   // Merge values; returns the least value that supersedes both values.
   MultiplierValue join(const MultiplierValue& v) const;
@@ -53,6 +83,14 @@ class MultiplierValue : public PointerAbstractValue<MultiplierValue> {
   friend MultiplierValue operator+(const MultiplierValue& v1, const MultiplierValue& v2);
   friend MultiplierValue operator*(const MultiplierValue& v1, const MultiplierValue& v2);
   friend MultiplierValue operator-(const MultiplierValue& v);
+  // Returns the value multiplied by the thread-independent constant k.
+  MultiplierValue scale(int64_t k) const;
+  // Returns the value multiplied by the thread-independent value symbol.
+  MultiplierValue scale(const llvm::Value* symbol) const;
+  // Returns the value divided by the constant d (rounding down). The
+  // quotient is linear if the coefficient is a multiple of d, and (top)
+  // otherwise, e.g. tid/32 is the same for some consecutive threads.
+  MultiplierValue floorDivide(int64_t d) const;
   friend MultiplierValue operator&&(const MultiplierValue& v1, const MultiplierValue& v2);
   friend MultiplierValue operator||(const MultiplierValue& v1, const MultiplierValue& v2);
   // Abstract value for predicate (v1 == v2).
@@ -61,11 +99,45 @@ class MultiplierValue : public PointerAbstractValue<MultiplierValue> {
   friend MultiplierValue neq(const MultiplierValue& v1, const MultiplierValue& v2);
   friend bool operator==(const MultiplierValue& v1, const MultiplierValue& v2);
   friend bool operator!=(const MultiplierValue& v1, const MultiplierValue& v2);
+  // Orders values by their type, coefficients and symbols (used to key call
+  // contexts).
+  friend bool operator<(const MultiplierValue& v1, const MultiplierValue& v2);
 
   // Getters and setters.
   MultiplierValueType getType() const { return t_; }
   bool isBoolean() const { return isBool_; }
 
+  // Is this an integer value with a compile-time constant coefficient of
+  // thread ID (tid.x), i.e. (zero), (one), (negone) or (stride) without
+  // symbol?
+  bool hasExactCoefficient() const;
+
+  // Returns the coefficient of thread ID (tid.x) if it is exact, and 0
+  // otherwise.
+  int64_t getCoefficient() const;
+
+  // Returns the dependence on the thread index along dim (0 for tid.x, 1
+  // for tid.y, 2 for tid.z) as an integer value of its own, e.g. (one) for
+  // dim 1 of tid.x + tid.y.
+  MultiplierValue getDimension(unsigned dim) const;
+
+  // Returns this value with its dependence on the thread index along dim
+  // replaced by the dependence of d on thread ID (tid.x).
+  MultiplierValue withDimension(unsigned dim, const MultiplierValue& d) const;
+
+  // Is this value the same for all threads of a block, i.e. (zero) without
+  // dependence on tid.y and tid.z?
+  bool isUniform() const;
+
+  // Returns the symbol of (stride) values (null if the coefficient is
+  // exact or unknown).
+  const llvm::Value* getSymbol() const { return symbol_; }
+
+  // Returns the value with the coefficients that depend on a symbol
+  // replaced by (top), e.g. for values passed across function boundaries,
+  // where the symbol is not defined.
+  MultiplierValue withoutSymbol() const;
+
   // Pretty printing 
   std::string getString() const;
 
@@ -74,14 +146,65 @@ class MultiplierValue : public PointerAbstractValue<MultiplierValue> {
 
  private:
   // Helper functions.
-  int getIntValue() const;
-  static MultiplierValue getMultiplierValue(int x, bool b);
+  // Returns the string of the dependence on thread ID (tid.x) only.
+  std::string getTermString() const;
+  // Is this an integer or boolean value linear in thread ID with a known
+  // (possibly symbolic) coefficient?
+  bool isLinear() const;
+  // Returns the coefficient of a linear value (of its symbol if any).
+  int64_t getLinearCoefficient() const;
+  // Returns the value c.symbol.threadID, or getLinear(c) if symbol is null.
+  static MultiplierValue getSymbolic(int64_t c, const llvm::Value* symbol);
+
+  // Operations on the dependence on thread ID (tid.x) only, i.e. on the
+  // type, coefficient and symbol of values. They are applied to each
+  // dimension by the operations on values.
+  static MultiplierValue addX(const MultiplierValue& v1,
+                              const MultiplierValue& v2);
+  static MultiplierValue multiplyX(const MultiplierValue& v1,
+                                   const MultiplierValue& v2);
+  static MultiplierValue negateX(const MultiplierValue& v);
+  static MultiplierValue scaleX(const MultiplierValue& v, int64_t k);
+  static MultiplierValue scaleX(const MultiplierValue& v,
+                                const llvm::Value* symbol);
+  static MultiplierValue floorDivideX(const MultiplierValue& v, int64_t d);
+  static MultiplierValue joinX(const MultiplierValue& v1,
+                               const MultiplierValue& v2);
+  static MultiplierValue withoutSymbolX(const MultiplierValue& v);
+  // Dependence on a dimension of a predicate comparing v1 and v2, which
+  // depend on the dimension as given.
+  static MultiplierValue compareX(const MultiplierValue& v1,
+                                  const MultiplierValue& v2);
+
+  // Applies op to the dependences of v1 and v2 on tid.y and tid.z, and sets
+  // the results as the dependences of this value.
+  template <typename Op>
+  MultiplierValue& setDimensions(const MultiplierValue& v1,
+                                 const MultiplierValue& v2, Op op);
+
+  // Dependence on tid.y or tid.z, represented as that on thread ID by the
+  // type, coefficient and symbol of values.
+  struct DimensionTerm {
+    MultiplierValueType Type;
+    int32_t Coefficient;
+    const llvm::Value* Symbol;
+  };
 
   // The type of value.
   MultiplierValueType t_;
 
   // Is this a boolean value or an integer value?
   bool isBool_;
+
+  // Coefficient of thread ID (of the symbol if any) for (stride) values;
+  // 0 if it is unknown.
+  int32_t coefficient_;
+
+  // Thread-independent factor of the coefficient for (stride) values.
+  const llvm::Value* symbol_;
+
+  // Dependences on tid.y and tid.z.
+  DimensionTerm dims_[2];
 };
 
 MultiplierValue operator+(const MultiplierValue& v1, const MultiplierValue& v2);
@@ -93,5 +216,6 @@ MultiplierValue eq(const MultiplierValue& v1, const MultiplierValue& v2);
 MultiplierValue neq(const MultiplierValue& v1, const MultiplierValue& v2);
 bool operator==(const MultiplierValue& v1, const MultiplierValue& v2);
 bool operator!=(const MultiplierValue& v1, const MultiplierValue& v2);
+bool operator<(const MultiplierValue& v1, const MultiplierValue& v2);
 
 #endif /* MultiplierValue.h */
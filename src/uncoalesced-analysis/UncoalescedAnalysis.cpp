@@ -1,26 +1,64 @@
 #define DEBUG_TYPE "uncoalesced-analysis"
 
 #include "UncoalescedAnalysis.h"
+#include "SourceOrder.h"
+#include "UncoalescedSummaries.h"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Format.h"
+
+#include <mutex>
 
 using namespace llvm;
 
-// Searches FunctionArgumentValues_ for argument values of F_. If found, returns
-// the values, otherwise returns (zero) for all arguments.
+static cl::opt<unsigned> WarpSize("uncoalesced-warp-size",
+    cl::desc("Number of threads per warp in the estimated cost of "
+             "uncoalesced accesses"),
+    cl::init(32));
+
+static cl::list<unsigned> BlockDim("uncoalesced-block-dim",
+    cl::CommaSeparated,
+    cl::desc("Shape of the thread blocks (<x>[,<y>[,<z>]]) in the uncoalesced "
+             "access analysis; by default, the threads of a warp are assumed "
+             "to differ only in x"));
+
+static cl::opt<std::string> LaunchConfigsPath("uncoalesced-launch-configs",
+    cl::desc("Launch configurations of the kernels (see drano "
+             "-emit-launch-configs); kernels launched with a single block "
+             "shape are analyzed for that shape"),
+    cl::value_desc("filename"), cl::init(""));
+
+static cl::opt<bool> MemoryStatsEnabled("uncoalesced-memory-stats",
+    cl::desc("Account the memory of the structures of the uncoalesced "
+             "access analysis and print it with the results"));
+
+MemoryStats* getUncoalescedMemoryStats() {
+  static MemoryStats Stats("uncoalesced access");
+  return MemoryStatsEnabled ? &Stats : nullptr;
+}
+
+// Sizes of the units of memory traffic, in bytes.
+static const uint64_t SectorSize = 32;
+static const uint64_t TransactionSize = 128;
+
+// Returns (zero) for all arguments.
 GPUState UncoalescedAnalysis::BuildInitialState() const {
-  std::map<const Value*, MultiplierValue> argMap;
-  // Check if argument values already exist.
-  if (FunctionArgumentValues_ &&
-      FunctionArgumentValues_->find(F_) != FunctionArgumentValues_->end()) {
-    argMap = FunctionArgumentValues_->at(F_);
-  }
+  return BuildInitialState(CallContext());
+}
+
+// Returns the values in ctx for the arguments of F_. Arguments missing in ctx
+// are set to (zero).
+GPUState UncoalescedAnalysis::BuildInitialState(const CallContext& ctx) const {
   GPUState st;
+  unsigned i = 0;
   for (Function::const_arg_iterator argIt = F_->arg_begin();
-                              argIt != F_->arg_end(); argIt++) {
+                              argIt != F_->arg_end(); argIt++, i++) {
     MultiplierValue v;
     const Value* arg = &*argIt;
     // Check if argument value exists.
-    if (argMap.find(arg) == argMap.end()) { v = MultiplierValue(ZERO); }
-    else { v = MultiplierValue(argMap.at(arg)); }
+    if (i >= ctx.size()) { v = MultiplierValue(ZERO); }
+    else { v = ctx[i]; }
     // If argument is a pointer, set v to address type.
     if (arg->getType()->isPointerTy()) { v.setAddressType(); }
     st.setValue(arg, v);
@@ -28,6 +66,289 @@ GPUState UncoalescedAnalysis::BuildInitialState() const {
   return st;
 }
 
+CallContext UncoalescedAnalysis::getCallContext(const CallInst* CI,
+    const Function* calledF, const GPUState& st) const {
+  CallContext ctx;
+  for (unsigned i = 0; i < calledF->arg_size(); i++) {
+    if (i < CI->getNumArgOperands()) {
+      // Symbolic coefficients refer to values of the caller.
+      MultiplierValue v = st.getValue(CI->getArgOperand(i)).withoutSymbol();
+      MultiplierValue arg = v.getDimension(0);
+      for (unsigned dim = 1; dim < 3; dim++) {
+        arg = arg.withDimension(dim, v.getDimension(dim));
+      }
+      ctx.push_back(arg);
+    } else {
+      ctx.push_back(MultiplierValue(BOT));
+    }
+  }
+  return ctx;
+}
+
+void printAccessTrace(const AccessTrace& trace, raw_ostream& os) {
+  for (unsigned i = 0; i < trace.size(); i++) {
+    if (i > 0) os << " @[ ";
+    trace[i]->getDebugLoc().print(os);
+  }
+  for (unsigned i = 1; i < trace.size(); i++) {
+    os << " ]";
+  }
+}
+
+unsigned getUncoalescedWarpSize() {
+  if (WarpSize == 0) {
+    report_fatal_error("-uncoalesced-warp-size must be at least 1", false);
+  }
+  return WarpSize;
+}
+
+BlockShape getUncoalescedBlockShape() {
+  if (BlockDim.empty() || BlockDim[0] == 0) return BlockShape();
+  BlockShape shape(BlockDim[0],
+                   BlockDim.size() > 1 ? std::max(1u, BlockDim[1]) : 1,
+                   BlockDim.size() > 2 ? std::max(1u, BlockDim[2]) : 1);
+  if (!shape.isValid()) {
+    report_fatal_error(Twine("-uncoalesced-block-dim must have at most ") +
+                       std::to_string(BlockShape::MaxThreads) + " threads",
+                       false);
+  }
+  return shape;
+}
+
+// Launch configurations of the kernels, read from
+// -uncoalesced-launch-configs on first use unless set in process. Modules
+// may be analyzed concurrently.
+static std::mutex LaunchConfigsMutex;
+static bool LaunchConfigsLoaded = false;
+static LaunchConfigMap LaunchConfigs;
+
+// Reads the launch configurations on first use. The caller must hold
+// LaunchConfigsMutex.
+static void loadLaunchConfigs() {
+  if (LaunchConfigsLoaded) return;
+  LaunchConfigsLoaded = true;
+  std::string Error;
+  if (!LaunchConfigsPath.empty() &&
+      !readLaunchConfigs(LaunchConfigsPath, LaunchConfigs, Error)) {
+    errs() << "warning: " << Error << "\n";
+  }
+}
+
+BlockShape getUncoalescedBlockShape(const Function* Kernel) {
+  {
+    std::lock_guard<std::mutex> lock(LaunchConfigsMutex);
+    loadLaunchConfigs();
+    auto it = LaunchConfigs.find(Kernel->getName().str());
+    if (it != LaunchConfigs.end()) {
+      BlockShape shape = it->second.getBlockShape();
+      if (shape.isKnown()) return shape;
+    }
+  }
+  return getUncoalescedBlockShape();
+}
+
+void setUncoalescedLaunchConfigs(const LaunchConfigMap& Configs) {
+  std::lock_guard<std::mutex> lock(LaunchConfigsMutex);
+  LaunchConfigsLoaded = true;
+  LaunchConfigs = Configs;
+}
+
+LaunchConfigMap getUncoalescedLaunchConfigs() {
+  std::lock_guard<std::mutex> lock(LaunchConfigsMutex);
+  loadLaunchConfigs();
+  return LaunchConfigs;
+}
+
+void TransactionCost::print(raw_ostream& os) const {
+  os << "(" << (Gather ? "gather: up to " : "") << Sectors << " sectors, "
+     << Transactions << " transactions per warp, "
+     << format("%.1fx", getWasteFactor()) << ")";
+}
+
+// Returns the number of units of unitSize bytes touched by threads accessing
+// width bytes each at the given byte offsets, the lowest offset being
+// aligned.
+static unsigned countUnits(const std::vector<int64_t>& offsets,
+                           uint64_t width, uint64_t unitSize) {
+  if (offsets.empty()) return 0;
+  int64_t base = *std::min_element(offsets.begin(), offsets.end());
+  std::set<uint64_t> units;
+  for (int64_t offset : offsets) {
+    uint64_t first = uint64_t(offset - base) / unitSize;
+    uint64_t last = (uint64_t(offset - base) + width - 1) / unitSize;
+    for (uint64_t unit = first; unit <= last; unit++) units.insert(unit);
+  }
+  return units.size();
+}
+
+// Returns the warps of warpSize threads of a block of the given shape, or a
+// single warp whose threads differ only in x if the shape is unknown.
+static BlockShape::Warps getBlockWarps(unsigned warpSize,
+                                       const BlockShape& shape) {
+  BlockShape block = shape.isKnown() ? shape : BlockShape(warpSize);
+  return block.getWarps(warpSize);
+}
+
+// Returns the number of threads and the cost of each of the given warps,
+// for an access with address info to elements of unit bytes, each thread
+// accessing width bytes. Threads whose indices differ along a dimension
+// with an unknown coefficient access unrelated addresses, so they are
+// counted separately, each group starting aligned.
+static std::vector<std::pair<unsigned, TransactionCost>> getWarpCosts(
+    const UncoalescedAccessInfo& info, uint64_t unit, uint64_t width,
+    const BlockShape::Warps& warps) {
+  MultiplierValue v = info.getMultiplierValue();
+  bool exact[3];
+  int64_t coefficients[3];
+  for (unsigned dim = 0; dim < 3; dim++) {
+    exact[dim] = v.getDimension(dim).hasExactCoefficient();
+    coefficients[dim] = v.getDimension(dim).getCoefficient();
+  }
+  std::vector<std::pair<unsigned, TransactionCost>> costs;
+  for (const auto& warp : warps) {
+    // Byte offsets of the threads, grouped by their indices along the
+    // dimensions with unknown coefficients.
+    std::map<std::array<uint64_t, 3>, std::vector<int64_t>> groups;
+    for (const std::array<uint64_t, 3>& tid : warp) {
+      std::array<uint64_t, 3> key = {{0, 0, 0}};
+      int64_t offset = 0;
+      for (unsigned dim = 0; dim < 3; dim++) {
+        if (exact[dim]) {
+          offset += coefficients[dim] * int64_t(tid[dim]) * int64_t(unit);
+        } else {
+          key[dim] = tid[dim];
+        }
+      }
+      groups[key].push_back(offset);
+    }
+    TransactionCost cost;
+    cost.Gather = groups.size() > 1;
+    for (const auto& group : groups) {
+      cost.Sectors += countUnits(group.second, width, SectorSize);
+      cost.Transactions += countUnits(group.second, width, TransactionSize);
+    }
+    cost.IdealSectors = (warp.size() * width + SectorSize - 1) / SectorSize;
+    costs.emplace_back(warp.size(), cost);
+  }
+  return costs;
+}
+
+TransactionCost getTransactionCost(const Instruction* I,
+                                   const UncoalescedAccessInfo& info,
+                                   unsigned warpSize,
+                                   const BlockShape& shape) {
+  const Type* type = nullptr;
+  if (const LoadInst* LI = dyn_cast<LoadInst>(I)) {
+    type = LI->getType();
+  } else if (const StoreInst* SI = dyn_cast<StoreInst>(I)) {
+    type = SI->getValueOperand()->getType();
+  }
+  uint64_t width = info.ElementSize;
+  if (type && type->isSized()) {
+    width = I->getModule()->getDataLayout().getTypeStoreSize(
+        const_cast<Type*>(type)).getFixedSize();
+  }
+  if (width == 0) width = 1;
+
+  // The most wasteful warp of the block.
+  TransactionCost cost;
+  for (const auto& pair :
+           getWarpCosts(info, std::max<uint64_t>(info.ElementSize, width),
+                        width, getBlockWarps(warpSize, shape))) {
+    if (cost.IdealSectors == 0 || pair.second.isWorseThan(cost)) {
+      cost = pair.second;
+    }
+  }
+  return cost;
+}
+
+// Returns the value standing for the thread-independent factor v in
+// symbolic coefficients, looking through integer casts (e.g. of a kernel
+// argument).
+static const Value* getSymbol(const Value* v) {
+  while (const CastInst* CI = dyn_cast<CastInst>(v)) v = CI->getOperand(0);
+  return v;
+}
+
+// Is an access uncoalesced if the multiplier of thread ID in its address is
+// v, for elements of psize bytes? Consecutive threads then access addresses
+// more than 4 bytes apart, or apart by an unknown distance. If warps span
+// several rows of the block, some warp must instead touch more sectors than
+// if its threads accessed consecutive 4-byte words (or the same element).
+bool UncoalescedAnalysis::isUncoalescedAddress(const MultiplierValue& v,
+                                               size_t psize) const {
+  unsigned warpSize = getUncoalescedWarpSize();
+  if (!Shape_.isKnown() || Shape_.X % warpSize == 0) {
+    switch (v.getType()) {
+      case MultiplierValueType::TOP:
+        return true;
+      case MultiplierValueType::ONE:
+      case MultiplierValueType::NEGONE:
+      case MultiplierValueType::STRIDE:
+        return !v.hasExactCoefficient() ||
+               uint64_t(std::abs(v.getCoefficient())) * psize > 4;
+      default:
+        return false;
+    }
+  }
+  uint64_t width = std::max<uint64_t>(psize, 1);
+  for (const auto& pair : getWarpCosts(UncoalescedAccessInfo(v, psize),
+                                       width, width, Warps_)) {
+    uint64_t words = (4 * pair.first + SectorSize - 1) / SectorSize;
+    uint64_t element = (width + SectorSize - 1) / SectorSize;
+    if (pair.second.Sectors > std::max(words, element)) return true;
+  }
+  return false;
+}
+
+bool UncoalescedAnalysis::isDistinctInWarps(const MultiplierValue& v) const {
+  unsigned warpSize = getUncoalescedWarpSize();
+  if (!Shape_.isKnown() || Shape_.X % warpSize == 0) return true;
+  int64_t coefficients[3];
+  for (unsigned dim = 0; dim < 3; dim++) {
+    if (!v.getDimension(dim).hasExactCoefficient()) return false;
+    coefficients[dim] = v.getDimension(dim).getCoefficient();
+  }
+  for (const auto& warp : Warps_) {
+    std::set<int64_t> values;
+    for (const std::array<uint64_t, 3>& tid : warp) {
+      int64_t value = 0;
+      for (unsigned dim = 0; dim < 3; dim++) {
+        value += coefficients[dim] * int64_t(tid[dim]);
+      }
+      if (!values.insert(value).second) return false;
+    }
+  }
+  return true;
+}
+
+int64_t UncoalescedAnalysis::getBlockDimension(const Value* v) const {
+  const CallInst* CI = dyn_cast<CallInst>(getSymbol(v));
+  const Function* F = CI ? CI->getCalledFunction() : nullptr;
+  if (!Shape_.isKnown() || !F) return 0;
+  if (F->getName().equals("llvm.nvvm.read.ptx.sreg.ntid.x")) return Shape_.X;
+  if (F->getName().equals("llvm.nvvm.read.ptx.sreg.ntid.y")) return Shape_.Y;
+  if (F->getName().equals("llvm.nvvm.read.ptx.sreg.ntid.z")) return Shape_.Z;
+  return 0;
+}
+
+MultiplierValue UncoalescedAnalysis::getProduct(
+    const Value* in1, const MultiplierValue& v1,
+    const Value* in2, const MultiplierValue& v2) const {
+  if (v1.isUniform() && !v2.isUniform()) {
+    return getProduct(in2, v2, in1, v1);
+  }
+  if (v1.isUniform() || !v2.isUniform()) return v1 * v2;
+  // v1 depends on the thread index and v2 does not.
+  if (const ConstantInt* C = dyn_cast<ConstantInt>(in2)) {
+    if (C->getBitWidth() > 64) return MultiplierValue(TOP);
+    return v1.scale(C->getSExtValue());
+  }
+  // blockDim is a constant if the block shape is known.
+  if (int64_t size = getBlockDimension(in2)) return v1.scale(size);
+  return v1.scale(getSymbol(in2));
+}
+
 MultiplierValue UncoalescedAnalysis::getConstantExprValue(const Value* p) {
   MultiplierValue v = MultiplierValue(BOT);
   ConstantExpr *pe = const_cast<ConstantExpr*>(cast<ConstantExpr>(p));
@@ -74,6 +395,9 @@ size_t UncoalescedAnalysis::getBaseTypeSize(
 
 void UncoalescedAnalysis::setBaseTypeSize(
     const Value *v, size_t size) {
+  if (memory_.isEnabled() && !baseSizeMap_.count(v)) {
+    memory_.add(MemoryBaseSizes, getMapNodeBytes<const Value*, size_t>());
+  }
   baseSizeMap_[v] = size;
 }
 
@@ -90,12 +414,25 @@ GPUState UncoalescedAnalysis::ExecuteInstruction(
     // Apply operation to get the resultant value.
     MultiplierValue v;
     auto op = BO->getOpcode();
+    const ConstantInt* C = dyn_cast<ConstantInt>(in2);
+    // Shifts by a constant amount multiply or divide by a power of two.
+    int64_t shift = C && C->getValue().ult(31) ? C->getZExtValue() : -1;
+    // Divisions by a constant (0 if it is zero or does not fit in 32 bits).
+    int64_t divisor = 0;
+    if (C && op == Instruction::UDiv && C->getValue().ule(INT32_MAX)) {
+      divisor = C->getZExtValue();
+    } else if (C && op == Instruction::SDiv &&
+               C->getValue().getMinSignedBits() <= 32) {
+      divisor = C->getSExtValue();
+    }
     switch (op) {
       case Instruction::URem:
       case Instruction::SRem:
+        v = v1;
+        break;
       case Instruction::AShr:
       case Instruction::LShr:
-        v = v1;
+        v = shift >= 0 ? v1.floorDivide(int64_t(1) << shift) : v1 * v2;
         break;
       case Instruction::Add:
         v = v1 + v2;
@@ -104,12 +441,17 @@ GPUState UncoalescedAnalysis::ExecuteInstruction(
         v = v1 + (- v2);
         break;
       case Instruction::Shl:
+        v = shift >= 0 ? v1.scale(int64_t(1) << shift) : v1 * v2;
+        break;
       case Instruction::Mul:
-        v = v1 * v2;
+        v = getProduct(in1, v1, in2, v2);
         break;
       case Instruction::UDiv:
       case Instruction::SDiv:
-        v = v1 * v2;
+        // Signed division rounds toward zero rather than down, which only
+        // changes the constant term unless the dividend changes sign across
+        // threads.
+        v = divisor != 0 ? v1.floorDivide(divisor) : v1 * v2;
         break;
       case Instruction::Or:
         v = v1 || v2;
@@ -136,15 +478,17 @@ GPUState UncoalescedAnalysis::ExecuteInstruction(
     } else {
       // If function has no name, return!
       Function *calledF = CI->getCalledFunction();
-      if (!calledF->hasName()) {
+      if (!calledF || !calledF->hasName()) {
         st.setValue(CI, MultiplierValue(TOP));
       } else {
         StringRef name = calledF->getName();
         if (name.equals("llvm.nvvm.read.ptx.sreg.tid.x")) {
           st.setValue(CI, MultiplierValue(ONE));
-        } else if (name.equals("llvm.nvvm.read.ptx.sreg.tid.y") ||
-            name.equals("llvm.nvvm.read.ptx.sreg.tid.z") ||
-            name.equals("llvm.nvvm.read.ptx.sreg.ntid.x") ||
+        } else if (name.equals("llvm.nvvm.read.ptx.sreg.tid.y")) {
+          st.setValue(CI, MultiplierValue::getThreadIndex(1));
+        } else if (name.equals("llvm.nvvm.read.ptx.sreg.tid.z")) {
+          st.setValue(CI, MultiplierValue::getThreadIndex(2));
+        } else if (name.equals("llvm.nvvm.read.ptx.sreg.ntid.x") ||
             name.equals("llvm.nvvm.read.ptx.sreg.ntid.y") ||
             name.equals("llvm.nvvm.read.ptx.sreg.ntid.z") ||
             name.equals("llvm.nvvm.read.ptx.sreg.ctaid.x") ||
@@ -171,39 +515,29 @@ GPUState UncoalescedAnalysis::ExecuteInstruction(
           st.setValue(CI, MultiplierValue(TOP));
         }
       }
-      // If calledF is not a declaration and FunctionArgumentValues_ is not
-      // nullptr, create a call context consisting of mapping from arguments
-      // to their abstract values and merge it with the existing call context
-      // for calledF. This represents the values that flow during the call into
-      // the arguments of calledF.
-      if (!calledF->isDeclaration() && FunctionArgumentValues_) {
-        std::map<const Value*, MultiplierValue> argMap;
-        // Check if argument values exist in the map.
-        if (FunctionArgumentValues_->find(calledF) !=
-                FunctionArgumentValues_->end()) {
-          argMap = FunctionArgumentValues_->at(calledF);
-        }
-        // Iterate over arguments and update argMap.
-        unsigned i = 0;
-        for (auto argIt = calledF->arg_begin();
-             argIt != calledF->arg_end() && i < CI->getNumArgOperands();
-                                                                 argIt++) {
-          const Value* arg = &*argIt;
-          MultiplierValue v = st.getValue(CI->getArgOperand(i));
-          if (argMap.find(arg) == argMap.end()) { argMap[arg] = v; }
-          else { argMap[arg] = v.join(argMap[arg]); }
-          ++i;
-        }
-        FunctionArgumentValues_->emplace(calledF, argMap);
+      // If calledF is not an intrinsic and Summaries_ is not nullptr, build
+      // the call context consisting of the abstract values of the arguments
+      // and fetch (or compute) the summary of calledF in that context. The
+      // summary provides the value returned by the call. Functions declared
+      // here have a summary only if they are resolved in another module.
+      const FunctionSummary* summaryPtr = nullptr;
+      CallContext ctx;
+      if (calledF && !calledF->isIntrinsic() && Summaries_) {
+        ctx = getCallContext(CI, calledF, st);
+        summaryPtr = Summaries_->lookupSummary(calledF, ctx);
+      }
+      if (summaryPtr) {
+        const FunctionSummary& summary = *summaryPtr;
+        st.setValue(CI, summary.ReturnValue);
 
         // Print called arguments.
         LLVM_DEBUG(errs() << "Called function " << calledF->getName()
               << " with args (");
-        for (auto argIt = calledF->arg_begin();
-             argIt != calledF->arg_end(); argIt++) {
-          LLVM_DEBUG(errs() << argMap[&*argIt].getString() << ", ");
+        for (const MultiplierValue& v : ctx) {
+          LLVM_DEBUG(errs() << v.getString() << ", ");
         }
-        LLVM_DEBUG(errs() << ")\n");
+        LLVM_DEBUG(errs() << ") returns "
+              << summary.ReturnValue.getString() << "\n");
       }
     }
 
@@ -228,9 +562,8 @@ GPUState UncoalescedAnalysis::ExecuteInstruction(
     size_t psize = getBaseTypeSize(p, p->getType(),
                                    LI->getModule()->getDataLayout());
     if (v.isAddressType() && (st.getNumThreads().getType() == TOP) &&
-        ((psize > 4 && (v.getType() == ONE || v.getType() == NEGONE)) ||
-         (v.getType() == TOP))) {
-      UncoalescedAccesses_.insert(LI);
+        isUncoalescedAddress(v, psize)) {
+      addUncoalescedAccess(LI, v, psize);
       LLVM_DEBUG(errs() << "UNCOALESCED ACCESS FOUND in access at ");
       LLVM_DEBUG(cast<Instruction>(LI)->getDebugLoc().print(errs()));
       LLVM_DEBUG(errs() << " in \n      " << *LI << "\n\n");
@@ -301,9 +634,8 @@ GPUState UncoalescedAnalysis::ExecuteInstruction(
     size_t psize = getBaseTypeSize(p, p->getType(),
                                    SI->getModule()->getDataLayout());
     if (v.isAddressType() && (st.getNumThreads().getType() == TOP) &&
-        ((psize > 4 && (v.getType() == ONE || v.getType() == NEGONE)) ||
-         (v.getType() == TOP))) {
-      UncoalescedAccesses_.insert(SI);
+        isUncoalescedAddress(v, psize)) {
+      addUncoalescedAccess(SI, v, psize);
       LLVM_DEBUG(errs() << "UNCOALESCED ACCESS FOUND in access at ");
       LLVM_DEBUG(cast<Instruction>(SI)->getDebugLoc().print(errs()));
       LLVM_DEBUG(errs() << " in \n      " << *SI << "\n\n");
@@ -371,6 +703,12 @@ GPUState UncoalescedAnalysis::ExecuteInstruction(
     } else {
       v = MultiplierValue(TOP);
     }
+    // Several threads of a warp may satisfy a predicate for a single value
+    // of tid.x if warps span several rows of the block.
+    if ((v.getType() == ONE || v.getType() == NEGONE) &&
+        !isDistinctInWarps(st.getValue(in1) + (-st.getValue(in2)))) {
+      v = MultiplierValue(TOP);
+    }
     st.setValue(CI, v);
 
   } else if (isa<BranchInst>(I)) {
@@ -395,6 +733,12 @@ GPUState UncoalescedAnalysis::ExecuteInstruction(
     }
 
   } else if (isa<TerminatorInst>(I)) {
+    // If this is a return instruction, join the returned value with the
+    // function return value.
+    if (isa<ReturnInst>(I) && cast<ReturnInst>(I)->getReturnValue()) {
+      ReturnValue_ = ReturnValue_.join(
+          st.getValue(cast<ReturnInst>(I)->getReturnValue()));
+    }
     // Add next blocks.
     const TerminatorInst *TI = cast<TerminatorInst>(I);
     for (unsigned i = 0; i < TI->getNumSuccessors(); i++) {
@@ -405,22 +749,79 @@ GPUState UncoalescedAnalysis::ExecuteInstruction(
   return st;
 }
 
-void UncoalescedAnalysis::BuildAnalysisInfo(GPUState st) {
+void UncoalescedAnalysis::addUncoalescedAccess(const Instruction* I,
+    const MultiplierValue& v, size_t psize) {
+  UncoalescedAccesses_.insert(I);
+  UncoalescedAccessInfo& info = AccessInfoMap_[I];
+  info = info.join(UncoalescedAccessInfo(v, psize));
+}
+
+void UncoalescedAnalysis::ComputeUncoalescedAccesses(GPUState st) {
   UncoalescedAccesses_.clear();
+  AccessInfoMap_.clear();
+  CalleeUncoalescedAccesses_.clear();
   baseSizeMap_.clear();
+  memory_.set(MemoryBaseSizes, 0);
+  ReturnValue_ = MultiplierValue(BOT);
 
   LLVM_DEBUG(errs() << "-------------- computing uncoalesced accesses ------------------\n");
-  errs() << "Function: " << F_->getName() << "\n";
   initialState_ = st;
   entryBlock_ = &F_->getEntryBlock();
   Execute();
 
+  if (!Summaries_) return;
+  // Attribute uncoalesced accesses in callees to the call sites in F_, using
+  // the call contexts reached at the end of the execution.
+  for (const_inst_iterator it = inst_begin(F_), ite = inst_end(F_);
+                                                      it != ite; ++it) {
+    const CallInst* CI = dyn_cast<CallInst>(&*it);
+    if (!CI || CI->isInlineAsm() || !hasStateBeforeInstruction(CI)) continue;
+    const Function* calledF = CI->getCalledFunction();
+    if (!calledF || calledF->isIntrinsic()) continue;
+    CallContext ctx = getCallContext(CI, calledF,
+                                     getStateBeforeInstruction(CI));
+    const FunctionSummary* summary = Summaries_->lookupSummary(calledF, ctx);
+    if (!summary) continue;
+    for (const AccessTrace& trace : summary->UncoalescedAccesses) {
+      AccessTrace callerTrace = trace;
+      callerTrace.push_back(CI);
+      CalleeUncoalescedAccesses_.insert(callerTrace);
+    }
+  }
+}
+
+void UncoalescedAnalysis::BuildAnalysisInfo(GPUState st) {
+  errs() << "Function: " << F_->getName() << "\n";
+  ComputeUncoalescedAccesses(st);
+
   // Print uncoalesced accesses found by the analysis.
-  errs() << "  Uncoalesced accesses: #" << UncoalescedAccesses_.size() << "\n";
-  for (auto it = UncoalescedAccesses_.begin(), ite = UncoalescedAccesses_.end();
-                                                                it != ite; ++it) {
+  errs() << "  Uncoalesced accesses: #" << UncoalescedAccesses_.size() +
+      CalleeUncoalescedAccesses_.size() << "\n";
+  // Most wasteful accesses first, then in source order. The cost is printed
+  // on a line of its own, so that each "--" line only holds the location.
+  std::vector<std::pair<const Instruction*, TransactionCost>> accesses;
+  for (const Instruction* I :
+           getInSourceOrder<const Instruction*>(UncoalescedAccesses_)) {
+    accesses.emplace_back(I, getTransactionCost(I, AccessInfoMap_.at(I),
+                                                getUncoalescedWarpSize(),
+                                                Shape_));
+  }
+  std::stable_sort(accesses.begin(), accesses.end(),
+                   [](const std::pair<const Instruction*, TransactionCost>& a,
+                      const std::pair<const Instruction*, TransactionCost>& b) {
+    return a.second.isWorseThan(b.second);
+  });
+  for (const auto& access : accesses) {
+    errs() << "  -- ";
+    access.first->getDebugLoc().print(errs());
+    errs() << "\n     cost ";
+    access.second.print(errs());
+    errs() << "\n";
+  }
+  for (const AccessTrace& trace :
+           getInSourceOrder<AccessTrace>(CalleeUncoalescedAccesses_)) {
     errs() << "  -- ";
-    (*it)->getDebugLoc().print(errs());
+    printAccessTrace(trace, errs());
     errs() << "\n";
   }
   errs() << "\n";
@@ -2,8 +2,10 @@
 #define UNCOALESCED_ACCESS_ANALYSIS_H
 
 #include "AbstractExecutionEngine.h"
+#include "BlockShape.h"
 #include "MultiplierValue.h"
 #include "GPUState.h"
+#include "LaunchConfig.h"
 
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/IR/Dominators.h"
@@ -12,39 +14,256 @@
 #include "llvm/IR/InstVisitor.h"
 #include "llvm/IR/Value.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <map> 
 #include <set> 
 #include <list> 
 #include <utility> 
+#include <vector> 
 
 using namespace llvm;
 
+class UncoalescedSummaries;
+
+// Abstract values of the arguments of a function at a call site.
+typedef std::vector<MultiplierValue> CallContext;
+
+// An uncoalesced access reached through a chain of calls. The first element
+// is the access, followed by the call sites through which it is reached
+// (innermost call first).
+typedef std::vector<const Instruction*> AccessTrace;
+
+// Why an access is uncoalesced: the multiplier of thread ID in its address
+// (ONE, NEGONE or STRIDE when consecutive threads access elements more than
+// 4 bytes apart, TOP otherwise), the dependences of the address on tid.y and
+// tid.z (which matter when warps span several rows of a block) and the size
+// of the accessed elements.
+struct UncoalescedAccessInfo {
+  UncoalescedAccessInfo()
+    : Multiplier(MultiplierValueType::BOT), ElementSize(0), Coefficient(0),
+      MultiplierY(MultiplierValueType::ZERO), CoefficientY(0),
+      MultiplierZ(MultiplierValueType::ZERO), CoefficientZ(0) {}
+  UncoalescedAccessInfo(MultiplierValueType multiplier, size_t elementSize,
+                        int64_t coefficient = 0)
+    : Multiplier(multiplier), ElementSize(elementSize),
+      Coefficient(coefficient),
+      MultiplierY(MultiplierValueType::ZERO), CoefficientY(0),
+      MultiplierZ(MultiplierValueType::ZERO), CoefficientZ(0) {}
+
+  // Information for an access whose address has the value v (symbolic
+  // coefficients are recorded as unknown).
+  UncoalescedAccessInfo(const MultiplierValue& v, size_t elementSize)
+    : ElementSize(elementSize) {
+    getTerm(v.getDimension(0), Multiplier, Coefficient);
+    getTerm(v.getDimension(1), MultiplierY, CoefficientY);
+    getTerm(v.getDimension(2), MultiplierZ, CoefficientZ);
+  }
+
+  MultiplierValueType Multiplier;
+  size_t ElementSize;
+
+  // Coefficient of thread ID for STRIDE multipliers (0 if it is symbolic).
+  int64_t Coefficient;
+
+  // Dependences of the address on tid.y and tid.z, in the same form as on
+  // thread ID (ZERO if there is none).
+  MultiplierValueType MultiplierY;
+  int64_t CoefficientY;
+  MultiplierValueType MultiplierZ;
+  int64_t CoefficientZ;
+
+  // Join of the information found for the same access (e.g. in different
+  // call contexts).
+  UncoalescedAccessInfo join(const UncoalescedAccessInfo& info) const {
+    if (Multiplier == MultiplierValueType::BOT) return info;
+    if (info.Multiplier == MultiplierValueType::BOT) return *this;
+    UncoalescedAccessInfo out = *this;
+    out.ElementSize = std::max(ElementSize, info.ElementSize);
+    joinTerm(out.Multiplier, out.Coefficient,
+             info.Multiplier, info.Coefficient);
+    joinTerm(out.MultiplierY, out.CoefficientY,
+             info.MultiplierY, info.CoefficientY);
+    joinTerm(out.MultiplierZ, out.CoefficientZ,
+             info.MultiplierZ, info.CoefficientZ);
+    return out;
+  }
+
+  // Returns the multiplier (and the dependences on tid.y and tid.z) as an
+  // abstract value.
+  MultiplierValue getMultiplierValue() const {
+    return getValue(Multiplier, Coefficient)
+        .withDimension(1, getValue(MultiplierY, CoefficientY))
+        .withDimension(2, getValue(MultiplierZ, CoefficientZ));
+  }
+
+  // Coefficient of thread ID in the address (0 if unknown).
+  int64_t getCoefficient() const {
+    return getMultiplierValue().getCoefficient();
+  }
+
+  // Estimated distance in bytes between the addresses accessed by
+  // consecutive threads (0 if unknown).
+  int64_t getStride() const {
+    return getCoefficient() * int64_t(ElementSize);
+  }
+
+  // Estimated distance in bytes between the addresses accessed by threads
+  // consecutive along dim (0 for x, 1 for y, 2 for z; 0 if unknown).
+  int64_t getStride(unsigned dim) const {
+    return getMultiplierValue().getDimension(dim).getCoefficient() *
+           int64_t(ElementSize);
+  }
+
+ private:
+  static void getTerm(const MultiplierValue& v, MultiplierValueType& type,
+                      int64_t& coefficient) {
+    type = v.getType();
+    coefficient = type == MultiplierValueType::STRIDE ? v.getCoefficient() : 0;
+  }
+
+  static MultiplierValue getValue(MultiplierValueType type,
+                                  int64_t coefficient) {
+    if (type == MultiplierValueType::STRIDE && coefficient != 0) {
+      return MultiplierValue::getLinear(coefficient);
+    }
+    return MultiplierValue(type);
+  }
+
+  static void joinTerm(MultiplierValueType& type, int64_t& coefficient,
+                       MultiplierValueType type2, int64_t coefficient2) {
+    if (type != type2 || coefficient != coefficient2) {
+      type = MultiplierValueType::TOP;
+      coefficient = 0;
+    }
+  }
+};
+
+// Estimated memory traffic of one warp request of an access: the 32-byte
+// sectors and 128-byte transactions touched by the threads of the warp,
+// assuming the address of the first thread is aligned.
+struct TransactionCost {
+  TransactionCost()
+    : Gather(false), Sectors(0), Transactions(0), IdealSectors(0) {}
+
+  // The stride is unknown (TOP multiplier), so threads may access unrelated
+  // addresses. Sectors and Transactions are then upper bounds.
+  bool Gather;
+
+  unsigned Sectors;
+  unsigned Transactions;
+
+  // Sectors touched if consecutive threads accessed consecutive elements.
+  unsigned IdealSectors;
+
+  // Ratio of the sectors fetched to the sectors needed.
+  double getWasteFactor() const {
+    return IdealSectors ? double(Sectors) / IdealSectors : 1.0;
+  }
+
+  // Orders costs from the most to the least wasteful.
+  bool isWorseThan(const TransactionCost& cost) const {
+    if (getWasteFactor() != cost.getWasteFactor()) {
+      return getWasteFactor() > cost.getWasteFactor();
+    }
+    return Sectors > cost.Sectors;
+  }
+
+  // Prints e.g. "(8 sectors, 2 transactions per warp, 1.0x)".
+  void print(raw_ostream& os) const;
+};
+
+// Returns the number of threads per warp given with -uncoalesced-warp-size.
+unsigned getUncoalescedWarpSize();
+
+// Returns the shape of thread blocks given with -uncoalesced-block-dim, or
+// an unknown shape.
+BlockShape getUncoalescedBlockShape();
+
+// Returns the shape of the thread blocks Kernel is analyzed for: the shape
+// of all its launches if its launch configuration (given with
+// -uncoalesced-launch-configs or setUncoalescedLaunchConfigs) has one, and
+// getUncoalescedBlockShape() otherwise.
+BlockShape getUncoalescedBlockShape(const Function* Kernel);
+
+// Sets the launch configurations of the kernels analyzed in this process,
+// replacing those read from the file given with -uncoalesced-launch-configs.
+void setUncoalescedLaunchConfigs(const LaunchConfigMap& Configs);
+
+// Returns the launch configurations of the kernels analyzed in this process.
+LaunchConfigMap getUncoalescedLaunchConfigs();
+
+// Returns the estimated cost of the access I, whose address has the
+// multiplier of thread ID and the element size in info, for the warp of a
+// block of the given shape whose access is the most wasteful. The threads
+// of a warp are numbered over the shape, and each thread accesses the bytes
+// of the loaded or stored value at the element size times its index
+// weighted by the multipliers. When the shape is unknown, the threads of a
+// warp differ only in x, and the stride between consecutive threads is the
+// element size times the multiplier.
+TransactionCost getTransactionCost(const Instruction* I,
+                                   const UncoalescedAccessInfo& info,
+                                   unsigned warpSize = getUncoalescedWarpSize(),
+                                   const BlockShape& shape =
+                                       getUncoalescedBlockShape());
+
+// Returns the memory statistics of the uncoalesced access analysis, or null
+// unless -uncoalesced-memory-stats is given.
+MemoryStats* getUncoalescedMemoryStats();
+
+// Prints the trace in the format used for inlined debug locations, i.e.
+// "access @[ call1 @[ call2 ] ]".
+void printAccessTrace(const AccessTrace& trace, raw_ostream& os);
+
 // Class to compute dependences of variables on thread ID and hence,
 // the uncoalesced accesses.
 class UncoalescedAnalysis
   : public AbstractExecutionEngine<MultiplierValue, GPUState> {
  public: 
-  UncoalescedAnalysis(const Function* F, const DominatorTree* DomTree)
-    : F_(F), DT_(DomTree), FunctionArgumentValues_(nullptr) {}
+  UncoalescedAnalysis(const Function* F, const DominatorTree* DomTree,
+                      const BlockShape& Shape = getUncoalescedBlockShape())
+    : UncoalescedAnalysis(F, DomTree, nullptr, Shape) {}
 
-  UncoalescedAnalysis(
-      const Function* F, const DominatorTree* DomTree,
-      std::map<const Function *, 
-               std::map<const Value *, MultiplierValue>>* FunctionArgumentValues)
-    : F_(F), DT_(DomTree), FunctionArgumentValues_(FunctionArgumentValues) {}
+  UncoalescedAnalysis(const Function* F, const DominatorTree* DomTree,
+                      UncoalescedSummaries* Summaries,
+                      const BlockShape& Shape = getUncoalescedBlockShape())
+    : F_(F), DT_(DomTree), Summaries_(Summaries), Shape_(Shape) {
+    setMemoryStats(getUncoalescedMemoryStats());
+    // The warps are only inspected if they span several rows of the block.
+    unsigned warpSize = getUncoalescedWarpSize();
+    if (Shape_.isKnown() && Shape_.X % warpSize != 0) {
+      Warps_ = Shape_.getWarps(warpSize);
+    }
+  }
 
   // Getters 
   const Function* getFunction() const { return F_; }
   const std::set<const Instruction*>& getUncoalescedAccesses() const {
     return UncoalescedAccesses_;
   } 
+  const std::map<const Instruction*, UncoalescedAccessInfo>&
+      getUncoalescedAccessInfo() const {
+    return AccessInfoMap_;
+  }
+  const std::set<AccessTrace>& getCalleeUncoalescedAccesses() const {
+    return CalleeUncoalescedAccesses_;
+  }
+  const MultiplierValue& getReturnValue() const { return ReturnValue_; }
 
-  // Builds initial GPU state for the function.
+  // Builds initial GPU state for the function. All arguments are assumed to
+  // be independent of thread ID.
   GPUState BuildInitialState() const;
 
-  // Builds analysis information for the function given the initial state.
+  // Builds initial GPU state for the function in the given call context.
+  GPUState BuildInitialState(const CallContext& ctx) const;
+
+  // Builds and prints analysis information for the function given the
+  // initial state.
   void BuildAnalysisInfo(GPUState st);
 
+  // Computes uncoalesced accesses in the function and its callees given the
+  // initial state.
+  void ComputeUncoalescedAccesses(GPUState st);
+
   // Implements execution of different instructions on the abstract state.
   GPUState ExecuteInstruction(const Instruction* I, GPUState st);
 
@@ -62,22 +281,62 @@ class UncoalescedAnalysis
   // Handles special cases where pointer is a constant expr. 
   MultiplierValue getConstantExprValue(const Value* p);
 
+  // Returns the call context for a call to calledF in state st.
+  CallContext getCallContext(const CallInst* CI, const Function* calledF,
+                             const GPUState& st) const;
+
+  // Returns the product of the values v1 of in1 and v2 of in2, scaling a
+  // value linear in thread ID by a thread-independent constant or symbol.
+  MultiplierValue getProduct(const Value* in1, const MultiplierValue& v1,
+                             const Value* in2, const MultiplierValue& v2) const;
+
+  // Returns the threads per block along the dimension read by v (through
+  // casts) if v reads blockDim (ntid) and the block shape is known, and 0
+  // otherwise.
+  int64_t getBlockDimension(const Value* v) const;
+
+  // Is an access to elements of psize bytes at address v uncoalesced?
+  bool isUncoalescedAddress(const MultiplierValue& v, size_t psize) const;
+
+  // Do the threads of each warp have distinct values for v, whose
+  // coefficient of thread ID is exact and non-zero? Threads with the same
+  // tid.x may share a warp if warps span several rows of the block.
+  bool isDistinctInWarps(const MultiplierValue& v) const;
+
+  // Records the uncoalesced access I with address value v and element size
+  // psize.
+  void addUncoalescedAccess(const Instruction* I, const MultiplierValue& v,
+                            size_t psize);
+
   std::set<const Instruction*> UncoalescedAccesses_;
 
+  // Map from uncoalesced accesses to why they are uncoalesced.
+  std::map<const Instruction*, UncoalescedAccessInfo> AccessInfoMap_;
+
+  // Uncoalesced accesses within callees, attributed to the call sites in
+  // this function through which they are reached.
+  std::set<AccessTrace> CalleeUncoalescedAccesses_;
+
+  // Join of values returned by the function.
+  MultiplierValue ReturnValue_;
+
   // Function being analyzed for uncoalesced accesses.
   const Function *F_;
 
   // Dominator Tree Information.
   const DominatorTree* DT_;
 
-  // Function to argument values map (initialized by merging different call
-  // contexts of the function.
+  // Memoized summaries of callees, keyed by their call contexts.
   // For e.g. if there is a call to F, say x = F(x1, x2) and abstract values of
-  // x1 and x2 are v1 and v2, then the following mapping 
-  //     F -> (arg0 -> v1, arg0 -> v2)
-  // is added to the map.
-  std::map<const Function *, std::map<const Value *, MultiplierValue>>* 
-      FunctionArgumentValues_;
+  // x1 and x2 are v1 and v2, then F is analyzed once in the context (v1, v2)
+  // and the summary is reused at every call to F in the same context.
+  UncoalescedSummaries* Summaries_;
+
+  // Shape of the thread blocks the function is executed by.
+  BlockShape Shape_;
+
+  // Warps of a block of shape Shape_, built once if they span several rows.
+  BlockShape::Warps Warps_;
 };
 
 #endif /* UncoalescedAnalysis.h */
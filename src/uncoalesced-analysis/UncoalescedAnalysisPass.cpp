@@ -1,5 +1,7 @@
 #include "UncoalescedAnalysisPass.h"
 
+#include "SourceOrder.h"
+
 using namespace llvm;
 
 bool UncoalescedAnalysisPass::runOnFunction(Function &F) {
@@ -7,7 +9,7 @@ bool UncoalescedAnalysisPass::runOnFunction(Function &F) {
   // GPUState::testGPUState();
 
   auto &DomTree = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
-  UncoalescedAnalysis UA(&F, &DomTree);
+  UncoalescedAnalysis UA(&F, &DomTree, getUncoalescedBlockShape(&F));
   errs() << "Analysis Results: \n";
   GPUState st = UA.BuildInitialState();
   UA.BuildAnalysisInfo(st);
@@ -25,3 +27,36 @@ INITIALIZE_PASS_END(UncoalescedAnalysisPass, "uncoalesced-analysis", "Pass to ge
 */
 static RegisterPass<UncoalescedAnalysisPass>
 Y("uncoalesced-analysis", "Pass to detect uncoalesced accesses in gpu programs.");
+
+AnalysisKey UncoalescedAccessAnalysis::Key;
+
+UncoalescedAccessResult UncoalescedAccessAnalysis::run(
+    Function &F, FunctionAnalysisManager &FAM) {
+  auto &DomTree = FAM.getResult<DominatorTreeAnalysis>(F);
+  UncoalescedAnalysis UA(&F, &DomTree, getUncoalescedBlockShape(&F));
+  UA.ComputeUncoalescedAccesses(UA.BuildInitialState());
+  UncoalescedAccessResult result;
+  result.F = &F;
+  result.UncoalescedAccesses = UA.getUncoalescedAccesses();
+  return result;
+}
+
+void UncoalescedAccessResult::print(raw_ostream& os) const {
+  os << "Analysis Results: \n";
+  os << "Function: " << F->getName() << "\n";
+  os << "  Uncoalesced accesses: #" << UncoalescedAccesses.size() << "\n";
+  for (const Instruction* I :
+           getInSourceOrder<const Instruction*>(UncoalescedAccesses)) {
+    os << "  -- ";
+    I->getDebugLoc().print(os);
+    os << "\n";
+  }
+  os << "\n";
+}
+
+PreservedAnalyses UncoalescedAccessPrinterPass::run(
+    Function &F, FunctionAnalysisManager &FAM) {
+  if (F.isDeclaration()) return PreservedAnalyses::all();
+  FAM.getResult<UncoalescedAccessAnalysis>(F).print(OS);
+  return PreservedAnalyses::all();
+}
@@ -57,6 +57,43 @@ struct UncoalescedAnalysisPass : public FunctionPass {
   }
 };
 
+// Results of the intra-procedural analysis of a function.
+struct UncoalescedAccessResult {
+  // Analyzed function.
+  const Function* F;
+
+  // Uncoalesced accesses within the function.
+  std::set<const Instruction*> UncoalescedAccesses;
+
+  // Prints uncoalesced accesses.
+  void print(raw_ostream& os) const;
+};
+
+// Intra-procedural analysis for the new pass manager. The dominator tree is
+// taken from the function analysis manager, and the result is cached until
+// a pass invalidates it.
+class UncoalescedAccessAnalysis
+  : public AnalysisInfoMixin<UncoalescedAccessAnalysis> {
+  friend AnalysisInfoMixin<UncoalescedAccessAnalysis>;
+  static AnalysisKey Key;
+
+ public:
+  typedef UncoalescedAccessResult Result;
+
+  Result run(Function &F, FunctionAnalysisManager &FAM);
+};
+
+// Prints the results of UncoalescedAccessAnalysis.
+class UncoalescedAccessPrinterPass
+  : public PassInfoMixin<UncoalescedAccessPrinterPass> {
+  raw_ostream &OS;
+
+ public:
+  explicit UncoalescedAccessPrinterPass(raw_ostream &OS) : OS(OS) {}
+
+  PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM);
+};
+
 }
 
 #endif /* UncoalescedAnalysisPass.h */
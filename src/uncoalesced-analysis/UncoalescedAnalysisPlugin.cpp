@@ -0,0 +1,68 @@
+//===- UncoalescedAnalysisPlugin.cpp - New pass manager plugin for the uncoalesced access analysis -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+// Registers the uncoalesced access analyses with the new pass manager:
+//   opt -load-pass-plugin=LLVMUncoalescedAnalysis.so \
+//       -passes=interproc-uncoalesced-analysis
+// The printer passes are available as "uncoalesced-analysis" (function) and
+// "interproc-uncoalesced-analysis" (module). The analyses themselves can be
+// requested with "require<uncoalesced-analysis>" and
+// "require<interproc-uncoalesced-analysis>".
+//===----------------------------------------------------------------------===//
+
+#include "InterprocUncoalescedAnalysisPass.h"
+#include "UncoalescedAnalysisPass.h"
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+using namespace llvm;
+
+static void registerUncoalescedAnalysisPasses(PassBuilder &PB) {
+  PB.registerAnalysisRegistrationCallback(
+      [](FunctionAnalysisManager &FAM) {
+        FAM.registerPass([] { return UncoalescedAccessAnalysis(); });
+      });
+  PB.registerAnalysisRegistrationCallback(
+      [](ModuleAnalysisManager &MAM) {
+        MAM.registerPass([] { return InterprocUncoalescedAccessAnalysis(); });
+      });
+  PB.registerPipelineParsingCallback(
+      [](StringRef Name, FunctionPassManager &FPM,
+         ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name == "uncoalesced-analysis") {
+          FPM.addPass(UncoalescedAccessPrinterPass(errs()));
+          return true;
+        }
+        if (Name == "require<uncoalesced-analysis>") {
+          FPM.addPass(RequireAnalysisPass<UncoalescedAccessAnalysis, Function>());
+          return true;
+        }
+        return false;
+      });
+  PB.registerPipelineParsingCallback(
+      [](StringRef Name, ModulePassManager &MPM,
+         ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name == "interproc-uncoalesced-analysis") {
+          MPM.addPass(InterprocUncoalescedAccessPrinterPass(errs()));
+          return true;
+        }
+        if (Name == "require<interproc-uncoalesced-analysis>") {
+          MPM.addPass(RequireAnalysisPass<InterprocUncoalescedAccessAnalysis,
+                                          Module>());
+          return true;
+        }
+        return false;
+      });
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "UncoalescedAnalysis", LLVM_VERSION_STRING,
+          registerUncoalescedAnalysisPasses};
+}
@@ -0,0 +1,288 @@
+#define DEBUG_TYPE "uncoalesced-analysis"
+
+#include "UncoalescedSummaries.h"
+
+#include "llvm/IR/InstIterator.h"
+
+using namespace llvm;
+
+const DominatorTree* UncoalescedSummaries::getDomTree(const Function* F) {
+  if (GetDomTree_) return GetDomTree_(F);
+  auto& DT = DomTreeMap_[F];
+  if (!DT) {
+    DT.reset(new DominatorTree(const_cast<Function&>(*F)));
+  }
+  return DT.get();
+}
+
+// Estimated bytes of the summary of a function in context ctx.
+static int64_t getSummaryBytes(const CallContext& ctx,
+                               const FunctionSummary& summary) {
+  int64_t bytes = getMapNodeBytes<CallContext, FunctionSummary>() +
+                  ctx.capacity() * sizeof(MultiplierValue);
+  for (const AccessTrace& trace : summary.UncoalescedAccesses) {
+    bytes += getSetNodeBytes<AccessTrace>() +
+             trace.capacity() * sizeof(const Instruction*);
+  }
+  return bytes + summary.AccessInfo.size() *
+      getMapNodeBytes<const Instruction*, UncoalescedAccessInfo>();
+}
+
+const FunctionSummary& UncoalescedSummaries::getSummary(
+    const Function* F, const CallContext& ctx) {
+  if (Store_ && !CachedFunctions_.count(F)) loadCache(F);
+  auto& contextMap = SummaryMap_[F];
+  auto it = contextMap.find(ctx);
+  if (it != contextMap.end()) {
+    return it->second;
+  }
+  AnalyzedFunctions_.insert(F);
+  // Insert a conservative summary for recursive calls while F is analyzed.
+  FunctionSummary& summary = contextMap[ctx];
+  summary.ReturnValue = MultiplierValue(TOP);
+
+  LLVM_DEBUG(errs() << "Analyzing function: " << F->getName()
+        << " in context (");
+  for (const MultiplierValue& v : ctx) {
+    LLVM_DEBUG(errs() << v.getString() << ", ");
+  }
+  LLVM_DEBUG(errs() << ")\n");
+
+  UncoalescedAnalysis UA(F, getDomTree(F), this, Shape_);
+  UA.ComputeUncoalescedAccesses(UA.BuildInitialState(ctx));
+
+  // Symbolic coefficients refer to values of F.
+  summary.ReturnValue = UA.getReturnValue().withoutSymbol();
+  summary.UncoalescedAccesses.clear();
+  for (const Instruction* I : UA.getUncoalescedAccesses()) {
+    summary.UncoalescedAccesses.insert(AccessTrace(1, I));
+  }
+  summary.UncoalescedAccesses.insert(
+      UA.getCalleeUncoalescedAccesses().begin(),
+      UA.getCalleeUncoalescedAccesses().end());
+  summary.AccessInfo = UA.getUncoalescedAccessInfo();
+  addAccessInfo(F, summary.AccessInfo);
+  addSummaryBytes(F, getSummaryBytes(ctx, summary));
+  return summary;
+}
+
+void UncoalescedSummaries::addAccessInfo(const Function* F,
+    const std::map<const Instruction*, UncoalescedAccessInfo>& info) {
+  auto& accesses = AccessMap_[F];
+  size_t size = accesses.size();
+  for (const auto& pair : info) {
+    accesses[pair.first] = accesses[pair.first].join(pair.second);
+  }
+  addSummaryBytes(F, (accesses.size() - size) *
+      getMapNodeBytes<const Instruction*, UncoalescedAccessInfo>());
+}
+
+void UncoalescedSummaries::addSummaryBytes(const Function* F,
+                                           int64_t bytes) {
+  if (!Stats_ || bytes == 0) return;
+  Stats_->add(MemorySummaries, bytes);
+  SummaryBytes_ += bytes;
+  int64_t& functionBytes = FunctionSummaryBytes_[F];
+  functionBytes += bytes;
+  Stats_->recordFunction(F, MemorySummaries, functionBytes);
+}
+
+const FunctionSummary* UncoalescedSummaries::lookupSummary(
+    const Function* F, const CallContext& ctx) {
+  if (!F->isDeclaration()) return &getSummary(F, ctx);
+  return ExternalResolver_ ? ExternalResolver_(F, ctx) : nullptr;
+}
+
+std::set<const Instruction*> UncoalescedSummaries::getUncoalescedAccesses(
+    const Function* F) const {
+  std::set<const Instruction*> accesses;
+  auto it = AccessMap_.find(F);
+  if (it == AccessMap_.end()) return accesses;
+  for (const auto& pair : it->second) accesses.insert(pair.first);
+  return accesses;
+}
+
+std::map<const Instruction*, UncoalescedAccessInfo>
+UncoalescedSummaries::getUncoalescedAccessInfo(const Function* F) const {
+  auto it = AccessMap_.find(F);
+  if (it == AccessMap_.end()) {
+    return std::map<const Instruction*, UncoalescedAccessInfo>();
+  }
+  return it->second;
+}
+
+const UncoalescedAccessInfo* UncoalescedSummaries::lookupAccessInfo(
+    const Instruction* I) const {
+  auto it = AccessMap_.find(I->getFunction());
+  if (it == AccessMap_.end()) return nullptr;
+  auto iit = it->second.find(I);
+  return iit != it->second.end() ? &iit->second : nullptr;
+}
+
+void UncoalescedSummaries::releaseFunction(const Function* F) {
+  if (Store_ && AnalyzedFunctions_.erase(F)) saveCache(F);
+  SummaryMap_.erase(F);
+  AccessMap_.erase(F);
+  DomTreeMap_.erase(F);
+  ReleasedFunctions_.insert(F);
+  auto it = FunctionSummaryBytes_.find(F);
+  if (it != FunctionSummaryBytes_.end()) {
+    Stats_->add(MemorySummaries, -it->second);
+    SummaryBytes_ -= it->second;
+    FunctionSummaryBytes_.erase(it);
+  }
+}
+
+// Writes the type of the dependence of v on each of tid.x, tid.y and tid.z,
+// followed by its coefficient for (stride) dependences. Values with symbolic
+// coefficients are never cached.
+static void writeMultiplierValue(CacheWriter& W, const MultiplierValue& v) {
+  for (unsigned dim = 0; dim < 3; dim++) {
+    MultiplierValue d = v.getDimension(dim);
+    W.writeU8(d.getType());
+    if (d.getType() == STRIDE) W.writeU32(uint32_t(d.getCoefficient()));
+  }
+}
+
+static MultiplierValue readMultiplierValue(CacheReader& R) {
+  MultiplierValue v;
+  for (unsigned dim = 0; dim < 3; dim++) {
+    auto type = MultiplierValueType(R.readU8());
+    v = v.withDimension(dim, type == STRIDE ?
+        MultiplierValue::getLinear(int32_t(R.readU32())) :
+        MultiplierValue(type));
+  }
+  return v;
+}
+
+// Writes the type and coefficient of a dependence of an access.
+static void writeAccessTerm(CacheWriter& W, MultiplierValueType type,
+                            int64_t coefficient) {
+  W.writeU8(type);
+  W.writeU32(uint32_t(coefficient));
+}
+
+static void readAccessTerm(CacheReader& R, MultiplierValueType& type,
+                           int64_t& coefficient) {
+  type = MultiplierValueType(R.readU8());
+  coefficient = int32_t(R.readU32());
+}
+
+// Cache entry layout:
+//   u32 #contexts
+//   for each context:
+//     u32 #args, value of each argument
+//     return value, u8 return value is address
+//     u32 #traces
+//     for each trace: u32 length, (string function, u32 position)*
+//     u32 #accesses within the function
+//     for each access: u32 position, u32 element size, and for each of
+//       tid.x, tid.y and tid.z a u8 multiplier type and an i32 coefficient
+//   where values are, for each of tid.x, tid.y and tid.z, a u8 value type,
+//   and for (stride) values an i32 coefficient.
+bool UncoalescedSummaries::loadCache(const Function* F) {
+  CachedFunctions_.insert(F);
+  std::string contents;
+  if (!Hasher_.isSelfContained(F) || !Store_->lookup(getCacheKey(Hasher_.getHash(F), "uc"), contents)) {
+    return false;
+  }
+
+  const Module* M = F->getParent();
+  std::map<CallContext, FunctionSummary> contextMap;
+  CacheReader R(contents);
+  uint32_t numContexts = R.readU32();
+  for (uint32_t c = 0; c < numContexts && !R.hasError(); c++) {
+    CallContext ctx;
+    uint32_t numArgs = R.readU32();
+    for (uint32_t i = 0; i < numArgs && !R.hasError(); i++) {
+      ctx.push_back(readMultiplierValue(R));
+    }
+    FunctionSummary& summary = contextMap[ctx];
+    summary.ReturnValue = readMultiplierValue(R);
+    if (R.readU8()) summary.ReturnValue.setAddressType();
+    uint32_t numTraces = R.readU32();
+    for (uint32_t t = 0; t < numTraces && !R.hasError(); t++) {
+      AccessTrace trace;
+      uint32_t length = R.readU32();
+      for (uint32_t i = 0; i < length && !R.hasError(); i++) {
+        const Function* G = M->getFunction(R.readString());
+        const Instruction* I =
+            G ? Numbering_.getInstruction(G, R.readU32()) : nullptr;
+        if (!I) return false;
+        trace.push_back(I);
+      }
+      summary.UncoalescedAccesses.insert(trace);
+    }
+    uint32_t numAccesses = R.readU32();
+    for (uint32_t a = 0; a < numAccesses && !R.hasError(); a++) {
+      const Instruction* I = Numbering_.getInstruction(F, R.readU32());
+      UncoalescedAccessInfo info;
+      info.ElementSize = R.readU32();
+      readAccessTerm(R, info.Multiplier, info.Coefficient);
+      readAccessTerm(R, info.MultiplierY, info.CoefficientY);
+      readAccessTerm(R, info.MultiplierZ, info.CoefficientZ);
+      if (!I) return false;
+      summary.AccessInfo[I] = info;
+    }
+  }
+  if (R.hasError()) return false;
+
+  LLVM_DEBUG(errs() << "Loaded " << contextMap.size()
+        << " cached summaries for " << F->getName() << "\n");
+  for (const auto& pair : contextMap) {
+    addAccessInfo(F, pair.second.AccessInfo);
+    addSummaryBytes(F, getSummaryBytes(pair.first, pair.second));
+  }
+  SummaryMap_[F].insert(contextMap.begin(), contextMap.end());
+
+  // The callees of F were analyzed from F when the summaries were cached, so
+  // their summaries are loaded too. Otherwise they would be missing from the
+  // results, and be analyzed again as top-most functions.
+  for (const_inst_iterator it = inst_begin(F), ite = inst_end(F);
+                                                   it != ite; ++it) {
+    const CallInst* CI = dyn_cast<CallInst>(&*it);
+    const Function* calledF = CI ? CI->getCalledFunction() : nullptr;
+    if (calledF && !calledF->isDeclaration() &&
+        !CachedFunctions_.count(calledF)) {
+      loadCache(calledF);
+    }
+  }
+  return true;
+}
+
+void UncoalescedSummaries::saveCache() {
+  if (!Store_) return;
+  for (const Function* F : AnalyzedFunctions_) saveCache(F);
+  AnalyzedFunctions_.clear();
+}
+
+void UncoalescedSummaries::saveCache(const Function* F) {
+  if (!Hasher_.isSelfContained(F)) return;
+  const auto& contextMap = SummaryMap_.at(F);
+  CacheWriter W;
+  W.writeU32(contextMap.size());
+  for (const auto& pair : contextMap) {
+    W.writeU32(pair.first.size());
+    for (const MultiplierValue& v : pair.first) writeMultiplierValue(W, v);
+    writeMultiplierValue(W, pair.second.ReturnValue);
+    W.writeU8(pair.second.ReturnValue.isAddressType());
+    W.writeU32(pair.second.UncoalescedAccesses.size());
+    for (const AccessTrace& trace : pair.second.UncoalescedAccesses) {
+      W.writeU32(trace.size());
+      for (const Instruction* I : trace) {
+        W.writeString(I->getFunction()->getName());
+        W.writeU32(Numbering_.getIndex(I));
+      }
+    }
+    W.writeU32(pair.second.AccessInfo.size());
+    for (const auto& access : pair.second.AccessInfo) {
+      const UncoalescedAccessInfo& info = access.second;
+      W.writeU32(Numbering_.getIndex(access.first));
+      W.writeU32(info.ElementSize);
+      writeAccessTerm(W, info.Multiplier, info.Coefficient);
+      writeAccessTerm(W, info.MultiplierY, info.CoefficientY);
+      writeAccessTerm(W, info.MultiplierZ, info.CoefficientZ);
+    }
+  }
+  Store_->store(getCacheKey(Hasher_.getHash(F), "uc"), W.getBuffer());
+}
@@ -0,0 +1,178 @@
+#ifndef UNCOALESCED_SUMMARIES_H
+#define UNCOALESCED_SUMMARIES_H
+
+#include "MultiplierValue.h"
+#include "StructuralHash.h"
+#include "SummaryCache.h"
+#include "UncoalescedAnalysis.h"
+
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+
+// Version of the uncoalesced analysis; must be bumped whenever a change to
+// the analysis may change its results, to invalidate cached summaries.
+#define UNCOALESCED_ANALYSIS_VERSION 7
+
+using namespace llvm;
+
+// Summary of a function analyzed in a specific call context.
+struct FunctionSummary {
+  // Join of values returned by the function.
+  MultiplierValue ReturnValue;
+
+  // Uncoalesced accesses within the function and its callees.
+  std::set<AccessTrace> UncoalescedAccesses;
+
+  // Why the accesses within the function are uncoalesced.
+  std::map<const Instruction*, UncoalescedAccessInfo> AccessInfo;
+};
+
+// Returns the summary of a function declared (but not defined) in the
+// analyzed module in a call context, or null if it is unknown. Used to
+// resolve calls to functions defined in other translation units.
+typedef std::function<const FunctionSummary*(const Function*,
+                                             const CallContext&)>
+    ExternalSummaryResolver;
+
+// Memoized function summaries keyed by call context. A function is analyzed
+// once for each distinct context in which it is called, and the summary is
+// reused at every call site with that context.
+class UncoalescedSummaries {
+ public:
+  // If Store is not null, summaries are additionally loaded from and stored
+  // to Store, keyed by the structural hash of each function. Dominator trees
+  // are obtained from GetDomTree if provided (e.g. from an analysis
+  // manager), and are built on first use otherwise. Functions are analyzed
+  // for thread blocks of the given shape, which is part of the cache keys
+  // with the warp size (which splits a known shape into warps).
+  explicit UncoalescedSummaries(SummaryStore* Store = nullptr,
+                                DomTreeGetter GetDomTree = nullptr,
+                                const BlockShape& Shape =
+                                    getUncoalescedBlockShape())
+    : Store_(Store), GetDomTree_(GetDomTree), Shape_(Shape),
+      Hasher_(Shape.isKnown() ?
+                  "uncoalesced-analysis-" + Shape.getString() + "-warp" +
+                      std::to_string(getUncoalescedWarpSize()) :
+                  std::string("uncoalesced-analysis"),
+              UNCOALESCED_ANALYSIS_VERSION),
+      Stats_(getUncoalescedMemoryStats()) {}
+
+  ~UncoalescedSummaries() {
+    if (Stats_) Stats_->add(MemorySummaries, -SummaryBytes_);
+  }
+
+  // Returns the summary of F in context ctx. F is analyzed if the summary is
+  // not available yet. Recursive calls to a summary under construction
+  // return a conservative summary.
+  const FunctionSummary& getSummary(const Function* F, const CallContext& ctx);
+
+  // Returns the summary of the callee F in context ctx: its summary if F is
+  // defined, and the summary given by the external resolver (if any) if F is
+  // only declared. Returns null if the summary is unknown.
+  const FunctionSummary* lookupSummary(const Function* F,
+                                       const CallContext& ctx);
+
+  // Resolves calls to declared functions with Resolver.
+  void setExternalResolver(ExternalSummaryResolver Resolver) {
+    ExternalResolver_ = Resolver;
+  }
+
+  // Returns the shape of the thread blocks functions are analyzed for.
+  const BlockShape& getBlockShape() const { return Shape_; }
+
+  // Has F been analyzed in any context?
+  bool isAnalyzed(const Function* F) const {
+    return SummaryMap_.find(F) != SummaryMap_.end() ||
+           ReleasedFunctions_.count(F);
+  }
+
+  // Returns the uncoalesced accesses within F across all its contexts.
+  std::set<const Instruction*> getUncoalescedAccesses(const Function* F) const;
+
+  // Returns why the accesses within F are uncoalesced (joined across its
+  // contexts).
+  std::map<const Instruction*, UncoalescedAccessInfo>
+      getUncoalescedAccessInfo(const Function* F) const;
+
+  // Returns why the access I is uncoalesced (joined across the contexts of
+  // its function), or null if it is not uncoalesced.
+  const UncoalescedAccessInfo* lookupAccessInfo(const Instruction* I) const;
+
+  // Releases the summaries of F, once no function calling F remains to be
+  // analyzed. The summaries are written to the cache first if F was analyzed
+  // in this run. F is still considered analyzed afterwards.
+  void releaseFunction(const Function* F);
+
+  // Writes the summaries of functions analyzed in this run to the cache.
+  // Functions that call functions defined outside their module are not
+  // cached, since their summaries depend on how the module is linked.
+  void saveCache();
+
+ private:
+  // Writes the summaries of F to the cache.
+  void saveCache(const Function* F);
+
+  // Loads the cached summaries of F, if any. Returns true on a cache hit.
+  bool loadCache(const Function* F);
+
+  // Returns the dominator tree for F.
+  const DominatorTree* getDomTree(const Function* F);
+
+  // Map from functions to their dominator trees (if built here).
+  std::map<const Function*, std::unique_ptr<DominatorTree>> DomTreeMap_;
+
+  // Map from functions to their summaries for each call context.
+  std::map<const Function*, std::map<CallContext, FunctionSummary>>
+      SummaryMap_;
+
+  // Map from functions to their own uncoalesced accesses (joined across
+  // contexts).
+  std::map<const Function*,
+           std::map<const Instruction*, UncoalescedAccessInfo>> AccessMap_;
+
+  // Joins the accesses in info into the accesses of F.
+  void addAccessInfo(const Function* F,
+      const std::map<const Instruction*, UncoalescedAccessInfo>& info);
+
+  // Accounts bytes more of summaries of F (see MemoryAccounting.h).
+  void addSummaryBytes(const Function* F, int64_t bytes);
+
+  // Resolver of calls to declared functions (may be empty).
+  ExternalSummaryResolver ExternalResolver_;
+
+  // Summary cache (null if caching is disabled).
+  SummaryStore* Store_;
+
+  // Provider of dominator trees (may be empty).
+  DomTreeGetter GetDomTree_;
+
+  // Shape of the thread blocks functions are analyzed for.
+  BlockShape Shape_;
+
+  // Computes structural hashes for cache keys.
+  StructuralHasher Hasher_;
+
+  // Positions of instructions in cached access traces.
+  InstructionNumbering Numbering_;
+
+  // Functions whose cache entries were looked up.
+  std::set<const Function*> CachedFunctions_;
+
+  // Functions analyzed in this run (their cache entries must be updated).
+  std::set<const Function*> AnalyzedFunctions_;
+
+  // Functions whose summaries were released.
+  std::set<const Function*> ReleasedFunctions_;
+
+  // Memory statistics (null unless memory is accounted), the bytes of all
+  // summaries and of the summaries of each function.
+  MemoryStats* Stats_;
+  int64_t SummaryBytes_ = 0;
+  std::map<const Function*, int64_t> FunctionSummaryBytes_;
+};
+
+#endif /* UncoalescedSummaries.h */